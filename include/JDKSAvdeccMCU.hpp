@@ -30,10 +30,12 @@
 */
 #pragma once
 #include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/AddressAccessTransfer.hpp"
 #include "JDKSAvdeccMCU/ADPManager.hpp"
 #include "JDKSAvdeccMCU/ControlDescription.hpp"
 #include "JDKSAvdeccMCU/ControlReceiver.hpp"
 #include "JDKSAvdeccMCU/ControlSender.hpp"
+#include "JDKSAvdeccMCU/MeteringControlSender.hpp"
 #include "JDKSAvdeccMCU/ControlValueHolder.hpp"
 #include "JDKSAvdeccMCU/ControllerEntity.hpp"
 #include "JDKSAvdeccMCU/EEPromStorage.hpp"
@@ -45,15 +47,21 @@
 #include "JDKSAvdeccMCU/RangedValue.hpp"
 #include "JDKSAvdeccMCU/PcapFile.hpp"
 #include "JDKSAvdeccMCU/PcapFileReader.hpp"
+#include "JDKSAvdeccMCU/PcapFileStreamReader.hpp"
 #include "JDKSAvdeccMCU/PcapFileWriter.hpp"
+#include "JDKSAvdeccMCU/FlightRecorder.hpp"
 #include "JDKSAvdeccMCU/RawSocket.hpp"
 #include "JDKSAvdeccMCU/RawSocketRunner.hpp"
 #include "JDKSAvdeccMCU/RawSocketPcapFile.hpp"
+#include "JDKSAvdeccMCU/PcapReplay.hpp"
 #include "JDKSAvdeccMCU/RawSocketWizNet.hpp"
 #include "JDKSAvdeccMCU/MDNSRegister.hpp"
+#include "JDKSAvdeccMCU/MemoryObjectUpload.hpp"
 #include "JDKSAvdeccMCU/Http.hpp"
 #include "JDKSAvdeccMCU/AppMessage.hpp"
 #include "JDKSAvdeccMCU/AppMessageParser.hpp"
 #include "JDKSAvdeccMCU/AppMessageHandler.hpp"
 #include "JDKSAvdeccMCU/Apc.hpp"
+#include "JDKSAvdeccMCU/ApcClient.hpp"
 #include "JDKSAvdeccMCU/Aps.hpp"
+#include "JDKSAvdeccMCU/ApsServer.hpp"
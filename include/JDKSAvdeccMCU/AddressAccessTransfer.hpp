@@ -0,0 +1,228 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/RawSocket.hpp"
+#include "JDKSAvdeccMCU/Frame.hpp"
+#include "JDKSAvdeccMCU/Handler.hpp"
+#include "JDKSAvdeccMCU/Helpers.hpp"
+#include "JDKSAvdeccMCU/ControllerEntity.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The AddressAccessTransfer class
+///
+/// Controller side engine for reading or writing a large block of memory
+/// in a target entity with AECP Address Access commands.
+///
+/// The block is split into the largest TLVs that fit in a single AA PDU and
+/// up to a window's worth of commands are kept in flight at once. Responses
+/// may complete out of order; the contiguous completed prefix of the block
+/// is tracked and fed into a running CRC32 so that the data can be verified
+/// without a second pass.
+///
+/// A write may optionally be followed by an AA EXECUTE command to a commit
+/// address, with the CRC32 of the written data as its 4 octet big endian
+/// payload, so the target can verify the data before committing it.
+///
+/// Register the transfer with the ControllerEntity via
+/// ControllerEntity::setAddressAccessTransfer() so that it receives the
+/// AA responses, and with the HandlerGroup so that it receives tick().
+///
+class AddressAccessTransfer : public Handler
+{
+  public:
+    /// The maximum number of AA commands that can be in flight at once
+    static const uint16_t max_window_size = 16;
+
+    /// The largest amount of data that fits in the single TLV of an AA PDU
+    static const uint16_t max_tlv_data_length = JDKSAVDECC_AECP_MAX_CONTROL_DATA_LENGTH
+                                                - ( JDKSAVDECC_AECPDU_AA_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN )
+                                                - JDKSAVDECC_AECPDU_AA_TLV_LEN;
+
+    /// The number of times a command is resent before the transfer fails
+    static const uint8_t max_retries = 3;
+
+    enum Result
+    {
+        ResultSuccess,
+        ResultAAStatus,
+        ResultTimedOut,
+        ResultCrcMismatch,
+        ResultCancelled
+    };
+
+    ///
+    /// \brief AddressAccessTransfer Constructor
+    /// \param controller_entity The controller entity to send commands with
+    /// \param window_size The number of commands to keep in flight, clamped
+    /// to max_window_size
+    ///
+    AddressAccessTransfer( ControllerEntity &controller_entity, uint16_t window_size = 8 );
+
+    ///
+    /// \brief startRead Start reading a block of memory from a target entity
+    /// \param target_entity_id The target entity
+    /// \param target_mac_address The target entity's MAC address
+    /// \param address The address in the target to start reading from
+    /// \param destination Where to store the data, must stay valid until the
+    /// transfer completes
+    /// \param length The number of octets to read
+    /// \param verify_crc32 true if the data read is to be verified
+    /// \param expected_crc32 The CRC32 that the data read is expected to have
+    /// \return false if a transfer is already in progress
+    ///
+    bool startRead( Eui64 const &target_entity_id,
+                    Eui48 const &target_mac_address,
+                    uint32_t address,
+                    uint8_t *destination,
+                    uint32_t length,
+                    bool verify_crc32 = false,
+                    uint32_t expected_crc32 = 0 );
+
+    ///
+    /// \brief startWrite Start writing a block of memory to a target entity
+    /// \param target_entity_id The target entity
+    /// \param target_mac_address The target entity's MAC address
+    /// \param address The address in the target to start writing to
+    /// \param source The data to write, must stay valid until the transfer
+    /// completes
+    /// \param length The number of octets to write
+    /// \param commit true if an EXECUTE with the CRC32 is to be sent to
+    /// commit_address once all the data is written
+    /// \param commit_address The address to send the EXECUTE to
+    /// \return false if a transfer is already in progress
+    ///
+    bool startWrite( Eui64 const &target_entity_id,
+                     Eui48 const &target_mac_address,
+                     uint32_t address,
+                     uint8_t const *source,
+                     uint32_t length,
+                     bool commit = false,
+                     uint32_t commit_address = 0 );
+
+    ///
+    /// \brief cancel Abandon the transfer in progress
+    ///
+    void cancel();
+
+    ///
+    /// \brief tick Send more commands and resend timed out ones
+    ///
+    virtual void tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override;
+
+    ///
+    /// \brief receivedAAResponse Handle an AA response for our controller
+    /// \return true if the response belonged to this transfer
+    ///
+    bool receivedAAResponse( jdksavdecc_aecp_aa const &aa, Frame &pdu );
+
+    ///
+    /// \brief transferCompleted Notification that the transfer finished
+    /// \param result The Result of the transfer
+    /// \param aa_status The AA status code from the target when result is
+    /// ResultAAStatus
+    ///
+    virtual void transferCompleted( Result result, uint8_t aa_status );
+
+    bool isBusy() const { return m_state != StateIdle; }
+
+    /// The number of octets at the start of the block that are complete
+    uint32_t getCompletedLength() const { return m_completed_offset; }
+
+    uint32_t getLength() const { return m_length; }
+
+    /// The CRC32 of the completed prefix of the block
+    uint32_t getCrc32() const { return m_crc32; }
+
+    ControllerEntity &getControllerEntity() { return m_controller_entity; }
+
+    RawSocket &getRawSocket() { return m_controller_entity.getRawSocket(); }
+
+  protected:
+    enum State
+    {
+        StateIdle,
+        StateReading,
+        StateWriting,
+        StateCommitting
+    };
+
+    /// One AA command in flight
+    struct Slot
+    {
+        bool m_in_use;
+        bool m_done;
+        uint8_t m_mode;
+        uint8_t m_retries;
+        uint16_t m_sequence_id;
+        uint16_t m_length;
+        uint32_t m_offset;
+        jdksavdecc_timestamp_in_milliseconds m_deadline;
+    };
+
+    void start( Eui64 const &target_entity_id, Eui48 const &target_mac_address, uint32_t address, uint32_t length );
+
+    /// Issue new commands until the window is full or the block is covered
+    void fillWindow();
+
+    /// Formulate and send the AA command for the slot
+    void sendSlot( Slot &slot );
+
+    /// Fold completed slots at the front of the block into the CRC
+    void advanceCompleted();
+
+    /// Finish the transfer and notify
+    void finish( Result result, uint8_t aa_status );
+
+    ControllerEntity &m_controller_entity;
+    uint16_t m_window_size;
+    State m_state;
+    Eui64 m_target_entity_id;
+    Eui48 m_target_mac_address;
+    uint32_t m_address;
+    uint8_t *m_destination;
+    uint8_t const *m_source;
+    uint32_t m_length;
+    uint32_t m_next_offset;
+    uint32_t m_completed_offset;
+    uint32_t m_crc32;
+    bool m_verify_crc32;
+    uint32_t m_expected_crc32;
+    bool m_commit;
+    uint32_t m_commit_address;
+    uint16_t m_sequence_id;
+    Slot m_slots[max_window_size];
+};
+}
@@ -45,6 +45,29 @@ class ApcStates;
 class ApcStateEvents;
 class ApcStateMachine;
 
+///
+/// \brief The ApcEvent struct
+///
+/// An event and its data for the transition table of ApcStates
+///
+struct ApcEvent
+{
+    enum Id
+    {
+        NetAvdeccMessage,
+        AppAvdeccFromAps,
+        TimeTick,
+        Count
+    };
+
+    ApcEvent( Id id ) : m_id( id ), m_frame( 0 ), m_msg( 0 ), m_time_in_seconds( 0 ) {}
+
+    Id m_id;
+    Frame const *m_frame;
+    AppMessage const *m_msg;
+    uint32_t m_time_in_seconds;
+};
+
 class ApcStateMachine
 {
   public:
@@ -78,6 +101,28 @@ class ApcStateMachine
     virtual void sendTcpData( uint8_t const *data, ssize_t len );
     virtual void onNetAvdeccMessageReceived( Frame const &frame );
 
+    ///
+    /// \brief tick
+    ///
+    /// onTimeTick() followed by run(), or a single transition table
+    /// lookup when the state machine is table driven
+    ///
+    void tick( uint32_t time_in_seconds );
+
+    ///
+    /// \brief setTableDriven
+    ///
+    /// When enabled, the frequent events in the WAITING state are handled
+    /// by ApcStates::dispatch() instead of setting state variables and
+    /// running the state procedures until the state is stable. Only enable
+    /// this when the ApcStates object does not override the transitions.
+    ///
+    void setTableDriven( bool enable ) { m_table_driven = enable; }
+
+    bool isTableDriven() const { return m_table_driven; }
+
+    bool dispatch( ApcEvent const &event );
+
     ApcStateVariables *getVariables() { return m_variables; }
     ApcStateVariables const *getVariables() const { return m_variables; }
     ApcStateActions *getActions() { return m_actions; }
@@ -92,6 +137,7 @@ class ApcStateMachine
     ApcStateActions *m_actions;
     ApcStateEvents *m_events;
     ApcStates *m_states;
+    bool m_table_driven;
 };
 
 class ApcStateVariables
@@ -213,6 +259,16 @@ class ApcStateVariables
      * See IEEE 1722.1 Annex C.5.3.1.17
      */
     bool m_tcpConnected;
+
+    ///
+    /// \brief isEventPending
+    ///
+    /// \return true if doWaiting() has a state variable to act on
+    ///
+    bool isEventPending() const
+    {
+        return m_incomingTcpClosed || m_finished || m_linkStatusMsg || m_apsMsgIn || m_apcMsgOut || m_idAssigned;
+    }
 };
 
 class ApcStateActions
@@ -330,12 +386,41 @@ class ApcStates
     ///
     typedef void ( ApcStates::*state_proc )();
 
+    ///
+    /// The states of Figure C.1 that are tracked alongside
+    /// m_current_state for the transition table
+    ///
+    enum StateId
+    {
+        StateNone,
+        StateBegin,
+        StateInitialize,
+        StateWaitForConnect,
+        StateConnected,
+        StateStartTransfer,
+        StateWaiting,
+        StateClosed,
+        StateLinkStatus,
+        StateReceiveMsg,
+        StateSendMsg,
+        StateEntityIdAssigned,
+        StateSendNop,
+        StateFinish,
+        StateCount
+    };
+
+    ///
+    /// A transition performs the actions of the state that an event
+    /// leads to and of the states back to the current one, in one step
+    ///
+    typedef void ( *transition_proc )( ApcStateMachine &owner, ApcEvent const &event );
+
     ///
     /// \brief States constructor
     ///
     /// Start the state machine in the begin state
     ///
-    ApcStates() : m_owner( 0 ), m_current_state( &ApcStates::doBegin ) {}
+    ApcStates() : m_owner( 0 ), m_current_state( &ApcStates::doBegin ), m_state_id( StateBegin ) {}
 
     ///
     /// \brief ~States
@@ -398,6 +483,33 @@ class ApcStates
     ///
     virtual bool run();
 
+    StateId getStateId() const { return m_state_id; }
+
+    ///
+    /// \brief dispatch
+    ///
+    /// Look up the event in the transition table for the current state
+    /// and perform the transition if there is one. This is not virtual
+    /// and does not run the state procedures, so it must only be used when
+    /// the transitions of Figure C.1 are not overridden.
+    ///
+    /// Link status and entity id messages only set their state variables,
+    /// so the table is not used while doWaiting() has one of those pending.
+    ///
+    /// \return false if the event has to be handled via the state
+    /// variables and run()
+    ///
+    bool dispatch( ApcEvent const &event )
+    {
+        transition_proc p = transition_table[m_state_id][event.m_id];
+        if ( p && !m_owner->getVariables()->isEventPending() )
+        {
+            p( *m_owner, event );
+            return true;
+        }
+        return false;
+    }
+
   protected:
     ///
     /// \brief doBegin
@@ -638,9 +750,22 @@ class ApcStates
     ///
     virtual void doFinish();
 
+    /// WAITING -> SEND_MSG -> WAITING
+    static void sendMsg( ApcStateMachine &owner, ApcEvent const &event );
+
+    /// WAITING -> RECEIVE_MSG -> WAITING
+    static void receiveMsg( ApcStateMachine &owner, ApcEvent const &event );
+
+    /// WAITING -> SEND_NOP -> WAITING when the NOP timeout has passed
+    static void timeTickWhileWaiting( ApcStateMachine &owner, ApcEvent const &event );
+
+    /// The transition for each state and event, or 0 to use run()
+    static const transition_proc transition_table[StateCount][ApcEvent::Count];
+
   protected:
     ApcStateMachine *m_owner;
     state_proc m_current_state;
+    StateId m_state_id;
 };
 
 class ApcStateEvents : public AppMessageHandler, public HttpClientHandler
@@ -876,4 +1001,5 @@ class ApcStateEvents : public AppMessageHandler, public HttpClientHandler
     AppMessageParser m_app_parser;
 };
 
+inline bool ApcStateMachine::dispatch( ApcEvent const &event ) { return m_table_driven && m_states->dispatch( event ); }
 }
@@ -0,0 +1,150 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Apc.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_APCCLIENT
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The ApcClient class
+///
+/// An ApcStateMachine connected to an APS with a non-blocking TCP socket.
+///
+/// Messages to the APS are appended to an outbound batch buffer instead
+/// of being written one at a time, so that a burst of L2 frames given to
+/// onNetAvdeccMessageReceived() is written with few send() calls. The
+/// batch is written with MSG_MORE while more messages are being added and
+/// without it at the end of poll() or on flush(), and TCP_NODELAY is set
+/// so that the final segment of a batch is never held back by Nagle.
+///
+class ApcClient : public ApcStateMachine
+{
+  public:
+    ///
+    /// \brief ApcClient
+    /// \param path The path for the HTTP CONNECT request
+    /// \param max_batch_octets The number of unwritten octets that may be
+    /// buffered before messages are dropped
+    ///
+    ApcClient( std::string const &path = "/", size_t max_batch_octets = 65536 );
+
+    virtual ~ApcClient();
+
+    ///
+    /// \brief start
+    ///
+    /// Reset the state machine and start connecting to the APS
+    ///
+    /// \param aps_address The APS address in the form "host:port"
+    /// \param primary_mac The MAC address to request an entity_id with
+    /// \param entity_id The entity_id to request, or all FF for any
+    ///
+    void start( std::string const &aps_address, Eui48 const &primary_mac, Eui64 const &entity_id = Eui64() );
+
+    ///
+    /// \brief stop
+    ///
+    /// Write any batched messages and close the connection
+    ///
+    void stop();
+
+    ///
+    /// \brief poll
+    ///
+    /// Wait up to timeout_ms for the socket, process any incoming data
+    /// and timers, then write the outbound batch
+    ///
+    /// \return false once the state machine has finished
+    ///
+    bool poll( int timeout_ms );
+
+    ///
+    /// \brief flush
+    ///
+    /// Write as much of the outbound batch as the socket will take now
+    ///
+    /// \return false if the connection failed
+    ///
+    bool flush() { return writeBatch( false ); }
+
+    int getFd() const { return m_fd; }
+
+    bool isConnected() const { return m_fd >= 0 && !m_connecting; }
+
+    size_t getPendingOctets() const { return m_batch.size() - m_batch_pos; }
+
+    uint32_t getDroppedCount() const { return m_dropped_count; }
+
+    virtual void closeTcpConnection() override;
+
+    virtual void connectToProxy( std::string const &addr ) override;
+
+    virtual void sendTcpData( uint8_t const *data, ssize_t len ) override;
+
+  protected:
+    void onConnectComplete();
+
+    void readIncoming();
+
+    bool writeBatch( bool more );
+
+    void closeSocket();
+
+    void onSocketFailed();
+
+    ApcStateVariables m_client_variables;
+    ApcStateActions m_client_actions;
+    ApcStates m_client_states;
+    ApcStateEvents m_client_events;
+
+    HttpClientParserFast m_http_parser;
+    HttpResponse m_http_response;
+
+    std::string m_path;
+    int m_fd;
+    bool m_connecting;
+
+    /// Octets before m_batch_pos have already been written
+    std::vector<uint8_t> m_batch;
+    size_t m_batch_pos;
+    size_t m_max_batch_octets;
+    uint32_t m_dropped_count;
+
+    std::vector<uint8_t> m_read_buf;
+};
+}
+
+#endif
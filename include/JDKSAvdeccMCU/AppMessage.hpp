@@ -78,7 +78,10 @@ struct AppMessage
     /// \brief AppMessage Copy Constructor
     /// \param other the AppMessage to copy
     ///
-    AppMessage( const AppMessage &other ) : m_appdu( other.m_appdu ) { m_appdu.base.payload = m_appdu.payload_buffer; }
+    /// The payload is copied into this message's own buffer, even when
+    /// other is a view of a parser's input
+    ///
+    AppMessage( const AppMessage &other ) { copyFrom( other ); }
 
     ///
     /// \brief operator =
@@ -88,11 +91,60 @@ struct AppMessage
     ///
     const AppMessage &operator=( const AppMessage &other )
     {
-        m_appdu = other.m_appdu;
-        m_appdu.base.payload = m_appdu.payload_buffer;
+        if ( this != &other )
+        {
+            copyFrom( other );
+        }
         return *this;
     }
 
+    ///
+    /// \brief copyFrom
+    ///
+    /// Copy the header and only the used part of the payload of other
+    ///
+    /// \param other the AppMessage to copy
+    ///
+    void copyFrom( const AppMessage &other )
+    {
+        m_appdu.base = other.m_appdu.base;
+        m_appdu.base.payload = m_appdu.payload_buffer;
+        if ( other.m_appdu.base.payload_length > 0 )
+        {
+            memcpy( m_appdu.payload_buffer, other.getPayload(), other.m_appdu.base.payload_length );
+        }
+    }
+
+    ///
+    /// \brief setPayloadView
+    ///
+    /// Make the payload refer to payload_length octets outside of the message
+    /// without copying them. Used by AppMessageParser to dispatch messages
+    /// that are complete in its input buffer; the view is only valid during
+    /// the dispatch.
+    ///
+    /// \param payload The payload octets
+    /// \param payload_length The number of payload octets
+    ///
+    void setPayloadView( uint8_t const *payload, uint16_t payload_length )
+    {
+        m_appdu.base.payload = const_cast<uint8_t *>( payload );
+        m_appdu.base.payload_length = payload_length;
+    }
+
+    ///
+    /// \brief clearPayloadView
+    ///
+    /// Point the payload back at the message's own buffer
+    ///
+    void clearPayloadView() { m_appdu.base.payload = m_appdu.payload_buffer; }
+
+    ///
+    /// \brief isPayloadView
+    /// \return true if the payload refers to octets outside of the message
+    ///
+    bool isPayloadView() const { return m_appdu.base.payload != m_appdu.payload_buffer; }
+
     ///
     /// \brief clear
     ///
@@ -201,11 +253,11 @@ struct AppMessage
     ///
     /// \brief getPayload
     ///
-    /// Get a const pointer to the payload
+    /// Get a const pointer to the payload, which may be a view
     ///
     /// \return uint8_t const pointer to payload
     ///
-    uint8_t const *getPayload() const { return m_appdu.payload_buffer; }
+    uint8_t const *getPayload() const { return m_appdu.base.payload; }
 
     ///
     /// \brief getPayload
@@ -214,7 +266,7 @@ struct AppMessage
     ///
     /// \return uint8_t pointer to the payload
     ///
-    uint8_t *getPayload() { return m_appdu.payload_buffer; }
+    uint8_t *getPayload() { return m_appdu.base.payload; }
 
     ///
     /// \brief getAddress
@@ -265,7 +317,7 @@ struct AppMessage
         Eui64 r;
         if ( getMessageType() == ENTITY_ID_REQUEST && getPayloadLength() == 8 )
         {
-            r = Eui64( m_appdu.payload_buffer );
+            r = Eui64( getPayload() );
         }
         return r;
     }
@@ -283,7 +335,7 @@ struct AppMessage
         Eui64 r;
         if ( getMessageType() == ENTITY_ID_RESPONSE && getPayloadLength() == 8 )
         {
-            r = Eui64( m_appdu.payload_buffer );
+            r = Eui64( getPayload() );
         }
         return r;
     }
@@ -40,8 +40,8 @@ namespace JDKSAvdeccMCU
 ///
 /// \brief The AppMessageParser class
 ///
-/// Consumes bytes one at a time and parses
-/// AppMessages from the byte stream
+/// Consumes bytes from a TCP stream, one at a time or in blocks, and
+/// parses AppMessages from the byte stream
 ///
 class AppMessageParser
 {
@@ -74,6 +74,22 @@ class AppMessageParser
     ///
     int parse( uint8_t octet );
 
+    ///
+    /// \brief parse parses a block of octets from a TCP stream
+    /// and dispatch to an AppMessageHandler
+    ///
+    /// Headers are read in place. Messages that are entirely within the
+    /// block are dispatched with a payload view of the block, without
+    /// copying. Only messages that straddle the ends of the block are
+    /// accumulated in the parser.
+    ///
+    /// \param data The incoming octets
+    /// \param len The number of incoming octets
+    ///
+    /// \return 0 on success, -1 on error
+    ///
+    int parse( uint8_t const *data, size_t len );
+
     ///
     /// \brief getErrorCount get the current error count
     /// \return error count
@@ -105,6 +121,12 @@ class AppMessageParser
     ///
     AppMessage *parseHeader( uint8_t octet );
 
+    ///
+    /// \brief loadHeader Read the header fields into the current message
+    /// \param header JDKSAVDECC_APPDU_HEADER_LEN octets of header
+    ///
+    void loadHeader( uint8_t const *header );
+
     ///
     /// \brief validateHeader
     /// \return
@@ -36,6 +36,11 @@
 #include "JDKSAvdeccMCU/AppMessageParser.hpp"
 #include "JDKSAvdeccMCU/Http.hpp"
 
+#if JDKSAVDECCMCU_ENABLE_THREADS
+#include <mutex>
+#endif
+#include <unordered_map>
+
 namespace JDKSAvdeccMCU
 {
 
@@ -45,6 +50,155 @@ class ApsStateActions;
 class ApsStates;
 class ApsStateEvents;
 
+///
+/// \brief The ApsEntityIdAllocator class
+///
+/// Hands out the 16 bit indexes that distinguish the entity_ids an APS
+/// assigns to its APCs. It is shared by all the ApsStateMachines of a
+/// server and may be used from several threads.
+///
+/// Free indexes are kept in a doubly linked FIFO list and in a bitmap,
+/// so allocating, releasing and claiming a specific index are all O(1).
+/// Released indexes go to the back of the list, which keeps an index
+/// unused for as long as possible after its APC disconnects. When the
+/// APC reconnects it gets the same entity_id back if it requests it,
+/// or if it requests none and its previous index is still free.
+///
+/// The tables take about 12 octets per index, so a server that only
+/// expects a few APCs can limit the indexes to 1 to last_index. Without
+/// JDKSAVDECCMCU_ENABLE_THREADS the allocator does no locking.
+///
+class ApsEntityIdAllocator
+{
+  public:
+    ///
+    /// \brief ApsEntityIdAllocator
+    /// \param last_index the largest index that is handed out, at most max_index
+    ///
+    ApsEntityIdAllocator( uint16_t last_index = max_index );
+
+    ///
+    /// \brief allocate
+    ///
+    /// \param server_link_mac The primary MAC address of the server
+    /// \param apc_link_mac The primary MAC address of the APC
+    /// \param requested_entity_id The entity_id that the APC requested
+    /// \return The index to use, or 0 if all are in use
+    ///
+    uint16_t allocate( Eui48 server_link_mac, Eui48 apc_link_mac, Eui64 requested_entity_id );
+
+    ///
+    /// \brief release
+    ///
+    /// Return an index to the free list
+    ///
+    void release( uint16_t index );
+
+    ///
+    /// \brief makeEntityId
+    ///
+    /// Form the entity_id for an index from the server's MAC address
+    ///
+    static Eui64 makeEntityId( Eui48 server_link_mac, uint16_t index );
+
+    ///
+    /// \brief getIndex
+    ///
+    /// Extract the index from an entity_id formed by makeEntityId
+    ///
+    /// \return the index or 0 if the entity_id is not from this server
+    ///
+    static uint16_t getIndex( Eui48 server_link_mac, Eui64 entity_id );
+
+    size_t getActiveCount() const
+    {
+        lock_type lock( m_mutex );
+        return m_active_count;
+    }
+
+    bool isActive( uint16_t index ) const
+    {
+        lock_type lock( m_mutex );
+        return index <= m_last_index_value && isActiveLocked( index );
+    }
+
+    uint16_t getLastIndex() const { return m_last_index_value; }
+
+    /// The largest possible index, 0 is never assigned
+    static const uint16_t max_index = 0xffff;
+
+  protected:
+#if JDKSAVDECCMCU_ENABLE_THREADS
+    typedef std::mutex mutex_type;
+    typedef std::lock_guard<std::mutex> lock_type;
+#else
+    struct mutex_type
+    {
+    };
+    struct lock_type
+    {
+        explicit lock_type( mutex_type & ) {}
+    };
+#endif
+
+    /// isActive for callers that already hold m_mutex
+    bool isActiveLocked( uint16_t index ) const
+    {
+        return ( m_in_use[index >> 6] & ( uint64_t( 1 ) << ( index & 0x3f ) ) ) != 0;
+    }
+
+    /// Remember that index was assigned to apc, forgetting its previous APC
+    void rememberApc( uint64_t apc, uint16_t index );
+
+    /// Remove a free index from the free list
+    void unlink( uint16_t index );
+
+    /// Append an index to the back of the free list
+    void append( uint16_t index );
+
+    mutable mutex_type m_mutex;
+    size_t m_active_count;
+    uint16_t m_last_index_value;
+
+    /// Free list links, index 0 is the list head
+    std::vector<uint16_t> m_next;
+    std::vector<uint16_t> m_prev;
+
+    /// One bit per index, set when in use
+    std::vector<uint64_t> m_in_use;
+
+    /// The APC MAC address each index was last assigned to
+    std::vector<uint64_t> m_last_apc;
+
+    /// The last index assigned to each APC MAC address. An entry is
+    /// erased when its index goes to a different APC, so there are never
+    /// more than last_index entries.
+    std::unordered_map<uint64_t, uint16_t> m_last_index;
+};
+
+
+///
+/// \brief The ApsEvent struct
+///
+/// An event and its data for the transition table of ApsStates
+///
+struct ApsEvent
+{
+    enum Id
+    {
+        NetAvdeccMessage,
+        AppAvdeccFromApc,
+        TimeTick,
+        Count
+    };
+
+    ApsEvent( Id id ) : m_id( id ), m_frame( 0 ), m_msg( 0 ), m_time_in_seconds( 0 ) {}
+
+    Id m_id;
+    Frame const *m_frame;
+    AppMessage const *m_msg;
+    uint32_t m_time_in_seconds;
+};
 
 ///
 /// \brief The ApsStateMachine class
@@ -56,14 +210,6 @@ class ApsStateMachine
 {
   public:
 
-    ///
-    /// \brief active_connections_type
-    ///
-    /// This container type is used to keep track of
-    /// actively assigned and in use APS connections.
-    ///
-    typedef std::set<uint16_t> active_connections_type;
-
     ///
     /// \brief ApsStateMachine
     ///
@@ -73,15 +219,13 @@ class ApsStateMachine
     /// \param actions The actions object to use
     /// \param events The events object to use
     /// \param states The states object to use
-    /// \param active_entity_id_count The shared active entity id count
-    /// \param active_connections The shared active connections set
+    /// \param entity_id_allocator The allocator shared by all APS sessions
     ///
     ApsStateMachine( ApsStateVariables *variables,
                      ApsStateActions *actions,
                      ApsStateEvents *events,
                      ApsStates *states,
-                     uint16_t &active_entity_id_count,
-                     active_connections_type &active_connections );
+                     ApsEntityIdAllocator &entity_id_allocator );
 
     ///
     /// \brief ~ApsStateMachine
@@ -192,6 +336,16 @@ class ApsStateMachine
     ///
     virtual void sendTcpData( uint8_t const *data, ssize_t len ) = 0;
 
+    ///
+    /// \brief sendMsgToApc
+    ///
+    /// Serialize an AppMessage and send it to the APC via sendTcpData().
+    /// Override to queue messages by type instead of as raw octets.
+    ///
+    /// \param msg The message to send
+    ///
+    virtual void sendMsgToApc( AppMessage const &msg );
+
     ///
     /// \brief sendAvdeccToL2
     ///
@@ -211,6 +365,28 @@ class ApsStateMachine
     ///
     virtual void onNetAvdeccMessageReceived( Frame const &frame );
 
+    ///
+    /// \brief tick
+    ///
+    /// onTimeTick() followed by run(), or a single transition table
+    /// lookup when the state machine is table driven
+    ///
+    void tick( uint32_t time_in_seconds );
+
+    ///
+    /// \brief setTableDriven
+    ///
+    /// When enabled, the frequent events in the WAITING state are handled
+    /// by ApsStates::dispatch() instead of setting state variables and
+    /// running the state procedures until the state is stable. Only enable
+    /// this when the ApsStates object does not override the transitions.
+    ///
+    void setTableDriven( bool enable ) { m_table_driven = enable; }
+
+    bool isTableDriven() const { return m_table_driven; }
+
+    bool dispatch( ApsEvent const &event );
+
     ///
     /// \brief onNetLinkStatusUpdated
     ///
@@ -310,9 +486,9 @@ class ApsStateMachine
     ApsStateActions *m_actions;
     ApsStateEvents *m_events;
     ApsStates *m_states;
-    uint16_t m_assigned_count;
-    uint16_t &m_active_entity_id_count;
-    active_connections_type &m_active_connections;
+    uint16_t m_assigned_index;
+    ApsEntityIdAllocator &m_entity_id_allocator;
+    bool m_table_driven;
 };
 
 
@@ -481,6 +657,16 @@ class ApsStateVariables
     /// address received from a layer 2 network port.
     ///
     AppMessage m_in;
+
+    ///
+    /// \brief isEventPending
+    ///
+    /// \return true if doWaiting() has a state variable to act on
+    ///
+    bool isEventPending() const
+    {
+        return m_incomingTcpClosed || m_finished || m_linkStatusChanged || m_apcMsg || m_L2Msg || m_assignEntityIdRequest;
+    }
 };
 
 
@@ -686,6 +872,37 @@ class ApsStates
     ///
     typedef void ( ApsStates::*state_proc )();
 
+    ///
+    /// The states of Figure C.2, tracked alongside m_current_state for
+    /// the transition table
+    ///
+    enum StateId
+    {
+        StateNone,
+        StateBegin,
+        StateInitialize,
+        StateWaitForConnect,
+        StateAccept,
+        StateReject,
+        StateClosed,
+        StateStartTransfer,
+        StateWaiting,
+        StateLinkStatus,
+        StateTransferToL2,
+        StateTransferToApc,
+        StateAssignEntityId,
+        StateSendNop,
+        StateCloseAndFinish,
+        StateFinish,
+        StateCount
+    };
+
+    ///
+    /// A transition performs the actions of the state that an event
+    /// leads to and of the states back to the current one, in one step
+    ///
+    typedef void ( *transition_proc )( ApsStateMachine &owner, ApsEvent const &event );
+
     ///
     /// \brief States constructor
     ///
@@ -755,6 +972,34 @@ class ApsStates
     ///
     virtual bool run();
 
+    StateId getStateId() const { return m_state_id; }
+
+    ///
+    /// \brief dispatch
+    ///
+    /// Look up the event in the transition table for the current state
+    /// and perform the transition if there is one. This is not virtual
+    /// and does not run the state procedures, so it must only be used when
+    /// the transitions of Figure C.2 are not overridden.
+    ///
+    /// Link status changes and TCP connection closes only set their state
+    /// variables, so the table is not used while doWaiting() has one of
+    /// those pending.
+    ///
+    /// \return false if the event has to be handled via the state
+    /// variables and run()
+    ///
+    bool dispatch( ApsEvent const &event )
+    {
+        transition_proc p = transition_table[m_state_id][event.m_id];
+        if ( p && !m_owner->getVariables()->isEventPending() )
+        {
+            p( *m_owner, event );
+            return true;
+        }
+        return false;
+    }
+
   protected:
     ///
     /// \brief doBegin
@@ -1043,9 +1288,22 @@ class ApsStates
     ///
     virtual void doFinish();
 
+    /// WAITING -> TRANSFER_TO_APC -> WAITING
+    static void transferToApc( ApsStateMachine &owner, ApsEvent const &event );
+
+    /// WAITING -> TRANSFER_TO_L2 -> WAITING
+    static void transferToL2( ApsStateMachine &owner, ApsEvent const &event );
+
+    /// WAITING -> SEND_NOP -> WAITING when the NOP timeout has passed
+    static void timeTickWhileWaiting( ApsStateMachine &owner, ApsEvent const &event );
+
+    /// The transition for each state and event, or 0 to use run()
+    static const transition_proc transition_table[StateCount][ApsEvent::Count];
+
   protected:
     ApsStateMachine *m_owner;
     state_proc m_current_state;
+    StateId m_state_id;
 };
 
 class ApsStateEvents : public AppMessageHandler, public HttpServerHandler
@@ -1290,4 +1548,5 @@ class ApsStateEvents : public AppMessageHandler, public HttpServerHandler
     AppMessageParser m_app_parser;
 };
 
+inline bool ApsStateMachine::dispatch( ApsEvent const &event ) { return m_table_driven && m_states->dispatch( event ); }
 }
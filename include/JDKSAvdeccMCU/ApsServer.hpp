@@ -0,0 +1,687 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Aps.hpp"
+#include "JDKSAvdeccMCU/RawSocket.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_APSSERVER
+
+#include <sys/uio.h>
+#include <unordered_map>
+
+namespace JDKSAvdeccMCU
+{
+
+class ApsServer;
+class ApsServerLink;
+class ApsServerSession;
+
+///
+/// \brief The ApsServerPollTarget class
+///
+/// Anything that the ApsServer registers with its epoll set.
+/// The epoll data pointer refers to one of these.
+///
+class ApsServerPollTarget
+{
+  public:
+    virtual ~ApsServerPollTarget() {}
+
+    ///
+    /// \brief onPollEvents
+    ///
+    /// Called by ApsServer::run() when the file descriptor is ready
+    ///
+    /// \param events The EPOLLIN/EPOLLOUT/EPOLLERR/EPOLLHUP bits
+    ///
+    virtual void onPollEvents( uint32_t events ) = 0;
+};
+
+///
+/// \brief The ApsOutboundQueue class
+///
+/// A bounded ring of serialized messages waiting to be written to an APC.
+///
+/// When a new message would exceed the soft limits the oldest queued ADP
+/// message is dropped first, then the oldest other droppable L2 message.
+/// AECP responses and APS control messages are never dropped; they may
+/// take the queue up to twice its soft limits, beyond which push() fails
+/// and the APC has to be disconnected. The message at the front that is
+/// partially written is never dropped.
+///
+class ApsOutboundQueue
+{
+  public:
+    enum Priority
+    {
+        /// ADP advertisements, which are repeated periodically anyway
+        PriorityAdp,
+
+        /// Other L2 traffic that the sender will retry
+        PriorityDroppable,
+
+        /// AECP responses and APS control messages
+        PriorityKeep
+    };
+
+    ///
+    /// \brief ApsOutboundQueue
+    /// \param max_messages The soft limit of queued messages
+    /// \param max_octets The soft limit of queued octets
+    ///
+    ApsOutboundQueue( size_t max_messages, size_t max_octets );
+
+    ///
+    /// \brief classify
+    ///
+    /// Determine the drop priority of a message to an APC
+    ///
+    static Priority classify( AppMessage const &msg );
+
+    ///
+    /// \brief push
+    ///
+    /// Queue a copy of the octets, dropping older messages if required
+    ///
+    /// \return false if the message could not be queued without dropping
+    /// a message that must not be dropped
+    ///
+    bool push( uint8_t const *data, size_t len, Priority priority );
+
+    ///
+    /// \brief fillIovecs
+    ///
+    /// Describe the unwritten octets of the first max_iov messages
+    ///
+    /// \return the number of iovecs filled in
+    ///
+    int fillIovecs( iovec *iov, int max_iov ) const;
+
+    ///
+    /// \brief consume
+    ///
+    /// Remove len octets that were written from the front of the queue
+    ///
+    void consume( size_t len );
+
+    void clear();
+
+    bool isEmpty() const { return m_count == 0; }
+
+    size_t getCount() const { return m_count; }
+
+    size_t getOctets() const { return m_octets; }
+
+    uint32_t getDroppedCount() const { return m_dropped_count; }
+
+  protected:
+    struct Slot
+    {
+        std::vector<uint8_t> m_data;
+        Priority m_priority;
+    };
+
+    Slot &at( size_t i ) { return m_slots[( m_head + i ) % m_slots.size()]; }
+
+    Slot const &at( size_t i ) const { return m_slots[( m_head + i ) % m_slots.size()]; }
+
+    /// Drop the oldest message of exactly the given priority
+    bool dropOldest( Priority priority );
+
+    /// Slot storage is kept when messages are consumed so that a busy
+    /// session does not allocate per message
+    std::vector<Slot> m_slots;
+    size_t m_max_messages;
+    size_t m_max_octets;
+    size_t m_head;
+    size_t m_count;
+    size_t m_head_pos;
+    size_t m_octets;
+    uint32_t m_dropped_count;
+};
+
+///
+/// \brief The ApsSubscriptionFilter class
+///
+/// Selects which L2 AVDECC frames an APC session receives. Each empty
+/// set matches everything:
+///
+///  - subtypes: the AVTP subtype of the frame must be one of these
+///  - entities: the ADP entity_id, the AECP target_entity_id or the ACMP
+///    talker or listener entity_id must be one of these
+///  - controllers: AECP responses are only received if their
+///    controller_entity_id is one of these
+///
+class ApsSubscriptionFilter
+{
+  public:
+    ApsSubscriptionFilter() { clear(); }
+
+    ///
+    /// \brief clear
+    ///
+    /// Match all frames
+    ///
+    void clear();
+
+    void addSubtype( uint8_t subtype );
+
+    void addEntity( Eui64 const &entity_id );
+
+    void addController( Eui64 const &controller_entity_id );
+
+    bool matchesSubtype( uint8_t subtype ) const
+    {
+        subtype &= 0x7f;
+        return m_all_subtypes || ( m_subtypes[subtype >> 6] & ( uint64_t( 1 ) << ( subtype & 0x3f ) ) ) != 0;
+    }
+
+    bool matchesController( uint64_t controller_entity_id ) const
+    {
+        return m_controllers.empty()
+               || std::binary_search( m_controllers.begin(), m_controllers.end(), controller_entity_id );
+    }
+
+    ///
+    /// \brief getEntities
+    ///
+    /// \return The sorted entity_ids, empty if all entities match
+    ///
+    std::vector<uint64_t> const &getEntities() const { return m_entities; }
+
+  protected:
+    bool m_all_subtypes;
+    uint64_t m_subtypes[2];
+    std::vector<uint64_t> m_entities;
+    std::vector<uint64_t> m_controllers;
+};
+
+///
+/// \brief The ApsFrameKeys class
+///
+/// The fields of an AVDECC frame that subscriptions match on,
+/// extracted once per frame
+///
+class ApsFrameKeys
+{
+  public:
+    ///
+    /// \brief ApsFrameKeys
+    ///
+    /// Extract the keys from the frame
+    ///
+    ApsFrameKeys( Frame const &frame );
+
+    uint8_t m_subtype;
+    bool m_is_aecp_response;
+    uint8_t m_entity_count;
+    uint64_t m_entity_id[2];
+    uint64_t m_controller_entity_id;
+};
+
+///
+/// \brief The ApsSubscriptionTable class
+///
+/// The filters of all sessions on a link compiled into a lookup table.
+/// Sessions without an entity filter are kept in one list and the others
+/// are indexed by entity_id, so matching a frame only looks at the
+/// sessions that can possibly want it.
+///
+class ApsSubscriptionTable
+{
+  public:
+    ApsSubscriptionTable() : m_generation( 0 ) {}
+
+    void add( ApsServerSession *session );
+
+    void remove( ApsServerSession *session );
+
+    ///
+    /// \brief match
+    ///
+    /// Find the sessions that should receive a frame
+    ///
+    /// \param keys The frame's keys
+    /// \param result Filled in with the matching sessions
+    ///
+    void match( ApsFrameKeys const &keys, std::vector<ApsServerSession *> &result );
+
+  protected:
+    typedef std::vector<ApsServerSession *> sessions_type;
+
+    void matchList( sessions_type const &sessions, ApsFrameKeys const &keys, std::vector<ApsServerSession *> &result );
+
+    static void removeFromList( sessions_type &sessions, ApsServerSession *session );
+
+    sessions_type m_any_entity;
+    std::unordered_map<uint64_t, sessions_type> m_by_entity;
+
+    /// Stamped into sessions to match each at most once per frame
+    uint32_t m_generation;
+};
+
+///
+/// \brief The ApsServerSession class
+///
+/// One accepted APC connection. Owns the complete ApsStateMachine
+/// object set for the connection plus a non-blocking TCP socket.
+///
+/// Outgoing messages are kept in an ApsOutboundQueue and written
+/// with one gathering send per ApsServer::run() iteration, or when
+/// epoll reports the socket as writable again. A session whose queue
+/// overflows with messages that can not be dropped is closed.
+///
+class ApsServerSession : public ApsStateMachine, public ApsServerPollTarget
+{
+  public:
+    ApsServerSession( ApsServer &server,
+                      ApsServerLink &link,
+                      int fd,
+                      std::string const &path,
+                      ApsEntityIdAllocator &entity_id_allocator );
+
+    virtual ~ApsServerSession();
+
+    int getFd() const { return m_fd; }
+
+    ApsServerLink &getLink() { return m_link; }
+
+    ///
+    /// \brief isClosing
+    ///
+    /// \return true if the session is finished and waiting to be reaped
+    ///
+    bool isClosing() const { return m_closing; }
+
+    ///
+    /// \brief getQueue
+    ///
+    /// \return The messages queued for the APC but not yet written
+    ///
+    ApsOutboundQueue const &getQueue() const { return m_queue; }
+
+    virtual void onPollEvents( uint32_t events ) override;
+
+    virtual void sendTcpData( uint8_t const *data, ssize_t len ) override;
+
+    virtual void sendMsgToApc( AppMessage const &msg ) override;
+
+    virtual void sendAvdeccToL2( Frame const &frame ) override;
+
+    virtual void closeTcpConnection() override;
+
+    ///
+    /// \brief setFilter
+    ///
+    /// Change which L2 frames this session receives
+    ///
+    void setFilter( ApsSubscriptionFilter const &filter );
+
+    ApsSubscriptionFilter const &getFilter() const { return m_filter; }
+
+    ///
+    /// \brief start
+    ///
+    /// Bring the state machine to the point of waiting for the
+    /// APC's HTTP CONNECT request
+    ///
+    virtual void start();
+
+    ///
+    /// \brief flushQueue
+    ///
+    /// Write as much queued data as the socket accepts
+    ///
+    void flushQueue();
+
+    /// Index of this session in its link's session list
+    size_t m_link_index;
+
+    /// True while the session is on the server's list to be flushed
+    bool m_flush_scheduled;
+
+    /// Used by ApsSubscriptionTable to match a session once per frame
+    uint32_t m_match_generation;
+
+  protected:
+    /// Read what is available from the socket and run the state machine
+    void readIncoming();
+
+    /// Queue octets and arrange for them to be flushed
+    void queue( uint8_t const *data, size_t len, ApsOutboundQueue::Priority priority );
+
+    /// Mark the session for removal by the server
+    void markClosing();
+
+    ApsServer &m_server;
+    ApsServerLink &m_link;
+    int m_fd;
+    bool m_closing;
+    bool m_want_write;
+    ApsOutboundQueue m_queue;
+    ApsSubscriptionFilter m_filter;
+
+    HttpRequest m_http_request;
+    ApsStateVariables m_state_variables;
+    ApsStateActions m_state_actions;
+    ApsStateEvents m_state_events;
+    ApsStates m_state_states;
+    HttpServerParserFast m_http_parser;
+};
+
+///
+/// \brief The ApsServerLink class
+///
+/// One AVDECC network port: the RawSocket, the TCP listener that APCs
+/// connect to for this port and the sessions attached to it.
+///
+class ApsServerLink : public ApsServerPollTarget
+{
+  public:
+    ApsServerLink( ApsServer &server, RawSocket *raw_socket, int raw_fd, int listen_fd );
+
+    virtual ~ApsServerLink();
+
+    ///
+    /// \brief onPollEvents
+    ///
+    /// The raw socket is readable, receive and fan out the frames
+    ///
+    virtual void onPollEvents( uint32_t events ) override;
+
+    ///
+    /// \brief receiveFrames
+    ///
+    /// Receive up to max_frames frames from the raw socket and
+    /// dispatch each of them to all sessions on this link
+    ///
+    void receiveFrames( int max_frames );
+
+    ///
+    /// \brief dispatchFrame
+    ///
+    /// Give the frame to every session on this link whose subscription
+    /// filter matches, except 'except'
+    ///
+    void dispatchFrame( Frame const &frame, ApsServerSession *except = 0 );
+
+    ///
+    /// \brief setLinkStatus
+    ///
+    /// Notify all sessions on this link of a link status change
+    ///
+    void setLinkStatus( bool link_status );
+
+    bool getLinkStatus() const { return m_link_status; }
+
+    RawSocket *getRawSocket() { return m_raw_socket; }
+
+    int getRawFd() const { return m_raw_fd; }
+
+    int getListenFd() const { return m_listener.m_fd; }
+
+    void addSession( ApsServerSession *session );
+
+    void removeSession( ApsServerSession *session );
+
+    ///
+    /// \brief removeSubscription
+    ///
+    /// Remove a session's filter from the subscription table before
+    /// the filter is changed
+    ///
+    void removeSubscription( ApsServerSession *session ) { m_subscriptions.remove( session ); }
+
+    ///
+    /// \brief addSubscription
+    ///
+    /// Compile a session's filter into the subscription table
+    ///
+    void addSubscription( ApsServerSession *session ) { m_subscriptions.add( session ); }
+
+    size_t getSessionCount() const { return m_sessions.size(); }
+
+  protected:
+    ///
+    /// \brief The Listener class
+    ///
+    /// The listening TCP socket for this link
+    ///
+    class Listener : public ApsServerPollTarget
+    {
+      public:
+        Listener( ApsServerLink &link, int fd ) : m_link( link ), m_fd( fd ) {}
+
+        virtual void onPollEvents( uint32_t events ) override;
+
+        ApsServerLink &m_link;
+        int m_fd;
+    };
+
+    ApsServer &m_server;
+    RawSocket *m_raw_socket;
+    int m_raw_fd;
+    bool m_link_status;
+    Listener m_listener;
+    std::vector<ApsServerSession *> m_sessions;
+    ApsSubscriptionTable m_subscriptions;
+    std::vector<ApsServerSession *> m_matches;
+    FrameWithMTU m_frame;
+
+    friend class Listener;
+    friend class ApsServer;
+};
+
+///
+/// \brief The ApsServer class
+///
+/// An AVDECC Proxy Server (IEEE Std 1722.1-2013 Annex C) that
+/// multiplexes many APC connections on a single thread with epoll.
+///
+/// Each network port is added with addLink() which supplies the
+/// RawSocket for the port and the TCP address that APCs connect to.
+/// AVDECC frames received on a link are fanned out to every session
+/// on that link, and frames sent by one APC are also delivered to the
+/// other APCs on the same link since the raw socket does not loop them
+/// back.
+///
+/// If the RawSocket has no pollable file descriptor it is polled every
+/// raw_poll_interval_ms instead.
+///
+/// Call run() repeatedly from the daemon's main loop.
+///
+class ApsServer
+{
+  public:
+    ///
+    /// \brief ApsServer
+    /// \param path The HTTP CONNECT path that APCs must request
+    /// \param max_sessions The maximum number of concurrent APC sessions
+    /// \param max_pending_octets The soft limit of unsent octets per session
+    /// \param max_pending_messages The soft limit of unsent messages per session
+    ///
+    ApsServer( std::string const &path = "/",
+               size_t max_sessions = 4096,
+               size_t max_pending_octets = 256 * 1024,
+               size_t max_pending_messages = 256 );
+
+    virtual ~ApsServer();
+
+    ///
+    /// \brief open
+    ///
+    /// Create the epoll set
+    ///
+    /// \return false on error
+    ///
+    bool open();
+
+    ///
+    /// \brief close
+    ///
+    /// Close all sessions, listeners and the epoll set
+    ///
+    void close();
+
+    ///
+    /// \brief addLink
+    ///
+    /// \param raw_socket The RawSocket for the network port
+    /// \param raw_fd The file descriptor of the RawSocket or -1 to poll it
+    /// \param listen_host The address to listen on for APCs, or 0 for any
+    /// \param listen_port The TCP port to listen on for APCs
+    /// \return the link index or -1 on error
+    ///
+    int addLink( RawSocket *raw_socket, int raw_fd, char const *listen_host, char const *listen_port );
+
+    ///
+    /// \brief setLinkStatus
+    ///
+    /// Notify the sessions on a link that the port's link status changed
+    ///
+    void setLinkStatus( size_t link_index, bool link_status );
+
+    ///
+    /// \brief flush
+    ///
+    /// Write the queued messages of all sessions that have new data.
+    /// This happens at the end of every run().
+    ///
+    void flush();
+
+    ///
+    /// \brief run
+    ///
+    /// Wait up to timeout_ms for activity and process it
+    ///
+    /// \param timeout_ms The maximum time to wait
+    /// \return false if the server is finished or has an error
+    ///
+    bool run( int timeout_ms );
+
+    ///
+    /// \brief finish
+    ///
+    /// Close all sessions and make run() return false
+    ///
+    void finish() { m_finished = true; }
+
+    size_t getLinkCount() const { return m_links.size(); }
+
+    ApsServerLink *getLink( size_t link_index ) { return m_links[link_index]; }
+
+    size_t getSessionCount() const { return m_session_count; }
+
+    size_t getMaxPendingOctets() const { return m_max_pending_octets; }
+
+    size_t getMaxPendingMessages() const { return m_max_pending_messages; }
+
+    std::string const &getPath() const { return m_path; }
+
+    ///
+    /// \brief createSession
+    ///
+    /// Factory for sessions, override to use a specialized ApsServerSession
+    ///
+    virtual ApsServerSession *createSession( ApsServerLink &link, int fd );
+
+    ///
+    /// \brief acceptSession
+    ///
+    /// Called by a link's listener with a newly accepted socket
+    ///
+    void acceptSession( ApsServerLink &link, int fd );
+
+    ///
+    /// \brief updatePoll
+    ///
+    /// Change the epoll events wanted for a session's socket
+    ///
+    bool updatePoll( int fd, ApsServerPollTarget *target, bool want_write );
+
+    ///
+    /// \brief retireSession
+    ///
+    /// Queue a closing session for deletion at the end of run()
+    ///
+    void retireSession( ApsServerSession *session );
+
+    ///
+    /// \brief scheduleFlush
+    ///
+    /// Queue a session with new outgoing data to be flushed by flush()
+    ///
+    void scheduleFlush( ApsServerSession *session ) { m_flush_list.push_back( session ); }
+
+    ///
+    /// \brief getReadBuffer
+    ///
+    /// The shared buffer that sessions read incoming TCP data into
+    ///
+    uint8_t *getReadBuffer() { return m_read_buffer; }
+
+    static const size_t read_buffer_size = 65536;
+
+    static const int max_events = 256;
+
+    static const int raw_poll_interval_ms = 10;
+
+    static const int max_frames_per_poll = 64;
+
+    static const int max_iovecs_per_send = 64;
+
+  protected:
+    /// Delete the sessions that closed during this run
+    void reapSessions();
+
+    /// Notify all sessions of the current time once per second
+    void tickSessions( uint32_t time_in_seconds );
+
+    std::string m_path;
+    size_t m_max_sessions;
+    size_t m_max_pending_octets;
+    size_t m_max_pending_messages;
+    int m_epoll_fd;
+    bool m_finished;
+    bool m_have_unpollable_links;
+    uint32_t m_last_tick_seconds;
+    size_t m_session_count;
+    ApsEntityIdAllocator m_entity_id_allocator;
+    std::vector<ApsServerLink *> m_links;
+    std::vector<ApsServerSession *> m_retired;
+    std::vector<ApsServerSession *> m_flush_list;
+    uint8_t m_read_buffer[read_buffer_size];
+};
+}
+
+#endif
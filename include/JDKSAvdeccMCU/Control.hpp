@@ -53,19 +53,122 @@ namespace JDKSAvdeccMCU
 /// for the control descriptor and manages the data transport
 /// for the control data via SET_CONTROL and GET_CONTROL commands
 ///
+/// The value details of the control descriptor, apart from the current
+/// values, can be formed once into a cached block held in storage that
+/// the caller supplies, see ControlWithStorage. The cache is filled when
+/// the control's ranges and options are set, and each READ_DESCRIPTOR
+/// response copies it and fills in the current values from the
+/// ControlValueHolder. Without storage, or when the storage is too small,
+/// the value details are formed in each response with empty ranges and
+/// no options, and setItemRange() and setSelectorOptions() are ignored.
+///
+/// The cached value details take, with size being the value length of
+/// the ControlValueHolder:
+///
+/// - linear: num_items * ( size * 5 + 4 ) octets
+/// - selector: ( num_options + 2 ) * size + 2 octets
+/// - array: size * 4 + 4 + num_items * size octets
+///
 class Control : public Handler
 {
   public:
+    /// The localized string reference for no string
+    static const uint16_t no_localized_string = 0xffff;
+
     /// Construct the SetControlSender object
-    Control(
-        Entity &entity, uint16_t descriptor_index, Eui64 control_type, uint16_t control_value_type, ControlValueHolder *holder );
+    Control( Entity &entity,
+             uint16_t descriptor_index,
+             Eui64 control_type,
+             uint16_t control_value_type,
+             ControlValueHolder *holder,
+             uint8_t *value_details_storage = 0,
+             uint16_t value_details_storage_size = 0 );
 
     virtual void tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override;
 
     virtual bool receivedPDU( RawSocket *incoming_socket, Frame &frame ) override;
 
+    ///
+    /// \brief formControlValueMetaData
+    ///
+    /// Append the value details of the control descriptor to the pdu,
+    /// with the current values of the ControlValueHolder
+    ///
+    /// \param pdu the READ_DESCRIPTOR response
+    /// \return the AEM status code
+    ///
     virtual uint8_t formControlValueMetaData( Frame &pdu );
 
+    ///
+    /// \brief setItemRange
+    ///
+    /// Set the range of an item of a linear control, or the range shared
+    /// by all of the items of an array control. Ignored for other control
+    /// value types or when the items are not encoded as EncodedT.
+    ///
+    /// \param item the item of a linear control, 0 for an array control
+    /// \param minimum the encoded minimum value
+    /// \param maximum the encoded maximum value
+    /// \param step the encoded step value
+    /// \param default_value the encoded default value
+    /// \param unit the units code and multiplier power, see
+    ///        jdksavdecc_control.h
+    /// \param localized_string the localized description of the item
+    ///
+    template <typename EncodedT>
+    void setItemRange( uint16_t item,
+                       EncodedT minimum,
+                       EncodedT maximum,
+                       EncodedT step,
+                       EncodedT default_value,
+                       uint16_t unit = 0,
+                       uint16_t localized_string = no_localized_string )
+    {
+        if ( m_holder->getValueLength() == sizeof( EncodedT ) )
+        {
+            uint8_t range[4 * sizeof( EncodedT )];
+            setEncodedValue( minimum, range, 0 );
+            setEncodedValue( maximum, range, sizeof( EncodedT ) );
+            setEncodedValue( step, range, 2 * sizeof( EncodedT ) );
+            setEncodedValue( default_value, range, 3 * sizeof( EncodedT ) );
+            setRangeDetails( item, range, unit, localized_string );
+        }
+    }
+
+    ///
+    /// \brief setSelectorOptions
+    ///
+    /// Set the options of a selector control. Ignored for other control
+    /// value types, when the items are not encoded as EncodedT or when the
+    /// options do not fit in a descriptor.
+    ///
+    /// \param default_value the encoded default value
+    /// \param options the encoded values that may be selected
+    /// \param num_options the number of options
+    /// \param unit the units code and multiplier power
+    ///
+    template <typename EncodedT>
+    void setSelectorOptions( EncodedT default_value, EncodedT const *options, uint16_t num_options, uint16_t unit = 0 )
+    {
+        if ( m_holder->getValueLength() == sizeof( EncodedT ) && setSelectorDetails( num_options, unit ) )
+        {
+            uint8_t *details = m_value_details.getBuf();
+            setEncodedValue( default_value, details, sizeof( EncodedT ) );
+            for ( uint16_t i = 0; i < num_options; ++i )
+            {
+                setEncodedValue( options[i], details, ( 2 + i ) * sizeof( EncodedT ) );
+            }
+        }
+    }
+
+    ///
+    /// \brief getNumberOfValues
+    /// \return the number_of_values field of the control descriptor
+    ///
+    uint16_t getNumberOfValues() const { return m_number_of_values; }
+
+    uint16_t getDescriptorIndex() const { return m_descriptor_index; }
+
     virtual uint8_t formControlPayload( Frame &pdu );
 
     virtual uint8_t validateSetControlCommand( Frame &pdu );
@@ -76,6 +179,15 @@ class Control : public Handler
 
     virtual uint8_t formGetControlResponse( Frame &pdu );
 
+    ///
+    /// \brief readControlDescriptor
+    ///
+    /// Append the CONTROL descriptor, followed by its value details, to
+    /// the pdu
+    ///
+    /// \param pdu the READ_DESCRIPTOR response
+    /// \return the AEM status code
+    ///
     virtual uint8_t readControlDescriptor( Frame &pdu );
 
     Entity &getEntity() { return m_entity; }
@@ -87,10 +199,80 @@ class Control : public Handler
     ControlValueHolder const *getControlValueHolder() const { return m_holder; }
 
   protected:
+    ///
+    /// \brief The ValueLayout enum
+    ///
+    /// How the value details of a control value type are laid out
+    ///
+    enum class ValueLayout : uint8_t
+    {
+        LAYOUT_NONE,     ///< Not supported
+        LAYOUT_LINEAR,   ///< A range and the current value for each item
+        LAYOUT_SELECTOR, ///< The current value, the default and the options
+        LAYOUT_ARRAY,    ///< One range for all items, then the current values
+        LAYOUT_VALUES    ///< Only the current values, as UTF8 and vendor controls
+    };
+
+    /// Get the layout of the control's value type
+    ValueLayout getValueLayout() const;
+
+    /// Get the length of the value details with no options, 0 if the
+    /// layout is not supported or the details do not fit in a descriptor
+    uint16_t getDefaultValueDetailsLength() const;
+
+    /// Form the value details with empty ranges and no options
+    void formDefaultValueDetails( uint8_t *details, uint16_t length ) const;
+
+    /// Form the cached value details with empty ranges and no options
+    void initValueDetails();
+
+    /// Store an encoded range in the cached value details
+    void setRangeDetails( uint16_t item, uint8_t const *range, uint16_t unit, uint16_t localized_string );
+
+    /// Resize the cached value details of a selector for its options
+    bool setSelectorDetails( uint16_t num_options, uint16_t unit );
+
+    static void setEncodedValue( int8_t v, uint8_t *base, uint16_t pos ) { jdksavdecc_uint8_set( uint8_t( v ), base, pos ); }
+    static void setEncodedValue( uint8_t v, uint8_t *base, uint16_t pos ) { jdksavdecc_uint8_set( v, base, pos ); }
+    static void setEncodedValue( int16_t v, uint8_t *base, uint16_t pos ) { jdksavdecc_uint16_set( uint16_t( v ), base, pos ); }
+    static void setEncodedValue( uint16_t v, uint8_t *base, uint16_t pos ) { jdksavdecc_uint16_set( v, base, pos ); }
+    static void setEncodedValue( int32_t v, uint8_t *base, uint16_t pos ) { jdksavdecc_uint32_set( uint32_t( v ), base, pos ); }
+    static void setEncodedValue( uint32_t v, uint8_t *base, uint16_t pos ) { jdksavdecc_uint32_set( v, base, pos ); }
+    static void setEncodedValue( int64_t v, uint8_t *base, uint16_t pos ) { jdksavdecc_uint64_set( uint64_t( v ), base, pos ); }
+    static void setEncodedValue( uint64_t v, uint8_t *base, uint16_t pos ) { jdksavdecc_uint64_set( v, base, pos ); }
+    static void setEncodedValue( float v, uint8_t *base, uint16_t pos ) { jdksavdecc_float_set( v, base, pos ); }
+    static void setEncodedValue( double v, uint8_t *base, uint16_t pos ) { jdksavdecc_double_set( v, base, pos ); }
+
     Entity &m_entity;
     uint16_t m_descriptor_index;
     Eui64 m_control_type;
     uint16_t m_control_value_type;
     ControlValueHolder *m_holder;
+    uint16_t m_number_of_values;
+
+    /// The cached value details with zeros in place of the current
+    /// values, empty when there is no cache
+    FixedBuffer m_value_details;
+};
+
+///
+/// \brief The ControlWithStorage class
+///
+/// A Control with ValueDetailsSize octets of storage for its cached
+/// value details. ValueDetailsSize is sized from the control's value type
+/// and number of items, see Control.
+///
+template <uint16_t ValueDetailsSize>
+class ControlWithStorage : public Control
+{
+  public:
+    ControlWithStorage(
+        Entity &entity, uint16_t descriptor_index, Eui64 control_type, uint16_t control_value_type, ControlValueHolder *holder )
+        : Control( entity, descriptor_index, control_type, control_value_type, holder, m_value_details_storage, ValueDetailsSize )
+    {
+    }
+
+  protected:
+    uint8_t m_value_details_storage[ValueDetailsSize];
 };
 }
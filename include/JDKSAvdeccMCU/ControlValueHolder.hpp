@@ -39,6 +39,233 @@
 namespace JDKSAvdeccMCU
 {
 
+#if JDKSAVDECCMCU_ENABLE_FLOAT
+
+///
+/// \brief ControlValueTraits template traits class
+///
+/// Specialized for each encoding of a control value item, giving the
+/// unsigned type with the same octets and the range of host float values
+/// that converts to the encoding without overflow
+///
+template <typename EncodedT>
+struct ControlValueTraits
+{
+};
+
+template <>
+struct ControlValueTraits<int8_t>
+{
+    typedef uint8_t bits_type;
+    static const bool is_integer = true;
+    static float lowest() { return float( INT8_MIN ); }
+    static float highest() { return float( INT8_MAX ); }
+};
+
+template <>
+struct ControlValueTraits<uint8_t>
+{
+    typedef uint8_t bits_type;
+    static const bool is_integer = true;
+    static float lowest() { return 0.0f; }
+    static float highest() { return float( UINT8_MAX ); }
+};
+
+template <>
+struct ControlValueTraits<int16_t>
+{
+    typedef uint16_t bits_type;
+    static const bool is_integer = true;
+    static float lowest() { return float( INT16_MIN ); }
+    static float highest() { return float( INT16_MAX ); }
+};
+
+template <>
+struct ControlValueTraits<uint16_t>
+{
+    typedef uint16_t bits_type;
+    static const bool is_integer = true;
+    static float lowest() { return 0.0f; }
+    static float highest() { return float( UINT16_MAX ); }
+};
+
+// The maximums of the wider integer types round up to the next power of
+// two as a float, so the highest float that converts is 2^(N-1) below it
+
+template <>
+struct ControlValueTraits<int32_t>
+{
+    typedef uint32_t bits_type;
+    static const bool is_integer = true;
+    static float lowest() { return float( INT32_MIN ); }
+    static float highest() { return 2147483520.0f; }
+};
+
+template <>
+struct ControlValueTraits<uint32_t>
+{
+    typedef uint32_t bits_type;
+    static const bool is_integer = true;
+    static float lowest() { return 0.0f; }
+    static float highest() { return 4294967040.0f; }
+};
+
+template <>
+struct ControlValueTraits<int64_t>
+{
+    typedef uint64_t bits_type;
+    static const bool is_integer = true;
+    static float lowest() { return float( INT64_MIN ); }
+    static float highest() { return 9223371487098961920.0f; }
+};
+
+template <>
+struct ControlValueTraits<uint64_t>
+{
+    typedef uint64_t bits_type;
+    static const bool is_integer = true;
+    static float lowest() { return 0.0f; }
+    static float highest() { return 18446742974197923840.0f; }
+};
+
+template <>
+struct ControlValueTraits<float>
+{
+    typedef uint32_t bits_type;
+    static const bool is_integer = false;
+    static float lowest() { return -FLT_MAX; }
+    static float highest() { return FLT_MAX; }
+};
+
+template <>
+struct ControlValueTraits<double>
+{
+    typedef uint64_t bits_type;
+    static const bool is_integer = false;
+    static float lowest() { return -FLT_MAX; }
+    static float highest() { return FLT_MAX; }
+};
+
+///
+/// \brief getControlValueScale
+///
+/// Get 10^power as a float, the factor between an encoded value and its
+/// unencoded value for a multiplier power
+///
+inline float getControlValueScale( int power )
+{
+    float r = 1.0f;
+    for ( ; power > 0; --power )
+    {
+        r *= 10.0f;
+    }
+    for ( ; power < 0; ++power )
+    {
+        r /= 10.0f;
+    }
+    return r;
+}
+
+///
+/// \brief encodeControlValues
+///
+/// Encode host float values into big endian control value items in one
+/// pass. Each value is divided by 10^multiplier_power, then integer
+/// encodings are rounded to nearest and clamped to their range. A NaN
+/// value is encoded as the lowest value of the type, never full scale.
+///
+/// The items are converted a block at a time through a host order
+/// scratch block, so that the conversion and the byte swap are each a
+/// simple loop that the compiler can vectorise
+///
+/// \param dest the first encoded item
+/// \param values the unencoded values
+/// \param count the number of items
+/// \param multiplier_power the power of ten of the unit multiplier
+/// \return true if any of the octets at dest changed
+///
+template <typename EncodedT>
+bool encodeControlValues( uint8_t *dest, float const *values, uint16_t count, int8_t multiplier_power = 0 )
+{
+    typedef ControlValueTraits<EncodedT> traits;
+    typedef typename traits::bits_type bits_type;
+    const uint16_t block_size = 64;
+    const float scale = getControlValueScale( -multiplier_power );
+    const float lowest = traits::lowest();
+    const float highest = traits::highest();
+    EncodedT block[block_size];
+    uint8_t encoded[block_size * sizeof( EncodedT )];
+    bool changed = false;
+
+    for ( uint16_t first = 0; first < count; first += block_size )
+    {
+        uint16_t n = ( count - first ) < block_size ? uint16_t( count - first ) : block_size;
+
+        for ( uint16_t i = 0; i < n; ++i )
+        {
+            float v = values[first + i] * scale;
+            if ( traits::is_integer )
+            {
+                v = v < 0.0f ? v - 0.5f : v + 0.5f;
+            }
+            // NaN fails the first comparison and goes to lowest
+            v = v > lowest ? v : lowest;
+            v = v < highest ? v : highest;
+            block[i] = EncodedT( v );
+        }
+
+        for ( uint16_t i = 0; i < n; ++i )
+        {
+            bits_type b;
+            memcpy( &b, &block[i], sizeof( b ) );
+            for ( uint16_t k = 0; k < sizeof( b ); ++k )
+            {
+                encoded[i * sizeof( b ) + k] = uint8_t( b >> ( 8 * ( sizeof( b ) - 1 - k ) ) );
+            }
+        }
+
+        uint8_t *p = dest + first * sizeof( EncodedT );
+        if ( memcmp( p, encoded, n * sizeof( EncodedT ) ) != 0 )
+        {
+            memcpy( p, encoded, n * sizeof( EncodedT ) );
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+///
+/// \brief decodeControlValues
+///
+/// Decode big endian control value items into host float values in one
+/// pass, multiplying each by 10^multiplier_power
+///
+/// \param values the unencoded values
+/// \param src the first encoded item
+/// \param count the number of items
+/// \param multiplier_power the power of ten of the unit multiplier
+///
+template <typename EncodedT>
+void decodeControlValues( float *values, uint8_t const *src, uint16_t count, int8_t multiplier_power = 0 )
+{
+    typedef typename ControlValueTraits<EncodedT>::bits_type bits_type;
+    const float scale = getControlValueScale( multiplier_power );
+
+    for ( uint16_t i = 0; i < count; ++i )
+    {
+        bits_type b = 0;
+        for ( uint16_t k = 0; k < sizeof( b ); ++k )
+        {
+            b = bits_type( ( b << 8 ) | src[i * sizeof( b ) + k] );
+        }
+        EncodedT v;
+        memcpy( &v, &b, sizeof( v ) );
+        values[i] = float( v ) * scale;
+    }
+}
+
+#endif
+
 class ControlValueHolder : public FixedBuffer
 {
   public:
@@ -135,6 +362,58 @@ class ControlValueHolder : public FixedBuffer
     }
 
 #if JDKSAVDECCMCU_ENABLE_FLOAT
+    ///
+    /// \brief setValuesFromFloats
+    ///
+    /// Set many items at once from host float values, see
+    /// encodeControlValues(). Items past the end are ignored, and nothing
+    /// is set unless the items are encoded as EncodedT.
+    ///
+    /// \param values the unencoded values
+    /// \param count the number of items to set
+    /// \param multiplier_power the power of ten of the unit multiplier
+    /// \param first_item the first item to set
+    ///
+    template <typename EncodedT>
+    void setValuesFromFloats( float const *values, uint16_t count, int8_t multiplier_power = 0, uint16_t first_item = 0 )
+    {
+        if ( m_value_length == sizeof( EncodedT ) && first_item < m_num_items )
+        {
+            if ( count > m_num_items - first_item )
+            {
+                count = m_num_items - first_item;
+            }
+            if ( encodeControlValues<EncodedT>( m_buf + first_item * m_value_length, values, count, multiplier_power ) )
+            {
+                m_dirty = true;
+            }
+        }
+    }
+
+    ///
+    /// \brief getValuesAsFloats
+    ///
+    /// Get many items at once as host float values, see
+    /// decodeControlValues()
+    ///
+    /// \param values the unencoded values
+    /// \param count the maximum number of items to get
+    /// \param multiplier_power the power of ten of the unit multiplier
+    /// \param first_item the first item to get
+    /// \return the number of items that were decoded
+    ///
+    template <typename EncodedT>
+    uint16_t getValuesAsFloats( float *values, uint16_t count, int8_t multiplier_power = 0, uint16_t first_item = 0 ) const
+    {
+        uint16_t r = 0;
+        if ( m_value_length == sizeof( EncodedT ) && first_item < m_num_items )
+        {
+            r = count < m_num_items - first_item ? count : uint16_t( m_num_items - first_item );
+            decodeControlValues<EncodedT>( values, m_buf + first_item * m_value_length, r, multiplier_power );
+        }
+        return r;
+    }
+
     float getValueFloat( uint8_t item = 0 ) const
     {
         uint32_t q = getValueQuadlet( item );
@@ -151,7 +430,7 @@ class ControlValueHolder : public FixedBuffer
 
     void setValue( void const *v )
     {
-        if ( memcmp( m_buf, v, m_value_length ) != 0 )
+        if ( memcmp( m_buf, v, m_value_length * m_num_items ) != 0 )
         {
             memcpy( m_buf, v, m_value_length * m_num_items );
             m_dirty = true;
@@ -173,6 +452,23 @@ class ControlValueHolderWithStorage : public ControlValueHolder
 
     ControlValueHolderWithStorage() : ControlValueHolder( m_value_storage, sizeof( BaseValueType ), NumItems ) {}
 
+#if JDKSAVDECCMCU_ENABLE_FLOAT
+    // Keep the templates for other encodings visible next to the
+    // overloads for BaseValueType
+    using ControlValueHolder::setValuesFromFloats;
+    using ControlValueHolder::getValuesAsFloats;
+
+    void setValuesFromFloats( float const *values, uint16_t count, int8_t multiplier_power = 0, uint16_t first_item = 0 )
+    {
+        ControlValueHolder::setValuesFromFloats<BaseValueType>( values, count, multiplier_power, first_item );
+    }
+
+    uint16_t getValuesAsFloats( float *values, uint16_t count, int8_t multiplier_power = 0, uint16_t first_item = 0 ) const
+    {
+        return ControlValueHolder::getValuesAsFloats<BaseValueType>( values, count, multiplier_power, first_item );
+    }
+#endif
+
   protected:
     uint8_t m_value_storage[sizeof( BaseValueType ) * NumItems];
 };
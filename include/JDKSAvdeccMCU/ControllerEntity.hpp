@@ -42,19 +42,26 @@
 namespace JDKSAvdeccMCU
 {
 
+class AddressAccessTransfer;
+
 class ControllerEntity : public Entity
 {
   public:
     ControllerEntity( ADPManager &adp_manager, RegisteredControllers *registered_controllers, EntityState *entity_state )
-        : Entity( adp_manager, registered_controllers, entity_state )
+        : Entity( adp_manager, registered_controllers, entity_state ), m_address_access_transfer( 0 )
     {
     }
 
     /// Handle incoming commands and responses
     virtual bool receivedPDU( RawSocket *incoming_socket, Frame &frame ) override;
 
+    /// Handle an AA response for this controller, by default passing it on to
+    /// the AddressAccessTransfer, if any
     virtual bool receivedAAResponse( jdksavdecc_aecp_aa const &aa, Frame &pdu );
 
+    /// Set the AddressAccessTransfer that receives AA responses, or 0 for none
+    void setAddressAccessTransfer( AddressAccessTransfer *transfer ) { m_address_access_transfer = transfer; }
+
     bool receivedAEMResponse( jdksavdecc_aecpdu_aem const &aem, Frame &pdu );
 
     // Formulate and send a ACQUIRE_ENTITY command to a target entity
@@ -148,5 +155,6 @@ class ControllerEntity : public Entity
     virtual bool receiveGetControlResponse( jdksavdecc_aecpdu_aem const &aem, Frame &pdu );
 
   protected:
+    AddressAccessTransfer *m_address_access_transfer;
 };
 }
@@ -31,14 +31,257 @@
 #pragma once
 
 #include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Handler.hpp"
 
 namespace JDKSAvdeccMCU
 {
 
-template <typename T>
-class EEPromStorage
+///
+/// \brief The EEPromDevice class
+///
+/// Abstract non-volatile memory with page erase semantics, like flash or
+/// EEPROM. Erased memory reads as 0xff and programming may only clear bits,
+/// so a page is erased before it is programmed again.
+///
+/// Devices that erase or program in the background return true from
+/// isBusy() until the operation finishes; users must not start another
+/// operation until then.
+///
+class EEPromDevice
 {
   public:
-    EEPromStorage( uint32_t magic_number );
+    virtual ~EEPromDevice();
+
+    /// The total size of the device in octets
+    virtual uint32_t getSize() const = 0;
+
+    /// The size of an erasable page in octets
+    virtual uint16_t getPageSize() const = 0;
+
+    /// true while a previous erase or program operation is still in progress
+    virtual bool isBusy() const { return false; }
+
+    /// Read len octets at offset into buf
+    virtual bool read( uint32_t offset, uint8_t *buf, uint16_t len ) = 0;
+
+    /// Erase the page starting at the page aligned offset
+    virtual bool erasePage( uint32_t offset ) = 0;
+
+    /// Program len octets from buf at offset, within erased memory
+    virtual bool program( uint32_t offset, uint8_t const *buf, uint16_t len ) = 0;
+};
+
+#if JDKSAVDECCMCU_ENABLE_EEPROMFILE
+
+///
+/// \brief The EEPromDeviceFile class
+///
+/// An EEPromDevice kept in a file, for testing on hosts. Programming ANDs
+/// the new data into the old like flash does, so writing to memory that was
+/// not erased shows up as corrupt data.
+///
+class EEPromDeviceFile : public EEPromDevice
+{
+  public:
+    EEPromDeviceFile( std::string const &filename, uint32_t size, uint16_t page_size );
+    virtual ~EEPromDeviceFile();
+
+    bool isOpen() const { return m_f != 0; }
+
+    virtual uint32_t getSize() const override { return m_size; }
+    virtual uint16_t getPageSize() const override { return m_page_size; }
+    virtual bool read( uint32_t offset, uint8_t *buf, uint16_t len ) override;
+    virtual bool erasePage( uint32_t offset ) override;
+    virtual bool program( uint32_t offset, uint8_t const *buf, uint16_t len ) override;
+
+  private:
+    FILE *m_f;
+    uint32_t m_size;
+    uint16_t m_page_size;
+};
+
+#endif
+
+///
+/// \brief The EEPromLog class
+///
+/// Log structured storage of a block of data in two banks of an
+/// EEPromDevice.
+///
+/// The data is split into fixed size chunks. Flushing compares the data with
+/// a shadow copy of what is stored and appends a record only for each chunk
+/// that changed. When the current bank is full the other bank is erased and
+/// every chunk is written to it, followed by a bank header with the next
+/// generation number; the header is written last so that the old bank stays
+/// valid until the new one is complete. Appending sequentially and
+/// alternating the banks spreads the erases evenly over every page.
+///
+/// Changes are coalesced: changed() starts a deferral timer and the flush
+/// happens when it expires, so a burst of changes costs one record per
+/// chunk touched. Device operations run from tick(), one at a time while
+/// the device is not busy.
+///
+/// Each bank must be a multiple of the page size and large enough for the
+/// bank header and a record for every chunk.
+///
+class EEPromLog
+{
+  public:
+    static const uint16_t bank_header_size = 16;
+    static const uint16_t record_overhead = 4;
+
+    EEPromLog( EEPromDevice &device,
+               uint32_t device_offset,
+               uint32_t bank_size,
+               uint32_t magic_number,
+               jdksavdecc_timestamp_in_milliseconds deferral_in_millis,
+               uint8_t *data,
+               uint8_t *shadow,
+               uint16_t data_size,
+               uint16_t chunk_size,
+               uint8_t *record );
+
+    ///
+    /// \brief load Read the newest valid bank into the data
+    /// \return false if there is no valid stored data, in which case the data
+    /// is left as it was and the next flush stores all of it
+    ///
+    bool load();
+
+    /// Note that the data changed, it is stored when the deferral expires
+    void changed( jdksavdecc_timestamp_in_milliseconds time_in_millis );
+
+    /// Store all changes now, waiting for the device as needed
+    bool flush();
+
+    /// Start a deferred flush when it is due and run device operations
+    void tick( jdksavdecc_timestamp_in_milliseconds time_in_millis );
+
+    /// true when changes are waiting for the deferral timer or being stored
+    bool isFlushPending() const { return m_pending || m_state != StateIdle; }
+
+    uint32_t getGeneration() const { return m_generation; }
+
+  protected:
+    enum State
+    {
+        StateIdle,
+        StateAppending,
+        StateErasing,
+        StateCompacting,
+        StateWritingHeader
+    };
+
+    uint32_t getBankOffset( uint8_t bank ) const { return m_device_offset + bank * m_bank_size; }
+
+    uint16_t getRecordSize() const { return m_chunk_size + record_overhead; }
+
+    /// Records do not straddle pages when they fit in one
+    uint32_t alignRecord( uint32_t pos ) const;
+
+    bool readHeader( uint8_t bank, uint32_t *generation );
+
+    /// Fill in m_record for the chunk from source, either m_data or m_shadow
+    void formRecord( uint16_t chunk, uint8_t const *source );
+
+    bool isRecordValid() const;
+
+    void startCompaction();
+
+    /// Run one device operation. Returns false on device error
+    bool step();
+
+    /// Run device operations until done or the device is busy
+    bool pump();
+
+    EEPromDevice &m_device;
+    uint32_t m_device_offset;
+    uint32_t m_bank_size;
+    uint32_t m_magic_number;
+    jdksavdecc_timestamp_in_milliseconds m_deferral_in_millis;
+    uint8_t *m_data;
+    uint8_t *m_shadow;
+    uint16_t m_data_size;
+    uint16_t m_chunk_size;
+    uint16_t m_chunk_count;
+    uint8_t *m_record;
+
+    State m_state;
+    bool m_pending;
+    jdksavdecc_timestamp_in_milliseconds m_deadline;
+    bool m_bank_valid;
+    uint8_t m_bank;
+    uint32_t m_generation;
+    uint32_t m_append_pos;
+    uint16_t m_next_chunk;
+    uint32_t m_compact_pos;
+};
+
+///
+/// \brief The EEPromStorage class
+///
+/// Persistent storage of a settings structure T, such as the entity name,
+/// control values and configuration index, in an EEPromLog. T must be a
+/// plain structure that can be copied with memcpy.
+///
+/// Change the value via get() or set() and call changed(); only the chunks
+/// that changed are appended to the log once the deferral time has passed.
+/// Add the storage to the HandlerGroup so that it receives tick().
+///
+template <typename T, uint16_t ChunkSize = 16>
+class EEPromStorage : public Handler
+{
+  public:
+    static const jdksavdecc_timestamp_in_milliseconds default_deferral_in_millis = 1000;
+
+    EEPromStorage( EEPromDevice &device,
+                   uint32_t device_offset,
+                   uint32_t bank_size,
+                   uint32_t magic_number,
+                   jdksavdecc_timestamp_in_milliseconds deferral_in_millis = default_deferral_in_millis )
+        : m_value()
+        , m_shadow()
+        , m_log( device,
+                 device_offset,
+                 bank_size,
+                 magic_number,
+                 deferral_in_millis,
+                 reinterpret_cast<uint8_t *>( &m_value ),
+                 reinterpret_cast<uint8_t *>( &m_shadow ),
+                 sizeof( T ),
+                 ChunkSize,
+                 m_record )
+    {
+    }
+
+    /// Load the stored value, returns false and keeps the current value if
+    /// there is none
+    bool load() { return m_log.load(); }
+
+    T &get() { return m_value; }
+
+    T const &get() const { return m_value; }
+
+    void set( T const &value, jdksavdecc_timestamp_in_milliseconds time_in_millis )
+    {
+        m_value = value;
+        changed( time_in_millis );
+    }
+
+    /// Note that the value was changed via get()
+    void changed( jdksavdecc_timestamp_in_milliseconds time_in_millis ) { m_log.changed( time_in_millis ); }
+
+    /// Store all changes now
+    bool flush() { return m_log.flush(); }
+
+    bool isFlushPending() const { return m_log.isFlushPending(); }
+
+    virtual void tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override { m_log.tick( time_in_millis ); }
+
+  private:
+    T m_value;
+    T m_shadow;
+    uint8_t m_record[ChunkSize + EEPromLog::record_overhead];
+    EEPromLog m_log;
 };
 }
@@ -148,12 +148,19 @@ class Entity : public Handler
     /// code
     uint8_t receiveEntityAvailableCommand( jdksavdecc_aecpdu_aem const &aem, Frame &pdu );
 
-    // Formulate and send a CONTROLLER_AVAILABLE command to a target controller
+    // Formulate and send a CONTROLLER_AVAILABLE command to a target controller.
+    // The response is matched by the acquire arbitration via its sequence_id,
+    // so it is not tracked as the in-flight command
     void sendControllerAvailable( Eui64 const &target_controller_entity_id, Eui48 const &target_mac_address )
     {
-        sendCommand( target_controller_entity_id, target_mac_address, JDKSAVDECC_AEM_COMMAND_CONTROLLER_AVAILABLE );
+        sendCommand( target_controller_entity_id, target_mac_address, JDKSAVDECC_AEM_COMMAND_CONTROLLER_AVAILABLE, false );
+        m_controller_available_sequence_id = m_outgoing_sequence_id;
     }
 
+    /// Send a response to the ACQUIRE_ENTITY command of the controller that is
+    /// waiting for the current owner to answer CONTROLLER_AVAILABLE
+    void sendAcquireInProgressResponse( uint8_t aem_status );
+
     /// The pdu contains a valid Controller Available command.
     /// Fill in the response in place in the pdu and return an AECP AEM status
     /// code
@@ -185,7 +192,24 @@ class Entity : public Handler
     /// code
     uint8_t receiveDeRegisterUnsolicitedNotificationCommand( jdksavdecc_aecpdu_aem const &aem, Frame &pdu );
 
+    /// How long the current owner has to answer CONTROLLER_AVAILABLE before
+    /// the acquiring controller takes over
+    static const jdksavdecc_timestamp_in_milliseconds acquire_in_progress_timeout_in_millis = JDKSAVDECC_AEM_TIMEOUT_IN_MS;
+
+    /// How often the acquiring controller is reminded with an IN_PROGRESS response
+    static const jdksavdecc_timestamp_in_milliseconds acquire_in_progress_resend_in_millis = 120;
+
+    /// The RELEASE flag of the ACQUIRE_ENTITY aem_acquire_flags, Clause 7.4.1.1
+    static const uint32_t acquire_entity_flag_release = 0x80000000;
+
+    /// The UNLOCK flag of the LOCK_ENTITY aem_lock_flags, Clause 7.4.2.1
+    static const uint32_t lock_entity_flag_unlock = 0x00000001;
+
   protected:
+    /// Refresh or remove a registered controller based on its ADP
+    /// ENTITY_AVAILABLE or ENTITY_DEPARTING message, if the frame is one
+    void receivedControllerAdvertisement( Frame const &frame );
+
     /// The advertising manager, also contains capabilities, entity_id, and
     /// entity_model_id
     ADPManager &m_adp_manager;
@@ -208,17 +232,30 @@ class Entity : public Handler
     Eui64 m_acquire_in_progress_by_controller_entity_id;
 
     /// If we are currently interrogating a controller with a controller
-    /// available, then this is the timestamp of when we started the controller
-    /// available negotiation mechanism
-    jdksavdecc_timestamp_in_milliseconds m_acquire_in_progress_time;
+    /// available, then this is the time when the acquiring controller takes
+    /// over if the current owner has not answered
+    jdksavdecc_timestamp_in_milliseconds m_acquire_in_progress_deadline;
+
+    /// If we are currently interrogating a controller with a controller
+    /// available, then this is the time of the next IN_PROGRESS response to
+    /// the acquiring controller
+    jdksavdecc_timestamp_in_milliseconds m_acquire_in_progress_resend_time;
+
+    /// The sequence_id of the last CONTROLLER_AVAILABLE command sent to the
+    /// current owner
+    uint16_t m_controller_available_sequence_id;
+
+    /// The ACQUIRE_ENTITY command of the acquiring controller, kept to form the
+    /// IN_PROGRESS and final responses
+    FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY_COMMAND_LEN> m_acquire_in_progress_pdu;
 
     /// If we are locked by a controller, then this contains the controller's
     /// entity id which locked us
     Eui64 m_locked_by_controller_entity_id;
 
-    /// If we are locked by a controller, then this contains the timestamp of
-    /// when the lock first ocurred
-    jdksavdecc_timestamp_in_milliseconds m_locked_time;
+    /// If we are locked by a controller, then this contains the time that the
+    /// lock expires
+    jdksavdecc_timestamp_in_milliseconds m_lock_deadline;
 
     /// The list of registered controllers
     RegisteredControllers *m_registered_controllers;
@@ -39,13 +39,29 @@
 namespace JDKSAvdeccMCU
 {
 class Entity;
+class Control;
 
 class EntityState : public Handler
 {
   public:
-    EntityState() {}
+    EntityState() : m_controls( 0 ), m_num_controls( 0 ) {}
     virtual ~EntityState();
 
+    ///
+    /// \brief setControls
+    ///
+    /// Set the Controls whose CONTROL descriptors readDescriptorControl()
+    /// serves in configuration 0
+    ///
+    /// \param controls pointer to array of pointers to Control objects
+    /// \param num_controls the number of pointers in the array
+    ///
+    void setControls( Control **controls, uint16_t num_controls )
+    {
+        m_controls = controls;
+        m_num_controls = num_controls;
+    }
+
     /// Run periodic state machines
     virtual void tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override;
 
@@ -164,7 +180,7 @@ class EntityState : public Handler
 
     /// The pdu contains a valid Read Control Descriptor command
     /// Fill in the response in place in the pdu and return an AECP AEM status
-    /// code
+    /// code. The default serves the Controls given to setControls()
     virtual uint8_t readDescriptorControl( Frame &pdu, uint16_t configuration_index, uint16_t descriptor_index );
 
     /// The pdu contains a valid Read Locale Descriptor command
@@ -182,6 +198,11 @@ class EntityState : public Handler
     /// code
     virtual uint8_t readDescriptorMemoryObject( Frame &pdu, uint16_t configuration_index, uint16_t descriptor_index );
 
+    /// Returned by receiveAARead, receiveAAWrite or receiveAAExecute when the
+    /// TLV can not be handled yet; no response is sent and the controller
+    /// retries the command after its AA timeout
+    static const uint8_t aa_status_no_response = 0xff;
+
     /// The pdu contains a valid Read Address Access TLV command
     /// Fill in the response in place in the pdu and return an AECP AA status
     /// code
@@ -196,5 +217,9 @@ class EntityState : public Handler
     /// Fill in the response in place in the pdu and return an AECP AA status
     /// code
     virtual uint8_t receiveAAExecute( uint32_t virtual_base_address, uint16_t length, uint8_t const *request );
+
+  protected:
+    Control **m_controls;
+    uint16_t m_num_controls;
 };
 }
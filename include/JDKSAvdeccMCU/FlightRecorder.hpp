@@ -0,0 +1,239 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Handler.hpp"
+#include "JDKSAvdeccMCU/RawSocket.hpp"
+#include "JDKSAvdeccMCU/PcapFileWriter.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1
+
+#include <atomic>
+#include <memory>
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The FlightRecorder class
+///
+/// Keeps the most recent frames that were received and sent in a fixed
+/// size ring in memory, so that the traffic which led up to a problem
+/// can be written to a pcap file after the fact.
+///
+/// Add it first to a HandlerGroup to record the received frames, it never
+/// handles them. Sent frames are recorded by sending through a
+/// FlightRecorderRawSocket.
+///
+/// Recording does not lock or allocate. Frames may be recorded from
+/// several threads, and dump() may be called from another thread while
+/// recording; slots that are overwritten during the dump are skipped.
+///
+/// Frames are stamped with the time base of the sockets and of tick(),
+/// not the wall clock, so that recordings made under PcapReplay or any
+/// other virtual clock line up with the times the handlers see.
+///
+/// trigger() requests a dump to "<file_prefix>-<n>.pcap" which is
+/// taken in tick() once post_trigger_in_ms has passed, so that the
+/// traffic right after the event is captured as well. The frames are
+/// handed to the background thread of a PcapFileWriter, so tick() does
+/// not wait for the file to be written. AEM responses with
+/// an error status trigger a dump as well. Entities can call trigger()
+/// from their Entity::commandTimedOut() override.
+///
+class FlightRecorder : public Handler
+{
+  public:
+    ///
+    /// \brief FlightRecorder
+    /// \param capacity_in_frames the number of frames kept, rounded up to a power of 2
+    /// \param window_in_ms the age of the oldest frame written by a triggered dump, 0 for all
+    /// \param file_prefix the file name prefix for triggered dumps
+    /// \param post_trigger_in_ms the time to keep recording after a trigger
+    ///
+    FlightRecorder( size_t capacity_in_frames,
+                    uint32_t window_in_ms,
+                    std::string const &file_prefix,
+                    jdksavdecc_timestamp_in_milliseconds post_trigger_in_ms = 1000 );
+
+    virtual ~FlightRecorder();
+
+    /// Start the triggered dump when it is due (from Handler)
+    virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp ) override;
+
+    /// Record the received frame, always returns false (from Handler)
+    virtual bool receivedPDU( RawSocket *incoming_socket, Frame &frame ) override;
+
+    ///
+    /// \brief record
+    ///
+    /// Record a frame made of the frame octets followed by data1 and
+    /// data2, as passed to RawSocket::sendFrame(). Frames longer than a
+    /// slot are truncated. Received frames keep the time the socket gave
+    /// them, sent frames get the socket's current time.
+    ///
+    void record( RawSocket const *socket,
+                 bool sent,
+                 Frame const &frame,
+                 uint8_t const *data1 = 0,
+                 uint16_t len1 = 0,
+                 uint8_t const *data2 = 0,
+                 uint16_t len2 = 0 );
+
+    ///
+    /// \brief trigger
+    ///
+    /// Request a dump from tick(). Triggers that happen before the
+    /// pending dump is written are merged into it.
+    ///
+    void trigger();
+
+    bool isTriggered() const { return m_triggered.load( std::memory_order_relaxed ); }
+
+    ///
+    /// \brief dump
+    ///
+    /// Write the recorded frames, oldest first
+    ///
+    /// \param writer the pcap file writer
+    /// \param window_in_ms only write frames at most this old, measured
+    /// from the last tick() time, 0 for all
+    /// \param socket only write frames of this socket, 0 for all
+    /// \return the number of frames written
+    ///
+    size_t dump( PcapFileWriter &writer, uint32_t window_in_ms = 0, RawSocket const *socket = 0 ) const;
+
+    ///
+    /// \brief dump
+    ///
+    /// Write the recorded frames to a new pcap file, replacing any
+    /// existing file of that name, and wait until they are written
+    ///
+    size_t dump( std::string const &filename, uint32_t window_in_ms = 0, RawSocket const *socket = 0 ) const;
+
+    uint64_t getRecordedCount() const { return m_next_ticket.load( std::memory_order_relaxed ); }
+
+    uint32_t getDumpCount() const { return m_dump_count; }
+
+    size_t getCapacity() const { return m_mask + 1; }
+
+  protected:
+    ///
+    /// \brief isTrigger
+    ///
+    /// \return true if recording this frame should trigger a dump. The
+    /// default triggers on AEM responses with a status other than
+    /// SUCCESS, IN_PROGRESS or NOT_IMPLEMENTED, which controllers
+    /// routinely get while probing an entity.
+    ///
+    virtual bool isTrigger( Frame const &frame, bool sent ) const;
+
+    ///
+    /// \brief getFrameTime
+    ///
+    /// \return the time in milliseconds to record for the frame
+    ///
+    jdksavdecc_timestamp_in_milliseconds getFrameTime( RawSocket const *socket, Frame const &frame, bool sent ) const;
+
+  private:
+    FlightRecorder( FlightRecorder const & );
+    FlightRecorder &operator=( FlightRecorder const & );
+
+    struct Slot
+    {
+        /// 0 when unused, odd while being written and 2 * (ticket + 1)
+        /// once the frame with that ticket is complete
+        std::atomic<uint64_t> m_sequence;
+        uint64_t m_time_in_microseconds;
+        RawSocket const *m_socket;
+        uint16_t m_length;
+        bool m_sent;
+        uint8_t m_data[JDKSAVDECC_FRAME_HEADER_LEN + 1500];
+    };
+
+    Slot *m_slots;
+    size_t m_mask;
+    std::atomic<uint64_t> m_next_ticket;
+
+    /// The time of the last tick(), the reference for dump windows
+    std::atomic<jdksavdecc_timestamp_in_milliseconds> m_now;
+
+    /// The writer of the last triggered dump, kept until its background
+    /// thread has had time to write it
+    std::unique_ptr<PcapFileWriter> m_dump_writer;
+
+    uint32_t m_window_in_ms;
+    std::string m_file_prefix;
+    jdksavdecc_timestamp_in_milliseconds m_post_trigger_in_ms;
+    std::atomic<bool> m_triggered;
+    bool m_trigger_seen;
+    jdksavdecc_timestamp_in_milliseconds m_trigger_time;
+    uint32_t m_dump_count;
+};
+
+///
+/// \brief The FlightRecorderRawSocket class
+///
+/// Passes everything through to another RawSocket and records the
+/// frames that are sent in a FlightRecorder. Sent frames are recorded
+/// under the other RawSocket, as received frames are, so that dump() for
+/// that socket has both directions.
+///
+class FlightRecorderRawSocket : public RawSocket
+{
+  public:
+    FlightRecorderRawSocket( RawSocket &socket, FlightRecorder &recorder ) : m_socket( socket ), m_recorder( recorder ) {}
+
+    virtual void setHandlerGroup( HandlerGroup *handler_group ) override { m_socket.setHandlerGroup( handler_group ); }
+
+    virtual jdksavdecc_timestamp_in_milliseconds getTimeInMilliseconds() const override
+    {
+        return m_socket.getTimeInMilliseconds();
+    }
+
+    virtual bool recvFrame( Frame *frame ) override { return m_socket.recvFrame( frame ); }
+
+    virtual bool sendFrame( Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override;
+
+    virtual bool sendReplyFrame( Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override;
+
+    virtual bool joinMulticast( const Eui48 &multicast_mac ) override { return m_socket.joinMulticast( multicast_mac ); }
+
+    virtual Eui48 const &getMACAddress() const override { return m_socket.getMACAddress(); }
+
+  private:
+    RawSocket &m_socket;
+    FlightRecorder &m_recorder;
+};
+}
+
+#endif
@@ -44,6 +44,22 @@ inline bool wasTimeOutHit( jdksavdecc_timestamp_in_milliseconds cur_time,
     return difftime > timeout;
 }
 
+///
+/// \brief wasDeadlineHit Test if a deadline has been reached
+///
+/// Correct across wrap around of the timestamp as long as the deadline is
+/// less than half of the timestamp range away
+///
+/// \param cur_time The current time
+/// \param deadline The time of the deadline
+/// \return true if cur_time is at or past the deadline
+///
+inline bool wasDeadlineHit( jdksavdecc_timestamp_in_milliseconds cur_time, jdksavdecc_timestamp_in_milliseconds deadline )
+{
+    jdksavdecc_timestamp_in_milliseconds difftime = cur_time - deadline;
+    return difftime <= ( ( ~jdksavdecc_timestamp_in_milliseconds( 0 ) ) >> 1 );
+}
+
 ///
 /// \brief parseAEM Helper function to parse AECP AEM message
 /// \param aem pointer to AECPDU AEM structure to fill in
@@ -314,4 +330,18 @@ bool parseACMP( jdksavdecc_acmpdu *acmpdu, Frame const &pdu );
 /// \return
 ///
 bool isACMPInvolvingTarget( jdksavdecc_acmpdu const &acmpdu, Eui64 const &entity_id );
+
+///
+/// \brief calculateCrc32 Incrementally calculate an IEEE 802.3 CRC32
+///
+/// Start with a crc of 0 and pass the result of each call to the next to
+/// checksum data that arrives in pieces. Uses a 16 entry table so that it
+/// is small enough for the MCU targets.
+///
+/// \param crc The crc of the data so far, 0 for the first piece
+/// \param buf The pointer to the data
+/// \param len The length of the data in octets
+/// \return The crc of all the data so far
+///
+uint32_t calculateCrc32( uint32_t crc, uint8_t const *buf, uint32_t len );
 }
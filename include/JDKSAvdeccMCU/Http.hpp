@@ -225,6 +225,26 @@ class HttpRequest
     ///
     virtual void flatten( std::string *dest ) const;
 
+    ///
+    /// \brief getFlattenedLength
+    ///
+    /// \return the exact number of octets that flatten() produces
+    ///
+    size_t getFlattenedLength() const;
+
+    ///
+    /// \brief flatten
+    ///
+    /// Flatten the request header into a caller supplied buffer without
+    /// allocating
+    ///
+    /// \param dest The buffer to fill
+    /// \param dest_len The size of the buffer
+    /// \return the number of octets written, or 0 if the buffer is too
+    /// small
+    ///
+    size_t flatten( uint8_t *dest, size_t dest_len ) const;
+
     std::string m_method;
     std::string m_path;
     std::string m_version;
@@ -241,9 +261,37 @@ class HttpResponse
 
     virtual void flatten( std::vector<uint8_t> *dest ) const;
 
+    ///
+    /// \brief getFlattenedLength
+    ///
+    /// \return the exact number of octets that flatten() produces,
+    /// including the content
+    ///
+    size_t getFlattenedLength() const;
+
+    ///
+    /// \brief flatten
+    ///
+    /// Flatten the response and content into a caller supplied buffer
+    /// without allocating
+    ///
+    /// \return the number of octets written, or 0 if the buffer is too
+    /// small
+    ///
+    size_t flatten( uint8_t *dest, size_t dest_len ) const;
+
     void addHeader( std::string const &line ) { m_headers.push_back( line ); }
 
-    void addHeader( std::string const &name, std::string const &value ) { m_headers.push_back( name + ": " + value ); }
+    void addHeader( std::string const &name, std::string const &value )
+    {
+        // Build the line in place instead of via temporaries
+        m_headers.push_back( std::string() );
+        std::string &line = m_headers.back();
+        line.reserve( name.length() + 2 + value.length() );
+        line.append( name );
+        line.append( ": " );
+        line.append( value );
+    }
 
     void setContent( std::string const &s )
     {
@@ -379,6 +427,198 @@ class HttpClientParserSimple : public HttpClientParser
 
     std::string m_cur_line;
 };
+
+///
+/// \brief The HttpSlice struct
+///
+/// An offset and length into the octets of an HttpHeaderBlock
+///
+struct HttpSlice
+{
+    HttpSlice() : m_offset( 0 ), m_length( 0 ) {}
+    HttpSlice( size_t offset, size_t length ) : m_offset( offset ), m_length( length ) {}
+
+    size_t m_offset;
+    size_t m_length;
+};
+
+///
+/// \brief The HttpHeaderSlice struct
+///
+/// The name and value of one header line, without the ':' separator,
+/// leading whitespace of the value or the line ending
+///
+struct HttpHeaderSlice
+{
+    HttpSlice m_name;
+    HttpSlice m_value;
+};
+
+///
+/// \brief The HttpHeaderBlock class
+///
+/// Collects the octets of an HTTP start line and header lines until the
+/// blank line, searching for line endings with memchr() instead of
+/// examining every octet. The start line and each header are recorded as
+/// slices of the collected octets; strings are only built when asked for.
+///
+/// The storage is kept when cleared so that a parser which is reused does
+/// not allocate per message.
+///
+class HttpHeaderBlock
+{
+  public:
+    HttpHeaderBlock( size_t max_octets = 8192 );
+
+    void clear();
+
+    ///
+    /// \brief scan
+    ///
+    /// Collect incoming octets and look for the end of the header
+    ///
+    /// \return -1 if the header is malformed or larger than max_octets,
+    /// otherwise the number of octets consumed. Octets following the
+    /// blank line are not consumed.
+    ///
+    ssize_t scan( uint8_t const *data, ssize_t len );
+
+    bool isComplete() const { return m_complete; }
+
+    uint8_t const *getOctets() const { return m_buf.empty() ? 0 : &m_buf[0]; }
+
+    HttpSlice const &getStartLine() const { return m_start_line; }
+
+    size_t getHeaderCount() const { return m_headers.size(); }
+
+    HttpHeaderSlice const &getHeader( size_t n ) const { return m_headers[n]; }
+
+    ///
+    /// \brief findHeader
+    ///
+    /// Find the first header with the specified name, ignoring case
+    ///
+    /// \return true if found, with its value in value
+    ///
+    bool findHeader( char const *name, HttpSlice *value ) const;
+
+    std::string getString( HttpSlice const &slice ) const
+    {
+        return std::string( reinterpret_cast<char const *>( getOctets() ) + slice.m_offset, slice.m_length );
+    }
+
+    void assignTo( std::string *dest, HttpSlice const &slice ) const
+    {
+        dest->assign( reinterpret_cast<char const *>( getOctets() ) + slice.m_offset, slice.m_length );
+    }
+
+    ///
+    /// \brief splitStartLine
+    ///
+    /// Split the start line into the three space separated fields of a
+    /// request line or status line. The third field may contain spaces.
+    ///
+    /// \return false if there are less than two fields
+    ///
+    bool splitStartLine( HttpSlice *first, HttpSlice *second, HttpSlice *rest ) const;
+
+  protected:
+    bool split();
+
+    std::vector<uint8_t> m_buf;
+    size_t m_max_octets;
+    size_t m_scan_pos;
+    size_t m_line_start;
+    bool m_complete;
+    HttpSlice m_start_line;
+    std::vector<HttpHeaderSlice> m_headers;
+};
+
+///
+/// \brief The HttpServerParserFast class
+///
+/// An HttpServerParser which uses HttpHeaderBlock to find the request
+/// line and headers. Only the method, path and version of the request are
+/// set; the header lines are only copied to HttpRequest::m_headers when
+/// store_header_lines is true, otherwise the handler can look them up via
+/// getHeaderBlock().
+///
+/// The content of a POST or PUT is exactly Content-Length octets, so the
+/// connection can carry further requests; without a Content-Length it is
+/// read until the connection is closed.
+///
+class HttpServerParserFast : public HttpServerParser
+{
+  public:
+    HttpServerParserFast( HttpRequest *request,
+                          HttpServerHandler *handler,
+                          bool store_header_lines = true,
+                          size_t max_header_octets = 8192 )
+        : HttpServerParser( request, handler )
+        , m_block( max_header_octets )
+        , m_store_header_lines( store_header_lines )
+        , m_parse_state( ParsingHeader )
+        , m_content_remaining( 0 )
+    {
+    }
+
+    virtual ~HttpServerParserFast() {}
+
+    virtual void clear();
+
+    virtual ssize_t onIncomingHttpData( uint8_t const *data, ssize_t len );
+
+    HttpHeaderBlock const &getHeaderBlock() const { return m_block; }
+
+  protected:
+    bool onHeaderComplete();
+
+    /// Append up to m_content_remaining octets of content, returns the number used
+    ssize_t onContent( uint8_t const *data, ssize_t len );
+
+    HttpHeaderBlock m_block;
+    bool m_store_header_lines;
+
+    enum
+    {
+        ParsingHeader,
+        ParsingContentLength,
+        ParsingContentUntilClose,
+        ParsingFinished
+    } m_parse_state;
+
+    size_t m_content_remaining;
+};
+
+///
+/// \brief The HttpClientParserFast class
+///
+/// An HttpClientParser which uses HttpHeaderBlock to find the status line
+/// and headers, see HttpServerParserFast
+///
+class HttpClientParserFast : public HttpClientParser
+{
+  public:
+    HttpClientParserFast( HttpResponse *response,
+                          HttpClientHandler *handler,
+                          bool store_header_lines = true,
+                          size_t max_header_octets = 8192 )
+        : HttpClientParser( response, handler ), m_block( max_header_octets ), m_store_header_lines( store_header_lines )
+    {
+    }
+
+    virtual ~HttpClientParserFast() {}
+
+    virtual void clear();
+
+    virtual ssize_t onIncomingHttpData( uint8_t const *data, ssize_t len );
+
+    HttpHeaderBlock const &getHeaderBlock() const { return m_block; }
+
+  protected:
+    HttpHeaderBlock m_block;
+    bool m_store_header_lines;
+};
 }
 
 #endif
@@ -0,0 +1,187 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Handler.hpp"
+#include "JDKSAvdeccMCU/Helpers.hpp"
+#include "JDKSAvdeccMCU/EEPromStorage.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The MemoryObjectUpload class
+///
+/// Device side receiver for a memory object (for instance a firmware image)
+/// that a controller uploads with AECP Address Access WRITE commands, for
+/// example with AddressAccessTransfer.
+///
+/// Writes to the AA address range [aa_base_address, aa_base_address +
+/// max_length) are staged in two RAM buffers covering consecutive windows of
+/// the object. Blocks may arrive in any order and retries are harmless; a
+/// per octet coverage map tracks what has arrived and the CRC32 of the
+/// contiguous received prefix is updated as blocks arrive. When the lower
+/// window is complete it is erased and programmed into the EEPromDevice
+/// page by page from tick() while the other buffer keeps accepting writes,
+/// so slow flash operations do not throttle the transfer.
+///
+/// An AA EXECUTE to commit_address with the 4 octet big endian CRC32 of the
+/// whole object finishes the upload: the CRC is checked, the remaining
+/// staged data is programmed and uploadCompleted() is called.
+///
+/// Writes beyond the two staged windows, and an EXECUTE while programming is
+/// still in progress, return EntityState::aa_status_no_response so the
+/// controller retries them after its AA timeout.
+///
+/// The staging size must be a multiple of the device page size and the
+/// device offset must be page aligned. For full speed the staging size
+/// should be at least the controller's window of in flight data.
+///
+class MemoryObjectUpload : public Handler
+{
+  public:
+    ///
+    /// \brief MemoryObjectUpload Constructor
+    /// \param device The device to program the object into
+    /// \param device_offset The page aligned offset in the device
+    /// \param max_length The maximum size of the object
+    /// \param aa_base_address The AA address of the start of the object
+    /// \param commit_address The AA address that EXECUTE commits at
+    /// \param staging Two staging buffers of staging_size octets each
+    /// \param coverage Two coverage maps of staging_size/8 octets each
+    /// \param staging_size The size of each staging buffer
+    ///
+    MemoryObjectUpload( EEPromDevice &device,
+                        uint32_t device_offset,
+                        uint32_t max_length,
+                        uint32_t aa_base_address,
+                        uint32_t commit_address,
+                        uint8_t *staging,
+                        uint8_t *coverage,
+                        uint16_t staging_size );
+
+    /// Program completed windows into the device
+    virtual void tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override;
+
+    /// Forward EntityState::receiveAARead here to read back the object
+    uint8_t receiveAARead( uint32_t virtual_base_address, uint16_t length, uint8_t *response );
+
+    /// Forward EntityState::receiveAAWrite here
+    uint8_t receiveAAWrite( uint32_t virtual_base_address, uint16_t length, uint8_t const *request );
+
+    /// Forward EntityState::receiveAAExecute here
+    uint8_t receiveAAExecute( uint32_t virtual_base_address, uint16_t length, uint8_t const *request );
+
+    /// Forget any upload in progress
+    void reset();
+
+    /// Notification that a complete object was verified and programmed
+    virtual void uploadCompleted( uint32_t length, uint32_t crc32 );
+
+    /// Notification that an upload was abandoned because of a CRC mismatch,
+    /// missing data or a device error
+    virtual void uploadFailed( uint8_t aa_status );
+
+    bool isActive() const { return m_active; }
+
+    /// The number of octets at the start of the object that have arrived
+    uint32_t getReceivedLength() const { return m_crc_offset; }
+
+    /// The number of octets at the start of the object that are programmed
+    uint32_t getProgrammedLength() const { return m_programmed_offset; }
+
+  protected:
+    /// One staging buffer and the window of the object it holds
+    struct Stage
+    {
+        bool m_in_use;
+        bool m_programming;
+        bool m_page_erased;
+        uint32_t m_base;
+        uint16_t m_received;
+        uint16_t m_program_length;
+        uint16_t m_program_pos;
+        uint8_t *m_buf;
+        uint8_t *m_coverage;
+    };
+
+    /// Find the stage holding the window starting at base, allocating a free
+    /// one if allowed
+    Stage *findStage( uint32_t base, bool allocate );
+
+    /// Fold newly contiguous received data into the CRC
+    void advanceCrc();
+
+    /// Run device operations for the lowest window until done or busy.
+    /// Returns false on device error
+    bool program();
+
+    void fail( uint8_t aa_status );
+
+    EEPromDevice &m_device;
+    uint32_t m_device_offset;
+    uint32_t m_max_length;
+    uint32_t m_aa_base_address;
+    uint32_t m_commit_address;
+    uint16_t m_staging_size;
+    Stage m_stage[2];
+    bool m_active;
+    uint32_t m_end_offset;
+    uint32_t m_crc_offset;
+    uint32_t m_crc32;
+    uint32_t m_programmed_offset;
+    bool m_committed;
+    uint32_t m_committed_length;
+    uint32_t m_committed_crc32;
+};
+
+///
+/// \brief The MemoryObjectUploadWithStaging class
+///
+/// A MemoryObjectUpload that contains its own staging buffers
+///
+template <uint16_t StagingSize>
+class MemoryObjectUploadWithStaging : public MemoryObjectUpload
+{
+  public:
+    MemoryObjectUploadWithStaging(
+        EEPromDevice &device, uint32_t device_offset, uint32_t max_length, uint32_t aa_base_address, uint32_t commit_address )
+        : MemoryObjectUpload(
+              device, device_offset, max_length, aa_base_address, commit_address, m_staging_storage, m_coverage_storage, StagingSize )
+    {
+    }
+
+  private:
+    uint8_t m_staging_storage[StagingSize * 2];
+    uint8_t m_coverage_storage[( StagingSize / 8 ) * 2];
+};
+}
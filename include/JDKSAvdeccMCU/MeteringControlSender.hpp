@@ -0,0 +1,185 @@
+/*
+  Copyright (c) 2014, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/RawSocket.hpp"
+#include "JDKSAvdeccMCU/Frame.hpp"
+#include "JDKSAvdeccMCU/Handler.hpp"
+#include "JDKSAvdeccMCU/Helpers.hpp"
+#include "JDKSAvdeccMCU/ControllerEntity.hpp"
+#include "JDKSAvdeccMCU/ControlValueHolder.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_FLOAT && JDKSAVDECCMCU_ENABLE_VECTOR
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The MeteringControlSender class
+///
+/// Sends the SET_CONTROL commands for a group of meter controls on one
+/// target entity. Unlike ControlSender, which sends its whole value every
+/// update period, a meter is only sent when one of its items has moved by
+/// more than its threshold since it was last sent, or when its refresh
+/// period has passed.
+///
+/// The meters that are due are sent together in one burst per interval,
+/// taking turns when there are more than max_frames_per_burst of them.
+/// The interval adapts to the target: it doubles up to the maximum when
+/// the target has not answered more than max_backlog commands of the
+/// previous burst by the time the next one is due, or when it answers
+/// with NO_RESOURCES, and shrinks back towards the minimum while it keeps
+/// up.
+///
+class MeteringControlSender : public Handler
+{
+  public:
+    ///
+    /// \brief MeteringControlSender
+    /// \param controller_entity the controller to send the commands from
+    /// \param target_entity_id the entity that owns the meters
+    /// \param target_mac_address the mac address of the target entity
+    /// \param min_interval_in_millis the shortest time between bursts
+    /// \param max_interval_in_millis the longest time between bursts
+    /// \param max_backlog the number of unanswered commands tolerated
+    /// \param max_frames_per_burst the most commands sent in one burst
+    ///
+    MeteringControlSender( ControllerEntity &controller_entity,
+                           Eui64 const &target_entity_id,
+                           Eui48 const &target_mac_address,
+                           jdksavdecc_timestamp_in_milliseconds min_interval_in_millis = 50,
+                           jdksavdecc_timestamp_in_milliseconds max_interval_in_millis = 1000,
+                           uint16_t max_backlog = 8,
+                           uint16_t max_frames_per_burst = 16 );
+
+    ///
+    /// \brief addMeter
+    ///
+    /// Add a meter control, its items encoded as EncodedT
+    ///
+    /// \param target_descriptor_index the CONTROL descriptor of the meter
+    /// \param holder the values of the meter
+    /// \param threshold the change of any one item that makes the meter
+    ///        due, in the units given by multiplier_power. 0 sends any change.
+    /// \param multiplier_power the power of ten of the unit multiplier
+    /// \param refresh_in_millis the time after which an unchanged meter is
+    ///        sent again anyway
+    /// \throws std::runtime_error if the holder's items are not EncodedT
+    ///
+    template <typename EncodedT>
+    void addMeter( uint16_t target_descriptor_index,
+                   ControlValueHolder *holder,
+                   float threshold = 0.0f,
+                   int8_t multiplier_power = 0,
+                   jdksavdecc_timestamp_in_milliseconds refresh_in_millis = 1000 )
+    {
+        if ( holder->getValueLength() != sizeof( EncodedT ) )
+        {
+            throw std::runtime_error( "MeteringControlSender: meter items have the wrong size" );
+        }
+        Meter m;
+        m.m_target_descriptor_index = target_descriptor_index;
+        m.m_holder = holder;
+        m.m_threshold = threshold;
+        m.m_multiplier_power = multiplier_power;
+        m.m_refresh_in_millis = refresh_in_millis;
+        m.m_decode = &decodeControlValues<EncodedT>;
+        m.m_sent = false;
+        m.m_last_send_time_in_millis = 0;
+        m_meters.push_back( m );
+    }
+
+    /// Send the meters that are due if it is time for a burst
+    virtual void tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override;
+
+    /// Count the SET_CONTROL responses of the target for the meters
+    virtual bool receivedPDU( RawSocket *incoming_socket, Frame &frame ) override;
+
+    ControllerEntity &getControllerEntity() { return m_controller_entity; }
+
+    Eui64 const &getTargetEntityID() const { return m_target_entity_id; }
+
+    Eui48 const &getTargetMACAddress() const { return m_target_mac_address; }
+
+    jdksavdecc_timestamp_in_milliseconds getInterval() const { return m_interval_in_millis; }
+
+    uint16_t getBacklog() const { return m_backlog; }
+
+    uint64_t getSentCount() const { return m_sent_count; }
+
+  protected:
+    ///
+    /// \brief The Meter struct
+    ///
+    /// A meter control and the value it was last sent with
+    ///
+    struct Meter
+    {
+        uint16_t m_target_descriptor_index;
+        ControlValueHolder *m_holder;
+        float m_threshold;
+        int8_t m_multiplier_power;
+        jdksavdecc_timestamp_in_milliseconds m_refresh_in_millis;
+        void ( *m_decode )( float *values, uint8_t const *src, uint16_t count, int8_t multiplier_power );
+        bool m_sent;
+        jdksavdecc_timestamp_in_milliseconds m_last_send_time_in_millis;
+        std::vector<uint8_t> m_last_sent_value;
+    };
+
+    /// Adapt the interval to the commands left unanswered since the last burst
+    void adaptInterval();
+
+    /// Is the meter due to be sent?
+    bool isDue( Meter const &m, jdksavdecc_timestamp_in_milliseconds time_in_millis ) const;
+
+    /// Has an item of the meter moved by more than its threshold since it was sent?
+    bool hasChanged( Meter const &m ) const;
+
+    /// Formulate the SET_CONTROL command for the meter and send it
+    void sendMeter( Meter &m, jdksavdecc_timestamp_in_milliseconds time_in_millis );
+
+    ControllerEntity &m_controller_entity;
+    Eui64 m_target_entity_id;
+    Eui48 m_target_mac_address;
+    jdksavdecc_timestamp_in_milliseconds m_min_interval_in_millis;
+    jdksavdecc_timestamp_in_milliseconds m_max_interval_in_millis;
+    jdksavdecc_timestamp_in_milliseconds m_interval_in_millis;
+    jdksavdecc_timestamp_in_milliseconds m_last_burst_time_in_millis;
+    uint16_t m_max_backlog;
+    uint16_t m_max_frames_per_burst;
+    uint16_t m_backlog;
+    bool m_target_out_of_resources;
+    size_t m_next_meter;
+    uint64_t m_sent_count;
+    std::vector<Meter> m_meters;
+};
+}
+#endif
@@ -74,16 +74,29 @@ inline uint32_t PcapFileSwap( uint32_t v )
 class PcapFile
 {
   public:
-    PcapFile( std::string const &filename, const char *mode )
+    PcapFile( std::string const &filename, const char *mode ) : m_f( 0 ) { open( filename, mode ); }
+
+    ~PcapFile() { close(); }
+
+    ///
+    /// \brief open
+    ///
+    /// Close the current file and open filename with mode
+    ///
+    /// \return true if the file was opened
+    ///
+    bool open( std::string const &filename, const char *mode )
     {
+        close();
 #if defined( _WIN32 )
         fopen_s( &m_f, filename.c_str(), mode );
 #else
         m_f = fopen( filename.c_str(), mode );
 #endif
+        return m_f != 0;
     }
 
-    ~PcapFile()
+    void close()
     {
         if ( m_f )
         {
@@ -95,6 +108,9 @@ class PcapFile
     FILE *get() { return m_f; }
 
   private:
+    PcapFile( PcapFile const & );
+    PcapFile &operator=( PcapFile const & );
+
     FILE *m_f;
 };
 }
@@ -0,0 +1,169 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/PcapFile.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The PcapFilePacketView struct
+///
+/// A captured packet as returned by PcapFileStreamReader. m_data points
+/// into the reader's mapping or read buffer and is only valid until the
+/// next call to PcapFileStreamReader::readPacket()
+///
+struct PcapFilePacketView
+{
+    uint64_t m_timestamp_in_nanoseconds;
+    uint8_t const *m_data;
+    uint32_t m_captured_length;
+    uint32_t m_original_length;
+    uint32_t m_interface_id;
+    uint16_t m_link_type;
+};
+
+///
+/// \brief The PcapFileStreamReader class
+///
+/// Reads classic pcap files with microsecond or nanosecond timestamps
+/// in either byte order, and pcapng files with any number of sections
+/// and interfaces.
+///
+/// Regular files are memory mapped where the platform allows it. Pipes,
+/// stdin (filename "-") and files that can not be mapped are read with
+/// large fread() calls into a buffer that only grows for packets bigger
+/// than the buffer.
+///
+class PcapFileStreamReader
+{
+  public:
+    enum Format
+    {
+        FormatUnknown,
+        FormatPcap,
+        FormatPcapNg
+    };
+
+    ///
+    /// \brief PcapFileStreamReader
+    ///
+    /// Open the file and read the file header. If the file can not be
+    /// opened then readPacket() returns false.
+    ///
+    /// \param filename file name, or "-" for stdin
+    /// \param buffer_size initial size of the read buffer when the file
+    ///        is not memory mapped
+    ///
+    PcapFileStreamReader( std::string const &filename, size_t buffer_size = 1024 * 1024 );
+    virtual ~PcapFileStreamReader();
+
+    bool isOpen() const { return m_format != FormatUnknown; }
+
+    bool isMapped() const { return m_mapping != 0; }
+
+    Format getFormat() const { return m_format; }
+
+    uint64_t getPacketCount() const { return m_packet_count; }
+
+    ///
+    /// \brief readPacket
+    ///
+    /// Read the next packet, skipping pcapng blocks that do not contain
+    /// packets. A truncated packet at the end of the file, as left by an
+    /// interrupted capture, is treated as the end of the file.
+    ///
+    /// Throws std::runtime_error if the file is corrupt
+    ///
+    /// \param packet the packet view to fill in
+    /// \return false at the end of the file
+    ///
+    bool readPacket( PcapFilePacketView *packet );
+
+    /// Largest packet or pcapng block that is accepted
+    static const uint32_t max_block_length = 16 * 1024 * 1024;
+
+  private:
+    PcapFileStreamReader( PcapFileStreamReader const & );
+    PcapFileStreamReader &operator=( PcapFileStreamReader const & );
+
+    struct Interface
+    {
+        uint16_t m_link_type;
+        bool m_binary_resolution;
+        uint8_t m_resolution;
+        int64_t m_offset_in_seconds;
+    };
+
+    /// Make len octets available at m_pos, returns false at the end of the file
+    bool ensure( size_t len );
+
+    void open();
+    void close();
+    void readFileHeader();
+    bool readPcapPacket( PcapFilePacketView *packet );
+    bool readPcapNgPacket( PcapFilePacketView *packet );
+    void readSectionHeader( uint8_t const *block, uint32_t block_length );
+    void readInterfaceDescription( uint8_t const *block, uint32_t block_length );
+    uint64_t toNanoseconds( Interface const &iface, uint64_t timestamp ) const;
+
+    uint16_t get16( uint8_t const *p ) const;
+    uint32_t get32( uint8_t const *p ) const;
+    uint64_t get64( uint8_t const *p ) const;
+
+    void fail( char const *what ) const;
+
+    std::string m_filename;
+    FILE *m_file;
+    bool m_owns_file;
+    uint8_t *m_mapping;
+    size_t m_mapping_length;
+    std::vector<uint8_t> m_buffer;
+    uint8_t const *m_data;
+    size_t m_pos;
+    size_t m_end;
+    bool m_eof;
+
+    Format m_format;
+    bool m_swap;
+    bool m_nanosecond;
+    uint16_t m_link_type;
+    std::vector<Interface> m_interfaces;
+    uint64_t m_last_timestamp_in_nanoseconds;
+    uint64_t m_packet_count;
+};
+}
+
+#endif
@@ -31,12 +31,37 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 namespace JDKSAvdeccMCU
 {
+
+///
+/// \brief The PcapFileWriter class
+///
+/// Packets are appended to one of two preallocated buffers. When the
+/// buffer fills up, or every flush interval, it is handed to a
+/// background thread which writes it to the file while the other buffer
+/// is filled. The caller only waits when the file can not keep up with
+/// the packets. Without a background thread, full buffers are written on
+/// the caller's thread.
+///
+/// Errors from the background thread are thrown as std::runtime_error
+/// from the next WritePacket() or flush()
+///
+/// An existing, non empty file is appended to unless append is false, in
+/// which case it is truncated and a new header is written.
+///
 class PcapFileWriter
 {
   public:
-    PcapFileWriter( std::string const &filename );
+    PcapFileWriter( std::string const &filename,
+                    size_t buffer_size = 4 * 1024 * 1024,
+                    bool background = true,
+                    uint32_t flush_interval_in_ms = 1000,
+                    bool append = true );
     virtual ~PcapFileWriter();
 
     void WritePacket( PcapFilePacket const &packet );
@@ -48,9 +73,73 @@ class PcapFileWriter
                       uint16_t ethertype,
                       PcapFilePacket const &packet_payload );
 
+    ///
+    /// \brief WritePacket
+    ///
+    /// Write a complete ethernet frame
+    ///
+    void WritePacket( uint64_t time_in_micros, uint8_t const *data, size_t len );
+
+    ///
+    /// \brief WritePacket
+    ///
+    /// Write an ethernet header followed by up to three payload segments,
+    /// copying each directly into the buffer
+    ///
+    void WritePacket( uint64_t time_in_micros,
+                      uint8_t const da[6],
+                      uint8_t const sa[6],
+                      uint16_t ethertype,
+                      uint8_t const *data1,
+                      size_t len1,
+                      uint8_t const *data2 = 0,
+                      size_t len2 = 0,
+                      uint8_t const *data3 = 0,
+                      size_t len3 = 0 );
+
+    ///
+    /// \brief flush
+    ///
+    /// Write all buffered packets to the file and wait until they are
+    /// written
+    ///
+    void flush();
+
   private:
+    PcapFileWriter( PcapFileWriter const & );
+    PcapFileWriter &operator=( PcapFileWriter const & );
+
+    struct Segment
+    {
+        uint8_t const *m_data;
+        size_t m_length;
+    };
+
+    void writeRecord( uint64_t time_in_micros, Segment const *segments, size_t count );
+
+    /// Hand the active buffer to the writer, the lock must be held
+    void handOff( std::unique_lock<std::mutex> &lock );
+
+    void writeBuffer( std::vector<uint8_t> const &buffer );
+    void throwIfFailed();
+    void runWriter();
+
     PcapFile m_file;
     std::string m_filename;
+    size_t m_buffer_size;
+    bool m_background;
+    uint32_t m_flush_interval_in_ms;
+
+    std::vector<uint8_t> m_buffers[2];
+    int m_active;
+    int m_pending;
+    bool m_stop;
+    std::string m_error;
+
+    std::mutex m_mutex;
+    std::condition_variable m_pending_ready;
+    std::condition_variable m_pending_written;
+    std::thread m_thread;
 };
 }
 #endif
@@ -0,0 +1,157 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/HandlerGroup.hpp"
+#include "JDKSAvdeccMCU/RawSocketPcapFile.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_RAWSOCKETPCAPFILE && JDKSAVDECCMCU_ENABLE_PCAPFILE
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The PcapReplay class
+///
+/// Replays captures through a HandlerGroup on a virtual clock. Instead
+/// of polling the sockets in real time, the clock jumps straight to the
+/// next event: the next captured frame or the next tick of the handlers.
+/// Handlers are ticked every tick_interval_in_ms of capture time, so a
+/// replay gives the same calls with the same timestamps on every run and
+/// takes as long as the handlers need to process them.
+///
+/// Several captures, one per interface, can be replayed together. Each
+/// capture has its own RawSocketPcapFile and its frames are received
+/// from that socket, interleaved with the frames of the other captures
+/// in capture time order. Frames with the same time are received in the
+/// order that the sockets were added.
+///
+/// Frames that handlers send are written to the output file of the
+/// RawSocketPcapFile that they are sent on, with the virtual time.
+///
+class PcapReplay
+{
+  public:
+    ///
+    /// \brief PcapReplay
+    /// \param handlers the handlers to tick and to give the frames to
+    /// \param tick_interval_in_ms the capture time between ticks, or 0
+    ///        to only tick when frames are received
+    ///
+    PcapReplay( HandlerGroup &handlers, jdksavdecc_timestamp_in_milliseconds tick_interval_in_ms = 10 );
+
+    ///
+    /// \brief PcapReplay
+    /// \param socket the capture to replay, its clock is taken over
+    /// \param handlers the handlers to tick and to give the frames to
+    /// \param tick_interval_in_ms the capture time between ticks, or 0
+    ///        to only tick when frames are received
+    ///
+    PcapReplay( RawSocketPcapFile &socket, HandlerGroup &handlers, jdksavdecc_timestamp_in_milliseconds tick_interval_in_ms = 10 );
+
+    ///
+    /// \brief addSocket
+    ///
+    /// Add another capture to replay. Its clock is taken over and its
+    /// frame times are made relative to the earliest packet of all the
+    /// captures when the replay starts.
+    ///
+    /// \param socket the capture to replay
+    /// \throws std::runtime_error if the replay has already started
+    ///
+    void addSocket( RawSocketPcapFile &socket );
+
+    ///
+    /// \brief step
+    ///
+    /// Move the clock to the next event and dispatch it
+    ///
+    /// \return false, without moving the clock, if there are no frames
+    /// left to replay
+    ///
+    bool step();
+
+    ///
+    /// \brief run
+    ///
+    /// Replay all of the captures
+    ///
+    /// \param linger_in_ms keep ticking the handlers for this long after
+    ///        the last frame, so that their timeouts can expire
+    /// \return the number of frames received
+    ///
+    uint64_t run( jdksavdecc_timestamp_in_milliseconds linger_in_ms = 0 );
+
+    jdksavdecc_timestamp_in_milliseconds getCurrentTime() const { return m_current_time; }
+
+    uint64_t getFrameCount() const { return m_frame_count; }
+
+    uint64_t getTickCount() const { return m_tick_count; }
+
+  private:
+    ///
+    /// \brief The PendingSocket struct
+    ///
+    /// A heap entry for a socket that has a frame left to receive
+    ///
+    struct PendingSocket
+    {
+        uint64_t m_timestamp_in_nanoseconds;
+        size_t m_socket_index;
+
+        /// Order for std::push_heap, which puts the greatest at the top
+        bool operator<( PendingSocket const &other ) const
+        {
+            if ( m_timestamp_in_nanoseconds != other.m_timestamp_in_nanoseconds )
+            {
+                return m_timestamp_in_nanoseconds > other.m_timestamp_in_nanoseconds;
+            }
+            return m_socket_index > other.m_socket_index;
+        }
+    };
+
+    void start();
+    void pushPending( size_t socket_index );
+    void moveTo( jdksavdecc_timestamp_in_milliseconds t );
+
+    std::vector<RawSocketPcapFile *> m_sockets;
+    std::vector<PendingSocket> m_pending;
+    HandlerGroup &m_handlers;
+    jdksavdecc_timestamp_in_milliseconds m_tick_interval_in_ms;
+    bool m_started;
+    jdksavdecc_timestamp_in_milliseconds m_current_time;
+    jdksavdecc_timestamp_in_milliseconds m_next_tick_time;
+    uint64_t m_frame_count;
+    uint64_t m_tick_count;
+    FrameWithMTU m_frame;
+};
+}
+#endif
@@ -84,6 +84,18 @@
 #ifndef JDKSAVDECCMCU_ENABLE_HTTP
 #define JDKSAVDECCMCU_ENABLE_HTTP 0
 #endif
+#ifndef JDKSAVDECCMCU_ENABLE_EEPROMFILE
+#define JDKSAVDECCMCU_ENABLE_EEPROMFILE 0
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_APSSERVER
+#define JDKSAVDECCMCU_ENABLE_APSSERVER 0
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_APCCLIENT
+#define JDKSAVDECCMCU_ENABLE_APCCLIENT 0
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_THREADS
+#define JDKSAVDECCMCU_ENABLE_THREADS 0
+#endif
 #ifndef JDKSAVDECCMCU_ENABLE_RAWSOCKETLIBUV
 #define JDKSAVDECCMCU_ENABLE_RAWSOCKETLIBUV 0
 #endif
@@ -72,6 +72,18 @@
 #ifndef JDKSAVDECCMCU_ENABLE_HTTP
 #define JDKSAVDECCMCU_ENABLE_HTTP 1
 #endif
+#ifndef JDKSAVDECCMCU_ENABLE_EEPROMFILE
+#define JDKSAVDECCMCU_ENABLE_EEPROMFILE 1
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_APSSERVER
+#define JDKSAVDECCMCU_ENABLE_APSSERVER 1
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_APCCLIENT
+#define JDKSAVDECCMCU_ENABLE_APCCLIENT 1
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_THREADS
+#define JDKSAVDECCMCU_ENABLE_THREADS 1
+#endif
 
 #include <sys/time.h>
 #include <sys/types.h>
@@ -93,6 +105,8 @@
 #include <cmath>
 #include <cstdlib>
 #include <cfloat>
+#include <limits>
+#include <cstdio>
 
 #include "jdksavdecc.h"
 
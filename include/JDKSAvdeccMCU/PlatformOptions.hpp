@@ -48,5 +48,9 @@
 #define JDKSAVDECCMCU_MAX_RAWSOCKETS 1
 #define JDKSAVDECCMCU_ENABLE_MDNSREGISTER 0
 #define JDKSAVDECCMCU_ENABLE_HTTP 0
+#define JDKSAVDECCMCU_ENABLE_EEPROMFILE 0
+#define JDKSAVDECCMCU_ENABLE_APSSERVER 0
+#define JDKSAVDECCMCU_ENABLE_APCCLIENT 0
+#define JDKSAVDECCMCU_ENABLE_THREADS 0
 #define JDKSAVDECCMCU_ENABLE_RAWSOCKETLIBUV 0
 #endif
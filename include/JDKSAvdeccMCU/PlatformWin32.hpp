@@ -74,6 +74,18 @@
 #ifndef JDKSAVDECCMCU_ENABLE_HTTP
 #define JDKSAVDECCMCU_ENABLE_HTTP 1
 #endif
+#ifndef JDKSAVDECCMCU_ENABLE_EEPROMFILE
+#define JDKSAVDECCMCU_ENABLE_EEPROMFILE 1
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_APSSERVER
+#define JDKSAVDECCMCU_ENABLE_APSSERVER 0
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_APCCLIENT
+#define JDKSAVDECCMCU_ENABLE_APCCLIENT 0
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_THREADS
+#define JDKSAVDECCMCU_ENABLE_THREADS 1
+#endif
 
 #include <WS2tcpip.h>
 #include <winsock2.h>
@@ -95,6 +107,8 @@
 #include <cmath>
 #include <cstdlib>
 #include <cfloat>
+#include <limits>
+#include <cstdio>
 
 #include "jdksavdecc.h"
 
@@ -79,6 +79,34 @@ T1 integer_pow10( T2 exponent )
 }
 
 
+///
+/// \brief constexpr_pow10
+///
+/// The value of a power of ten as a double, computed at compile time.
+/// Exact for exponents from 0 to 22, negative exponents are rounded
+/// once.
+///
+constexpr double constexpr_pow10( int exponent )
+{
+    return exponent > 0 ? 10.0 * constexpr_pow10( exponent - 1 )
+                        : exponent < 0 ? 1.0 / constexpr_pow10( -exponent ) : 1.0;
+}
+
+///
+/// \brief encodingCanHold
+///
+/// Test at compile time if an encoded range value fits in the encoding
+/// type T
+///
+template <typename T>
+constexpr bool encodingCanHold( int64_t v )
+{
+    return !std::is_integral<T>::value
+           || ( std::is_signed<T>::value
+                    ? ( v >= int64_t( std::numeric_limits<T>::min() ) && v <= int64_t( std::numeric_limits<T>::max() ) )
+                    : ( v >= 0 && uint64_t( v ) <= uint64_t( std::numeric_limits<T>::max() ) ) );
+}
+
 ///
 /// \brief getEncodingMultiplier
 ///
@@ -2189,5 +2217,268 @@ class RangedValue<
     bool m_changed;
 };
 
-}
+///
+/// \brief The StaticRangedValue class
+///
+/// A RangedValue without virtual functions, for code that knows the type
+/// of its values. The range, step, multiplier and encoding are all
+/// template parameters, so the scale factors are compile time constants
+/// and encoding or decoding inlines to a multiply, a round and a clamp.
+///
+/// The value is held encoded. setValue() clamps to the range instead of
+/// throwing, and decoding multiplies by 10^MultiplierPowerValue, which
+/// may differ from RangedValue's division in the last bit.
+///
+template <UnitsCode UnitsValue,
+          int64_t MinValue,
+          int64_t MaxValue,
+          int64_t DefaultValue = 0,
+          int64_t StepValue = 1,
+          int MultiplierPowerValue = 0,
+          typename EncodedT = int32_t,
+          typename ValueT = float>
+class StaticRangedValue
+{
+    static_assert( MinValue <= DefaultValue, "MinValue is not less than or equal to DefaultValue" );
+    static_assert( DefaultValue <= MaxValue, "DefaultValue is not less than or equal to MaxValue" );
+    static_assert( encodingCanHold<EncodedT>( MinValue ), "MinValue is too small for the encoding" );
+    static_assert( encodingCanHold<EncodedT>( MaxValue ), "MaxValue is too large for the encoding" );
+    static_assert( std::is_arithmetic<EncodedT>::value && std::is_arithmetic<ValueT>::value,
+                   "StaticRangedValue needs numeric types" );
+
+  public:
+    typedef ValueT value_type;
+    typedef EncodedT encoded_type;
 
+    static const UnitsCode units = UnitsValue;
+    static const int64_t min_value = MinValue;
+    static const int64_t max_value = MaxValue;
+    static const int64_t step_value = StepValue;
+    static const int64_t default_value = DefaultValue;
+    static const int multiplier_power = MultiplierPowerValue;
+
+    ///
+    /// \brief Value Constructor
+    ///
+    /// Initialize to the default value
+    ///
+    StaticRangedValue() : m_encoded_value( encoded_type( default_value ) ), m_changed( true ) {}
+
+    ///
+    /// \brief Value implicit Constructor
+    ///
+    /// Initialize based on value, clamped to the range
+    ///
+    /// \param v value
+    ///
+    StaticRangedValue( value_type v ) : m_encoded_value( encode( v ) ), m_changed( true ) {}
+
+    ///
+    /// \brief operator value_type
+    ///
+    operator value_type() const { return getValue(); }
+
+    ///
+    /// \brief encode
+    ///
+    /// Convert an unencoded value to the encoding, rounding to nearest for
+    /// integer encodings and clamping to the range
+    ///
+    /// \param v the unencoded value
+    /// \return the encoded value
+    ///
+    static encoded_type encode( value_type v )
+    {
+        value_type e;
+        if ( std::is_floating_point<value_type>::value )
+        {
+            e = v * encodingScale();
+            if ( std::is_integral<encoded_type>::value )
+            {
+                e = e < value_type( 0 ) ? e - value_type( 0.5 ) : e + value_type( 0.5 );
+            }
+        }
+        else
+        {
+            e = v * getEncodingMultiplier() / getEncodingDivider();
+        }
+
+        // NaN goes to the minimum
+        return e > value_type( min_value ) ? ( e < value_type( max_value ) ? encoded_type( e ) : encoded_type( max_value ) )
+                                           : encoded_type( min_value );
+    }
+
+    ///
+    /// \brief decode
+    ///
+    /// Convert an encoded value to an unencoded value
+    ///
+    /// \param e the encoded value
+    /// \return the unencoded value
+    ///
+    static value_type decode( encoded_type e )
+    {
+        if ( std::is_floating_point<value_type>::value )
+        {
+            return value_type( e ) * decodingScale();
+        }
+        return value_type( e ) * getDecodingMultiplier() / getDecodingDivider();
+    }
+
+    ///
+    /// \brief setDefault
+    ///
+    /// Sets the value to the default value
+    ///
+    /// \return true if the value changed
+    ///
+    bool setDefault() { return setEncodedValue( encoded_type( default_value ) ); }
+
+    ///
+    /// \brief setValue
+    ///
+    /// Set the value, clamped to the range
+    ///
+    /// \param v the requested value
+    /// \return true if the value changed
+    ///
+    bool setValue( value_type v ) { return setEncodedValue( encode( v ) ); }
+
+    ///
+    /// \brief setEncodedValue
+    ///
+    /// Set the value from an encoded value, clamped to the range
+    ///
+    /// \param e the encoded value
+    /// \return true if the value changed
+    ///
+    bool setEncodedValue( encoded_type e )
+    {
+        if ( !( e > encoded_type( min_value ) ) )
+        {
+            e = encoded_type( min_value );
+        }
+        else if ( e > encoded_type( max_value ) )
+        {
+            e = encoded_type( max_value );
+        }
+
+        bool r = false;
+        if ( m_encoded_value != e )
+        {
+            m_encoded_value = e;
+            m_changed = true;
+            r = true;
+        }
+        return r;
+    }
+
+    ///
+    /// \brief incValue
+    ///
+    /// Increment the current value by the step size.
+    /// Will not increment past the max value
+    ///
+    /// \return true if the value changed
+    ///
+    bool incValue()
+    {
+        return setEncodedValue( m_encoded_value < encoded_type( max_value - step_value )
+                                    ? encoded_type( m_encoded_value + encoded_type( step_value ) )
+                                    : encoded_type( max_value ) );
+    }
+
+    ///
+    /// \brief decValue
+    ///
+    /// Decrement the current value by the step size.
+    /// Will not decrement past the min value
+    ///
+    /// \return true if the value changed
+    ///
+    bool decValue()
+    {
+        return setEncodedValue( m_encoded_value > encoded_type( min_value + step_value )
+                                    ? encoded_type( m_encoded_value - encoded_type( step_value ) )
+                                    : encoded_type( min_value ) );
+    }
+
+    value_type getValue() const { return decode( m_encoded_value ); }
+
+    encoded_type getEncodedValue() const { return m_encoded_value; }
+
+    static value_type getMinValue() { return value_type( min_value ) * getDecodingMultiplier() / getDecodingDivider(); }
+
+    static value_type getMaxValue() { return value_type( max_value ) * getDecodingMultiplier() / getDecodingDivider(); }
+
+    static value_type getDefaultValue()
+    {
+        return value_type( default_value ) * getDecodingMultiplier() / getDecodingDivider();
+    }
+
+    static value_type getStepValue() { return value_type( step_value ) * getDecodingMultiplier() / getDecodingDivider(); }
+
+    ///
+    /// \brief encodingScale
+    /// \return 10^-multiplier_power, the factor from unencoded to encoded
+    ///
+    static constexpr value_type encodingScale() { return value_type( constexpr_pow10( -multiplier_power ) ); }
+
+    ///
+    /// \brief decodingScale
+    /// \return 10^multiplier_power, the factor from encoded to unencoded
+    ///
+    static constexpr value_type decodingScale() { return value_type( constexpr_pow10( multiplier_power ) ); }
+
+    static constexpr value_type getEncodingMultiplier()
+    {
+        return multiplier_power < 0 ? value_type( constexpr_pow10( -multiplier_power ) ) : value_type( 1 );
+    }
+
+    static constexpr value_type getEncodingDivider()
+    {
+        return multiplier_power > 0 ? value_type( constexpr_pow10( multiplier_power ) ) : value_type( 1 );
+    }
+
+    static constexpr value_type getDecodingMultiplier()
+    {
+        return multiplier_power > 0 ? value_type( constexpr_pow10( multiplier_power ) ) : value_type( 1 );
+    }
+
+    static constexpr value_type getDecodingDivider()
+    {
+        return multiplier_power < 0 ? value_type( constexpr_pow10( -multiplier_power ) ) : value_type( 1 );
+    }
+
+    static EncodingType getStorageType() { return EncodingTypeFor<value_type>::getEncodingType(); }
+
+    static EncodingType getEncodingType() { return EncodingTypeFor<encoded_type>::getEncodingType(); }
+
+    static constexpr UnitsCode getUnitsCode() { return UnitsValue; }
+
+    static constexpr int8_t getEncodingMultiplierPower() { return multiplier_power; }
+
+    static const char *getUnitsSuffix() { return getAvdeccUnitsSuffix( UnitsValue ); }
+
+    void setChanged() { m_changed = true; }
+
+    void clearChanged() { m_changed = false; }
+
+    bool getChanged() const { return m_changed; }
+
+  private:
+    ///
+    /// \brief m_encoded_value
+    ///
+    /// The value in its encoding, always within the range
+    ///
+    encoded_type m_encoded_value;
+
+    ///
+    /// \brief m_changed
+    ///
+    /// True if the value has changed since the last time clearChanged() was called
+    ///
+    bool m_changed;
+};
+}
@@ -28,19 +28,31 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/RawSocket.hpp"
-#include "JDKSAvdeccMCU/PcapFileReader.hpp"
+#include "JDKSAvdeccMCU/PcapFileStreamReader.hpp"
 #include "JDKSAvdeccMCU/PcapFileWriter.hpp"
 
 #if JDKSAVDECCMCU_ENABLE_RAWSOCKETPCAPFILE && JDKSAVDECCMCU_ENABLE_PCAPFILE
 namespace JDKSAvdeccMCU
 {
+///
+/// \brief The RawSocketPcapFile class
+///
+/// Receives the frames of one ethertype from a capture file and writes
+/// the frames that are sent to another capture file. Frame times are the
+/// absolute capture times in milliseconds unless setTimeOrigin() makes
+/// them relative, as PcapReplay does.
+///
 class RawSocketPcapFile : public RawSocket
 {
     uint16_t m_ethertype;
     Eui48 m_my_mac;
     Eui48 m_default_dest_mac;
     Eui48 m_join_multicast;
-    PcapFileReader m_pcap_file_reader;
+    PcapFileStreamReader m_pcap_file_reader;
+    bool m_seen_first_timestamp;
+    uint64_t m_first_timestamp_in_nanoseconds;
+    uint64_t m_time_origin_in_nanoseconds;
+    uint64_t m_next_incoming_timestamp_in_nanoseconds;
     PcapFileWriter m_pcap_file_writer;
     mutable jdksavdecc_timestamp_in_milliseconds m_current_time;
     jdksavdecc_timestamp_in_milliseconds m_time_granularity_in_ms;
@@ -77,8 +89,78 @@ class RawSocketPcapFile : public RawSocket
 
     virtual const Eui48 &getMACAddress() const override;
 
+    ///
+    /// \brief hasNextFrame
+    /// \return true if there is another frame to be received
+    ///
+    bool hasNextFrame() const { return m_next_incoming_frame.getLength() > 0; }
+
+    ///
+    /// \brief getNextFrameTime
+    /// \return the capture time of the next frame, relative to the time
+    /// origin
+    ///
+    jdksavdecc_timestamp_in_milliseconds getNextFrameTime() const { return m_next_incoming_frame.getTimeInMilliseconds(); }
+
+    ///
+    /// \brief getNextFrameTimestampInNanoseconds
+    /// \return the absolute capture time of the next frame, as stored in
+    /// the file
+    ///
+    uint64_t getNextFrameTimestampInNanoseconds() const { return m_next_incoming_timestamp_in_nanoseconds; }
+
+    ///
+    /// \brief getFirstTimestampInNanoseconds
+    /// \return the absolute capture time of the first packet in the file
+    /// that has been read, of any ethertype
+    ///
+    uint64_t getFirstTimestampInNanoseconds() const { return m_first_timestamp_in_nanoseconds; }
+
+    ///
+    /// \brief getTimeOrigin
+    /// \return the absolute capture time that frame times are relative to
+    ///
+    uint64_t getTimeOrigin() const { return m_time_origin_in_nanoseconds; }
+
+    ///
+    /// \brief setTimeOrigin
+    ///
+    /// Set the absolute capture time that frame times are relative to.
+    /// By default it is 0, so frame times are absolute capture times;
+    /// PcapReplay sets it to the earliest packet of all of its captures
+    /// so that they are replayed together from time 0. Frames captured
+    /// before the origin are given time 0.
+    ///
+    void setTimeOrigin( uint64_t timestamp_in_nanoseconds );
+
+    ///
+    /// \brief setCurrentTime
+    ///
+    /// Move the virtual clock. recvFrame() returns the frames captured up
+    /// to this time.
+    ///
+    void setCurrentTime( jdksavdecc_timestamp_in_milliseconds t ) { m_current_time = t; }
+
+    ///
+    /// \brief setTimeGranularity
+    ///
+    /// Set how far each getTimeInMilliseconds() call advances the clock,
+    /// 0 to only move it with setCurrentTime()
+    ///
+    void setTimeGranularity( jdksavdecc_timestamp_in_milliseconds time_granularity_in_ms )
+    {
+        m_time_granularity_in_ms = time_granularity_in_ms;
+    }
+
   private:
     bool readNextIncomingFrame();
+    void writeFrame( Eui48 const &da,
+                     Eui48 const &sa,
+                     Frame const &frame,
+                     uint8_t const *data1,
+                     uint16_t len1,
+                     uint8_t const *data2,
+                     uint16_t len2 );
     HandlerGroup *m_handler_group;
 };
 }
@@ -39,6 +39,8 @@ namespace JDKSAvdeccMCU
 
 struct RegisteredController
 {
+    RegisteredController() : m_last_seen_time( 0 ), m_timeout_in_millis( 0 ) {}
+
     /// Controller's entity_id
     /// The entity id is FF:FF:FF:FF:FF:FF:FF:FF If the the slot is not
     /// in use
@@ -46,6 +48,13 @@ struct RegisteredController
 
     /// Controller's MAC address
     Eui48 m_mac_address;
+
+    /// The time that the controller was last heard from
+    jdksavdecc_timestamp_in_milliseconds m_last_seen_time;
+
+    /// How long the controller may stay silent before it is considered gone.
+    /// 0 means the controller never expires
+    jdksavdecc_timestamp_in_milliseconds m_timeout_in_millis;
 };
 
 class RegisteredControllers
@@ -57,6 +66,31 @@ class RegisteredControllers
     virtual bool findController( Eui64 entity_id ) const = 0;
     virtual bool addController( Eui64 entity_id, Eui48 mac_address ) = 0;
     virtual void removeController( Eui64 entity_id ) = 0;
+
+    ///
+    /// \brief refreshController Note that a registered controller is still alive
+    /// \param entity_id The controller's entity id
+    /// \param time_in_millis The current time
+    /// \param timeout_in_millis How long until the controller expires if not heard from again
+    ///
+    virtual void refreshController( Eui64 entity_id,
+                                    jdksavdecc_timestamp_in_milliseconds time_in_millis,
+                                    jdksavdecc_timestamp_in_milliseconds timeout_in_millis )
+    {
+        (void)entity_id;
+        (void)time_in_millis;
+        (void)timeout_in_millis;
+    }
+
+    ///
+    /// \brief expireControllers Remove all controllers that were not refreshed in time
+    /// \param time_in_millis The current time
+    ///
+    virtual void expireControllers( jdksavdecc_timestamp_in_milliseconds time_in_millis ) { (void)time_in_millis; }
+
+    /// The default time a controller stays registered after it was last heard from,
+    /// the maximum ADP valid_time
+    static const jdksavdecc_timestamp_in_milliseconds default_timeout_in_millis = 62000;
 };
 
 template <uint16_t MaxControllers>
@@ -98,6 +132,7 @@ class RegisteredControllersStorage : public RegisteredControllers
             {
                 m_controller[m_num_controllers].m_entity_id = entity_id;
                 m_controller[m_num_controllers].m_mac_address = mac_address;
+                m_num_controllers++;
                 r = true;
             }
         }
@@ -133,4 +168,217 @@ class RegisteredControllersStorage : public RegisteredControllers
     uint16_t m_num_controllers;
     RegisteredController m_controller[MaxControllers];
 };
+
+///
+/// \brief The RegisteredControllersHashedStorage class
+///
+/// Registered controller storage for entities with many subscribed controllers.
+///
+/// Each controller lives in a stable slot for as long as it is registered.
+/// Lookups by entity id go through an open addressed (linear probing) hash
+/// table of slot indexes, and a dense array of slot indexes is kept for
+/// iteration via getController(). Controllers that are not refreshed
+/// before their timeout are dropped by expireControllers().
+///
+template <uint16_t MaxControllers, uint16_t HashTableSize = MaxControllers * 2>
+class RegisteredControllersHashedStorage : public RegisteredControllers
+{
+  public:
+    /// The value of a slot index that refers to no slot
+    static const uint16_t no_slot = 0xffff;
+
+    RegisteredControllersHashedStorage() : m_num_controllers( 0 ), m_num_free_slots( MaxControllers )
+    {
+        for ( uint16_t i = 0; i < HashTableSize; ++i )
+        {
+            m_hash_table[i] = no_slot;
+        }
+        // hand out the low slots first
+        for ( uint16_t i = 0; i < MaxControllers; ++i )
+        {
+            m_free_slots[i] = MaxControllers - 1 - i;
+        }
+    }
+
+    virtual uint16_t getControllerCount() const override { return m_num_controllers; }
+
+    virtual RegisteredController *getController( uint16_t i ) override { return &m_slot[m_dense[i]]; }
+    virtual RegisteredController const *getController( uint16_t i ) const override { return &m_slot[m_dense[i]]; }
+
+    virtual bool findController( Eui64 entity_id ) const override { return findSlot( entity_id ) != no_slot; }
+
+    ///
+    /// \brief findSlot Find the stable slot index of a controller
+    /// \param entity_id The controller's entity id
+    /// \return The slot index, or no_slot if the controller is not registered
+    ///
+    uint16_t findSlot( Eui64 const &entity_id ) const
+    {
+        uint16_t pos = getHomePosition( entity_id );
+        for ( uint16_t i = 0; i < HashTableSize; ++i )
+        {
+            uint16_t slot = m_hash_table[pos];
+            if ( slot == no_slot )
+            {
+                break;
+            }
+            if ( m_slot[slot].m_entity_id == entity_id )
+            {
+                return slot;
+            }
+            pos = nextPosition( pos );
+        }
+        return no_slot;
+    }
+
+    ///
+    /// \brief getControllerInSlot Get the controller in a stable slot
+    /// \param slot The slot index returned by findSlot()
+    /// \return pointer to the RegisteredController
+    ///
+    RegisteredController *getControllerInSlot( uint16_t slot ) { return &m_slot[slot]; }
+    RegisteredController const *getControllerInSlot( uint16_t slot ) const { return &m_slot[slot]; }
+
+    virtual bool addController( Eui64 entity_id, Eui48 mac_address ) override
+    {
+        bool r = false;
+        uint16_t slot = findSlot( entity_id );
+
+        if ( slot != no_slot )
+        {
+            // already added, the controller may have moved to another interface
+            m_slot[slot].m_mac_address = mac_address;
+            r = true;
+        }
+        else if ( m_num_free_slots > 0 )
+        {
+            slot = m_free_slots[--m_num_free_slots];
+
+            RegisteredController &controller = m_slot[slot];
+            controller.m_entity_id = entity_id;
+            controller.m_mac_address = mac_address;
+            controller.m_last_seen_time = 0;
+            controller.m_timeout_in_millis = 0;
+
+            uint16_t pos = getHomePosition( entity_id );
+            while ( m_hash_table[pos] != no_slot )
+            {
+                pos = nextPosition( pos );
+            }
+            m_hash_table[pos] = slot;
+
+            m_dense_position[slot] = m_num_controllers;
+            m_dense[m_num_controllers++] = slot;
+            r = true;
+        }
+        return r;
+    }
+
+    virtual void removeController( Eui64 entity_id ) override
+    {
+        uint16_t slot = findSlot( entity_id );
+        if ( slot != no_slot )
+        {
+            removeSlot( slot );
+        }
+    }
+
+    virtual void refreshController( Eui64 entity_id,
+                                    jdksavdecc_timestamp_in_milliseconds time_in_millis,
+                                    jdksavdecc_timestamp_in_milliseconds timeout_in_millis ) override
+    {
+        uint16_t slot = findSlot( entity_id );
+        if ( slot != no_slot )
+        {
+            m_slot[slot].m_last_seen_time = time_in_millis;
+            m_slot[slot].m_timeout_in_millis = timeout_in_millis;
+        }
+    }
+
+    virtual void expireControllers( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override
+    {
+        // walk backwards since removal moves the last dense item into the removed position
+        for ( uint16_t i = m_num_controllers; i > 0; --i )
+        {
+            uint16_t slot = m_dense[i - 1];
+            RegisteredController const &controller = m_slot[slot];
+            if ( controller.m_timeout_in_millis != 0
+                 && wasTimeOutHit( time_in_millis, controller.m_last_seen_time, controller.m_timeout_in_millis ) )
+            {
+                removeSlot( slot );
+            }
+        }
+    }
+
+  private:
+    uint16_t getHomePosition( Eui64 const &entity_id ) const
+    {
+        // FNV-1a over the 8 octets of the entity id
+        uint32_t h = 2166136261UL;
+        for ( uint16_t i = 0; i < 8; ++i )
+        {
+            h = ( h ^ entity_id.value[i] ) * 16777619UL;
+        }
+        return uint16_t( h % HashTableSize );
+    }
+
+    static uint16_t nextPosition( uint16_t pos ) { return uint16_t( ( pos + 1 ) % HashTableSize ); }
+
+    void removeSlot( uint16_t slot )
+    {
+        // find the slot's position in the hash table
+        uint16_t pos = getHomePosition( m_slot[slot].m_entity_id );
+        while ( m_hash_table[pos] != slot )
+        {
+            pos = nextPosition( pos );
+        }
+
+        // Remove it and shift back any following entries of the probe sequence that
+        // would no longer be reachable from their home position
+        m_hash_table[pos] = no_slot;
+        uint16_t next = nextPosition( pos );
+        while ( m_hash_table[next] != no_slot )
+        {
+            uint16_t home = getHomePosition( m_slot[m_hash_table[next]].m_entity_id );
+            bool home_is_between = ( pos <= next ) ? ( pos < home && home <= next ) : ( pos < home || home <= next );
+            if ( !home_is_between )
+            {
+                m_hash_table[pos] = m_hash_table[next];
+                m_hash_table[next] = no_slot;
+                pos = next;
+            }
+            next = nextPosition( next );
+        }
+
+        // Move the last item in the dense list into the removed item's position
+        uint16_t dense_pos = m_dense_position[slot];
+        uint16_t last_slot = m_dense[m_num_controllers - 1];
+        m_dense[dense_pos] = last_slot;
+        m_dense_position[last_slot] = dense_pos;
+        m_num_controllers--;
+
+        // And give the slot back
+        m_slot[slot].m_entity_id.clear();
+        m_slot[slot].m_mac_address.clear();
+        m_free_slots[m_num_free_slots++] = slot;
+    }
+
+    uint16_t m_num_controllers;
+    uint16_t m_num_free_slots;
+
+    /// The controllers, indexed by stable slot index
+    RegisteredController m_slot[MaxControllers];
+
+    /// The slot indexes of all registered controllers, packed for iteration
+    uint16_t m_dense[MaxControllers];
+
+    /// The position in m_dense of each slot
+    uint16_t m_dense_position[MaxControllers];
+
+    /// The stack of unused slot indexes
+    uint16_t m_free_slots[MaxControllers];
+
+    /// Slot indexes by entity id hash, no_slot if empty
+    uint16_t m_hash_table[HashTableSize];
+};
 }
@@ -31,8 +31,1035 @@
 
 #include "jdksavdecc_world.h"
 #include "jdksavdecc_control.h"
+#include "jdksavdecc_print.h"
+#include <float.h>
+
+
+/// The layout of the value details of a control value type,
+/// see IEEE Std 1722.1-2013 Clause 7.3.5.2
+enum jdksavdecc_control_layout
+{
+    jdksavdecc_control_layout_none,
+    jdksavdecc_control_layout_linear,
+    jdksavdecc_control_layout_selector,
+    jdksavdecc_control_layout_array,
+    jdksavdecc_control_layout_utf8
+};
+
+/// The encoding of each value in the value details and the control data
+enum jdksavdecc_control_format
+{
+    jdksavdecc_control_format_int8,
+    jdksavdecc_control_format_uint8,
+    jdksavdecc_control_format_int16,
+    jdksavdecc_control_format_uint16,
+    jdksavdecc_control_format_int32,
+    jdksavdecc_control_format_uint32,
+    jdksavdecc_control_format_int64,
+    jdksavdecc_control_format_uint64,
+    jdksavdecc_control_format_float,
+    jdksavdecc_control_format_double,
+    jdksavdecc_control_format_string_ref,
+    jdksavdecc_control_format_none
+};
+
+/// The fields of an item in the value details
+enum jdksavdecc_control_field
+{
+    jdksavdecc_control_field_minimum,
+    jdksavdecc_control_field_maximum,
+    jdksavdecc_control_field_step,
+    jdksavdecc_control_field_default,
+    jdksavdecc_control_field_current,
+    jdksavdecc_control_field_unit,
+    jdksavdecc_control_field_string
+};
+
+enum jdksavdecc_control_number_kind
+{
+    jdksavdecc_control_number_signed,
+    jdksavdecc_control_number_unsigned,
+    jdksavdecc_control_number_floating
+};
+
+/// A value read from the value details or the control data
+struct jdksavdecc_control_number
+{
+    enum jdksavdecc_control_number_kind kind;
+    union
+    {
+        int64_t s;
+        uint64_t u;
+        double f;
+    } v;
+};
 
-#ifdef TODO
+struct jdksavdecc_control_format_info
+{
+    uint8_t size;
+    void ( *read )( struct jdksavdecc_control_number *result, void const *base, ssize_t pos );
+    void ( *write )( struct jdksavdecc_control_number const *value, void *base, ssize_t pos );
+    int64_t minimum;
+    uint64_t maximum;
+};
+
+struct jdksavdecc_control_value_type_info
+{
+    uint8_t layout;
+    uint8_t format;
+};
+
+static void jdksavdecc_control_read_int8( struct jdksavdecc_control_number *result, void const *base, ssize_t pos )
+{
+    result->kind = jdksavdecc_control_number_signed;
+    result->v.s = (int8_t)jdksavdecc_uint8_get( base, pos );
+}
+
+static void jdksavdecc_control_read_uint8( struct jdksavdecc_control_number *result, void const *base, ssize_t pos )
+{
+    result->kind = jdksavdecc_control_number_unsigned;
+    result->v.u = jdksavdecc_uint8_get( base, pos );
+}
+
+static void jdksavdecc_control_read_int16( struct jdksavdecc_control_number *result, void const *base, ssize_t pos )
+{
+    result->kind = jdksavdecc_control_number_signed;
+    result->v.s = (int16_t)jdksavdecc_uint16_get( base, pos );
+}
+
+static void jdksavdecc_control_read_uint16( struct jdksavdecc_control_number *result, void const *base, ssize_t pos )
+{
+    result->kind = jdksavdecc_control_number_unsigned;
+    result->v.u = jdksavdecc_uint16_get( base, pos );
+}
+
+static void jdksavdecc_control_read_int32( struct jdksavdecc_control_number *result, void const *base, ssize_t pos )
+{
+    result->kind = jdksavdecc_control_number_signed;
+    result->v.s = (int32_t)jdksavdecc_uint32_get( base, pos );
+}
+
+static void jdksavdecc_control_read_uint32( struct jdksavdecc_control_number *result, void const *base, ssize_t pos )
+{
+    result->kind = jdksavdecc_control_number_unsigned;
+    result->v.u = jdksavdecc_uint32_get( base, pos );
+}
+
+static void jdksavdecc_control_read_int64( struct jdksavdecc_control_number *result, void const *base, ssize_t pos )
+{
+    result->kind = jdksavdecc_control_number_signed;
+    result->v.s = (int64_t)jdksavdecc_uint64_get( base, pos );
+}
+
+static void jdksavdecc_control_read_uint64( struct jdksavdecc_control_number *result, void const *base, ssize_t pos )
+{
+    result->kind = jdksavdecc_control_number_unsigned;
+    result->v.u = jdksavdecc_uint64_get( base, pos );
+}
+
+static void jdksavdecc_control_read_float( struct jdksavdecc_control_number *result, void const *base, ssize_t pos )
+{
+    result->kind = jdksavdecc_control_number_floating;
+    result->v.f = jdksavdecc_float_get( base, pos );
+}
+
+static void jdksavdecc_control_read_double( struct jdksavdecc_control_number *result, void const *base, ssize_t pos )
+{
+    result->kind = jdksavdecc_control_number_floating;
+    result->v.f = jdksavdecc_double_get( base, pos );
+}
+
+static void jdksavdecc_control_write_int8( struct jdksavdecc_control_number const *value, void *base, ssize_t pos )
+{
+    jdksavdecc_uint8_set( (uint8_t)value->v.s, base, pos );
+}
+
+static void jdksavdecc_control_write_uint8( struct jdksavdecc_control_number const *value, void *base, ssize_t pos )
+{
+    jdksavdecc_uint8_set( (uint8_t)value->v.u, base, pos );
+}
+
+static void jdksavdecc_control_write_int16( struct jdksavdecc_control_number const *value, void *base, ssize_t pos )
+{
+    jdksavdecc_uint16_set( (uint16_t)value->v.s, base, pos );
+}
+
+static void jdksavdecc_control_write_uint16( struct jdksavdecc_control_number const *value, void *base, ssize_t pos )
+{
+    jdksavdecc_uint16_set( (uint16_t)value->v.u, base, pos );
+}
+
+static void jdksavdecc_control_write_int32( struct jdksavdecc_control_number const *value, void *base, ssize_t pos )
+{
+    jdksavdecc_uint32_set( (uint32_t)value->v.s, base, pos );
+}
+
+static void jdksavdecc_control_write_uint32( struct jdksavdecc_control_number const *value, void *base, ssize_t pos )
+{
+    jdksavdecc_uint32_set( (uint32_t)value->v.u, base, pos );
+}
+
+static void jdksavdecc_control_write_int64( struct jdksavdecc_control_number const *value, void *base, ssize_t pos )
+{
+    jdksavdecc_uint64_set( (uint64_t)value->v.s, base, pos );
+}
+
+static void jdksavdecc_control_write_uint64( struct jdksavdecc_control_number const *value, void *base, ssize_t pos )
+{
+    jdksavdecc_uint64_set( value->v.u, base, pos );
+}
+
+static void jdksavdecc_control_write_float( struct jdksavdecc_control_number const *value, void *base, ssize_t pos )
+{
+    jdksavdecc_float_set( (float)value->v.f, base, pos );
+}
+
+static void jdksavdecc_control_write_double( struct jdksavdecc_control_number const *value, void *base, ssize_t pos )
+{
+    jdksavdecc_double_set( value->v.f, base, pos );
+}
+
+/// Indexed by enum jdksavdecc_control_format
+static struct jdksavdecc_control_format_info const jdksavdecc_control_formats[] = {
+    {1, jdksavdecc_control_read_int8, jdksavdecc_control_write_int8, INT8_MIN, INT8_MAX},
+    {1, jdksavdecc_control_read_uint8, jdksavdecc_control_write_uint8, 0, UINT8_MAX},
+    {2, jdksavdecc_control_read_int16, jdksavdecc_control_write_int16, INT16_MIN, INT16_MAX},
+    {2, jdksavdecc_control_read_uint16, jdksavdecc_control_write_uint16, 0, UINT16_MAX},
+    {4, jdksavdecc_control_read_int32, jdksavdecc_control_write_int32, INT32_MIN, INT32_MAX},
+    {4, jdksavdecc_control_read_uint32, jdksavdecc_control_write_uint32, 0, UINT32_MAX},
+    {8, jdksavdecc_control_read_int64, jdksavdecc_control_write_int64, INT64_MIN, INT64_MAX},
+    {8, jdksavdecc_control_read_uint64, jdksavdecc_control_write_uint64, 0, UINT64_MAX},
+    {4, jdksavdecc_control_read_float, jdksavdecc_control_write_float, 0, 0},
+    {8, jdksavdecc_control_read_double, jdksavdecc_control_write_double, 0, 0},
+    {2, jdksavdecc_control_read_uint16, jdksavdecc_control_write_uint16, 0, UINT16_MAX},
+    {0, 0, 0, 0, 0}};
+
+/// Indexed by control value type, see IEEE Std 1722.1-2013 Clause 7.3.5
+static struct jdksavdecc_control_value_type_info const jdksavdecc_control_value_types[] = {
+    {jdksavdecc_control_layout_linear, jdksavdecc_control_format_int8},
+    {jdksavdecc_control_layout_linear, jdksavdecc_control_format_uint8},
+    {jdksavdecc_control_layout_linear, jdksavdecc_control_format_int16},
+    {jdksavdecc_control_layout_linear, jdksavdecc_control_format_uint16},
+    {jdksavdecc_control_layout_linear, jdksavdecc_control_format_int32},
+    {jdksavdecc_control_layout_linear, jdksavdecc_control_format_uint32},
+    {jdksavdecc_control_layout_linear, jdksavdecc_control_format_int64},
+    {jdksavdecc_control_layout_linear, jdksavdecc_control_format_uint64},
+    {jdksavdecc_control_layout_linear, jdksavdecc_control_format_float},
+    {jdksavdecc_control_layout_linear, jdksavdecc_control_format_double},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_int8},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_uint8},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_int16},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_uint16},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_int32},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_uint32},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_int64},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_uint64},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_float},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_double},
+    {jdksavdecc_control_layout_selector, jdksavdecc_control_format_string_ref},
+    {jdksavdecc_control_layout_array, jdksavdecc_control_format_int8},
+    {jdksavdecc_control_layout_array, jdksavdecc_control_format_uint8},
+    {jdksavdecc_control_layout_array, jdksavdecc_control_format_int16},
+    {jdksavdecc_control_layout_array, jdksavdecc_control_format_uint16},
+    {jdksavdecc_control_layout_array, jdksavdecc_control_format_int32},
+    {jdksavdecc_control_layout_array, jdksavdecc_control_format_uint32},
+    {jdksavdecc_control_layout_array, jdksavdecc_control_format_int64},
+    {jdksavdecc_control_layout_array, jdksavdecc_control_format_uint64},
+    {jdksavdecc_control_layout_array, jdksavdecc_control_format_float},
+    {jdksavdecc_control_layout_array, jdksavdecc_control_format_double},
+    {jdksavdecc_control_layout_utf8, jdksavdecc_control_format_none},
+    {jdksavdecc_control_layout_none, jdksavdecc_control_format_none},
+    {jdksavdecc_control_layout_none, jdksavdecc_control_format_none},
+    {jdksavdecc_control_layout_none, jdksavdecc_control_format_none},
+    {jdksavdecc_control_layout_none, jdksavdecc_control_format_none}};
+
+static struct jdksavdecc_control_value_type_info const jdksavdecc_control_value_type_unsupported
+    = {jdksavdecc_control_layout_none, jdksavdecc_control_format_none};
+
+/// Unit suffixes by unit code, in the groups of 8 codes of IEEE Std 1722.1-2013 Clause 7.3.3
+static char const *const jdksavdecc_control_units_suffix[32][8] = {
+    {"", "", "%", "Fstop", 0, 0, 0, 0},
+    {"sec", "min", "hours", "days", "months", "years", "samples", "frames"},
+    {"Hz", "Semitones", "Cents", "Octaves", "frames/sec", 0, 0, 0},
+    {"metres", 0, 0, 0, 0, 0, 0, 0},
+    {"K", 0, 0, 0, 0, 0, 0, 0},
+    {"g", 0, 0, 0, 0, 0, 0, 0},
+    {"V", "dBV", "dBu", 0, 0, 0, 0, 0},
+    {"A", 0, 0, 0, 0, 0, 0, 0},
+    {"W", "dBm", "dBW", 0, 0, 0, 0, 0},
+    {"Pa", 0, 0, 0, 0, 0, 0, 0},
+    {"bits", "Bytes", "KiB", "MiB", "GiB", "TiB", 0, 0},
+    {"bps", "Bps", "KiB/s", "MiB/s", "GiB/s", "TiB/s", 0, 0},
+    {"cd", 0, 0, 0, 0, 0, 0, 0},
+    {"J", 0, 0, 0, 0, 0, 0, 0},
+    {"Rads", 0, 0, 0, 0, 0, 0, 0},
+    {"Newtons", 0, 0, 0, 0, 0, 0, 0},
+    {"\xce\xa9", 0, 0, 0, 0, 0, 0, 0},
+    {"m/s", "rad/s", 0, 0, 0, 0, 0, 0},
+    {"m/s\xc2\xb2", "rad/s\xc2\xb2", 0, 0, 0, 0, 0, 0},
+    {"T", 0, 0, 0, 0, 0, 0, 0},
+    {"m\xc2\xb2", 0, 0, 0, 0, 0, 0, 0},
+    {"m\xc2\xb3", "L", 0, 0, 0, 0, 0, 0},
+    {"dB", "dB (Peak)", "dB (RMS)", "dBFS", "dBFS (Peak)", "dBFS (RMS)", "dBTP", "dB (A)"},
+    {"dB (B)", "dB (C)", "dB (SPL)", "LU", "LUFS", 0, 0, 0}};
+
+/// 10^0 to 10^22 are exact doubles
+static double const jdksavdecc_control_powers_of_ten[]
+    = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static double const jdksavdecc_control_negative_powers_of_ten[]
+    = {1e0,   1e-1,  1e-2,  1e-3,  1e-4,  1e-5,  1e-6,  1e-7,  1e-8,  1e-9,  1e-10, 1e-11,
+       1e-12, 1e-13, 1e-14, 1e-15, 1e-16, 1e-17, 1e-18, 1e-19, 1e-20, 1e-21, 1e-22};
+
+static uint64_t const jdksavdecc_control_integer_powers_of_ten[] = {1ULL,
+                                                                    10ULL,
+                                                                    100ULL,
+                                                                    1000ULL,
+                                                                    10000ULL,
+                                                                    100000ULL,
+                                                                    1000000ULL,
+                                                                    10000000ULL,
+                                                                    100000000ULL,
+                                                                    1000000000ULL,
+                                                                    10000000000ULL,
+                                                                    100000000000ULL,
+                                                                    1000000000000ULL,
+                                                                    10000000000000ULL,
+                                                                    100000000000000ULL,
+                                                                    1000000000000000ULL,
+                                                                    10000000000000000ULL,
+                                                                    100000000000000000ULL,
+                                                                    1000000000000000000ULL,
+                                                                    10000000000000000000ULL};
+
+/// v * 10^power, without overflowing when only the power is out of range
+static double jdksavdecc_control_scale( double v, int power )
+{
+    while ( power > 22 )
+    {
+        v *= 1e22;
+        power -= 22;
+    }
+    while ( power < -22 )
+    {
+        v *= 1e-22;
+        power += 22;
+    }
+    if ( power >= 0 )
+    {
+        v *= jdksavdecc_control_powers_of_ten[power];
+    }
+    else
+    {
+        v *= jdksavdecc_control_negative_powers_of_ten[-power];
+    }
+    return v;
+}
+
+static struct jdksavdecc_control_value_type_info const *
+    jdksavdecc_control_get_value_type_info( struct jdksavdecc_control_info const *control_info )
+{
+    uint16_t value_type = jdksavdecc_control_get_control_value_type( control_info );
+    struct jdksavdecc_control_value_type_info const *r = &jdksavdecc_control_value_type_unsupported;
+    if ( value_type < sizeof( jdksavdecc_control_value_types ) / sizeof( jdksavdecc_control_value_types[0] ) )
+    {
+        r = &jdksavdecc_control_value_types[value_type];
+    }
+    return r;
+}
+
+/// The offset of a field of an item within the descriptor, or -1 if the
+/// descriptor does not contain it
+static ssize_t jdksavdecc_control_get_field_offset( struct jdksavdecc_control_info const *control_info,
+                                                    struct jdksavdecc_control_value_type_info const *type_info,
+                                                    uint16_t item,
+                                                    enum jdksavdecc_control_field field )
+{
+    ssize_t r = -1;
+    ssize_t field_size = 2;
+    ssize_t size = jdksavdecc_control_formats[type_info->format].size;
+    ssize_t values_offset;
+    uint16_t number_of_values;
+
+    if ( control_info->descriptor_data == 0 || control_info->descriptor_len < JDKSAVDECC_DESCRIPTOR_CONTROL_LEN )
+    {
+        return -1;
+    }
+    values_offset = jdksavdecc_descriptor_control_get_values_offset( control_info->descriptor_data, 0 );
+    number_of_values = jdksavdecc_descriptor_control_get_number_of_values( control_info->descriptor_data, 0 );
+
+    if ( field < jdksavdecc_control_field_unit )
+    {
+        field_size = size;
+    }
+
+    switch ( type_info->layout )
+    {
+    case jdksavdecc_control_layout_linear:
+        // minimum, maximum, step, default, current, unit and string for each item
+        if ( item < number_of_values )
+        {
+            r = values_offset + item * ( size * 5 + 4 );
+            r += field < jdksavdecc_control_field_string ? field * size : size * 5 + 2;
+        }
+        break;
+    case jdksavdecc_control_layout_selector:
+        // current, default, the options and then unit for the single item
+        if ( item == 0 )
+        {
+            if ( field == jdksavdecc_control_field_current )
+            {
+                r = values_offset;
+            }
+            else if ( field == jdksavdecc_control_field_default )
+            {
+                r = values_offset + size;
+            }
+            else if ( field == jdksavdecc_control_field_unit )
+            {
+                r = values_offset + size * ( 2 + number_of_values );
+            }
+        }
+        break;
+    case jdksavdecc_control_layout_array:
+        // minimum, maximum, step, default, unit and string shared by all items,
+        // then the current value of each item
+        if ( item < number_of_values )
+        {
+            if ( field == jdksavdecc_control_field_current )
+            {
+                r = values_offset + size * 4 + 4 + item * size;
+            }
+            else if ( field == jdksavdecc_control_field_unit )
+            {
+                r = values_offset + size * 4;
+            }
+            else if ( field == jdksavdecc_control_field_string )
+            {
+                r = values_offset + size * 4 + 2;
+            }
+            else
+            {
+                r = values_offset + field * size;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+
+    if ( r >= 0 && r + field_size > (ssize_t)control_info->descriptor_len )
+    {
+        r = -1;
+    }
+    return r;
+}
+
+/// The offset of an item within the control data of a GET_CONTROL or
+/// SET_CONTROL command, or -1 if the control data does not contain it
+static ssize_t jdksavdecc_control_get_data_offset( struct jdksavdecc_control_info const *control_info,
+                                                   struct jdksavdecc_control_value_type_info const *type_info,
+                                                   uint16_t item,
+                                                   uint16_t control_data_len )
+{
+    ssize_t r = -1;
+    ssize_t size = jdksavdecc_control_formats[type_info->format].size;
+
+    if ( ( type_info->layout == jdksavdecc_control_layout_linear || type_info->layout == jdksavdecc_control_layout_array )
+         && item < jdksavdecc_control_get_num_items( control_info ) )
+    {
+        r = item * size;
+    }
+    else if ( type_info->layout == jdksavdecc_control_layout_selector && item == 0 )
+    {
+        r = 0;
+    }
+
+    if ( r >= 0 && r + size > control_data_len )
+    {
+        r = -1;
+    }
+    return r;
+}
+
+static bool jdksavdecc_control_printer_ok( struct jdksavdecc_printer const *printer )
+{
+    // jdksavdecc_printer_printc() silently drops characters once the buffer is full
+    return printer->max_len > printer->pos + 2;
+}
+
+static void jdksavdecc_control_print_digits( struct jdksavdecc_printer *printer, uint64_t v )
+{
+    char digits[20];
+    int n = 0;
+    do
+    {
+        digits[n++] = (char)( '0' + ( v % 10 ) );
+        v /= 10;
+    } while ( v > 0 );
+    while ( n > 0 )
+    {
+        jdksavdecc_printer_printc( printer, digits[--n] );
+    }
+}
+
+/// Print magnitude * 10^power exactly, so that integer values with a
+/// multiplier show their full precision
+static void jdksavdecc_control_print_scaled_integer( struct jdksavdecc_printer *printer,
+                                                     bool negative,
+                                                     uint64_t magnitude,
+                                                     int power )
+{
+    char digits[20];
+    int n = 0;
+    int i;
+
+    if ( negative && magnitude != 0 )
+    {
+        jdksavdecc_printer_printc( printer, '-' );
+    }
+
+    if ( power >= 0 )
+    {
+        jdksavdecc_control_print_digits( printer, magnitude );
+        if ( magnitude != 0 )
+        {
+            for ( i = 0; i < power; ++i )
+            {
+                jdksavdecc_printer_printc( printer, '0' );
+            }
+        }
+        return;
+    }
+
+    do
+    {
+        digits[n++] = (char)( '0' + ( magnitude % 10 ) );
+        magnitude /= 10;
+    } while ( magnitude > 0 );
+
+    if ( n <= -power )
+    {
+        jdksavdecc_printer_printc( printer, '0' );
+        jdksavdecc_printer_printc( printer, '.' );
+        for ( i = n; i < -power; ++i )
+        {
+            jdksavdecc_printer_printc( printer, '0' );
+        }
+        while ( n > 0 )
+        {
+            jdksavdecc_printer_printc( printer, digits[--n] );
+        }
+    }
+    else
+    {
+        while ( n > 0 )
+        {
+            if ( n == -power )
+            {
+                jdksavdecc_printer_printc( printer, '.' );
+            }
+            jdksavdecc_printer_printc( printer, digits[--n] );
+        }
+    }
+}
+
+/// Print v with 6 significant digits, like the %g conversion of printf
+static void jdksavdecc_control_print_double( struct jdksavdecc_printer *printer, double v )
+{
+    char digits[7];
+    double scaled;
+    uint64_t m;
+    int exponent = 0;
+    int bias = 0;
+    int last;
+    int i;
+
+    if ( v != v )
+    {
+        jdksavdecc_printer_print( printer, "nan" );
+        return;
+    }
+    if ( v < 0 )
+    {
+        jdksavdecc_printer_printc( printer, '-' );
+        v = -v;
+    }
+    if ( v > DBL_MAX )
+    {
+        jdksavdecc_printer_print( printer, "inf" );
+        return;
+    }
+    if ( v == 0 )
+    {
+        jdksavdecc_printer_printc( printer, '0' );
+        return;
+    }
+
+    // find the exponent of the leading digit, with denormals brought into
+    // range first, and round to 6 digits
+    if ( v < 1e-280 )
+    {
+        v = jdksavdecc_control_scale( v, 100 );
+        bias = -100;
+    }
+    while ( v >= jdksavdecc_control_scale( 1.0, exponent + 1 ) )
+    {
+        ++exponent;
+    }
+    while ( v < jdksavdecc_control_scale( 1.0, exponent ) )
+    {
+        --exponent;
+    }
+    scaled = jdksavdecc_control_scale( v, 5 - exponent );
+    m = (uint64_t)scaled;
+    if ( scaled - (double)m >= 0.5 )
+    {
+        ++m;
+    }
+    if ( m >= 1000000 )
+    {
+        m /= 10;
+        ++exponent;
+    }
+    exponent += bias;
+
+    for ( i = 5; i >= 0; --i )
+    {
+        digits[i] = (char)( '0' + ( m % 10 ) );
+        m /= 10;
+    }
+    last = 5;
+    while ( last > 0 && digits[last] == '0' )
+    {
+        --last;
+    }
+
+    if ( exponent >= -4 && exponent < 6 )
+    {
+        if ( exponent < 0 )
+        {
+            jdksavdecc_printer_printc( printer, '0' );
+            jdksavdecc_printer_printc( printer, '.' );
+            for ( i = exponent + 1; i < 0; ++i )
+            {
+                jdksavdecc_printer_printc( printer, '0' );
+            }
+            for ( i = 0; i <= last; ++i )
+            {
+                jdksavdecc_printer_printc( printer, digits[i] );
+            }
+        }
+        else
+        {
+            for ( i = 0; i <= exponent || i <= last; ++i )
+            {
+                if ( i == exponent + 1 )
+                {
+                    jdksavdecc_printer_printc( printer, '.' );
+                }
+                jdksavdecc_printer_printc( printer, digits[i] );
+            }
+        }
+    }
+    else
+    {
+        jdksavdecc_printer_printc( printer, digits[0] );
+        if ( last > 0 )
+        {
+            jdksavdecc_printer_printc( printer, '.' );
+            for ( i = 1; i <= last; ++i )
+            {
+                jdksavdecc_printer_printc( printer, digits[i] );
+            }
+        }
+        jdksavdecc_printer_printc( printer, 'e' );
+        jdksavdecc_printer_printc( printer, exponent < 0 ? '-' : '+' );
+        if ( exponent < 0 )
+        {
+            exponent = -exponent;
+        }
+        if ( exponent < 10 )
+        {
+            jdksavdecc_printer_printc( printer, '0' );
+        }
+        jdksavdecc_control_print_digits( printer, (uint64_t)exponent );
+    }
+}
+
+/// Print the value of a number and its units
+static void jdksavdecc_control_print_number( struct jdksavdecc_printer *printer,
+                                             struct jdksavdecc_control_number const *value,
+                                             uint16_t unit )
+{
+    int power = (int8_t)( unit >> 8 );
+    char const *suffix = jdksavdecc_control_units_suffix[( unit >> 3 ) & 0x1f][unit & 0x7];
+
+    switch ( value->kind )
+    {
+    case jdksavdecc_control_number_signed:
+        jdksavdecc_control_print_scaled_integer(
+            printer, value->v.s < 0, value->v.s < 0 ? 0 - (uint64_t)value->v.s : (uint64_t)value->v.s, power );
+        break;
+    case jdksavdecc_control_number_unsigned:
+        jdksavdecc_control_print_scaled_integer( printer, false, value->v.u, power );
+        break;
+    case jdksavdecc_control_number_floating:
+        jdksavdecc_control_print_double( printer, jdksavdecc_control_scale( value->v.f, power ) );
+        break;
+    }
+
+    if ( suffix && *suffix )
+    {
+        jdksavdecc_printer_printc( printer, ' ' );
+        jdksavdecc_printer_print( printer, suffix );
+    }
+}
+
+/// Print a localized string reference, or its number without an entity model
+static void jdksavdecc_control_print_string_ref( struct jdksavdecc_printer *printer,
+                                                 uint16_t localized_string_id,
+                                                 struct jdksavdecc_entity_model *entity_model,
+                                                 uint16_t locale_id )
+{
+    struct jdksavdecc_string s;
+    size_t i;
+
+    if ( entity_model != 0 && entity_model->read_localized_string != 0 )
+    {
+        jdksavdecc_string_init( &s );
+        entity_model->read_localized_string( entity_model, 0, locale_id, localized_string_id, &s );
+        for ( i = 0; i < sizeof( s.value ) && s.value[i] != 0; ++i )
+        {
+            jdksavdecc_printer_printc( printer, (char)s.value[i] );
+        }
+    }
+    else
+    {
+        jdksavdecc_control_print_digits( printer, localized_string_id );
+    }
+}
+
+/// Print the value of an item at pos in base, with the units of the item
+static bool jdksavdecc_control_print_item( struct jdksavdecc_control_info const *control_info,
+                                           struct jdksavdecc_control_value_type_info const *type_info,
+                                           uint16_t item,
+                                           void const *base,
+                                           ssize_t pos,
+                                           char *string_buf,
+                                           size_t string_buf_max_len,
+                                           struct jdksavdecc_entity_model *entity_model,
+                                           uint16_t locale_id )
+{
+    struct jdksavdecc_printer printer;
+    struct jdksavdecc_control_number value;
+    ssize_t unit_offset = jdksavdecc_control_get_field_offset( control_info, type_info, item, jdksavdecc_control_field_unit );
+    uint16_t unit = 0;
+
+    if ( pos < 0 )
+    {
+        return false;
+    }
+    if ( unit_offset >= 0 )
+    {
+        unit = jdksavdecc_uint16_get( control_info->descriptor_data, unit_offset );
+    }
+
+    jdksavdecc_printer_init( &printer, string_buf, string_buf_max_len );
+    if ( string_buf_max_len > 0 )
+    {
+        string_buf[0] = '\0';
+    }
+
+    if ( type_info->format == jdksavdecc_control_format_string_ref )
+    {
+        jdksavdecc_control_print_string_ref( &printer, jdksavdecc_uint16_get( base, pos ), entity_model, locale_id );
+    }
+    else
+    {
+        jdksavdecc_control_formats[type_info->format].read( &value, base, pos );
+        jdksavdecc_control_print_number( &printer, &value, unit );
+    }
+    return jdksavdecc_control_printer_ok( &printer );
+}
+
+/// Copy a null terminated or full length UTF8 value into a string
+static bool jdksavdecc_control_print_utf8(
+    uint8_t const *data, size_t data_len, char *string_buf, size_t string_buf_max_len )
+{
+    size_t i;
+    for ( i = 0; i < data_len && data[i] != 0; ++i )
+    {
+        if ( i + 1 >= string_buf_max_len )
+        {
+            return false;
+        }
+        string_buf[i] = (char)data[i];
+    }
+    if ( string_buf_max_len > 0 )
+    {
+        string_buf[i] = '\0';
+    }
+    return string_buf_max_len > 0;
+}
+
+/// Parse an optionally signed decimal number with an optional fraction and
+/// exponent. The value is mantissa * 10^exponent
+static size_t jdksavdecc_control_parse_decimal(
+    char const *s, size_t len, bool *negative, uint64_t *mantissa, int *exponent )
+{
+    size_t i = 0;
+    size_t digits = 0;
+    int e = 0;
+    uint64_t m = 0;
+    bool dropped = false;
+    bool round_up = false;
+
+    *negative = false;
+    while ( i < len && s[i] == ' ' )
+    {
+        ++i;
+    }
+    if ( i < len && ( s[i] == '-' || s[i] == '+' ) )
+    {
+        *negative = s[i] == '-';
+        ++i;
+    }
+
+    // the digits that do not fit in the mantissa only scale it, the first
+    // of them rounds it
+    for ( ; i < len && s[i] >= '0' && s[i] <= '9'; ++i, ++digits )
+    {
+        if ( !dropped && m <= ( UINT64_MAX - (uint64_t)( s[i] - '0' ) ) / 10 )
+        {
+            m = m * 10 + (uint64_t)( s[i] - '0' );
+        }
+        else
+        {
+            round_up = round_up || ( !dropped && s[i] >= '5' );
+            dropped = true;
+            ++e;
+        }
+    }
+    if ( i < len && s[i] == '.' )
+    {
+        for ( ++i; i < len && s[i] >= '0' && s[i] <= '9'; ++i, ++digits )
+        {
+            if ( !dropped && m <= ( UINT64_MAX - (uint64_t)( s[i] - '0' ) ) / 10 )
+            {
+                m = m * 10 + (uint64_t)( s[i] - '0' );
+                --e;
+            }
+            else
+            {
+                round_up = round_up || ( !dropped && s[i] >= '5' );
+                dropped = true;
+            }
+        }
+    }
+    if ( round_up && m < UINT64_MAX )
+    {
+        ++m;
+    }
+    if ( digits == 0 )
+    {
+        return 0;
+    }
+
+    if ( i + 1 < len && ( s[i] == 'e' || s[i] == 'E' ) )
+    {
+        size_t j = i + 1;
+        bool negative_exponent = false;
+        int x = 0;
+        if ( j < len && ( s[j] == '-' || s[j] == '+' ) )
+        {
+            negative_exponent = s[j] == '-';
+            ++j;
+        }
+        if ( j < len && s[j] >= '0' && s[j] <= '9' )
+        {
+            for ( ; j < len && s[j] >= '0' && s[j] <= '9'; ++j )
+            {
+                if ( x < 10000 )
+                {
+                    x = x * 10 + ( s[j] - '0' );
+                }
+            }
+            e += negative_exponent ? -x : x;
+            i = j;
+        }
+    }
+
+    *mantissa = m;
+    *exponent = e;
+    return i;
+}
+
+/// Convert mantissa * 10^exponent to the raw value of a format, rounding
+/// to the nearest integer for integer formats. Returns false if it is out
+/// of range
+static bool jdksavdecc_control_scale_to_format( struct jdksavdecc_control_number *result,
+                                                enum jdksavdecc_control_format format,
+                                                bool negative,
+                                                uint64_t mantissa,
+                                                int exponent )
+{
+    struct jdksavdecc_control_format_info const *format_info = &jdksavdecc_control_formats[format];
+    uint64_t magnitude = mantissa;
+
+    if ( format == jdksavdecc_control_format_float || format == jdksavdecc_control_format_double )
+    {
+        result->kind = jdksavdecc_control_number_floating;
+        result->v.f = jdksavdecc_control_scale( (double)mantissa, exponent );
+        if ( negative )
+        {
+            result->v.f = -result->v.f;
+        }
+        return true;
+    }
+
+    if ( mantissa != 0 )
+    {
+        if ( exponent > 19 )
+        {
+            return false;
+        }
+        else if ( exponent > 0 )
+        {
+            if ( mantissa > UINT64_MAX / jdksavdecc_control_integer_powers_of_ten[exponent] )
+            {
+                return false;
+            }
+            magnitude = mantissa * jdksavdecc_control_integer_powers_of_ten[exponent];
+        }
+        else if ( exponent < -19 )
+        {
+            magnitude = 0;
+        }
+        else if ( exponent < 0 )
+        {
+            uint64_t divisor = jdksavdecc_control_integer_powers_of_ten[-exponent];
+            magnitude = mantissa / divisor;
+            if ( mantissa % divisor >= divisor - divisor / 2 )
+            {
+                ++magnitude;
+            }
+        }
+    }
+
+    if ( format_info->minimum < 0 )
+    {
+        result->kind = jdksavdecc_control_number_signed;
+        if ( negative )
+        {
+            if ( magnitude > 0 - (uint64_t)format_info->minimum )
+            {
+                return false;
+            }
+            result->v.s = magnitude == 0 - (uint64_t)format_info->minimum ? format_info->minimum : -(int64_t)magnitude;
+        }
+        else
+        {
+            if ( magnitude > format_info->maximum )
+            {
+                return false;
+            }
+            result->v.s = (int64_t)magnitude;
+        }
+    }
+    else
+    {
+        result->kind = jdksavdecc_control_number_unsigned;
+        if ( ( negative && magnitude != 0 ) || magnitude > format_info->maximum )
+        {
+            return false;
+        }
+        result->v.u = magnitude;
+    }
+    return true;
+}
+
+/// The offset of value from minimum rounded to the nearest multiple of
+/// step that is not past range, where range is maximum - minimum
+static uint64_t jdksavdecc_control_round_to_step( uint64_t offset, uint64_t step, uint64_t range )
+{
+    uint64_t remainder;
+    if ( step == 0 )
+    {
+        return offset;
+    }
+    remainder = offset % step;
+    offset -= remainder;
+    if ( remainder >= step - step / 2 && range - offset >= step )
+    {
+        offset += step;
+    }
+    return offset;
+}
+
+/// Clamp a value of an item to the minimum and maximum in the value details
+/// and round it to the nearest step from the minimum. Values of items
+/// without a minimum, maximum and step in the descriptor are left as they are
+static void jdksavdecc_control_fit_to_item_range( struct jdksavdecc_control_info const *control_info,
+                                                  struct jdksavdecc_control_value_type_info const *type_info,
+                                                  uint16_t item,
+                                                  struct jdksavdecc_control_number *value )
+{
+    struct jdksavdecc_control_format_info const *format_info = &jdksavdecc_control_formats[type_info->format];
+    struct jdksavdecc_control_number minimum, maximum, step;
+    ssize_t minimum_pos
+        = jdksavdecc_control_get_field_offset( control_info, type_info, item, jdksavdecc_control_field_minimum );
+    ssize_t maximum_pos
+        = jdksavdecc_control_get_field_offset( control_info, type_info, item, jdksavdecc_control_field_maximum );
+    ssize_t step_pos = jdksavdecc_control_get_field_offset( control_info, type_info, item, jdksavdecc_control_field_step );
+
+    if ( minimum_pos < 0 || maximum_pos < 0 || step_pos < 0 )
+    {
+        return;
+    }
+    format_info->read( &minimum, control_info->descriptor_data, minimum_pos );
+    format_info->read( &maximum, control_info->descriptor_data, maximum_pos );
+    format_info->read( &step, control_info->descriptor_data, step_pos );
+
+    switch ( value->kind )
+    {
+    case jdksavdecc_control_number_signed:
+        if ( minimum.v.s <= maximum.v.s )
+        {
+            uint64_t range = (uint64_t)maximum.v.s - (uint64_t)minimum.v.s;
+            int64_t v = value->v.s < minimum.v.s ? minimum.v.s : value->v.s > maximum.v.s ? maximum.v.s : value->v.s;
+            uint64_t offset = jdksavdecc_control_round_to_step(
+                (uint64_t)v - (uint64_t)minimum.v.s, step.v.s > 0 ? (uint64_t)step.v.s : 0, range );
+            value->v.s = minimum.v.s + (int64_t)offset;
+        }
+        break;
+    case jdksavdecc_control_number_unsigned:
+        if ( minimum.v.u <= maximum.v.u )
+        {
+            uint64_t v = value->v.u < minimum.v.u ? minimum.v.u : value->v.u > maximum.v.u ? maximum.v.u : value->v.u;
+            value->v.u = minimum.v.u + jdksavdecc_control_round_to_step( v - minimum.v.u, step.v.u, maximum.v.u - minimum.v.u );
+        }
+        break;
+    case jdksavdecc_control_number_floating:
+        if ( minimum.v.f <= maximum.v.f )
+        {
+            double v = value->v.f < minimum.v.f ? minimum.v.f : value->v.f > maximum.v.f ? maximum.v.f : value->v.f;
+            if ( step.v.f > 0.0 && ( maximum.v.f - minimum.v.f ) / step.v.f < 9007199254740992.0 )
+            {
+                // the number of steps from the minimum is exact in a double
+                double steps = (double)(uint64_t)( ( v - minimum.v.f ) / step.v.f + 0.5 );
+                v = minimum.v.f + steps * step.v.f;
+                if ( v > maximum.v.f )
+                {
+                    v -= step.v.f;
+                }
+            }
+            value->v.f = v;
+        }
+        break;
+    }
+}
 
 bool jdksavdecc_control_init( struct jdksavdecc_control_info *self, void const *descriptor_data, uint16_t descriptor_len )
 {
@@ -80,13 +1107,13 @@ bool jdksavdecc_control_get_item_localized_description( struct jdksavdecc_contro
                                                         struct jdksavdecc_string *result )
 {
     bool r = false;
+    ssize_t pos = jdksavdecc_control_get_field_offset(
+        control_info, jdksavdecc_control_get_value_type_info( control_info ), item, jdksavdecc_control_field_string );
 
-    if ( control_info->descriptor_data != 0 && control_info->descriptor_len >= JDKSAVDECC_DESCRIPTOR_CONTROL_LEN )
+    if ( pos >= 0 )
     {
+        uint16_t localized_string_id = jdksavdecc_uint16_get( control_info->descriptor_data, pos );
 
-        uint16_t localized_string_id = 0xffff;
-
-        // TODO
         jdksavdecc_string_init( result );
 
         entity_model->read_localized_string( entity_model, configuration_index, locale_id, localized_string_id, result );
@@ -98,103 +1125,73 @@ bool jdksavdecc_control_get_item_localized_description( struct jdksavdecc_contro
 
 bool jdksavdecc_control_is_numeric( struct jdksavdecc_control_info const *control_info )
 {
-    // TODO
-    return false;
+    return jdksavdecc_control_get_value_type_info( control_info )->format < jdksavdecc_control_format_string_ref;
 }
 
 bool jdksavdecc_control_is_integer( struct jdksavdecc_control_info const *control_info )
 {
-    // TODO
-    return false;
+    return jdksavdecc_control_get_value_type_info( control_info )->format < jdksavdecc_control_format_float;
 }
 
 bool jdksavdecc_control_uses_multiplier( struct jdksavdecc_control_info const *control_info )
 {
-    // TODO
-    return false;
+    return jdksavdecc_control_is_numeric( control_info );
 }
 
 bool jdksavdecc_control_is_floating_point( struct jdksavdecc_control_info const *control_info )
 {
-    // TODO
-    return false;
+    uint8_t format = jdksavdecc_control_get_value_type_info( control_info )->format;
+    return format == jdksavdecc_control_format_float || format == jdksavdecc_control_format_double;
 }
 
 bool jdksavdecc_control_is_selector( struct jdksavdecc_control_info const *control_info )
 {
-    // TODO
-    return false;
+    return jdksavdecc_control_get_value_type_info( control_info )->layout == jdksavdecc_control_layout_selector;
 }
 
 bool jdksavdecc_control_is_linear( struct jdksavdecc_control_info const *control_info )
 {
-    // TODO
-    return false;
+    return jdksavdecc_control_get_value_type_info( control_info )->layout == jdksavdecc_control_layout_linear;
 }
 
 bool jdksavdecc_control_is_array( struct jdksavdecc_control_info const *control_info )
 {
-    // TODO
-    return false;
+    return jdksavdecc_control_get_value_type_info( control_info )->layout == jdksavdecc_control_layout_array;
 }
 
 bool jdksavdecc_control_is_vendor_blob( struct jdksavdecc_control_info const *control_info )
 {
-    // TODO
-    return false;
-}
-
-bool jdksavdecc_control_get_vendor_id( struct jdksavdecc_control_info const *control_info,
-                                       struct jdksavdecc_eui64 *result_vendor_eui64 )
-{
-    // TODO
-    return false;
-}
-
-uint16_t jdksavdecc_control_get_vendor_blob_length( struct jdksavdecc_control_info const *control_info )
-{
-    // TODO
-    return false;
-}
-
-bool jdksavdecc_control_get_vendor_blob( struct jdksavdecc_control_info const *control_info,
-                                         uint16_t item,
-                                         uint8_t const *control_data,
-                                         uint16_t control_data_len,
-                                         uint8_t *blob_buf,
-                                         size_t blob_buf_max_len )
-{
-    // TODO
-    return false;
-}
-
-bool jdksavdecc_control_set_vendor_blob( struct jdksavdecc_control_info const *control_info,
-                                         uint16_t item,
-                                         uint8_t *control_data,
-                                         uint16_t control_data_len,
-                                         uint8_t const *blob_buf,
-                                         size_t blob_buf_max_len )
-{
-    // TODO
-    return false;
+    return jdksavdecc_control_get_control_value_type( control_info ) == JDKSAVDECC_CONTROL_VALUE_VENDOR;
 }
 
 int jdksavdecc_control_get_item_multiplier_power( struct jdksavdecc_control_info const *control_info, uint16_t item )
 {
-    // TODO
-    return 0;
+    int r = 0;
+    ssize_t pos = jdksavdecc_control_get_field_offset(
+        control_info, jdksavdecc_control_get_value_type_info( control_info ), item, jdksavdecc_control_field_unit );
+    if ( pos >= 0 )
+    {
+        r = (int8_t)jdksavdecc_uint8_get( control_info->descriptor_data, pos );
+    }
+    return r;
 }
 
 double jdksavdecc_control_get_item_multiplier( struct jdksavdecc_control_info const *control_info, uint16_t item )
 {
-    // TODO
-    return 1.0;
+    return jdksavdecc_control_scale( 1.0, jdksavdecc_control_get_item_multiplier_power( control_info, item ) );
 }
 
 char const *jdksavdecc_control_get_item_units_as_string( struct jdksavdecc_control_info const *control_info, uint16_t item )
 {
-    // TODO
-    return 0;
+    char const *r = 0;
+    ssize_t pos = jdksavdecc_control_get_field_offset(
+        control_info, jdksavdecc_control_get_value_type_info( control_info ), item, jdksavdecc_control_field_unit );
+    if ( pos >= 0 )
+    {
+        uint8_t code = jdksavdecc_uint8_get( control_info->descriptor_data, pos + 1 );
+        r = jdksavdecc_control_units_suffix[code >> 3][code & 0x7];
+    }
+    return r;
 }
 
 bool jdksavdecc_control_get_item_as_string( struct jdksavdecc_control_info const *control_info,
@@ -206,8 +1203,21 @@ bool jdksavdecc_control_get_item_as_string( struct jdksavdecc_control_info const
                                             struct jdksavdecc_entity_model *entity_model,
                                             uint16_t locale_id )
 {
-    // TODO
-    return false;
+    struct jdksavdecc_control_value_type_info const *type_info = jdksavdecc_control_get_value_type_info( control_info );
+
+    if ( type_info->layout == jdksavdecc_control_layout_utf8 )
+    {
+        return item == 0 && jdksavdecc_control_print_utf8( control_data, control_data_len, string_buf, string_buf_max_len );
+    }
+    return jdksavdecc_control_print_item( control_info,
+                                          type_info,
+                                          item,
+                                          control_data,
+                                          jdksavdecc_control_get_data_offset( control_info, type_info, item, control_data_len ),
+                                          string_buf,
+                                          string_buf_max_len,
+                                          entity_model,
+                                          locale_id );
 }
 
 bool jdksavdecc_control_set_item_from_string( struct jdksavdecc_control_info const *control_info,
@@ -217,8 +1227,112 @@ bool jdksavdecc_control_set_item_from_string( struct jdksavdecc_control_info con
                                               char const *string_buf,
                                               size_t string_buf_max_len )
 {
-    // TODO
-    return false;
+    struct jdksavdecc_control_value_type_info const *type_info = jdksavdecc_control_get_value_type_info( control_info );
+    struct jdksavdecc_control_number value;
+    ssize_t pos;
+    size_t len = 0;
+    size_t end;
+    bool negative;
+    uint64_t mantissa;
+    int exponent;
+    char const *suffix;
+
+    while ( len < string_buf_max_len && string_buf[len] != '\0' )
+    {
+        ++len;
+    }
+
+    if ( type_info->layout == jdksavdecc_control_layout_utf8 )
+    {
+        if ( item != 0 || len > control_data_len )
+        {
+            return false;
+        }
+        memcpy( control_data, string_buf, len );
+        memset( control_data + len, 0, control_data_len - len );
+        return true;
+    }
+
+    // selector strings can only be set by their localized string id
+    if ( type_info->format >= jdksavdecc_control_format_string_ref )
+    {
+        return false;
+    }
+    pos = jdksavdecc_control_get_data_offset( control_info, type_info, item, control_data_len );
+    if ( pos < 0 )
+    {
+        return false;
+    }
+
+    end = jdksavdecc_control_parse_decimal( string_buf, len, &negative, &mantissa, &exponent );
+    if ( end == 0 )
+    {
+        return false;
+    }
+
+    // anything after the number must be the units of the item
+    while ( end < len && string_buf[end] == ' ' )
+    {
+        ++end;
+    }
+    if ( end < len )
+    {
+        suffix = jdksavdecc_control_get_item_units_as_string( control_info, item );
+        if ( suffix == 0 || strlen( suffix ) != len - end || memcmp( suffix, string_buf + end, len - end ) != 0 )
+        {
+            return false;
+        }
+    }
+
+    exponent -= jdksavdecc_control_get_item_multiplier_power( control_info, item );
+    if ( !jdksavdecc_control_scale_to_format(
+             &value, (enum jdksavdecc_control_format)type_info->format, negative, mantissa, exponent ) )
+    {
+        return false;
+    }
+    jdksavdecc_control_fit_to_item_range( control_info, type_info, item, &value );
+    jdksavdecc_control_formats[type_info->format].write( &value, control_data, pos );
+    return true;
+}
+
+/// Print a field of an item from the value details in the descriptor
+static bool jdksavdecc_control_get_item_field_as_string( struct jdksavdecc_control_info const *control_info,
+                                                         uint16_t item,
+                                                         enum jdksavdecc_control_field field,
+                                                         char *string_buf,
+                                                         size_t string_buf_max_len,
+                                                         struct jdksavdecc_entity_model *entity_model,
+                                                         uint16_t locale_id )
+{
+    struct jdksavdecc_control_value_type_info const *type_info = jdksavdecc_control_get_value_type_info( control_info );
+
+    if ( type_info->layout == jdksavdecc_control_layout_utf8 )
+    {
+        ssize_t values_offset;
+        if ( item != 0 || field != jdksavdecc_control_field_current || control_info->descriptor_data == 0
+             || control_info->descriptor_len < JDKSAVDECC_DESCRIPTOR_CONTROL_LEN )
+        {
+            return false;
+        }
+        values_offset = jdksavdecc_descriptor_control_get_values_offset( control_info->descriptor_data, 0 );
+        if ( values_offset > (ssize_t)control_info->descriptor_len )
+        {
+            return false;
+        }
+        return jdksavdecc_control_print_utf8( (uint8_t const *)control_info->descriptor_data + values_offset,
+                                              control_info->descriptor_len - values_offset,
+                                              string_buf,
+                                              string_buf_max_len );
+    }
+    return jdksavdecc_control_print_item( control_info,
+                                          type_info,
+                                          item,
+                                          control_info->descriptor_data,
+                                          jdksavdecc_control_get_field_offset( control_info, type_info, item, field ),
+                                          string_buf,
+                                          string_buf_max_len,
+                                          entity_model,
+                                          locale_id );
 }
 
 bool jdksavdecc_control_get_item_current_as_string( struct jdksavdecc_control_info const *control_info,
@@ -228,8 +1342,8 @@ bool jdksavdecc_control_get_item_current_as_string( struct jdksavdecc_control_in
                                                     struct jdksavdecc_entity_model *entity_model,
                                                     uint16_t locale_id )
 {
-    // TODO
-    return false;
+    return jdksavdecc_control_get_item_field_as_string(
+        control_info, item, jdksavdecc_control_field_current, string_buf, string_buf_max_len, entity_model, locale_id );
 }
 
 bool jdksavdecc_control_get_item_minimum_as_string( struct jdksavdecc_control_info const *control_info,
@@ -239,8 +1353,8 @@ bool jdksavdecc_control_get_item_minimum_as_string( struct jdksavdecc_control_in
                                                     struct jdksavdecc_entity_model *entity_model,
                                                     uint16_t locale_id )
 {
-    // TODO
-    return false;
+    return jdksavdecc_control_get_item_field_as_string(
+        control_info, item, jdksavdecc_control_field_minimum, string_buf, string_buf_max_len, entity_model, locale_id );
 }
 
 bool jdksavdecc_control_get_item_maximum_as_string( struct jdksavdecc_control_info const *control_info,
@@ -250,8 +1364,8 @@ bool jdksavdecc_control_get_item_maximum_as_string( struct jdksavdecc_control_in
                                                     struct jdksavdecc_entity_model *entity_model,
                                                     uint16_t locale_id )
 {
-    // TODO
-    return false;
+    return jdksavdecc_control_get_item_field_as_string(
+        control_info, item, jdksavdecc_control_field_maximum, string_buf, string_buf_max_len, entity_model, locale_id );
 }
 
 bool jdksavdecc_control_get_item_step_as_string( struct jdksavdecc_control_info const *control_info,
@@ -261,8 +1375,8 @@ bool jdksavdecc_control_get_item_step_as_string( struct jdksavdecc_control_info
                                                  struct jdksavdecc_entity_model *entity_model,
                                                  uint16_t locale_id )
 {
-    // TODO
-    return false;
+    return jdksavdecc_control_get_item_field_as_string(
+        control_info, item, jdksavdecc_control_field_step, string_buf, string_buf_max_len, entity_model, locale_id );
 }
 
 bool jdksavdecc_control_get_item_default_as_string( struct jdksavdecc_control_info const *control_info,
@@ -271,6 +1385,43 @@ bool jdksavdecc_control_get_item_default_as_string( struct jdksavdecc_control_in
                                                     size_t string_buf_max_len,
                                                     struct jdksavdecc_entity_model *entity_model,
                                                     uint16_t locale_id )
+{
+    return jdksavdecc_control_get_item_field_as_string(
+        control_info, item, jdksavdecc_control_field_default, string_buf, string_buf_max_len, entity_model, locale_id );
+}
+
+#ifdef TODO
+
+bool jdksavdecc_control_get_vendor_id( struct jdksavdecc_control_info const *control_info,
+                                       struct jdksavdecc_eui64 *result_vendor_eui64 )
+{
+    // TODO
+    return false;
+}
+
+uint16_t jdksavdecc_control_get_vendor_blob_length( struct jdksavdecc_control_info const *control_info )
+{
+    // TODO
+    return false;
+}
+
+bool jdksavdecc_control_get_vendor_blob( struct jdksavdecc_control_info const *control_info,
+                                         uint16_t item,
+                                         uint8_t const *control_data,
+                                         uint16_t control_data_len,
+                                         uint8_t *blob_buf,
+                                         size_t blob_buf_max_len )
+{
+    // TODO
+    return false;
+}
+
+bool jdksavdecc_control_set_vendor_blob( struct jdksavdecc_control_info const *control_info,
+                                         uint16_t item,
+                                         uint8_t *control_data,
+                                         uint16_t control_data_len,
+                                         uint8_t const *blob_buf,
+                                         size_t blob_buf_max_len )
 {
     // TODO
     return false;
@@ -888,7 +2039,4 @@ bool jdksavdecc_control_get_current_gptp_time_item( struct jdksavdecc_control_in
     return false;
 }
 
-#else
-const char *jdksavdecc_control_file = __FILE__;
-
 #endif
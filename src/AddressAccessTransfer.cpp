@@ -0,0 +1,358 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/AddressAccessTransfer.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+AddressAccessTransfer::AddressAccessTransfer( ControllerEntity &controller_entity, uint16_t window_size )
+    : m_controller_entity( controller_entity )
+    , m_window_size( window_size == 0 ? 1 : ( window_size > max_window_size ? max_window_size : window_size ) )
+    , m_state( StateIdle )
+    , m_address( 0 )
+    , m_destination( 0 )
+    , m_source( 0 )
+    , m_length( 0 )
+    , m_next_offset( 0 )
+    , m_completed_offset( 0 )
+    , m_crc32( 0 )
+    , m_verify_crc32( false )
+    , m_expected_crc32( 0 )
+    , m_commit( false )
+    , m_commit_address( 0 )
+    , m_sequence_id( 0 )
+{
+    for ( uint16_t i = 0; i < max_window_size; ++i )
+    {
+        m_slots[i].m_in_use = false;
+        m_slots[i].m_done = false;
+    }
+}
+
+bool AddressAccessTransfer::startRead( Eui64 const &target_entity_id,
+                                       Eui48 const &target_mac_address,
+                                       uint32_t address,
+                                       uint8_t *destination,
+                                       uint32_t length,
+                                       bool verify_crc32,
+                                       uint32_t expected_crc32 )
+{
+    bool r = false;
+    if ( m_state == StateIdle )
+    {
+        m_destination = destination;
+        m_source = 0;
+        m_verify_crc32 = verify_crc32;
+        m_expected_crc32 = expected_crc32;
+        m_commit = false;
+        m_state = StateReading;
+        start( target_entity_id, target_mac_address, address, length );
+        r = true;
+    }
+    return r;
+}
+
+bool AddressAccessTransfer::startWrite( Eui64 const &target_entity_id,
+                                        Eui48 const &target_mac_address,
+                                        uint32_t address,
+                                        uint8_t const *source,
+                                        uint32_t length,
+                                        bool commit,
+                                        uint32_t commit_address )
+{
+    bool r = false;
+    if ( m_state == StateIdle )
+    {
+        m_destination = 0;
+        m_source = source;
+        m_verify_crc32 = false;
+        m_commit = commit;
+        m_commit_address = commit_address;
+        m_state = StateWriting;
+        start( target_entity_id, target_mac_address, address, length );
+        r = true;
+    }
+    return r;
+}
+
+void AddressAccessTransfer::start( Eui64 const &target_entity_id,
+                                   Eui48 const &target_mac_address,
+                                   uint32_t address,
+                                   uint32_t length )
+{
+    m_target_entity_id = target_entity_id;
+    m_target_mac_address = target_mac_address;
+    m_address = address;
+    m_length = length;
+    m_next_offset = 0;
+    m_completed_offset = 0;
+    m_crc32 = 0;
+
+    fillWindow();
+
+    // A zero length transfer completes immediately
+    advanceCompleted();
+}
+
+void AddressAccessTransfer::cancel()
+{
+    if ( m_state != StateIdle )
+    {
+        finish( ResultCancelled, JDKSAVDECC_AECP_AA_STATUS_SUCCESS );
+    }
+}
+
+void AddressAccessTransfer::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    if ( m_state != StateIdle )
+    {
+        for ( uint16_t i = 0; i < max_window_size; ++i )
+        {
+            Slot &slot = m_slots[i];
+            if ( slot.m_in_use && !slot.m_done && wasDeadlineHit( time_in_millis, slot.m_deadline ) )
+            {
+                if ( slot.m_retries >= max_retries )
+                {
+                    finish( ResultTimedOut, JDKSAVDECC_AECP_AA_STATUS_SUCCESS );
+                    break;
+                }
+                // Resend with the same sequence_id, the target treats it as a
+                // retry of the same command
+                slot.m_retries++;
+                sendSlot( slot );
+            }
+        }
+    }
+}
+
+bool AddressAccessTransfer::receivedAAResponse( jdksavdecc_aecp_aa const &aa, Frame &pdu )
+{
+    bool r = false;
+
+    if ( m_state != StateIdle && aa.aecpdu_header.header.target_entity_id == m_target_entity_id )
+    {
+        for ( uint16_t i = 0; i < max_window_size; ++i )
+        {
+            Slot &slot = m_slots[i];
+            if ( slot.m_in_use && !slot.m_done && slot.m_sequence_id == aa.sequence_id )
+            {
+                r = true;
+                uint8_t aa_status = aa.aecpdu_header.header.status;
+
+                if ( aa_status != JDKSAVDECC_AECP_AA_STATUS_SUCCESS )
+                {
+                    finish( ResultAAStatus, aa_status );
+                    break;
+                }
+
+                if ( slot.m_mode == JDKSAVDECC_AECP_AA_MODE_READ )
+                {
+                    // The response TLV carries the data that was read, it must
+                    // be exactly what we asked for
+                    uint16_t tlv_pos = JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AECPDU_AA_LEN;
+                    uint16_t data_pos = tlv_pos + JDKSAVDECC_AECPDU_AA_TLV_LEN;
+                    uint16_t tlv_length = 0;
+                    if ( aa.tlv_count > 0 && pdu.getLength() >= data_pos )
+                    {
+                        tlv_length = pdu.getDoublet( tlv_pos + JDKSAVDECC_AECPDU_AA_TLV_OFFSET_MODE_LENGTH ) & 0x0fff;
+                    }
+                    if ( tlv_length != slot.m_length || pdu.getLength() < data_pos + slot.m_length )
+                    {
+                        finish( ResultAAStatus, JDKSAVDECC_AECP_AA_STATUS_TLV_INVALID );
+                        break;
+                    }
+                    memcpy( m_destination + slot.m_offset, pdu.getBuf( data_pos ), slot.m_length );
+                }
+                else if ( slot.m_mode == JDKSAVDECC_AECP_AA_MODE_EXECUTE )
+                {
+                    // The target accepted the CRC and committed the data
+                    finish( ResultSuccess, JDKSAVDECC_AECP_AA_STATUS_SUCCESS );
+                    break;
+                }
+
+                slot.m_done = true;
+                advanceCompleted();
+                fillWindow();
+                break;
+            }
+        }
+    }
+    return r;
+}
+
+void AddressAccessTransfer::transferCompleted( Result result, uint8_t aa_status )
+{
+    (void)result;
+    (void)aa_status;
+}
+
+void AddressAccessTransfer::fillWindow()
+{
+    if ( m_state == StateReading || m_state == StateWriting )
+    {
+        for ( uint16_t i = 0; i < m_window_size && m_next_offset < m_length; ++i )
+        {
+            Slot &slot = m_slots[i];
+            if ( !slot.m_in_use )
+            {
+                uint32_t remaining = m_length - m_next_offset;
+                slot.m_in_use = true;
+                slot.m_done = false;
+                slot.m_mode = ( m_state == StateReading ) ? JDKSAVDECC_AECP_AA_MODE_READ : JDKSAVDECC_AECP_AA_MODE_WRITE;
+                slot.m_retries = 0;
+                slot.m_sequence_id = ++m_sequence_id;
+                slot.m_offset = m_next_offset;
+                slot.m_length = remaining > max_tlv_data_length ? max_tlv_data_length : uint16_t( remaining );
+                m_next_offset += slot.m_length;
+                sendSlot( slot );
+            }
+        }
+    }
+}
+
+void AddressAccessTransfer::sendSlot( Slot &slot )
+{
+    FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AECPDU_AA_LEN + JDKSAVDECC_AECPDU_AA_TLV_LEN> pdu(
+        0, m_target_mac_address, getRawSocket().getMACAddress(), JDKSAVDECC_AVTP_ETHERTYPE );
+
+    uint32_t address = m_address + slot.m_offset;
+    uint8_t const *data = 0;
+    uint16_t data_length = 0;
+    uint16_t tlv_length = slot.m_length;
+    uint8_t crc_octets[4];
+
+    if ( slot.m_mode == JDKSAVDECC_AECP_AA_MODE_WRITE )
+    {
+        // The data goes straight from the source block, no copy
+        data = m_source + slot.m_offset;
+        data_length = slot.m_length;
+    }
+    else if ( slot.m_mode == JDKSAVDECC_AECP_AA_MODE_EXECUTE )
+    {
+        address = m_commit_address;
+        jdksavdecc_uint32_set( m_crc32, crc_octets, 0 );
+        data = crc_octets;
+        data_length = sizeof( crc_octets );
+        tlv_length = data_length;
+    }
+
+    uint16_t control_data_length = JDKSAVDECC_AECPDU_AA_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN
+                                   + JDKSAVDECC_AECPDU_AA_TLV_LEN + data_length;
+
+    // AECPDU common control header
+    pdu.putOctet( JDKSAVDECC_1722A_SUBTYPE_AECP );
+    pdu.putOctet( 0x00 + JDKSAVDECC_AECP_MESSAGE_TYPE_ADDRESS_ACCESS_COMMAND );
+    pdu.putOctet( ( ( JDKSAVDECC_AECP_AA_STATUS_SUCCESS ) << 3 ) + ( ( control_data_length >> 8 ) & 0x7 ) );
+    pdu.putOctet( control_data_length & 0xff );
+    pdu.putEUI64( m_target_entity_id );
+    pdu.putEUI64( m_controller_entity.getEntityID() );
+    pdu.putDoublet( slot.m_sequence_id );
+    pdu.putDoublet( 1 ); // tlv_count
+
+    // See 9.2.1.3.3: mode in the top 4 bits, length in the bottom 12 bits
+    pdu.putDoublet( ( uint16_t( slot.m_mode ) << 12 ) + ( tlv_length & 0x0fff ) );
+    pdu.putQuadlet( 0 ); // address_upper
+    pdu.putQuadlet( address );
+
+    getRawSocket().sendFrame( pdu, data, data_length );
+
+    slot.m_deadline = getRawSocket().getTimeInMilliseconds() + JDKSAVDECC_AECP_AA_TIMEOUT_IN_MS;
+}
+
+void AddressAccessTransfer::advanceCompleted()
+{
+    // Slots may complete in any order; only fold in the one that continues the
+    // contiguous completed prefix, then look again
+    bool progressed = true;
+    while ( progressed )
+    {
+        progressed = false;
+        for ( uint16_t i = 0; i < max_window_size; ++i )
+        {
+            Slot &slot = m_slots[i];
+            if ( slot.m_in_use && slot.m_done && slot.m_offset == m_completed_offset )
+            {
+                uint8_t const *data = ( m_state == StateReading ) ? m_destination : m_source;
+                m_crc32 = calculateCrc32( m_crc32, data + slot.m_offset, slot.m_length );
+                m_completed_offset += slot.m_length;
+                slot.m_in_use = false;
+                progressed = true;
+            }
+        }
+    }
+
+    if ( ( m_state == StateReading || m_state == StateWriting ) && m_completed_offset == m_length )
+    {
+        if ( m_state == StateReading )
+        {
+            if ( m_verify_crc32 && m_crc32 != m_expected_crc32 )
+            {
+                finish( ResultCrcMismatch, JDKSAVDECC_AECP_AA_STATUS_SUCCESS );
+            }
+            else
+            {
+                finish( ResultSuccess, JDKSAVDECC_AECP_AA_STATUS_SUCCESS );
+            }
+        }
+        else if ( m_commit )
+        {
+            // All data is written, ask the target to verify and commit it
+            m_state = StateCommitting;
+            Slot &slot = m_slots[0];
+            slot.m_in_use = true;
+            slot.m_done = false;
+            slot.m_mode = JDKSAVDECC_AECP_AA_MODE_EXECUTE;
+            slot.m_retries = 0;
+            slot.m_sequence_id = ++m_sequence_id;
+            slot.m_offset = m_length;
+            slot.m_length = 0;
+            sendSlot( slot );
+        }
+        else
+        {
+            finish( ResultSuccess, JDKSAVDECC_AECP_AA_STATUS_SUCCESS );
+        }
+    }
+}
+
+void AddressAccessTransfer::finish( Result result, uint8_t aa_status )
+{
+    for ( uint16_t i = 0; i < max_window_size; ++i )
+    {
+        m_slots[i].m_in_use = false;
+        m_slots[i].m_done = false;
+    }
+    m_state = StateIdle;
+    transferCompleted( result, aa_status );
+}
+}
@@ -39,7 +39,7 @@ ApcStateMachine::ApcStateMachine( ApcStateVariables *variables,
                                   ApcStateActions *actions,
                                   ApcStateEvents *events,
                                   ApcStates *states )
-    : m_variables( variables ), m_actions( actions ), m_events( events ), m_states( states )
+    : m_variables( variables ), m_actions( actions ), m_events( events ), m_states( states ), m_table_driven( false )
 {
 }
 
@@ -62,7 +62,7 @@ void ApcStateMachine::setApsAddress( const std::string &addr ) { getVariables()-
 void ApcStateMachine::setPath( const std::string &path )
 {
     std::vector<std::string> headers;
-    getVariables()->m_request.setCONNECT( "/", headers );
+    getVariables()->m_request.setCONNECT( path, headers );
 }
 
 bool ApcStateMachine::run() { return getStates()->run(); }
@@ -89,7 +89,26 @@ ssize_t ApcStateMachine::onIncomingTcpData( const uint8_t *data, ssize_t len ) {
 
 void ApcStateMachine::sendTcpData( const uint8_t *data, ssize_t len ) {}
 
-void ApcStateMachine::onNetAvdeccMessageReceived( const Frame &frame ) { getEvents()->onNetAvdeccMessageReceived( frame ); }
+void ApcStateMachine::onNetAvdeccMessageReceived( const Frame &frame )
+{
+    ApcEvent event( ApcEvent::NetAvdeccMessage );
+    event.m_frame = &frame;
+    if ( !dispatch( event ) )
+    {
+        getEvents()->onNetAvdeccMessageReceived( frame );
+    }
+}
+
+void ApcStateMachine::tick( uint32_t time_in_seconds )
+{
+    ApcEvent event( ApcEvent::TimeTick );
+    event.m_time_in_seconds = time_in_seconds;
+    if ( !dispatch( event ) )
+    {
+        onTimeTick( time_in_seconds );
+        run();
+    }
+}
 
 void ApcStateMachine::clear()
 {
@@ -156,6 +175,10 @@ void ApcStateEvents::onNetAvdeccMessageReceived( const Frame &frame )
     getVariables()->m_apcMsg.clear();
     getVariables()->m_apcMsg.setAvdeccFromApc( frame );
     getVariables()->m_apcMsgOut = true;
+
+    // Run the state machine now so that the message is handed to the APS
+    // before another frame overwrites m_apcMsg
+    getOwner()->run();
 }
 
 void ApcStateEvents::onTimeTick( uint32_t time_in_seconds ) { getVariables()->m_currentTime = time_in_seconds; }
@@ -182,11 +205,11 @@ bool ApcStateEvents::onIncomingHttpResponse( const HttpResponse &request )
 
 ssize_t ApcStateEvents::onIncomingTcpAppData( const uint8_t *data, ssize_t len )
 {
-    ssize_t r = 0;
+    ssize_t r = -1;
 
-    for ( ssize_t r = 0; r < len; ++r )
+    if ( m_app_parser.parse( data, size_t( len ) ) == 0 )
     {
-        m_app_parser.parse( data[r] );
+        r = len;
     }
 
     return r;
@@ -222,8 +245,18 @@ void ApcStateEvents::onAppLinkDown( const AppMessage &msg )
 
 void ApcStateEvents::onAppAvdeccFromAps( const AppMessage &msg )
 {
+    ApcEvent event( ApcEvent::AppAvdeccFromAps );
+    event.m_msg = &msg;
+    if ( getOwner()->dispatch( event ) )
+    {
+        return;
+    }
+
     getVariables()->m_apsMsg = msg;
     getVariables()->m_apsMsgIn = true;
+
+    // A single read may contain many messages, process each one now
+    getOwner()->run();
 }
 
 void ApcStateEvents::onAppAvdeccFromApc( const AppMessage &msg )
@@ -285,14 +318,24 @@ void ApcStateActions::sendIdRequest( const Eui48 &primaryMac, const Eui64 &entit
 
 void ApcStateActions::sendHttpRequest( const HttpRequest &request )
 {
-    std::string buf;
-    request.flatten( &buf );
-    getEvents()->sendTcpData( reinterpret_cast<const uint8_t *>( buf.data() ), buf.length() );
+    uint8_t buf[512];
+    size_t len = request.flatten( buf, sizeof( buf ) );
+    if ( len > 0 )
+    {
+        getEvents()->sendTcpData( buf, len );
+    }
+    else
+    {
+        // Requests with many headers don't fit on the stack
+        std::string s;
+        request.flatten( &s );
+        getEvents()->sendTcpData( reinterpret_cast<const uint8_t *>( s.data() ), s.length() );
+    }
 }
 
 void ApcStateActions::sendMsgToAps( const AppMessage &apcMsg )
 {
-    FixedBufferWithSize<1500> msg_as_octets;
+    FixedBufferWithSize<JDKSAVDECC_APPDU_HEADER_LEN + JDKSAVDECC_APPDU_MAX_PAYLOAD_LENGTH> msg_as_octets;
     if ( apcMsg.store( &msg_as_octets ) )
     {
         getEvents()->sendTcpData( msg_as_octets.getBuf(), msg_as_octets.getLength() );
@@ -334,7 +377,11 @@ void ApcStateVariables::clear()
     m_tcpConnected = false;
 }
 
-void ApcStates::clear() { m_current_state = &ApcStates::doBegin; }
+void ApcStates::clear()
+{
+    m_current_state = &ApcStates::doBegin;
+    m_state_id = StateBegin;
+}
 
 bool ApcStates::run()
 {
@@ -367,13 +414,18 @@ void ApcStates::doBegin() { goToInitialize(); }
 void ApcStates::goToInitialize()
 {
     m_current_state = &ApcStates::doInitialize;
+    m_state_id = StateInitialize;
     getActions()->initialize();
     getActions()->connectToProxy( getVariables()->m_addr );
 }
 
 void ApcStates::doInitialize() { goToWaitForConnect(); }
 
-void ApcStates::goToWaitForConnect() { m_current_state = &ApcStates::doWaitForConnect; }
+void ApcStates::goToWaitForConnect()
+{
+    m_current_state = &ApcStates::doWaitForConnect;
+    m_state_id = StateWaitForConnect;
+}
 
 void ApcStates::doWaitForConnect()
 {
@@ -390,6 +442,7 @@ void ApcStates::doWaitForConnect()
 void ApcStates::goToConnected()
 {
     m_current_state = &ApcStates::doConnected;
+    m_state_id = StateConnected;
 
     getVariables()->m_responseValid = false;
     getVariables()->m_responseReceived = false;
@@ -411,13 +464,18 @@ void ApcStates::doConnected()
 void ApcStates::goToStartTransfer()
 {
     m_current_state = &ApcStates::doStartTransfer;
+    m_state_id = StateStartTransfer;
     getActions()->sendIdRequest( getVariables()->m_primaryMac, getVariables()->m_entityId );
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
 }
 
 void ApcStates::doStartTransfer() { goToWaiting(); }
 
-void ApcStates::goToWaiting() { m_current_state = &ApcStates::doWaiting; }
+void ApcStates::goToWaiting()
+{
+    m_current_state = &ApcStates::doWaiting;
+    m_state_id = StateWaiting;
+}
 
 void ApcStates::doWaiting()
 {
@@ -454,6 +512,7 @@ void ApcStates::doWaiting()
 void ApcStates::goToClosed()
 {
     m_current_state = &ApcStates::doClosed;
+    m_state_id = StateClosed;
     getActions()->notifyProxyUnavailable();
 }
 
@@ -462,6 +521,7 @@ void ApcStates::doClosed() { goToFinish(); }
 void ApcStates::goToLinkStatus()
 {
     m_current_state = &ApcStates::doLinkStatus;
+    m_state_id = StateLinkStatus;
     getActions()->notifyLinkStatus( getVariables()->m_linkMsg );
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
     getVariables()->m_linkStatusMsg = false;
@@ -471,6 +531,8 @@ void ApcStates::doLinkStatus() { goToWaiting(); }
 
 void ApcStates::goToReceiveMsg()
 {
+    m_current_state = &ApcStates::doReceiveMsg;
+    m_state_id = StateReceiveMsg;
     getActions()->processMsg( getVariables()->m_apsMsg );
     getVariables()->m_apsMsgIn = false;
 }
@@ -479,6 +541,8 @@ void ApcStates::doReceiveMsg() { goToWaiting(); }
 
 void ApcStates::goToSendMsg()
 {
+    m_current_state = &ApcStates::doSendMsg;
+    m_state_id = StateSendMsg;
     getActions()->sendMsgToAps( getVariables()->m_apcMsg );
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
     getVariables()->m_apcMsgOut = false;
@@ -488,6 +552,8 @@ void ApcStates::doSendMsg() { goToWaiting(); }
 
 void ApcStates::goToEntityIdAssigned()
 {
+    m_current_state = &ApcStates::doEntityIdAssigned;
+    m_state_id = StateEntityIdAssigned;
     getVariables()->m_entityId = getVariables()->m_newId;
     getActions()->notifyNewEntityId( getVariables()->m_newId );
     getActions()->notifyProxyAvailable();
@@ -499,6 +565,8 @@ void ApcStates::doEntityIdAssigned() { goToWaiting(); }
 
 void ApcStates::goToSendNop()
 {
+    m_current_state = &ApcStates::doSendNop;
+    m_state_id = StateSendNop;
     getActions()->sendNopToAps();
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
 }
@@ -508,8 +576,61 @@ void ApcStates::doSendNop() { goToWaiting(); }
 void ApcStates::goToFinish()
 {
     m_current_state = &ApcStates::doFinish;
+    m_state_id = StateFinish;
     getActions()->closeTcpConnection();
 }
 
-void ApcStates::doFinish() { m_current_state = 0; }
+void ApcStates::doFinish()
+{
+    m_current_state = 0;
+    m_state_id = StateNone;
+}
+
+void ApcStates::sendMsg( ApcStateMachine &owner, const ApcEvent &event )
+{
+    // As onNetAvdeccMessageReceived(), goToSendMsg() and doSendMsg()
+    ApcStateVariables *v = owner.getVariables();
+
+    v->m_apcMsg.clear();
+    v->m_apcMsg.setAvdeccFromApc( *event.m_frame );
+    owner.getActions()->sendMsgToAps( v->m_apcMsg );
+    v->m_nopTimeout = v->m_currentTime + 10;
+}
+
+void ApcStates::receiveMsg( ApcStateMachine &owner, const ApcEvent &event )
+{
+    // As goToReceiveMsg() and doReceiveMsg(), without copying the message
+    // into m_apsMsg
+    owner.getActions()->processMsg( *event.m_msg );
+}
+
+void ApcStates::timeTickWhileWaiting( ApcStateMachine &owner, const ApcEvent &event )
+{
+    // As onTimeTick() followed by the doWaiting() test for the NOP timeout
+    ApcStateVariables *v = owner.getVariables();
+    v->m_currentTime = event.m_time_in_seconds;
+    if ( v->m_currentTime > v->m_nopTimeout )
+    {
+        owner.getActions()->sendNopToAps();
+        v->m_nopTimeout = v->m_currentTime + 10;
+    }
+}
+
+const ApcStates::transition_proc ApcStates::transition_table[ApcStates::StateCount][ApcEvent::Count] = {
+    // NetAvdeccMessage, AppAvdeccFromAps, TimeTick
+    {0, 0, 0}, // StateNone
+    {0, 0, 0}, // StateBegin
+    {0, 0, 0}, // StateInitialize
+    {0, 0, 0}, // StateWaitForConnect
+    {0, 0, 0}, // StateConnected
+    {0, 0, 0}, // StateStartTransfer
+    {&ApcStates::sendMsg, &ApcStates::receiveMsg, &ApcStates::timeTickWhileWaiting}, // StateWaiting
+    {0, 0, 0}, // StateClosed
+    {0, 0, 0}, // StateLinkStatus
+    {0, 0, 0}, // StateReceiveMsg
+    {0, 0, 0}, // StateSendMsg
+    {0, 0, 0}, // StateEntityIdAssigned
+    {0, 0, 0}, // StateSendNop
+    {0, 0, 0}  // StateFinish
+};
 }
@@ -0,0 +1,331 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/ApcClient.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_APCCLIENT
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace JDKSAvdeccMCU
+{
+
+ApcClient::ApcClient( std::string const &path, size_t max_batch_octets )
+    : ApcStateMachine( &m_client_variables, &m_client_actions, &m_client_events, &m_client_states )
+    , m_client_events( &m_http_parser, path )
+    , m_http_parser( &m_http_response, &m_client_events, false )
+    , m_path( path )
+    , m_fd( -1 )
+    , m_connecting( false )
+    , m_batch_pos( 0 )
+    , m_max_batch_octets( std::max( max_batch_octets, size_t( JDKSAVDECC_APPDU_HEADER_LEN + JDKSAVDECC_APPDU_MAX_PAYLOAD_LENGTH ) ) )
+    , m_dropped_count( 0 )
+    , m_read_buf( 65536 )
+{
+    m_batch.reserve( m_max_batch_octets );
+    setTableDriven( true );
+}
+
+ApcClient::~ApcClient() { closeSocket(); }
+
+void ApcClient::start( std::string const &aps_address, Eui48 const &primary_mac, Eui64 const &entity_id )
+{
+    closeSocket();
+    m_dropped_count = 0;
+
+    setup();
+    setApsAddress( aps_address );
+    setPrimaryMac( primary_mac );
+    setEntityId( entity_id );
+    setPath( m_path );
+    onTimeTick( uint32_t( getTimeInMilliseconds() / 1000 ) );
+    run();
+}
+
+void ApcClient::stop()
+{
+    if ( isConnected() )
+    {
+        writeBatch( false );
+    }
+    getVariables()->m_finished = true;
+    run();
+    closeSocket();
+}
+
+bool ApcClient::poll( int timeout_ms )
+{
+    if ( m_fd >= 0 )
+    {
+        pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if ( m_connecting || getPendingOctets() > 0 )
+        {
+            pfd.events |= POLLOUT;
+        }
+
+        if ( ::poll( &pfd, 1, timeout_ms ) > 0 )
+        {
+            if ( m_connecting )
+            {
+                if ( pfd.revents & ( POLLOUT | POLLERR | POLLHUP ) )
+                {
+                    onConnectComplete();
+                }
+            }
+            else if ( pfd.revents & ( POLLIN | POLLERR | POLLHUP ) )
+            {
+                readIncoming();
+            }
+        }
+    }
+
+    tick( uint32_t( getTimeInMilliseconds() / 1000 ) );
+    bool r = getStates()->getStateId() != ApcStates::StateNone;
+
+    if ( isConnected() && getPendingOctets() > 0 )
+    {
+        if ( !writeBatch( false ) )
+        {
+            r = run();
+        }
+    }
+    return r;
+}
+
+void ApcClient::closeTcpConnection() { closeSocket(); }
+
+void ApcClient::connectToProxy( std::string const &addr )
+{
+    closeSocket();
+
+    // Split "host:port", allowing "[v6addr]:port"
+    std::string host;
+    std::string port;
+    std::string::size_type colon = addr.rfind( ':' );
+    if ( colon != std::string::npos )
+    {
+        host = addr.substr( 0, colon );
+        port = addr.substr( colon + 1 );
+    }
+    if ( host.size() >= 2 && host[0] == '[' && host[host.size() - 1] == ']' )
+    {
+        host = host.substr( 1, host.size() - 2 );
+    }
+
+    addrinfo hints;
+    addrinfo *ai = 0;
+    memset( &hints, 0, sizeof( hints ) );
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if ( host.empty() || port.empty() || ::getaddrinfo( host.c_str(), port.c_str(), &hints, &ai ) != 0 )
+    {
+        // WaitForConnect only leaves on finish or connect
+        getVariables()->m_finished = true;
+        return;
+    }
+
+    for ( addrinfo *p = ai; p && m_fd < 0; p = p->ai_next )
+    {
+        m_fd = ::socket( p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol );
+        if ( m_fd >= 0 )
+        {
+            if ( ::connect( m_fd, p->ai_addr, p->ai_addrlen ) == 0 || errno == EINPROGRESS )
+            {
+                // Completion is reported by poll() in either case
+                m_connecting = true;
+            }
+            else
+            {
+                ::close( m_fd );
+                m_fd = -1;
+            }
+        }
+    }
+    ::freeaddrinfo( ai );
+
+    if ( m_fd < 0 )
+    {
+        getVariables()->m_finished = true;
+    }
+}
+
+void ApcClient::sendTcpData( uint8_t const *data, ssize_t len )
+{
+    if ( !isConnected() || len <= 0 )
+    {
+        ++m_dropped_count;
+        return;
+    }
+
+    if ( getPendingOctets() + size_t( len ) > m_max_batch_octets )
+    {
+        // More messages are on the way, so let the kernel coalesce
+        writeBatch( true );
+
+        if ( !isConnected() || getPendingOctets() + size_t( len ) > m_max_batch_octets )
+        {
+            ++m_dropped_count;
+            return;
+        }
+    }
+
+    if ( m_batch_pos > 0 && m_batch.size() + size_t( len ) > m_batch.capacity() )
+    {
+        m_batch.erase( m_batch.begin(), m_batch.begin() + m_batch_pos );
+        m_batch_pos = 0;
+    }
+    m_batch.insert( m_batch.end(), data, data + len );
+}
+
+void ApcClient::onConnectComplete()
+{
+    int err = 0;
+    socklen_t err_len = sizeof( err );
+    if ( ::getsockopt( m_fd, SOL_SOCKET, SO_ERROR, &err, &err_len ) != 0 || err != 0 )
+    {
+        closeSocket();
+        getVariables()->m_finished = true;
+        return;
+    }
+
+    m_connecting = false;
+
+    // Batching already avoids small writes; don't let Nagle delay the
+    // last segment of a batch waiting for an ACK
+    int on = 1;
+    ::setsockopt( m_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+
+    getEvents()->onIncomingTcpConnection();
+}
+
+void ApcClient::readIncoming()
+{
+    while ( m_fd >= 0 )
+    {
+        ssize_t len = ::recv( m_fd, &m_read_buf[0], m_read_buf.size(), 0 );
+        if ( len > 0 )
+        {
+            if ( onIncomingTcpData( &m_read_buf[0], len ) < 0 )
+            {
+                onSocketFailed();
+            }
+        }
+        else if ( len < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        else if ( len < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+        {
+            break;
+        }
+        else
+        {
+            onSocketFailed();
+        }
+    }
+}
+
+bool ApcClient::writeBatch( bool more )
+{
+    int flags = MSG_NOSIGNAL;
+#ifdef MSG_MORE
+    if ( more )
+    {
+        flags |= MSG_MORE;
+    }
+#endif
+
+    while ( isConnected() && m_batch_pos < m_batch.size() )
+    {
+        ssize_t len = ::send( m_fd, &m_batch[m_batch_pos], m_batch.size() - m_batch_pos, flags );
+        if ( len > 0 )
+        {
+            m_batch_pos += size_t( len );
+        }
+        else if ( len < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        else if ( len < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+        {
+            break;
+        }
+        else
+        {
+            onSocketFailed();
+            return false;
+        }
+    }
+
+    if ( m_batch_pos == m_batch.size() )
+    {
+        m_batch.clear();
+        m_batch_pos = 0;
+    }
+    return m_fd >= 0;
+}
+
+void ApcClient::closeSocket()
+{
+    if ( m_fd >= 0 )
+    {
+        ::close( m_fd );
+        m_fd = -1;
+    }
+    m_connecting = false;
+    m_batch.clear();
+    m_batch_pos = 0;
+}
+
+void ApcClient::onSocketFailed()
+{
+    closeSocket();
+    getEvents()->onTcpConnectionClosed();
+
+    // The Connected state only leaves on an HTTP response, so treat a
+    // connection lost before the response as a rejected request
+    if ( !getVariables()->m_responseReceived )
+    {
+        getVariables()->m_responseReceived = true;
+        getVariables()->m_responseValid = false;
+    }
+}
+}
+
+#endif
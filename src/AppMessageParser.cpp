@@ -106,6 +106,78 @@ int AppMessageParser::parse( uint8_t octet )
     return r;
 }
 
+int AppMessageParser::parse( uint8_t const *data, size_t len )
+{
+    size_t pos = 0;
+
+    while ( pos < len && m_error_count == 0 )
+    {
+        if ( m_header_buffer.getLength() == 0 && len - pos >= JDKSAVDECC_APPDU_HEADER_LEN )
+        {
+            // At a message boundary with a whole header in the block, read
+            // the header in place
+            loadHeader( data + pos );
+            AppMessage *msg = validateHeader();
+            if ( m_error_count > 0 )
+            {
+                break;
+            }
+            pos += JDKSAVDECC_APPDU_HEADER_LEN;
+
+            if ( msg )
+            {
+                // A message without payload
+                dispatchMsg( *msg );
+            }
+            else if ( len - pos >= m_octets_left_in_payload )
+            {
+                // The payload is in the block too, dispatch it as a view
+                uint16_t payload_length = uint16_t( m_octets_left_in_payload );
+                m_current_message.setPayloadView( data + pos, payload_length );
+                m_octets_left_in_payload = 0;
+                pos += payload_length;
+                dispatchMsg( m_current_message );
+                m_current_message.clearPayloadView();
+            }
+            else
+            {
+                // The payload continues in the next block, accumulate it
+                m_header_buffer.putBuf( data + pos - JDKSAVDECC_APPDU_HEADER_LEN, JDKSAVDECC_APPDU_HEADER_LEN );
+            }
+        }
+        else if ( m_header_buffer.canPut() )
+        {
+            // A header straddling the blocks
+            parse( data[pos++] );
+        }
+        else if ( m_octets_left_in_payload )
+        {
+            // The rest of a payload that started in an earlier block
+            jdksavdecc_appdu *p = &m_current_message.m_appdu.base;
+            size_t n = len - pos;
+            if ( n > m_octets_left_in_payload )
+            {
+                n = m_octets_left_in_payload;
+            }
+            memcpy( p->payload + p->payload_length, data + pos, n );
+            p->payload_length += uint16_t( n );
+            m_octets_left_in_payload -= n;
+            pos += n;
+            if ( m_octets_left_in_payload == 0 )
+            {
+                m_header_buffer.clear();
+                dispatchMsg( m_current_message );
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return m_error_count > 0 ? -1 : 0;
+}
+
 AppMessage *AppMessageParser::parseHeader( uint8_t octet )
 {
     AppMessage *msg = 0;
@@ -117,24 +189,28 @@ AppMessage *AppMessageParser::parseHeader( uint8_t octet )
     if ( m_header_buffer.isFull() )
     {
         // yes, try parse the header
+        loadHeader( m_header_buffer.getBuf() );
 
-        jdksavdecc_appdu *p = &m_current_message.m_appdu.base;
+        // and validate the header
+        msg = validateHeader();
+    }
 
-        p->version = m_header_buffer.getOctet( JDKSAVDECC_APPDU_OFFSET_VERSION );
+    return msg;
+}
 
-        p->message_type = m_header_buffer.getOctet( JDKSAVDECC_APPDU_OFFSET_MESSAGE_TYPE );
+void AppMessageParser::loadHeader( uint8_t const *header )
+{
+    jdksavdecc_appdu *p = &m_current_message.m_appdu.base;
 
-        p->payload_length = m_header_buffer.getDoublet( JDKSAVDECC_APPDU_OFFSET_PAYLOAD_LENGTH );
+    p->version = header[JDKSAVDECC_APPDU_OFFSET_VERSION];
 
-        p->address = m_header_buffer.getEUI48( JDKSAVDECC_APPDU_OFFSET_ADDRESS );
+    p->message_type = header[JDKSAVDECC_APPDU_OFFSET_MESSAGE_TYPE];
 
-        p->reserved = m_header_buffer.getDoublet( JDKSAVDECC_APPDU_OFFSET_RESERVED );
+    p->payload_length = jdksavdecc_uint16_get( header, JDKSAVDECC_APPDU_OFFSET_PAYLOAD_LENGTH );
 
-        // and validate the header
-        msg = validateHeader();
-    }
+    p->address = jdksavdecc_eui48_get( header, JDKSAVDECC_APPDU_OFFSET_ADDRESS );
 
-    return msg;
+    p->reserved = jdksavdecc_uint16_get( header, JDKSAVDECC_APPDU_OFFSET_RESERVED );
 }
 
 AppMessage *AppMessageParser::validateHeader()
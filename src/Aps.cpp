@@ -35,22 +35,136 @@
 namespace JDKSAvdeccMCU
 {
 
+ApsEntityIdAllocator::ApsEntityIdAllocator( uint16_t last_index )
+    : m_active_count( 0 )
+    , m_last_index_value( last_index )
+    , m_next( size_t( last_index ) + 1 )
+    , m_prev( size_t( last_index ) + 1 )
+    , m_in_use( ( size_t( last_index ) + 64 ) / 64 )
+    , m_last_apc( size_t( last_index ) + 1 )
+{
+    m_last_index.reserve( last_index );
+
+    // Start with all indexes in order on the free list
+    for ( size_t i = 0; i <= last_index; ++i )
+    {
+        m_next[i] = uint16_t( i == last_index ? 0 : i + 1 );
+        m_prev[i] = uint16_t( i == 0 ? last_index : i - 1 );
+    }
+}
+
+uint16_t ApsEntityIdAllocator::allocate( Eui48 server_link_mac, Eui48 apc_link_mac, Eui64 requested_entity_id )
+{
+    lock_type lock( m_mutex );
+    uint64_t apc = apc_link_mac.convertToUint64();
+
+    // Prefer the entity_id that the APC asks for, then the one it had last
+    uint16_t index = getIndex( server_link_mac, requested_entity_id );
+    if ( index == 0 || index > m_last_index_value || isActiveLocked( index ) )
+    {
+        std::unordered_map<uint64_t, uint16_t>::const_iterator last = m_last_index.find( apc );
+        index = ( last != m_last_index.end() ) ? last->second : 0;
+    }
+    if ( index == 0 || isActiveLocked( index ) )
+    {
+        // The least recently released index
+        index = m_next[0];
+        if ( index == 0 )
+        {
+            return 0;
+        }
+    }
+
+    unlink( index );
+    m_in_use[index >> 6] |= uint64_t( 1 ) << ( index & 0x3f );
+    ++m_active_count;
+    rememberApc( apc, index );
+    return index;
+}
+
+void ApsEntityIdAllocator::rememberApc( uint64_t apc, uint16_t index )
+{
+    uint64_t previous_apc = m_last_apc[index];
+    if ( previous_apc != apc )
+    {
+        std::unordered_map<uint64_t, uint16_t>::iterator previous = m_last_index.find( previous_apc );
+        if ( previous != m_last_index.end() && previous->second == index )
+        {
+            m_last_index.erase( previous );
+        }
+        m_last_apc[index] = apc;
+    }
+    m_last_index[apc] = index;
+}
+
+void ApsEntityIdAllocator::release( uint16_t index )
+{
+    lock_type lock( m_mutex );
+    if ( index != 0 && index <= m_last_index_value && isActiveLocked( index ) )
+    {
+        m_in_use[index >> 6] &= ~( uint64_t( 1 ) << ( index & 0x3f ) );
+        --m_active_count;
+        append( index );
+    }
+}
+
+void ApsEntityIdAllocator::unlink( uint16_t index )
+{
+    m_next[m_prev[index]] = m_next[index];
+    m_prev[m_next[index]] = m_prev[index];
+}
+
+void ApsEntityIdAllocator::append( uint16_t index )
+{
+    uint16_t last = m_prev[0];
+    m_next[last] = index;
+    m_prev[index] = last;
+    m_next[index] = 0;
+    m_prev[0] = index;
+}
+
+Eui64 ApsEntityIdAllocator::makeEntityId( Eui48 server_link_mac, uint16_t index )
+{
+    Eui64 r;
+    r.value[0] = server_link_mac.value[0];
+    r.value[1] = server_link_mac.value[1];
+    r.value[2] = server_link_mac.value[2];
+    r.value[3] = uint8_t( ( index >> 8 ) & 0xff );
+    r.value[4] = uint8_t( ( index >> 0 ) & 0xff );
+    r.value[5] = server_link_mac.value[3];
+    r.value[6] = server_link_mac.value[4];
+    r.value[7] = server_link_mac.value[5];
+    return r;
+}
+
+uint16_t ApsEntityIdAllocator::getIndex( Eui48 server_link_mac, Eui64 entity_id )
+{
+    uint16_t r = 0;
+    if ( entity_id.value[0] == server_link_mac.value[0] && entity_id.value[1] == server_link_mac.value[1]
+         && entity_id.value[2] == server_link_mac.value[2] && entity_id.value[5] == server_link_mac.value[3]
+         && entity_id.value[6] == server_link_mac.value[4] && entity_id.value[7] == server_link_mac.value[5] )
+    {
+        r = uint16_t( ( entity_id.value[3] << 8 ) | entity_id.value[4] );
+    }
+    return r;
+}
+
 ApsStateMachine::ApsStateMachine( ApsStateVariables *variables,
                                   ApsStateActions *actions,
                                   ApsStateEvents *events,
                                   ApsStates *states,
-                                  uint16_t &active_entity_id_count,
-                                  active_connections_type &active_connections )
+                                  ApsEntityIdAllocator &entity_id_allocator )
     : m_variables( variables )
     , m_actions( actions )
     , m_events( events )
     , m_states( states )
-    , m_active_entity_id_count( active_entity_id_count )
-    , m_active_connections( active_connections )
+    , m_assigned_index( 0 )
+    , m_entity_id_allocator( entity_id_allocator )
+    , m_table_driven( false )
 {
 }
 
-ApsStateMachine::~ApsStateMachine() {}
+ApsStateMachine::~ApsStateMachine() { m_entity_id_allocator.release( m_assigned_index ); }
 
 void ApsStateMachine::setup() { clear(); }
 
@@ -70,7 +184,11 @@ void ApsStateMachine::onTcpConnectionClosed() { m_events->onTcpConnectionClosed(
 
 void ApsStateMachine::onTimeTick( uint32_t time_in_seconds ) { getEvents()->onTimeTick( time_in_seconds ); }
 
-void ApsStateMachine::closeTcpConnection() { m_active_connections.erase( m_assigned_count ); }
+void ApsStateMachine::closeTcpConnection()
+{
+    m_entity_id_allocator.release( m_assigned_index );
+    m_assigned_index = 0;
+}
 
 void ApsStateMachine::closeTcpServer() {}
 
@@ -78,9 +196,37 @@ ssize_t ApsStateMachine::onIncomingTcpData( const uint8_t *data, ssize_t len ) {
 
 void ApsStateMachine::sendTcpData( const uint8_t *data, ssize_t len ) {}
 
+void ApsStateMachine::sendMsgToApc( const AppMessage &msg )
+{
+    FixedBufferWithSize<JDKSAVDECC_APPDU_HEADER_LEN + JDKSAVDECC_APPDU_MAX_PAYLOAD_LENGTH> msg_as_octets;
+    if ( msg.store( &msg_as_octets ) )
+    {
+        sendTcpData( msg_as_octets.getBuf(), msg_as_octets.getLength() );
+    }
+}
+
 void ApsStateMachine::sendAvdeccToL2( Frame const &frame ) {}
 
-void ApsStateMachine::onNetAvdeccMessageReceived( const Frame &frame ) { getEvents()->onNetAvdeccMessageReceived( frame ); }
+void ApsStateMachine::onNetAvdeccMessageReceived( const Frame &frame )
+{
+    ApsEvent event( ApsEvent::NetAvdeccMessage );
+    event.m_frame = &frame;
+    if ( !dispatch( event ) )
+    {
+        getEvents()->onNetAvdeccMessageReceived( frame );
+    }
+}
+
+void ApsStateMachine::tick( uint32_t time_in_seconds )
+{
+    ApsEvent event( ApsEvent::TimeTick );
+    event.m_time_in_seconds = time_in_seconds;
+    if ( !dispatch( event ) )
+    {
+        onTimeTick( time_in_seconds );
+        run();
+    }
+}
 
 void ApsStateMachine::onNetLinkStatusUpdated( Eui48 link_mac, bool link_status )
 {
@@ -89,27 +235,16 @@ void ApsStateMachine::onNetLinkStatusUpdated( Eui48 link_mac, bool link_status )
 
 Eui64 ApsStateMachine::assignEntityId( Eui48 server_link_mac, Eui48 apc_link_mac, Eui64 requested_entity_id )
 {
-    // increase our count of assigned entity_id's
-    ++m_active_entity_id_count;
+    // An APC that asks again gives up the entity_id it had
+    m_entity_id_allocator.release( m_assigned_index );
 
-    // loop and increment while this count still active
-    while ( m_active_connections.count( m_active_entity_id_count ) > 0 )
-    {
-        ++m_active_entity_id_count;
-    }
-
-    m_assigned_count = m_active_entity_id_count;
-    m_active_connections.insert( m_assigned_count );
+    m_assigned_index = m_entity_id_allocator.allocate( server_link_mac, apc_link_mac, requested_entity_id );
 
     Eui64 r;
-    r.value[0] = server_link_mac.value[0];
-    r.value[1] = server_link_mac.value[1];
-    r.value[2] = server_link_mac.value[2];
-    r.value[3] = uint8_t( ( m_active_entity_id_count >> 8 ) & 0xff );
-    r.value[4] = uint8_t( ( m_active_entity_id_count >> 0 ) & 0xff );
-    r.value[5] = server_link_mac.value[3];
-    r.value[6] = server_link_mac.value[4];
-    r.value[7] = server_link_mac.value[5];
+    if ( m_assigned_index != 0 )
+    {
+        r = ApsEntityIdAllocator::makeEntityId( server_link_mac, m_assigned_index );
+    }
     return r;
 }
 
@@ -200,11 +335,11 @@ bool ApsStateEvents::onIncomingHttpConnectRequest( const HttpRequest &request )
 
 ssize_t ApsStateEvents::onIncomingTcpAppData( const uint8_t *data, ssize_t len )
 {
-    ssize_t r = 0;
+    ssize_t r = -1;
 
-    for ( ssize_t r = 0; r < len; ++r )
+    if ( m_app_parser.parse( data, size_t( len ) ) == 0 )
     {
-        m_app_parser.parse( data[r] );
+        r = len;
     }
 
     return r;
@@ -226,6 +361,10 @@ void ApsStateEvents::onNetAvdeccMessageReceived( const Frame &frame )
 {
     getVariables()->m_in.setAvdeccFromAps( frame );
     getVariables()->m_L2Msg = true;
+
+    // Run the state machine now so that the message is handed to the APC
+    // before another frame overwrites m_in
+    getOwner()->run();
 }
 
 void ApsStateEvents::onTimeTick( uint32_t time_in_seconds ) { getVariables()->m_currentTime = time_in_seconds; }
@@ -237,10 +376,13 @@ void ApsStateEvents::onAppNop( const AppMessage &msg )
 
 void ApsStateEvents::onAppEntityIdRequest( const AppMessage &msg )
 {
+    getVariables()->m_a = msg.getAddress();
     getVariables()->m_entity_id = msg.getEntityIdRequestEntityId();
     getVariables()->m_assignEntityIdRequest = true;
 
-    // TODO: assign proper entity_id
+    // Several messages may be parsed from one block of TCP data, so run the
+    // state machine now before the next message overwrites the request
+    getOwner()->run();
 }
 
 void ApsStateEvents::onAppEntityIdResponse( const AppMessage &msg )
@@ -265,8 +407,19 @@ void ApsStateEvents::onAppAvdeccFromAps( const AppMessage &msg )
 
 void ApsStateEvents::onAppAvdeccFromApc( const AppMessage &msg )
 {
+    ApsEvent event( ApsEvent::AppAvdeccFromApc );
+    event.m_msg = &msg;
+    if ( getOwner()->dispatch( event ) )
+    {
+        return;
+    }
+
     getVariables()->m_out = msg;
     getVariables()->m_apcMsg = true;
+
+    // Several messages may be parsed from one block of TCP data, so run the
+    // state machine now before the next message overwrites m_out
+    getOwner()->run();
 }
 
 void ApsStateEvents::onAppVendor( const AppMessage &msg )
@@ -298,6 +451,7 @@ void ApsStateActions::sendHttpResponse( int requestValid )
     char statusbuf[16];
     HttpResponse response;
 
+    response.m_reason_phrase = "OK";
     if ( requestValid < 0 )
     {
         requestValid = 404;
@@ -310,22 +464,16 @@ void ApsStateActions::sendHttpResponse( int requestValid )
 #endif
     response.m_version = "HTTP/1.1";
     response.m_status_code = statusbuf;
-    response.m_reason_phrase = "OK";
 
-    std::vector<uint8_t> buf;
-    response.flatten( &buf );
+    // The short fields fit in the strings' own storage, so with a stack
+    // buffer the whole response is formed without touching the heap
+    uint8_t buf[128];
+    size_t len = response.flatten( buf, sizeof( buf ) );
 
-    getEvents()->sendTcpData( buf.data(), buf.size() );
+    getEvents()->sendTcpData( buf, len );
 }
 
-void ApsStateActions::sendMsgToApc( const AppMessage &apsMsg )
-{
-    FixedBufferWithSize<1500> msg_as_octets;
-    if ( apsMsg.store( &msg_as_octets ) )
-    {
-        getEvents()->sendTcpData( msg_as_octets.getBuf(), msg_as_octets.getLength() );
-    }
-}
+void ApsStateActions::sendMsgToApc( const AppMessage &apsMsg ) { getOwner()->sendMsgToApc( apsMsg ); }
 
 void ApsStateActions::sendLinkStatus( Eui48 link_mac, bool linkStatus )
 {
@@ -392,6 +540,7 @@ void ApsStateVariables::clear()
 void ApsStates::clear()
 {
     m_current_state = &ApsStates::doBegin;
+    m_state_id = StateBegin;
 
     getVariables()->m_tcpConnected = false;
     getVariables()->m_incomingTcpClosed = false;
@@ -432,6 +581,7 @@ void ApsStates::doBegin() { goToInitialize(); }
 void ApsStates::goToInitialize()
 {
     m_current_state = &ApsStates::doInitialize;
+    m_state_id = StateInitialize;
     getActions()->initialize();
 }
 
@@ -440,6 +590,7 @@ void ApsStates::doInitialize() { goToWaitForConnect(); }
 void ApsStates::goToWaitForConnect()
 {
     m_current_state = &ApsStates::doWaitForConnect;
+    m_state_id = StateWaitForConnect;
     getVariables()->m_tcpConnected = false;
     getVariables()->m_incomingTcpClosed = false;
 }
@@ -459,6 +610,7 @@ void ApsStates::doWaitForConnect()
 void ApsStates::goToAccept()
 {
     m_current_state = &ApsStates::doAccept;
+    m_state_id = StateAccept;
     getVariables()->m_requestValid = -1;
 }
 
@@ -479,12 +631,17 @@ void ApsStates::doAccept()
 void ApsStates::goToReject()
 {
     m_current_state = &ApsStates::doReject;
+    m_state_id = StateReject;
     getActions()->sendHttpResponse( getVariables()->m_requestValid );
 }
 
 void ApsStates::doReject() { goToClosed(); }
 
-void ApsStates::goToClosed() { m_current_state = &ApsStates::doClosed; }
+void ApsStates::goToClosed()
+{
+    m_current_state = &ApsStates::doClosed;
+    m_state_id = StateClosed;
+}
 
 void ApsStates::doClosed()
 {
@@ -495,6 +652,7 @@ void ApsStates::doClosed()
 void ApsStates::goToStartTransfer()
 {
     m_current_state = &ApsStates::doStartTransfer;
+    m_state_id = StateStartTransfer;
 
     getActions()->sendHttpResponse( getVariables()->m_requestValid );
 
@@ -505,7 +663,11 @@ void ApsStates::goToStartTransfer()
 
 void ApsStates::doStartTransfer() { goToWaiting(); }
 
-void ApsStates::goToWaiting() { m_current_state = &ApsStates::doWaiting; }
+void ApsStates::goToWaiting()
+{
+    m_current_state = &ApsStates::doWaiting;
+    m_state_id = StateWaiting;
+}
 
 void ApsStates::doWaiting()
 {
@@ -542,6 +704,7 @@ void ApsStates::doWaiting()
 void ApsStates::goToLinkStatus()
 {
     m_current_state = &ApsStates::doLinkStatus;
+    m_state_id = StateLinkStatus;
 
     getActions()->sendLinkStatus( getVariables()->m_linkMac, getVariables()->m_linkStatus );
 
@@ -555,6 +718,7 @@ void ApsStates::doLinkStatus() { goToWaiting(); }
 void ApsStates::goToTransferToL2()
 {
     m_current_state = &ApsStates::doTransferToL2;
+    m_state_id = StateTransferToL2;
     getActions()->sendAvdeccToL2( &getVariables()->m_out );
     getVariables()->m_apcMsg = false;
 }
@@ -564,6 +728,7 @@ void ApsStates::doTransferToL2() { goToWaiting(); }
 void ApsStates::goToTransferToApc()
 {
     m_current_state = &ApsStates::doTransferToApc;
+    m_state_id = StateTransferToApc;
     getActions()->sendAvdeccToApc( &getVariables()->m_in );
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
     getVariables()->m_L2Msg = false;
@@ -574,6 +739,7 @@ void ApsStates::doTransferToApc() { goToWaiting(); }
 void ApsStates::goToAssignEntityId()
 {
     m_current_state = &ApsStates::doAssignEntityId;
+    m_state_id = StateAssignEntityId;
     getActions()->sendEntityIdAssignment( getVariables()->m_a, getVariables()->m_entity_id );
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
     getVariables()->m_assignEntityIdRequest = false;
@@ -584,6 +750,7 @@ void ApsStates::doAssignEntityId() { goToWaiting(); }
 void ApsStates::goToSendNop()
 {
     m_current_state = &ApsStates::doSendNop;
+    m_state_id = StateSendNop;
     getActions()->sendNopToApc();
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
 }
@@ -593,6 +760,7 @@ void ApsStates::doSendNop() { goToWaiting(); }
 void ApsStates::goToCloseAndFinish()
 {
     m_current_state = &ApsStates::doCloseAndFinish;
+    m_state_id = StateCloseAndFinish;
     getActions()->closeTcpConnection();
 }
 
@@ -601,14 +769,68 @@ void ApsStates::doCloseAndFinish() { goToFinish(); }
 void ApsStates::goToFinish()
 {
     m_current_state = &ApsStates::doFinish;
+    m_state_id = StateFinish;
     getActions()->closeTcpServer();
 }
 
-void ApsStates::doFinish() { m_current_state = 0; }
+void ApsStates::doFinish()
+{
+    m_current_state = 0;
+    m_state_id = StateNone;
+}
 
 ApsStates::ApsStates()
     : m_owner( 0 ),
-    m_current_state( &ApsStates::doBegin )
+    m_current_state( &ApsStates::doBegin ),
+    m_state_id( StateBegin )
 {}
 
+void ApsStates::transferToApc( ApsStateMachine &owner, const ApsEvent &event )
+{
+    // As goToTransferToApc() followed by doTransferToApc()
+    ApsStateVariables *v = owner.getVariables();
+    v->m_in.setAvdeccFromAps( *event.m_frame );
+    owner.getActions()->sendMsgToApc( v->m_in );
+    v->m_nopTimeout = v->m_currentTime + 10;
+}
+
+void ApsStates::transferToL2( ApsStateMachine &owner, const ApsEvent &event )
+{
+    // As goToTransferToL2() followed by doTransferToL2(), without copying
+    // the message into m_out
+    owner.getActions()->sendAvdeccToL2( event.m_msg );
+}
+
+void ApsStates::timeTickWhileWaiting( ApsStateMachine &owner, const ApsEvent &event )
+{
+    // As onTimeTick() followed by the doWaiting() test for the NOP timeout
+    ApsStateVariables *v = owner.getVariables();
+    v->m_currentTime = event.m_time_in_seconds;
+    if ( ( (int)v->m_nopTimeout - (int)v->m_currentTime ) < 0 )
+    {
+        owner.getActions()->sendNopToApc();
+        v->m_nopTimeout = v->m_currentTime + 10;
+    }
+}
+
+const ApsStates::transition_proc ApsStates::transition_table[ApsStates::StateCount][ApsEvent::Count] = {
+    // NetAvdeccMessage, AppAvdeccFromApc, TimeTick
+    {0, 0, 0}, // StateNone
+    {0, 0, 0}, // StateBegin
+    {0, 0, 0}, // StateInitialize
+    {0, 0, 0}, // StateWaitForConnect
+    {0, 0, 0}, // StateAccept
+    {0, 0, 0}, // StateReject
+    {0, 0, 0}, // StateClosed
+    {0, 0, 0}, // StateStartTransfer
+    {&ApsStates::transferToApc, &ApsStates::transferToL2, &ApsStates::timeTickWhileWaiting}, // StateWaiting
+    {0, 0, 0}, // StateLinkStatus
+    {0, 0, 0}, // StateTransferToL2
+    {0, 0, 0}, // StateTransferToApc
+    {0, 0, 0}, // StateAssignEntityId
+    {0, 0, 0}, // StateSendNop
+    {0, 0, 0}, // StateCloseAndFinish
+    {0, 0, 0}  // StateFinish
+};
+
 }
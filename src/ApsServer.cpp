@@ -0,0 +1,914 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/ApsServer.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_APSSERVER
+
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+namespace JDKSAvdeccMCU
+{
+
+ApsOutboundQueue::ApsOutboundQueue( size_t max_messages, size_t max_octets )
+    : m_slots( max_messages * 2 )
+    , m_max_messages( max_messages )
+    , m_max_octets( max_octets )
+    , m_head( 0 )
+    , m_count( 0 )
+    , m_head_pos( 0 )
+    , m_octets( 0 )
+    , m_dropped_count( 0 )
+{
+}
+
+ApsOutboundQueue::Priority ApsOutboundQueue::classify( AppMessage const &msg )
+{
+    Priority r = PriorityKeep;
+
+    if ( msg.getMessageType() == AppMessage::AVDECC_FROM_APS && msg.getPayloadLength() >= 2 )
+    {
+        uint8_t const *payload = msg.getPayload();
+        uint8_t subtype = payload[0] & 0x7f;
+
+        if ( subtype == JDKSAVDECC_SUBTYPE_ADP )
+        {
+            r = PriorityAdp;
+        }
+        else if ( subtype == JDKSAVDECC_SUBTYPE_AECP && ( payload[1] & 1 ) != 0 )
+        {
+            // All AECP response message types are odd
+            r = PriorityKeep;
+        }
+        else
+        {
+            r = PriorityDroppable;
+        }
+    }
+    return r;
+}
+
+bool ApsOutboundQueue::push( uint8_t const *data, size_t len, Priority priority )
+{
+    while ( m_count + 1 > m_max_messages || m_octets + len > m_max_octets )
+    {
+        if ( dropOldest( PriorityAdp ) )
+        {
+            continue;
+        }
+        if ( priority == PriorityAdp )
+        {
+            // Nothing older to make room with, drop the new advertisement
+            ++m_dropped_count;
+            return true;
+        }
+        if ( dropOldest( PriorityDroppable ) )
+        {
+            continue;
+        }
+        if ( priority == PriorityDroppable )
+        {
+            ++m_dropped_count;
+            return true;
+        }
+        // Messages that must be kept may go past the soft limits
+        break;
+    }
+
+    if ( m_count == m_slots.size() || m_octets + len > m_max_octets * 2 )
+    {
+        return false;
+    }
+
+    Slot &slot = at( m_count );
+    slot.m_data.assign( data, data + len );
+    slot.m_priority = priority;
+    ++m_count;
+    m_octets += len;
+    return true;
+}
+
+bool ApsOutboundQueue::dropOldest( Priority priority )
+{
+    // The partially written message at the front must be completed
+    for ( size_t i = ( m_head_pos > 0 ) ? 1 : 0; i < m_count; ++i )
+    {
+        if ( at( i ).m_priority == priority )
+        {
+            m_octets -= at( i ).m_data.size();
+
+            // Close the gap, swapping keeps each slot's storage allocated
+            for ( size_t j = i; j + 1 < m_count; ++j )
+            {
+                at( j ).m_data.swap( at( j + 1 ).m_data );
+                at( j ).m_priority = at( j + 1 ).m_priority;
+            }
+            --m_count;
+            at( m_count ).m_data.clear();
+            ++m_dropped_count;
+            return true;
+        }
+    }
+    return false;
+}
+
+int ApsOutboundQueue::fillIovecs( iovec *iov, int max_iov ) const
+{
+    int n = 0;
+    for ( size_t i = 0; i < m_count && n < max_iov; ++i )
+    {
+        Slot const &slot = at( i );
+        size_t offset = ( i == 0 ) ? m_head_pos : 0;
+        iov[n].iov_base = const_cast<uint8_t *>( slot.m_data.data() + offset );
+        iov[n].iov_len = slot.m_data.size() - offset;
+        ++n;
+    }
+    return n;
+}
+
+void ApsOutboundQueue::consume( size_t len )
+{
+    while ( len > 0 && m_count > 0 )
+    {
+        Slot &slot = at( 0 );
+        size_t remaining = slot.m_data.size() - m_head_pos;
+        if ( len < remaining )
+        {
+            m_head_pos += len;
+            m_octets -= len;
+            break;
+        }
+        len -= remaining;
+        m_octets -= remaining;
+        slot.m_data.clear();
+        m_head_pos = 0;
+        m_head = ( m_head + 1 ) % m_slots.size();
+        --m_count;
+    }
+}
+
+void ApsOutboundQueue::clear()
+{
+    while ( m_count > 0 )
+    {
+        consume( at( 0 ).m_data.size() - m_head_pos );
+    }
+    m_head = 0;
+}
+
+void ApsSubscriptionFilter::clear()
+{
+    m_all_subtypes = true;
+    m_subtypes[0] = 0;
+    m_subtypes[1] = 0;
+    m_entities.clear();
+    m_controllers.clear();
+}
+
+void ApsSubscriptionFilter::addSubtype( uint8_t subtype )
+{
+    subtype &= 0x7f;
+    m_all_subtypes = false;
+    m_subtypes[subtype >> 6] |= uint64_t( 1 ) << ( subtype & 0x3f );
+}
+
+void ApsSubscriptionFilter::addEntity( Eui64 const &entity_id )
+{
+    uint64_t v = entity_id.convertToUint64();
+    std::vector<uint64_t>::iterator i = std::lower_bound( m_entities.begin(), m_entities.end(), v );
+    if ( i == m_entities.end() || *i != v )
+    {
+        m_entities.insert( i, v );
+    }
+}
+
+void ApsSubscriptionFilter::addController( Eui64 const &controller_entity_id )
+{
+    uint64_t v = controller_entity_id.convertToUint64();
+    std::vector<uint64_t>::iterator i = std::lower_bound( m_controllers.begin(), m_controllers.end(), v );
+    if ( i == m_controllers.end() || *i != v )
+    {
+        m_controllers.insert( i, v );
+    }
+}
+
+ApsFrameKeys::ApsFrameKeys( Frame const &frame )
+    : m_subtype( 0 ), m_is_aecp_response( false ), m_entity_count( 0 ), m_controller_entity_id( 0 )
+{
+    uint8_t const *p = frame.getPayload();
+    uint16_t len = frame.getPayloadLength();
+
+    if ( len >= JDKSAVDECC_COMMON_CONTROL_HEADER_LEN )
+    {
+        m_subtype = p[0] & 0x7f;
+
+        m_entity_id[0] = jdksavdecc_uint64_get( p, JDKSAVDECC_COMMON_CONTROL_HEADER_OFFSET_STREAM_ID );
+        m_entity_id[1] = 0;
+
+        if ( m_subtype == JDKSAVDECC_SUBTYPE_ADP )
+        {
+            m_entity_count = 1;
+        }
+        else if ( m_subtype == JDKSAVDECC_SUBTYPE_AECP && len >= JDKSAVDECC_AECPDU_COMMON_LEN )
+        {
+            m_entity_count = 1;
+            // All AECP response message types are odd
+            m_is_aecp_response = ( p[1] & 1 ) != 0;
+            m_controller_entity_id = jdksavdecc_uint64_get( p, JDKSAVDECC_AECPDU_COMMON_OFFSET_CONTROLLER_ENTITY_ID );
+        }
+        else if ( m_subtype == JDKSAVDECC_SUBTYPE_ACMP && len >= JDKSAVDECC_ACMPDU_LEN )
+        {
+            m_entity_count = 2;
+            m_entity_id[0] = jdksavdecc_uint64_get( p, JDKSAVDECC_ACMPDU_OFFSET_TALKER_ENTITY_ID );
+            m_entity_id[1] = jdksavdecc_uint64_get( p, JDKSAVDECC_ACMPDU_OFFSET_LISTENER_ENTITY_ID );
+            m_controller_entity_id = jdksavdecc_uint64_get( p, JDKSAVDECC_ACMPDU_OFFSET_CONTROLLER_ENTITY_ID );
+        }
+    }
+}
+
+void ApsSubscriptionTable::add( ApsServerSession *session )
+{
+    std::vector<uint64_t> const &entities = session->getFilter().getEntities();
+    if ( entities.empty() )
+    {
+        m_any_entity.push_back( session );
+    }
+    else
+    {
+        for ( size_t i = 0; i < entities.size(); ++i )
+        {
+            m_by_entity[entities[i]].push_back( session );
+        }
+    }
+}
+
+void ApsSubscriptionTable::remove( ApsServerSession *session )
+{
+    std::vector<uint64_t> const &entities = session->getFilter().getEntities();
+    if ( entities.empty() )
+    {
+        removeFromList( m_any_entity, session );
+    }
+    else
+    {
+        for ( size_t i = 0; i < entities.size(); ++i )
+        {
+            std::unordered_map<uint64_t, sessions_type>::iterator item = m_by_entity.find( entities[i] );
+            if ( item != m_by_entity.end() )
+            {
+                removeFromList( item->second, session );
+                if ( item->second.empty() )
+                {
+                    m_by_entity.erase( item );
+                }
+            }
+        }
+    }
+}
+
+void ApsSubscriptionTable::removeFromList( sessions_type &sessions, ApsServerSession *session )
+{
+    sessions_type::iterator i = std::find( sessions.begin(), sessions.end(), session );
+    if ( i != sessions.end() )
+    {
+        *i = sessions.back();
+        sessions.pop_back();
+    }
+}
+
+void ApsSubscriptionTable::match( ApsFrameKeys const &keys, std::vector<ApsServerSession *> &result )
+{
+    result.clear();
+    ++m_generation;
+
+    matchList( m_any_entity, keys, result );
+
+    if ( !m_by_entity.empty() )
+    {
+        for ( uint8_t i = 0; i < keys.m_entity_count; ++i )
+        {
+            std::unordered_map<uint64_t, sessions_type>::const_iterator item = m_by_entity.find( keys.m_entity_id[i] );
+            if ( item != m_by_entity.end() )
+            {
+                matchList( item->second, keys, result );
+            }
+        }
+    }
+}
+
+void ApsSubscriptionTable::matchList( sessions_type const &sessions,
+                                      ApsFrameKeys const &keys,
+                                      std::vector<ApsServerSession *> &result )
+{
+    for ( size_t i = 0; i < sessions.size(); ++i )
+    {
+        ApsServerSession *session = sessions[i];
+        if ( session->m_match_generation != m_generation )
+        {
+            ApsSubscriptionFilter const &filter = session->getFilter();
+
+            session->m_match_generation = m_generation;
+            if ( filter.matchesSubtype( keys.m_subtype )
+                 && ( !keys.m_is_aecp_response || filter.matchesController( keys.m_controller_entity_id ) ) )
+            {
+                result.push_back( session );
+            }
+        }
+    }
+}
+
+ApsServerSession::ApsServerSession( ApsServer &server,
+                                    ApsServerLink &link,
+                                    int fd,
+                                    std::string const &path,
+                                    ApsEntityIdAllocator &entity_id_allocator )
+    : ApsStateMachine( &m_state_variables, &m_state_actions, &m_state_events, &m_state_states, entity_id_allocator )
+    , m_link_index( 0 )
+    , m_flush_scheduled( false )
+    , m_match_generation( 0 )
+    , m_server( server )
+    , m_link( link )
+    , m_fd( fd )
+    , m_closing( false )
+    , m_want_write( false )
+    , m_queue( server.getMaxPendingMessages(), server.getMaxPendingOctets() )
+    , m_state_events( &m_http_parser, path )
+    , m_http_parser( &m_http_request, &m_state_events, false )
+{
+    setTableDriven( true );
+}
+
+ApsServerSession::~ApsServerSession()
+{
+    if ( m_fd >= 0 )
+    {
+        ::close( m_fd );
+    }
+}
+
+void ApsServerSession::start()
+{
+    setup();
+
+    // Run the state machine to get it to the WaitForConnect state, which
+    // clears the link status
+    run();
+
+    getVariables()->m_linkMac = m_link.getRawSocket()->getMACAddress();
+    getVariables()->m_linkStatus = m_link.getLinkStatus();
+
+    onIncomingTcpConnection();
+    run();
+}
+
+void ApsServerSession::onPollEvents( uint32_t events )
+{
+    if ( !m_closing && ( events & EPOLLOUT ) )
+    {
+        flushQueue();
+    }
+    if ( !m_closing && ( events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) ) )
+    {
+        readIncoming();
+    }
+}
+
+void ApsServerSession::readIncoming()
+{
+    uint8_t *buf = m_server.getReadBuffer();
+    ssize_t len = ::recv( m_fd, buf, ApsServer::read_buffer_size, 0 );
+
+    if ( len > 0 )
+    {
+        if ( onIncomingTcpData( buf, len ) < 0 )
+        {
+            // Protocol error from the APC
+            closeTcpConnection();
+        }
+        else
+        {
+            run();
+        }
+    }
+    else if ( len == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) )
+    {
+        // The APC closed the connection or the socket failed
+        onTcpConnectionClosed();
+        run();
+
+        // The state machine only notices the close once the transfer
+        // started, so make sure the session goes away regardless
+        markClosing();
+    }
+}
+
+void ApsServerSession::sendTcpData( uint8_t const *data, ssize_t len )
+{
+    if ( len > 0 )
+    {
+        queue( data, size_t( len ), ApsOutboundQueue::PriorityKeep );
+    }
+}
+
+void ApsServerSession::sendMsgToApc( AppMessage const &msg )
+{
+    FixedBufferWithSize<JDKSAVDECC_APPDU_HEADER_LEN + JDKSAVDECC_APPDU_MAX_PAYLOAD_LENGTH> msg_as_octets;
+    if ( msg.store( &msg_as_octets ) )
+    {
+        queue( msg_as_octets.getBuf(), msg_as_octets.getLength(), ApsOutboundQueue::classify( msg ) );
+    }
+}
+
+void ApsServerSession::queue( uint8_t const *data, size_t len, ApsOutboundQueue::Priority priority )
+{
+    if ( m_closing )
+    {
+        return;
+    }
+
+    if ( !m_queue.push( data, len, priority ) )
+    {
+        // The APC fell too far behind to keep up with responses
+        closeTcpConnection();
+        return;
+    }
+
+    // While the socket is known to be full, wait for EPOLLOUT instead
+    if ( !m_flush_scheduled && !m_want_write )
+    {
+        m_flush_scheduled = true;
+        m_server.scheduleFlush( this );
+    }
+}
+
+void ApsServerSession::flushQueue()
+{
+    iovec iov[ApsServer::max_iovecs_per_send];
+
+    while ( !m_queue.isEmpty() )
+    {
+        msghdr msg;
+        memset( &msg, 0, sizeof( msg ) );
+        msg.msg_iov = iov;
+        msg.msg_iovlen = size_t( m_queue.fillIovecs( iov, ApsServer::max_iovecs_per_send ) );
+
+        ssize_t r = ::sendmsg( m_fd, &msg, MSG_NOSIGNAL );
+        if ( r < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            if ( errno != EAGAIN && errno != EWOULDBLOCK )
+            {
+                markClosing();
+                return;
+            }
+            break;
+        }
+        m_queue.consume( size_t( r ) );
+    }
+
+    // Ask for EPOLLOUT only while data is left over
+    bool want_write = !m_queue.isEmpty();
+    if ( want_write != m_want_write )
+    {
+        m_want_write = want_write;
+        m_server.updatePoll( m_fd, this, want_write );
+    }
+}
+
+void ApsServerSession::sendAvdeccToL2( Frame const &frame )
+{
+    m_link.getRawSocket()->sendFrame( frame );
+
+    // Other APCs on the same link would see this frame on a real
+    // network segment, so give it to them as well
+    m_link.dispatchFrame( frame, this );
+}
+
+void ApsServerSession::setFilter( ApsSubscriptionFilter const &filter )
+{
+    m_link.removeSubscription( this );
+    m_filter = filter;
+    if ( !m_closing )
+    {
+        m_link.addSubscription( this );
+    }
+}
+
+void ApsServerSession::closeTcpConnection()
+{
+    ApsStateMachine::closeTcpConnection();
+    markClosing();
+}
+
+void ApsServerSession::markClosing()
+{
+    if ( !m_closing )
+    {
+        m_closing = true;
+        if ( m_fd >= 0 )
+        {
+            // closing the socket also removes it from the epoll set
+            ::close( m_fd );
+            m_fd = -1;
+        }
+        m_server.retireSession( this );
+    }
+}
+
+ApsServerLink::ApsServerLink( ApsServer &server, RawSocket *raw_socket, int raw_fd, int listen_fd )
+    : m_server( server ), m_raw_socket( raw_socket ), m_raw_fd( raw_fd ), m_link_status( true ), m_listener( *this, listen_fd )
+{
+}
+
+ApsServerLink::~ApsServerLink()
+{
+    if ( m_listener.m_fd >= 0 )
+    {
+        ::close( m_listener.m_fd );
+    }
+}
+
+void ApsServerLink::onPollEvents( uint32_t events ) { receiveFrames( ApsServer::max_frames_per_poll ); }
+
+void ApsServerLink::receiveFrames( int max_frames )
+{
+    for ( int i = 0; i < max_frames; ++i )
+    {
+        if ( !m_raw_socket->recvFrame( &m_frame ) )
+        {
+            break;
+        }
+        dispatchFrame( m_frame );
+    }
+}
+
+void ApsServerLink::dispatchFrame( Frame const &frame, ApsServerSession *except )
+{
+    ApsFrameKeys keys( frame );
+
+    // Delivering a frame to a session only queues it for the APC and never
+    // dispatches another frame, so m_matches is not reused while in use
+    m_subscriptions.match( keys, m_matches );
+
+    for ( size_t i = 0; i < m_matches.size(); ++i )
+    {
+        ApsServerSession *session = m_matches[i];
+        if ( session != except && !session->isClosing() )
+        {
+            session->onNetAvdeccMessageReceived( frame );
+        }
+    }
+}
+
+void ApsServerLink::setLinkStatus( bool link_status )
+{
+    m_link_status = link_status;
+    for ( size_t i = 0; i < m_sessions.size(); ++i )
+    {
+        ApsServerSession *session = m_sessions[i];
+        if ( !session->isClosing() )
+        {
+            session->onNetLinkStatusUpdated( m_raw_socket->getMACAddress(), link_status );
+            session->run();
+        }
+    }
+}
+
+void ApsServerLink::addSession( ApsServerSession *session )
+{
+    session->m_link_index = m_sessions.size();
+    m_sessions.push_back( session );
+    m_subscriptions.add( session );
+}
+
+void ApsServerLink::removeSession( ApsServerSession *session )
+{
+    size_t pos = session->m_link_index;
+    if ( pos < m_sessions.size() && m_sessions[pos] == session )
+    {
+        m_subscriptions.remove( session );
+
+        // swap the last session into this slot
+        m_sessions[pos] = m_sessions.back();
+        m_sessions[pos]->m_link_index = pos;
+        m_sessions.pop_back();
+    }
+}
+
+void ApsServerLink::Listener::onPollEvents( uint32_t events )
+{
+    int fd;
+    while ( ( fd = ::accept4( m_fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC ) ) >= 0 )
+    {
+        m_link.m_server.acceptSession( m_link, fd );
+    }
+}
+
+ApsServer::ApsServer( std::string const &path, size_t max_sessions, size_t max_pending_octets, size_t max_pending_messages )
+    : m_path( path )
+    , m_max_sessions( max_sessions )
+    , m_max_pending_octets( max_pending_octets )
+    , m_max_pending_messages( max_pending_messages )
+    , m_epoll_fd( -1 )
+    , m_finished( false )
+    , m_have_unpollable_links( false )
+    , m_last_tick_seconds( 0 )
+    , m_session_count( 0 )
+{
+}
+
+ApsServer::~ApsServer() { close(); }
+
+bool ApsServer::open()
+{
+    if ( m_epoll_fd < 0 )
+    {
+        m_epoll_fd = ::epoll_create1( EPOLL_CLOEXEC );
+    }
+    return m_epoll_fd >= 0;
+}
+
+void ApsServer::close()
+{
+    for ( size_t i = 0; i < m_links.size(); ++i )
+    {
+        ApsServerLink *link = m_links[i];
+        while ( link->getSessionCount() > 0 )
+        {
+            ApsServerSession *session = link->m_sessions.back();
+            link->m_sessions.pop_back();
+            delete session;
+        }
+        delete link;
+    }
+    m_links.clear();
+    m_retired.clear();
+    m_flush_list.clear();
+    m_session_count = 0;
+
+    if ( m_epoll_fd >= 0 )
+    {
+        ::close( m_epoll_fd );
+        m_epoll_fd = -1;
+    }
+}
+
+int ApsServer::addLink( RawSocket *raw_socket, int raw_fd, char const *listen_host, char const *listen_port )
+{
+    if ( !open() )
+    {
+        return -1;
+    }
+
+    addrinfo hints;
+    addrinfo *ai = 0;
+    memset( &hints, 0, sizeof( hints ) );
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    if ( ::getaddrinfo( listen_host, listen_port, &hints, &ai ) != 0 )
+    {
+        return -1;
+    }
+
+    int listen_fd = -1;
+    for ( addrinfo *p = ai; p && listen_fd < 0; p = p->ai_next )
+    {
+        listen_fd = ::socket( p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol );
+        if ( listen_fd >= 0 )
+        {
+            int on = 1;
+            ::setsockopt( listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+            if ( ::bind( listen_fd, p->ai_addr, p->ai_addrlen ) != 0 || ::listen( listen_fd, SOMAXCONN ) != 0 )
+            {
+                ::close( listen_fd );
+                listen_fd = -1;
+            }
+        }
+    }
+    ::freeaddrinfo( ai );
+
+    if ( listen_fd < 0 )
+    {
+        return -1;
+    }
+
+    ApsServerLink *link = new ApsServerLink( *this, raw_socket, raw_fd, listen_fd );
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = static_cast<ApsServerPollTarget *>( &link->m_listener );
+    bool ok = ::epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev ) == 0;
+
+    if ( ok && raw_fd >= 0 )
+    {
+        ev.events = EPOLLIN;
+        ev.data.ptr = static_cast<ApsServerPollTarget *>( link );
+        ok = ::epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, raw_fd, &ev ) == 0;
+    }
+
+    if ( !ok )
+    {
+        delete link;
+        return -1;
+    }
+
+    if ( raw_fd < 0 )
+    {
+        m_have_unpollable_links = true;
+    }
+
+    m_links.push_back( link );
+    return int( m_links.size() - 1 );
+}
+
+void ApsServer::setLinkStatus( size_t link_index, bool link_status )
+{
+    if ( link_index < m_links.size() )
+    {
+        m_links[link_index]->setLinkStatus( link_status );
+        flush();
+    }
+}
+
+void ApsServer::flush()
+{
+    for ( size_t i = 0; i < m_flush_list.size(); ++i )
+    {
+        ApsServerSession *session = m_flush_list[i];
+        session->m_flush_scheduled = false;
+        if ( !session->isClosing() )
+        {
+            session->flushQueue();
+        }
+    }
+    m_flush_list.clear();
+}
+
+bool ApsServer::run( int timeout_ms )
+{
+    if ( m_finished || m_epoll_fd < 0 )
+    {
+        close();
+        return false;
+    }
+
+    // Links without a file descriptor need to be polled, and the sessions
+    // need their once per second tick to send NOPs
+    int max_timeout_ms = m_have_unpollable_links ? raw_poll_interval_ms : 1000;
+    if ( timeout_ms < 0 || timeout_ms > max_timeout_ms )
+    {
+        timeout_ms = max_timeout_ms;
+    }
+
+    epoll_event events[max_events];
+    int n = ::epoll_wait( m_epoll_fd, events, max_events, timeout_ms );
+    if ( n < 0 && errno != EINTR )
+    {
+        return false;
+    }
+
+    for ( int i = 0; i < n; ++i )
+    {
+        static_cast<ApsServerPollTarget *>( events[i].data.ptr )->onPollEvents( events[i].events );
+    }
+
+    if ( m_have_unpollable_links )
+    {
+        for ( size_t i = 0; i < m_links.size(); ++i )
+        {
+            if ( m_links[i]->getRawFd() < 0 )
+            {
+                m_links[i]->receiveFrames( max_frames_per_poll );
+            }
+        }
+    }
+
+    tickSessions( uint32_t( getTimeInMilliseconds() / 1000 ) );
+
+    // One gathering write per session for everything queued this round
+    flush();
+
+    reapSessions();
+
+    return true;
+}
+
+ApsServerSession *ApsServer::createSession( ApsServerLink &link, int fd )
+{
+    return new ApsServerSession( *this, link, fd, m_path, m_entity_id_allocator );
+}
+
+void ApsServer::acceptSession( ApsServerLink &link, int fd )
+{
+    if ( m_session_count >= m_max_sessions )
+    {
+        ::close( fd );
+        return;
+    }
+
+    // The APS protocol is request/response, don't let Nagle delay replies
+    int on = 1;
+    ::setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+
+    ApsServerSession *session = createSession( link, fd );
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = static_cast<ApsServerPollTarget *>( session );
+    if ( ::epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, fd, &ev ) != 0 )
+    {
+        delete session;
+        return;
+    }
+
+    link.addSession( session );
+    ++m_session_count;
+
+    session->start();
+}
+
+bool ApsServer::updatePoll( int fd, ApsServerPollTarget *target, bool want_write )
+{
+    epoll_event ev;
+    ev.events = EPOLLIN | ( want_write ? EPOLLOUT : 0 );
+    ev.data.ptr = target;
+    return ::epoll_ctl( m_epoll_fd, EPOLL_CTL_MOD, fd, &ev ) == 0;
+}
+
+void ApsServer::retireSession( ApsServerSession *session ) { m_retired.push_back( session ); }
+
+void ApsServer::reapSessions()
+{
+    for ( size_t i = 0; i < m_retired.size(); ++i )
+    {
+        ApsServerSession *session = m_retired[i];
+        session->getLink().removeSession( session );
+        delete session;
+        --m_session_count;
+    }
+    m_retired.clear();
+}
+
+void ApsServer::tickSessions( uint32_t time_in_seconds )
+{
+    if ( time_in_seconds == m_last_tick_seconds )
+    {
+        return;
+    }
+    m_last_tick_seconds = time_in_seconds;
+
+    for ( size_t i = 0; i < m_links.size(); ++i )
+    {
+        ApsServerLink *link = m_links[i];
+        for ( size_t j = 0; j < link->m_sessions.size(); ++j )
+        {
+            ApsServerSession *session = link->m_sessions[j];
+            if ( !session->isClosing() )
+            {
+                session->tick( time_in_seconds );
+            }
+        }
+    }
+}
+}
+
+#endif
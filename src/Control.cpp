@@ -35,14 +35,22 @@
 namespace JDKSAvdeccMCU
 {
 
-Control::Control(
-    Entity &entity, uint16_t descriptor_index, Eui64 control_type, uint16_t control_value_type, ControlValueHolder *holder )
+Control::Control( Entity &entity,
+                  uint16_t descriptor_index,
+                  Eui64 control_type,
+                  uint16_t control_value_type,
+                  ControlValueHolder *holder,
+                  uint8_t *value_details_storage,
+                  uint16_t value_details_storage_size )
     : m_entity( entity )
     , m_descriptor_index( descriptor_index )
     , m_control_type( control_type )
     , m_control_value_type( control_value_type )
     , m_holder( holder )
+    , m_number_of_values( 0 )
+    , m_value_details( value_details_storage, value_details_storage ? value_details_storage_size : 0 )
 {
+    initValueDetails();
 }
 
 void Control::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) { (void)time_in_millis; }
@@ -57,10 +65,67 @@ bool Control::receivedPDU( RawSocket *incoming_socket, Frame &frame )
 uint8_t Control::formControlValueMetaData( Frame &pdu )
 {
     uint8_t status = JDKSAVDECC_AEM_STATUS_ENTITY_MISBEHAVING;
-    // TODO: Fill in meta data for the control descriptor
-    (void)pdu;
+    ValueLayout layout = getValueLayout();
+    uint16_t size = m_holder->getValueLength();
+    uint16_t num_items = m_holder->getNumItems();
+    uint8_t const *values = m_holder->getBuf();
+    uint16_t length = m_value_details.getLength() > 0 ? m_value_details.getLength() : getDefaultValueDetailsLength();
 
-    switch ( m_control_value_type )
+    if ( layout == ValueLayout::LAYOUT_NONE )
+    {
+        status = JDKSAVDECC_AEM_STATUS_NOT_IMPLEMENTED;
+    }
+    else if ( layout == ValueLayout::LAYOUT_VALUES )
+    {
+        if ( pdu.canPut( m_holder->getLength() ) )
+        {
+            pdu.putBuf( values, m_holder->getLength() );
+            status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+        }
+    }
+    else if ( length > 0 && pdu.canPut( length ) )
+    {
+        // Copy the cached details, or form them without a cache, and fill
+        // in the current values
+        uint16_t pos = pdu.getLength();
+        if ( m_value_details.getLength() > 0 )
+        {
+            pdu.putBuf( m_value_details );
+        }
+        else
+        {
+            formDefaultValueDetails( pdu.getBuf( pos ), length );
+            pdu.setLength( pos + length );
+        }
+        uint8_t *details = pdu.getBuf( pos );
+
+        switch ( layout )
+        {
+        case ValueLayout::LAYOUT_LINEAR:
+            for ( uint16_t i = 0; i < num_items; ++i )
+            {
+                memcpy( details + i * ( size * 5 + 4 ) + size * 4, values + i * size, size );
+            }
+            break;
+        case ValueLayout::LAYOUT_SELECTOR:
+            memcpy( details, values, size );
+            break;
+        case ValueLayout::LAYOUT_ARRAY:
+            memcpy( details + size * 4 + 4, values, num_items * size );
+            break;
+        default:
+            break;
+        }
+        status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+    }
+    return status;
+}
+
+Control::ValueLayout Control::getValueLayout() const
+{
+    ValueLayout layout = ValueLayout::LAYOUT_NONE;
+
+    switch ( m_control_value_type & JDKSAVDECC_CONTROL_VALUE_MASK )
     {
     case JDKSAVDECC_CONTROL_VALUE_LINEAR_INT8:
     case JDKSAVDECC_CONTROL_VALUE_LINEAR_UINT8:
@@ -72,6 +137,7 @@ uint8_t Control::formControlValueMetaData( Frame &pdu )
     case JDKSAVDECC_CONTROL_VALUE_LINEAR_UINT64:
     case JDKSAVDECC_CONTROL_VALUE_LINEAR_FLOAT:
     case JDKSAVDECC_CONTROL_VALUE_LINEAR_DOUBLE:
+        layout = ValueLayout::LAYOUT_LINEAR;
         break;
 
     case JDKSAVDECC_CONTROL_VALUE_SELECTOR_INT8:
@@ -85,6 +151,7 @@ uint8_t Control::formControlValueMetaData( Frame &pdu )
     case JDKSAVDECC_CONTROL_VALUE_SELECTOR_FLOAT:
     case JDKSAVDECC_CONTROL_VALUE_SELECTOR_DOUBLE:
     case JDKSAVDECC_CONTROL_VALUE_SELECTOR_STRING:
+        layout = ValueLayout::LAYOUT_SELECTOR;
         break;
 
     case JDKSAVDECC_CONTROL_VALUE_ARRAY_INT8:
@@ -97,22 +164,134 @@ uint8_t Control::formControlValueMetaData( Frame &pdu )
     case JDKSAVDECC_CONTROL_VALUE_ARRAY_UINT64:
     case JDKSAVDECC_CONTROL_VALUE_ARRAY_FLOAT:
     case JDKSAVDECC_CONTROL_VALUE_ARRAY_DOUBLE:
+        layout = ValueLayout::LAYOUT_ARRAY;
         break;
 
     case JDKSAVDECC_CONTROL_VALUE_UTF8:
+    case JDKSAVDECC_CONTROL_VALUE_VENDOR:
+        layout = ValueLayout::LAYOUT_VALUES;
+        break;
+
     case JDKSAVDECC_CONTROL_VALUE_BODE_PLOT:
     case JDKSAVDECC_CONTROL_VALUE_SMPTE_TIME:
     case JDKSAVDECC_CONTROL_VALUE_SAMPLE_RATE:
     case JDKSAVDECC_CONTROL_VALUE_GPTP_TIME:
+    case JDKSAVDECC_CONTROL_VALUE_EXPANSION:
+    default:
         break;
-    case JDKSAVDECC_CONTROL_VALUE_VENDOR:
+    }
+    return layout;
+}
+
+uint16_t Control::getDefaultValueDetailsLength() const
+{
+    uint16_t size = m_holder->getValueLength();
+    uint16_t num_items = m_holder->getNumItems();
+    uint32_t length = 0;
+
+    switch ( getValueLayout() )
+    {
+    case ValueLayout::LAYOUT_LINEAR:
+        // minimum, maximum, step, default, current, unit and string for each item
+        length = uint32_t( num_items ) * ( size * 5 + 4 );
         break;
-    case JDKSAVDECC_CONTROL_VALUE_EXPANSION:
+    case ValueLayout::LAYOUT_SELECTOR:
+        // current, default, no options yet and unit
+        length = size * 2 + 2;
+        break;
+    case ValueLayout::LAYOUT_ARRAY:
+        // minimum, maximum, step, default, unit and string, then the current values
+        length = size * 4 + 4 + uint32_t( num_items ) * size;
         break;
     default:
         break;
     }
-    return status;
+
+    // Details that do not fit in a descriptor are left empty, and
+    // formControlValueMetaData() reports the control as misbehaving
+    return length > JDKSAVDECC_DESCRIPTOR_CONTROL_VALUE_DETAILS_MAX_LENGTH ? 0 : uint16_t( length );
+}
+
+void Control::formDefaultValueDetails( uint8_t *details, uint16_t length ) const
+{
+    uint16_t size = m_holder->getValueLength();
+    uint16_t num_items = m_holder->getNumItems();
+
+    if ( length == 0 )
+    {
+        return;
+    }
+    memset( details, 0, length );
+    if ( getValueLayout() == ValueLayout::LAYOUT_LINEAR )
+    {
+        for ( uint16_t i = 0; i < num_items; ++i )
+        {
+            jdksavdecc_uint16_set( no_localized_string, details, i * ( size * 5 + 4 ) + size * 5 + 2 );
+        }
+    }
+    else if ( getValueLayout() == ValueLayout::LAYOUT_ARRAY )
+    {
+        jdksavdecc_uint16_set( no_localized_string, details, size * 4 + 2 );
+    }
+}
+
+void Control::initValueDetails()
+{
+    uint16_t length = getDefaultValueDetailsLength();
+
+    m_number_of_values = getValueLayout() == ValueLayout::LAYOUT_SELECTOR ? 0 : m_holder->getNumItems();
+
+    // Without room for the details there is no cache
+    if ( length > m_value_details.getMaxLength() )
+    {
+        length = 0;
+    }
+    formDefaultValueDetails( m_value_details.getBuf(), length );
+    m_value_details.setLength( length );
+}
+
+void Control::setRangeDetails( uint16_t item, uint8_t const *range, uint16_t unit, uint16_t localized_string )
+{
+    uint16_t size = m_holder->getValueLength();
+    ValueLayout layout = getValueLayout();
+    uint16_t pos = 0;
+    uint16_t unit_pos = size * 4;
+
+    if ( m_value_details.getLength() == 0 )
+    {
+        return;
+    }
+    if ( layout == ValueLayout::LAYOUT_LINEAR && item < m_holder->getNumItems() )
+    {
+        // The current value sits between the range and the unit
+        pos = item * ( size * 5 + 4 );
+        unit_pos = pos + size * 5;
+    }
+    else if ( layout != ValueLayout::LAYOUT_ARRAY )
+    {
+        return;
+    }
+
+    memcpy( m_value_details.getBuf( pos ), range, size * 4 );
+    m_value_details.setDoublet( unit, unit_pos );
+    m_value_details.setDoublet( localized_string, unit_pos + 2 );
+}
+
+bool Control::setSelectorDetails( uint16_t num_options, uint16_t unit )
+{
+    uint16_t size = m_holder->getValueLength();
+    uint32_t length = ( uint32_t( num_options ) + 2 ) * size + 2;
+
+    if ( getValueLayout() != ValueLayout::LAYOUT_SELECTOR || length > m_value_details.getMaxLength()
+         || length > JDKSAVDECC_DESCRIPTOR_CONTROL_VALUE_DETAILS_MAX_LENGTH )
+    {
+        return false;
+    }
+    memset( m_value_details.getBuf(), 0, length );
+    m_value_details.setLength( uint16_t( length ) );
+    m_value_details.setDoublet( unit, uint16_t( length - 2 ) );
+    m_number_of_values = num_options;
+    return true;
 }
 
 uint8_t Control::formControlPayload( Frame &pdu )
@@ -213,9 +392,34 @@ uint8_t Control::formGetControlResponse( Frame &pdu )
 uint8_t Control::readControlDescriptor( Frame &pdu )
 {
     uint8_t status = JDKSAVDECC_AEM_STATUS_ENTITY_MISBEHAVING;
+    uint16_t start = pdu.getLength();
 
-    // TODO: fill in control descriptor contents for READ_DESCRIPTOR
-    (void)pdu;
+    if ( pdu.canPut( JDKSAVDECC_DESCRIPTOR_CONTROL_LEN ) )
+    {
+        pdu.putDoublet( JDKSAVDECC_DESCRIPTOR_CONTROL );                      // descriptor_type
+        pdu.putDoublet( m_descriptor_index );                                 // descriptor_index
+        pdu.putAvdeccString();                                                // object_name
+        pdu.putDoublet( no_localized_string );                                // localized_description
+        pdu.putQuadlet( 0 );                                                  // block_latency
+        pdu.putQuadlet( 0 );                                                  // control_latency
+        pdu.putDoublet( 0 );                                                  // control_domain
+        pdu.putDoublet( m_control_value_type );                               // control_value_type
+        pdu.putEUI64( m_control_type );                                       // control_type
+        pdu.putQuadlet( 0 );                                                  // reset_time
+        pdu.putDoublet( JDKSAVDECC_DESCRIPTOR_CONTROL_OFFSET_VALUE_DETAILS ); // values_offset
+        pdu.putDoublet( getNumberOfValues() );                                // number_of_values
+        pdu.putDoublet( JDKSAVDECC_DESCRIPTOR_INVALID );                      // signal_type, no signal source
+        pdu.putDoublet( 0 );                                                  // signal_index
+        pdu.putDoublet( 0 );                                                  // signal_output
+
+        status = formControlValueMetaData( pdu );
+    }
+
+    if ( status != JDKSAVDECC_AEM_STATUS_SUCCESS )
+    {
+        // Leave no partial descriptor behind
+        pdu.setLength( start );
+    }
     return status;
 }
 }
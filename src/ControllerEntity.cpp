@@ -32,6 +32,7 @@
 #include "JDKSAvdeccMCU/World.hpp"
 
 #include "JDKSAvdeccMCU/ControllerEntity.hpp"
+#include "JDKSAvdeccMCU/AddressAccessTransfer.hpp"
 
 namespace JDKSAvdeccMCU
 {
@@ -54,6 +55,18 @@ bool ControllerEntity::receivedPDU( RawSocket *incoming_socket, Frame &frame )
         done = true;
     }
 
+    // AA responses for us go to the transfer engine, AA commands targetting us
+    // are handled by the Entity
+    if ( !done )
+    {
+        jdksavdecc_aecp_aa aa;
+        if ( parseAA( &aa, frame ) && isAAForController( aa, getEntityID() ) )
+        {
+            r = receivedAAResponse( aa, frame );
+            done = true;
+        }
+    }
+
     if ( !done )
     {
         r = Entity::receivedPDU( incoming_socket, frame );
@@ -70,8 +83,10 @@ bool ControllerEntity::receivedAEMResponse( jdksavdecc_aecpdu_aem const &aem, Fr
     bool unsolicited = ( aem.command_type >> 15 ) & 1;
 
     // only bother with the response if it is either unsolicited,
-    // or is solicited and matches the last request we did send
-    bool interesting = unsolicited;
+    // or is solicited and matches the last request we did send.
+    // CONTROLLER_AVAILABLE responses are not tracked as the in-flight command,
+    // the acquire arbitration matches them itself
+    bool interesting = unsolicited || actual_command_type == JDKSAVDECC_AEM_COMMAND_CONTROLLER_AVAILABLE;
 
     if ( !unsolicited )
     {
@@ -170,9 +185,12 @@ void ControllerEntity::sendAcquireEntity( const Eui64 &target_entity_id, const E
 
 bool ControllerEntity::receivedAAResponse( jdksavdecc_aecp_aa const &aa, Frame &pdu )
 {
-    (void)aa;
-    (void)pdu;
-    return false;
+    bool r = false;
+    if ( m_address_access_transfer )
+    {
+        r = m_address_access_transfer->receivedAAResponse( aa, pdu );
+    }
+    return r;
 }
 
 bool ControllerEntity::receiveAcquireEntityResponse( jdksavdecc_aecpdu_aem const &aem, Frame &pdu )
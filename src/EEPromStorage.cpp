@@ -32,6 +32,419 @@
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/EEPromStorage.hpp"
 
+#include "JDKSAvdeccMCU/Helpers.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+EEPromDevice::~EEPromDevice() {}
+
+#if JDKSAVDECCMCU_ENABLE_EEPROMFILE
+
+EEPromDeviceFile::EEPromDeviceFile( std::string const &filename, uint32_t size, uint16_t page_size )
+    : m_f( 0 ), m_size( size ), m_page_size( page_size )
+{
+#if defined( _WIN32 )
+    fopen_s( &m_f, filename.c_str(), "r+b" );
+    if ( !m_f )
+    {
+        fopen_s( &m_f, filename.c_str(), "w+b" );
+    }
+#else
+    m_f = fopen( filename.c_str(), "r+b" );
+    if ( !m_f )
+    {
+        m_f = fopen( filename.c_str(), "w+b" );
+    }
+#endif
+    if ( m_f )
+    {
+        // A new or short file is extended with erased memory
+        fseek( m_f, 0, SEEK_END );
+        long len = ftell( m_f );
+        for ( long i = len; i < long( m_size ); ++i )
+        {
+            fputc( 0xff, m_f );
+        }
+        fflush( m_f );
+    }
+}
+
+EEPromDeviceFile::~EEPromDeviceFile()
+{
+    if ( m_f )
+    {
+        fclose( m_f );
+        m_f = 0;
+    }
+}
+
+bool EEPromDeviceFile::read( uint32_t offset, uint8_t *buf, uint16_t len )
+{
+    bool r = false;
+    if ( m_f && offset + len <= m_size )
+    {
+        if ( fseek( m_f, long( offset ), SEEK_SET ) == 0 && fread( buf, 1, len, m_f ) == len )
+        {
+            r = true;
+        }
+    }
+    return r;
+}
+
+bool EEPromDeviceFile::erasePage( uint32_t offset )
+{
+    bool r = false;
+    if ( m_f && ( offset % m_page_size ) == 0 && offset + m_page_size <= m_size )
+    {
+        if ( fseek( m_f, long( offset ), SEEK_SET ) == 0 )
+        {
+            r = true;
+            for ( uint16_t i = 0; i < m_page_size; ++i )
+            {
+                if ( fputc( 0xff, m_f ) == EOF )
+                {
+                    r = false;
+                    break;
+                }
+            }
+            fflush( m_f );
+        }
+    }
+    return r;
+}
+
+bool EEPromDeviceFile::program( uint32_t offset, uint8_t const *buf, uint16_t len )
+{
+    bool r = false;
+    if ( m_f && offset + len <= m_size )
+    {
+        r = true;
+        for ( uint16_t i = 0; i < len && r; ++i )
+        {
+            // Like flash, programming can only clear bits
+            int old_value = EOF;
+            if ( fseek( m_f, long( offset + i ), SEEK_SET ) == 0 )
+            {
+                old_value = fgetc( m_f );
+            }
+            if ( old_value == EOF || fseek( m_f, long( offset + i ), SEEK_SET ) != 0
+                 || fputc( old_value & buf[i], m_f ) == EOF )
+            {
+                r = false;
+            }
+        }
+        fflush( m_f );
+    }
+    return r;
+}
+
+#endif
+
+EEPromLog::EEPromLog( EEPromDevice &device,
+                      uint32_t device_offset,
+                      uint32_t bank_size,
+                      uint32_t magic_number,
+                      jdksavdecc_timestamp_in_milliseconds deferral_in_millis,
+                      uint8_t *data,
+                      uint8_t *shadow,
+                      uint16_t data_size,
+                      uint16_t chunk_size,
+                      uint8_t *record )
+    : m_device( device )
+    , m_device_offset( device_offset )
+    , m_bank_size( bank_size )
+    , m_magic_number( magic_number )
+    , m_deferral_in_millis( deferral_in_millis )
+    , m_data( data )
+    , m_shadow( shadow )
+    , m_data_size( data_size )
+    , m_chunk_size( chunk_size )
+    , m_chunk_count( ( data_size + chunk_size - 1 ) / chunk_size )
+    , m_record( record )
+    , m_state( StateIdle )
+    , m_pending( false )
+    , m_deadline( 0 )
+    , m_bank_valid( false )
+    , m_bank( 0 )
+    , m_generation( 0 )
+    , m_append_pos( bank_header_size )
+    , m_next_chunk( 0 )
+    , m_compact_pos( bank_header_size )
+{
+}
+
+bool EEPromLog::load()
+{
+    uint32_t generation[2];
+    bool valid[2];
+    valid[0] = readHeader( 0, &generation[0] );
+    valid[1] = readHeader( 1, &generation[1] );
+
+    m_state = StateIdle;
+    m_pending = false;
+    m_bank_valid = valid[0] || valid[1];
+
+    if ( !m_bank_valid )
+    {
+        // Nothing stored yet, the first flush will compact everything
+        memcpy( m_shadow, m_data, m_data_size );
+        return false;
+    }
+
+    m_bank = ( valid[0] && ( !valid[1] || int32_t( generation[0] - generation[1] ) > 0 ) ) ? 0 : 1;
+    m_generation = generation[m_bank];
+
+    // Replay the records in the order they were appended. Chunks that were
+    // never written keep their current values.
+    uint32_t bank_offset = getBankOffset( m_bank );
+    uint16_t record_size = getRecordSize();
+    uint32_t pos = alignRecord( bank_header_size );
+    while ( pos + record_size <= m_bank_size )
+    {
+        if ( !m_device.read( bank_offset + pos, m_record, record_size ) )
+        {
+            break;
+        }
+        uint16_t chunk = jdksavdecc_uint16_get( m_record, 0 );
+        if ( chunk == 0xffff )
+        {
+            // Erased memory, the end of the log
+            break;
+        }
+        pos = alignRecord( pos + record_size );
+        if ( isRecordValid() && chunk < m_chunk_count )
+        {
+            uint16_t offset = chunk * m_chunk_size;
+            uint16_t len = m_data_size - offset < m_chunk_size ? m_data_size - offset : m_chunk_size;
+            memcpy( m_data + offset, m_record + 2, len );
+        }
+        // A torn record from a power failure is skipped, and is only ever last
+    }
+    m_append_pos = pos;
+    memcpy( m_shadow, m_data, m_data_size );
+    return true;
+}
+
+void EEPromLog::changed( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    // The first change of a burst starts the timer, later ones ride along
+    if ( !m_pending )
+    {
+        m_pending = true;
+        m_deadline = time_in_millis + m_deferral_in_millis;
+    }
+}
+
+bool EEPromLog::flush()
+{
+    m_pending = false;
+    if ( m_state == StateIdle )
+    {
+        m_state = StateAppending;
+        m_next_chunk = 0;
+    }
+    while ( m_state != StateIdle )
+    {
+        if ( !pump() )
+        {
+            m_state = StateIdle;
+            return false;
+        }
+    }
+    return true;
+}
+
+void EEPromLog::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    if ( m_pending && m_state == StateIdle && wasDeadlineHit( time_in_millis, m_deadline ) )
+    {
+        m_pending = false;
+        m_state = StateAppending;
+        m_next_chunk = 0;
+    }
+    if ( m_state != StateIdle && !pump() )
+    {
+        // Give up on this flush, try again on the next change
+        m_state = StateIdle;
+    }
+}
+
+uint32_t EEPromLog::alignRecord( uint32_t pos ) const
+{
+    uint16_t page_size = m_device.getPageSize();
+    uint16_t record_size = getRecordSize();
+    if ( record_size <= page_size && ( pos % page_size ) + record_size > page_size )
+    {
+        pos += page_size - ( pos % page_size );
+    }
+    return pos;
+}
+
+bool EEPromLog::readHeader( uint8_t bank, uint32_t *generation )
+{
+    uint8_t header[bank_header_size];
+    if ( !m_device.read( getBankOffset( bank ), header, sizeof( header ) ) )
+    {
+        return false;
+    }
+    if ( jdksavdecc_uint32_get( header, 0 ) != m_magic_number || jdksavdecc_uint16_get( header, 8 ) != m_data_size
+         || jdksavdecc_uint16_get( header, 10 ) != m_chunk_size
+         || jdksavdecc_uint32_get( header, 12 ) != calculateCrc32( 0, header, 12 ) )
+    {
+        return false;
+    }
+    *generation = jdksavdecc_uint32_get( header, 4 );
+    return true;
+}
+
+void EEPromLog::formRecord( uint16_t chunk, uint8_t const *source )
+{
+    uint16_t offset = chunk * m_chunk_size;
+    uint16_t len = m_data_size - offset < m_chunk_size ? m_data_size - offset : m_chunk_size;
+    jdksavdecc_uint16_set( chunk, m_record, 0 );
+    memcpy( m_record + 2, source + offset, len );
+    memset( m_record + 2 + len, 0xff, m_chunk_size - len );
+    jdksavdecc_uint16_set( uint16_t( calculateCrc32( 0, m_record, 2 + m_chunk_size ) ), m_record, 2 + m_chunk_size );
+}
+
+bool EEPromLog::isRecordValid() const
+{
+    return jdksavdecc_uint16_get( m_record, 2 + m_chunk_size ) == uint16_t( calculateCrc32( 0, m_record, 2 + m_chunk_size ) );
+}
+
+void EEPromLog::startCompaction()
+{
+    m_state = StateErasing;
+    m_compact_pos = 0;
+}
+
+bool EEPromLog::step()
+{
+    uint16_t record_size = getRecordSize();
+    uint8_t other_bank = m_bank ^ 1;
+
+    switch ( m_state )
+    {
+    case StateIdle:
+        break;
+    case StateAppending:
+    {
+        if ( !m_bank_valid )
+        {
+            startCompaction();
+            break;
+        }
+        // Find the next chunk that differs from what is stored
+        while ( m_next_chunk < m_chunk_count )
+        {
+            uint16_t offset = m_next_chunk * m_chunk_size;
+            uint16_t len = m_data_size - offset < m_chunk_size ? m_data_size - offset : m_chunk_size;
+            if ( memcmp( m_data + offset, m_shadow + offset, len ) != 0 )
+            {
+                break;
+            }
+            m_next_chunk++;
+        }
+        if ( m_next_chunk == m_chunk_count )
+        {
+            m_state = StateIdle;
+            break;
+        }
+        uint32_t pos = alignRecord( m_append_pos );
+        if ( pos + record_size > m_bank_size )
+        {
+            // The bank is full
+            startCompaction();
+            break;
+        }
+        formRecord( m_next_chunk, m_data );
+        if ( !m_device.program( getBankOffset( m_bank ) + pos, m_record, record_size ) )
+        {
+            return false;
+        }
+        // Only now is what was formed the shadow of this chunk
+        uint16_t offset = m_next_chunk * m_chunk_size;
+        memcpy( m_shadow + offset, m_record + 2, m_data_size - offset < m_chunk_size ? m_data_size - offset : m_chunk_size );
+        m_append_pos = pos + record_size;
+        m_next_chunk++;
+        break;
+    }
+    case StateErasing:
+        if ( !m_device.erasePage( getBankOffset( other_bank ) + m_compact_pos ) )
+        {
+            return false;
+        }
+        m_compact_pos += m_device.getPageSize();
+        if ( m_compact_pos >= m_bank_size )
+        {
+            m_state = StateCompacting;
+            m_compact_pos = alignRecord( bank_header_size );
+            m_next_chunk = 0;
+        }
+        break;
+    case StateCompacting:
+        if ( m_next_chunk == m_chunk_count )
+        {
+            m_state = StateWritingHeader;
+            break;
+        }
+        if ( m_compact_pos + record_size > m_bank_size )
+        {
+            // The bank is too small to ever hold all the chunks
+            return false;
+        }
+        // Copy what is already stored, so the shadow stays true of whichever
+        // bank is valid. Anything changed since is appended once the header
+        // of the new bank is written.
+        formRecord( m_next_chunk, m_shadow );
+        if ( !m_device.program( getBankOffset( other_bank ) + m_compact_pos, m_record, record_size ) )
+        {
+            return false;
+        }
+        m_compact_pos = alignRecord( m_compact_pos + record_size );
+        m_next_chunk++;
+        break;
+    case StateWritingHeader:
+    {
+        // Written last, this is what makes the new bank valid
+        uint8_t header[bank_header_size];
+        uint32_t generation = m_generation + 1;
+        jdksavdecc_uint32_set( m_magic_number, header, 0 );
+        jdksavdecc_uint32_set( generation, header, 4 );
+        jdksavdecc_uint16_set( m_data_size, header, 8 );
+        jdksavdecc_uint16_set( m_chunk_size, header, 10 );
+        jdksavdecc_uint32_set( calculateCrc32( 0, header, 12 ), header, 12 );
+        if ( !m_device.program( getBankOffset( other_bank ), header, sizeof( header ) ) )
+        {
+            return false;
+        }
+        m_bank = other_bank;
+        m_bank_valid = true;
+        m_generation = generation;
+        m_append_pos = m_compact_pos;
+        // Append anything that differs from what was compacted
+        m_state = StateAppending;
+        m_next_chunk = 0;
+        break;
+    }
+    }
+    return true;
+}
+
+bool EEPromLog::pump()
+{
+    while ( m_state != StateIdle && !m_device.isBusy() )
+    {
+        if ( !step() )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
 #ifdef __avr__
 #include "EEProm.h"
 
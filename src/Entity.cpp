@@ -45,8 +45,10 @@ Entity::Entity( ADPManager &adp_manager,
                 ACMPListenerGroupHandlerBase *acmp_listener_group_handler )
     : m_adp_manager( adp_manager )
     , m_outgoing_sequence_id( 0 )
-    , m_acquire_in_progress_time( 0 )
-    , m_locked_time( 0 )
+    , m_acquire_in_progress_deadline( 0 )
+    , m_acquire_in_progress_resend_time( 0 )
+    , m_controller_available_sequence_id( 0 )
+    , m_lock_deadline( 0 )
     , m_registered_controllers( registered_controllers )
     , m_last_sent_command_time( 0 )
     , m_last_sent_command_type( JDKSAVDECC_AEM_COMMAND_EXPANSION )
@@ -68,21 +70,35 @@ void Entity::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
 {
     uint16_t cmd = m_last_sent_command_type;
     // If we are locked, then time out the lock
-    if ( isSet( m_locked_by_controller_entity_id ) )
+    if ( isSet( m_locked_by_controller_entity_id ) && wasDeadlineHit( time_in_millis, m_lock_deadline ) )
     {
-        if ( wasTimeOutHit( time_in_millis, m_locked_time, JDKSAVDECC_AEM_LOCK_TIMEOUT_MS ) )
+        m_locked_by_controller_entity_id.clear();
+    }
+
+    // Stop sending unsolicited notifications to controllers that went away
+    m_registered_controllers->expireControllers( time_in_millis );
+
+    if ( isSet( m_acquire_in_progress_by_controller_entity_id ) )
+    {
+        if ( wasDeadlineHit( time_in_millis, m_acquire_in_progress_deadline ) )
         {
+            // The current owner did not answer the CONTROLLER_AVAILABLE in
+            // time, so it is gone and the acquiring controller is the new owner.
+            // Any lock held by the old owner goes away with it
+            m_acquired_by_controller_entity_id = m_acquire_in_progress_by_controller_entity_id;
+            m_acquired_by_controller_mac_address = m_acquire_in_progress_pdu.getSA();
             m_locked_by_controller_entity_id.clear();
+            m_acquire_in_progress_by_controller_entity_id.clear();
+            sendAcquireInProgressResponse( JDKSAVDECC_AEM_STATUS_SUCCESS );
+        }
+        else if ( wasDeadlineHit( time_in_millis, m_acquire_in_progress_resend_time ) )
+        {
+            // Keep the acquiring controller from timing out its command
+            sendAcquireInProgressResponse( JDKSAVDECC_AEM_STATUS_IN_PROGRESS );
+            m_acquire_in_progress_resend_time = time_in_millis + acquire_in_progress_resend_in_millis;
         }
     }
 
-    // TODO: if acquire is in progress more than 250 ms then
-    // expire that one, update the new owner entity id and send
-    // an acquire entity response message to the new owner
-
-    // TODO: Send acquire in progress every 120 ms while we are
-    // m_acquire_in_progress_by_controller_entity_id
-
     // Check to see if we had a command in flight that timed out
     if ( cmd != JDKSAVDECC_AEM_COMMAND_EXPANSION
          && wasTimeOutHit( time_in_millis, m_last_sent_command_time, JDKSAVDECC_AEM_TIMEOUT_IN_MS ) )
@@ -90,21 +106,8 @@ void Entity::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
         m_last_sent_command_type = JDKSAVDECC_AEM_COMMAND_EXPANSION; // clear knowledge of sent
                                                                      // command
 
-        // Was the command a CONTROLLER_AVAILABLE? if so, handle it here
-        if ( cmd == JDKSAVDECC_AEM_COMMAND_CONTROLLER_AVAILABLE )
-        {
-            // Yes, this means that the old controller goes away and the new one
-            // is approved
-            m_acquired_by_controller_entity_id = m_acquire_in_progress_by_controller_entity_id;
-            // Also clear any lock that may have been there
-            m_locked_by_controller_entity_id = Eui64();
-            // TODO: Formulate and send reply to the new controller
-        }
-        else
-        {
-            // Notify entity info about the timed out command
-            commandTimedOut( m_last_sent_command_target_entity_id, cmd, m_outgoing_sequence_id );
-        }
+        // Notify entity info about the timed out command
+        commandTimedOut( m_last_sent_command_target_entity_id, cmd, m_outgoing_sequence_id );
     }
 
     // Run periodic state machine events for ACMP Controller
@@ -143,6 +146,9 @@ bool Entity::receivedPDU( RawSocket *incoming_socket, Frame &frame )
     // we already know the message is AVTP ethertype and is either directly
     // targetting my MAC address or is a multicast message
 
+    // Registered controllers stay alive while they keep advertising
+    receivedControllerAdvertisement( frame );
+
     // Try see if it is an AEM message
     {
         jdksavdecc_aecpdu_aem aem;
@@ -153,6 +159,12 @@ bool Entity::receivedPDU( RawSocket *incoming_socket, Frame &frame )
                 status_code = receivedAEMCommand( incoming_socket, aem, frame );
                 r = true;
             }
+            else if ( isAEMForController( aem, getEntityID() )
+                      && ( aem.command_type & 0x7fff ) == JDKSAVDECC_AEM_COMMAND_CONTROLLER_AVAILABLE )
+            {
+                // The current owner answering during an acquire in progress
+                r = receiveControllerAvailableResponse( aem, frame );
+            }
         }
     }
 
@@ -202,6 +214,11 @@ uint8_t Entity::receivedAEMCommand( RawSocket *incoming_socket, jdksavdecc_aecpd
     // commands that change state will set command_is_set_something to true
     bool command_is_set_something = false;
 
+    // Any command from a registered controller shows that it is still alive
+    m_registered_controllers->refreshController( aem.aecpdu_header.controller_entity_id,
+                                                 getRawSocket().getTimeInMilliseconds(),
+                                                 RegisteredControllers::default_timeout_in_millis );
+
     switch ( actual_command_type )
     {
     case JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY:
@@ -300,7 +317,8 @@ uint8_t Entity::receivedAEMCommand( RawSocket *incoming_socket, jdksavdecc_aecpd
         break;
     }
 
-    // fill in the new response status
+    // fill in the message type and new response status
+    pdu.setOctet( JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE, JDKSAVDECC_FRAME_HEADER_LEN + 1 );
     pdu.setOctet( ( pdu.getOctet( JDKSAVDECC_FRAME_HEADER_LEN + 2 ) & 0x7 ) + ( response_status << 3 ),
                   JDKSAVDECC_FRAME_HEADER_LEN + 2 );
 
@@ -359,16 +377,45 @@ uint8_t Entity::validatePermissions( jdksavdecc_aecpdu_aem const &aem )
 uint8_t Entity::receivedAACommand( RawSocket *incoming_socket, jdksavdecc_aecp_aa const &aa, Frame &pdu )
 {
     // Yes go through the TLV's and dispatch the read/writes and respond
-    uint8_t *p = pdu.getBuf() + JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AECPDU_AA_LEN;
+    uint16_t pos = JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AECPDU_AA_LEN;
+    uint16_t end = JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_COMMON_CONTROL_HEADER_LEN + aa.aecpdu_header.header.control_data_length;
+    if ( end > pdu.getLength() )
+    {
+        end = pdu.getLength();
+    }
     uint8_t aa_status = JDKSAVDECC_AECP_AA_STATUS_NOT_IMPLEMENTED;
     for ( uint16_t i = 0; i < aa.tlv_count; ++i )
     {
+        if ( pos + JDKSAVDECC_AECPDU_AA_TLV_LEN > end )
+        {
+            aa_status = JDKSAVDECC_AECP_AA_STATUS_TLV_INVALID;
+            break;
+        }
+        uint8_t *p = pdu.getBuf( pos );
+
         // See 9.2.1.3.3
         uint8_t tlv_mode = ( p[JDKSAVDECC_AECPDU_AA_TLV_OFFSET_MODE_LENGTH] >> 4 ) & 0xf;
 
-        uint16_t tlv_length = ( ( ( uint16_t )( p[JDKSAVDECC_AECPDU_AA_TLV_OFFSET_MODE_LENGTH] & 0xf ) ) << 4 )
+        uint16_t tlv_length = ( ( ( uint16_t )( p[JDKSAVDECC_AECPDU_AA_TLV_OFFSET_MODE_LENGTH] & 0xf ) ) << 8 )
                               + p[JDKSAVDECC_AECPDU_AA_TLV_OFFSET_MODE_LENGTH + 1];
 
+        // A READ command carries no data, the data read is put in its place in
+        // the response. Since that grows the pdu only the last TLV may be a
+        // READ.
+        if ( tlv_mode == JDKSAVDECC_AECP_AA_MODE_READ )
+        {
+            if ( i + 1 != aa.tlv_count || pos + JDKSAVDECC_AECPDU_AA_TLV_LEN + tlv_length > pdu.getMaxLength() )
+            {
+                aa_status = JDKSAVDECC_AECP_AA_STATUS_TLV_INVALID;
+                break;
+            }
+        }
+        else if ( pos + JDKSAVDECC_AECPDU_AA_TLV_LEN + tlv_length > end )
+        {
+            aa_status = JDKSAVDECC_AECP_AA_STATUS_TLV_INVALID;
+            break;
+        }
+
         // require top 32 bits of address to be zero
         if ( p[JDKSAVDECC_AECPDU_AA_TLV_OFFSET_ADDRESS_UPPER] == 0 && p[JDKSAVDECC_AECPDU_AA_TLV_OFFSET_ADDRESS_UPPER + 1] == 0
              && p[JDKSAVDECC_AECPDU_AA_TLV_OFFSET_ADDRESS_UPPER + 2] == 0
@@ -382,6 +429,10 @@ uint8_t Entity::receivedAACommand( RawSocket *incoming_socket, jdksavdecc_aecp_a
                 if ( m_entity_state )
                 {
                     aa_status = m_entity_state->receiveAARead( tlv_address, tlv_length, p + JDKSAVDECC_AECPDU_AA_TLV_LEN );
+                    if ( aa_status == JDKSAVDECC_AECP_AA_STATUS_SUCCESS )
+                    {
+                        end = pos + JDKSAVDECC_AECPDU_AA_TLV_LEN + tlv_length;
+                    }
                 }
                 break;
             case JDKSAVDECC_AECP_AA_MODE_WRITE:
@@ -398,15 +449,27 @@ uint8_t Entity::receivedAACommand( RawSocket *incoming_socket, jdksavdecc_aecp_a
                 break;
             }
         }
-        p = p + JDKSAVDECC_AECPDU_AA_TLV_LEN + tlv_length;
+        else
+        {
+            aa_status = JDKSAVDECC_AECP_AA_STATUS_ADDRESS_TOO_HIGH;
+        }
+        pos = pos + JDKSAVDECC_AECPDU_AA_TLV_LEN + tlv_length;
         if ( aa_status != JDKSAVDECC_AECP_AA_STATUS_SUCCESS )
         {
             break;
         }
     }
-    // Send the response to either just the requesting controller or it and all
-    // registered controllers
-    pdu.setOctet( ( pdu.getOctet( JDKSAVDECC_FRAME_HEADER_LEN + 2 ) & 0x7 ) + ( aa_status << 3 ), JDKSAVDECC_FRAME_HEADER_LEN + 2 );
+
+    // The entity state asked us to stay quiet, the controller will retry
+    if ( aa_status == EntityState::aa_status_no_response )
+    {
+        return aa_status;
+    }
+
+    // Turn the command into the response in place, with the status and the
+    // length including any data that was read
+    pdu.setLength( end );
+    setAAReply( aa_status, end, pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN, pdu.getLength() );
 
     // Only send responses to the requesting controller
     sendResponses( false, false, aa_status, pdu );
@@ -638,11 +701,16 @@ void Entity::sendUnsolicitedResponses( uint16_t aem_command_type,
 
 uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, Frame &pdu )
 {
-
     uint8_t status = JDKSAVDECC_AECP_STATUS_NOT_IMPLEMENTED;
+    Eui64 const controller_entity_id = aem.aecpdu_header.controller_entity_id;
+
+    if ( pdu.getLength() < JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY_COMMAND_LEN )
+    {
+        return JDKSAVDECC_AEM_STATUS_BAD_ARGUMENTS;
+    }
 
     bool controller_id_matches_current_owner;
-    controller_id_matches_current_owner = ( m_acquired_by_controller_entity_id == aem.aecpdu_header.controller_entity_id );
+    controller_id_matches_current_owner = ( m_acquired_by_controller_entity_id == controller_entity_id );
 
     bool has_current_owner;
     has_current_owner = ( isSet( m_acquired_by_controller_entity_id ) != 0 );
@@ -654,7 +722,8 @@ uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, F
     {
 
         // is it a release or an acquire?
-        if ( jdksavdecc_aem_command_acquire_entity_get_aem_acquire_flags( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN ) & 0x80000000 )
+        if ( jdksavdecc_aem_command_acquire_entity_get_aem_acquire_flags( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN )
+             & acquire_entity_flag_release )
         {
             // This is a request to release.  A release only works if the
             // requesting controller is the current owner, or there is no
@@ -665,6 +734,17 @@ uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, F
                 // clear current acquire state
                 m_acquired_by_controller_entity_id = Eui64();
                 status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+
+                // If another controller was waiting for us, it gets us right
+                // away instead of waiting for the CONTROLLER_AVAILABLE to time
+                // out
+                if ( isSet( m_acquire_in_progress_by_controller_entity_id ) )
+                {
+                    m_acquired_by_controller_entity_id = m_acquire_in_progress_by_controller_entity_id;
+                    m_acquired_by_controller_mac_address = m_acquire_in_progress_pdu.getSA();
+                    m_acquire_in_progress_by_controller_entity_id.clear();
+                    sendAcquireInProgressResponse( JDKSAVDECC_AEM_STATUS_SUCCESS );
+                }
             }
             else
             {
@@ -680,7 +760,17 @@ uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, F
             if ( ( has_current_owner && controller_id_matches_current_owner ) || ( !has_current_owner ) )
             {
                 // Yes, success.
+                m_acquired_by_controller_entity_id = controller_entity_id;
+                m_acquired_by_controller_mac_address = pdu.getSA();
                 status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+
+                // The owner just showed that it is still available, so any
+                // controller waiting to take over has lost
+                if ( isSet( m_acquire_in_progress_by_controller_entity_id ) )
+                {
+                    sendAcquireInProgressResponse( JDKSAVDECC_AEM_STATUS_ENTITY_ACQUIRED );
+                    m_acquire_in_progress_by_controller_entity_id.clear();
+                }
             }
             else
             {
@@ -688,10 +778,22 @@ uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, F
                 // controller?
                 if ( isSet( m_acquire_in_progress_by_controller_entity_id ) )
                 {
-                    // yes, we we are already waiting for a dispute between 2
-                    // controllers.
-                    // return that we are acquired
-                    status = JDKSAVDECC_AEM_STATUS_ENTITY_ACQUIRED;
+                    if ( m_acquire_in_progress_by_controller_entity_id == controller_entity_id )
+                    {
+                        // The same controller retried, keep its latest command
+                        // for the final response
+                        m_acquire_in_progress_pdu.setLength( 0 );
+                        m_acquire_in_progress_pdu.putBuf(
+                            pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY_COMMAND_LEN );
+                        status = JDKSAVDECC_AEM_STATUS_IN_PROGRESS;
+                    }
+                    else
+                    {
+                        // yes, we we are already waiting for a dispute between
+                        // 2 controllers.
+                        // return that we are acquired
+                        status = JDKSAVDECC_AEM_STATUS_ENTITY_ACQUIRED;
+                    }
                 }
                 else
                 {
@@ -702,8 +804,15 @@ uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, F
 
                     sendControllerAvailable( m_acquired_by_controller_entity_id, m_acquired_by_controller_mac_address );
 
-                    // Keep track of when this happened
-                    m_acquire_in_progress_time = getRawSocket().getTimeInMilliseconds();
+                    // Remember who is asking and when the dispute has to be
+                    // settled by
+                    jdksavdecc_timestamp_in_milliseconds now = getRawSocket().getTimeInMilliseconds();
+                    m_acquire_in_progress_by_controller_entity_id = controller_entity_id;
+                    m_acquire_in_progress_pdu.setLength( 0 );
+                    m_acquire_in_progress_pdu.putBuf(
+                        pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY_COMMAND_LEN );
+                    m_acquire_in_progress_deadline = now + acquire_in_progress_timeout_in_millis;
+                    m_acquire_in_progress_resend_time = now + acquire_in_progress_resend_in_millis;
 
                     // Return IN_PROGRESS, the real response will be coming
                     // either
@@ -720,15 +829,86 @@ uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, F
         status = JDKSAVDECC_AEM_STATUS_BAD_ARGUMENTS;
     }
 
-    // TODO: Fill in response fields
+    // The response carries the current owner, or zero if there is none
+    Eui64 owner = m_acquired_by_controller_entity_id.isSet() ? m_acquired_by_controller_entity_id : Eui64( uint64_t( 0 ) );
+    owner.store( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY_RESPONSE_OFFSET_OWNER_ENTITY_ID );
+
     return status;
 }
 
+void Entity::sendAcquireInProgressResponse( uint8_t aem_status )
+{
+    FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY_RESPONSE_LEN> response;
+
+    response.putBuf( m_acquire_in_progress_pdu );
+    response.setDA( m_acquire_in_progress_pdu.getSA() );
+    response.setSA( getRawSocket().getMACAddress() );
+
+    // sv=0, version=0, message_type = AEM_RESPONSE
+    response.setOctet( JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE, JDKSAVDECC_FRAME_HEADER_LEN + 1 );
+
+    // status, keeping the top 3 bits of control_data_length
+    response.setOctet( ( response.getOctet( JDKSAVDECC_FRAME_HEADER_LEN + 2 ) & 0x7 ) + ( aem_status << 3 ),
+                       JDKSAVDECC_FRAME_HEADER_LEN + 2 );
+
+    Eui64 owner = m_acquired_by_controller_entity_id.isSet() ? m_acquired_by_controller_entity_id : Eui64( uint64_t( 0 ) );
+    owner.store( response.getBuf(),
+                 JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY_RESPONSE_OFFSET_OWNER_ENTITY_ID );
+
+    getRawSocket().sendFrame( response );
+}
+
 uint8_t Entity::receiveLockEntityCommand( jdksavdecc_aecpdu_aem const &aem, Frame &pdu )
 {
-    (void)aem;
-    (void)pdu;
-    return JDKSAVDECC_AECP_STATUS_NOT_IMPLEMENTED;
+    uint8_t status = JDKSAVDECC_AECP_STATUS_NOT_IMPLEMENTED;
+    Eui64 const controller_entity_id = aem.aecpdu_header.controller_entity_id;
+
+    if ( pdu.getLength() < JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_LOCK_ENTITY_COMMAND_LEN )
+    {
+        return JDKSAVDECC_AEM_STATUS_BAD_ARGUMENTS;
+    }
+
+    bool is_locked_by_other
+        = isSet( m_locked_by_controller_entity_id ) && m_locked_by_controller_entity_id != controller_entity_id;
+
+    if ( jdksavdecc_aem_command_lock_entity_get_descriptor_index( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN ) != 0
+         || jdksavdecc_aem_command_lock_entity_get_descriptor_type( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN )
+            != JDKSAVDECC_DESCRIPTOR_ENTITY )
+    {
+        // We only support locking at the entity level
+        status = JDKSAVDECC_AEM_STATUS_BAD_ARGUMENTS;
+    }
+    else if ( isSet( m_acquired_by_controller_entity_id ) && m_acquired_by_controller_entity_id != controller_entity_id )
+    {
+        // Only the owner can lock an acquired entity
+        status = JDKSAVDECC_AEM_STATUS_ENTITY_ACQUIRED;
+    }
+    else if ( is_locked_by_other )
+    {
+        // Someone else holds the lock, for both lock and unlock requests
+        status = JDKSAVDECC_AEM_STATUS_ENTITY_LOCKED;
+    }
+    else if ( jdksavdecc_aem_command_lock_entity_get_aem_lock_flags( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN )
+              & lock_entity_flag_unlock )
+    {
+        // Unlock
+        m_locked_by_controller_entity_id.clear();
+        status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+    }
+    else
+    {
+        // Lock, or refresh our own lock
+        m_locked_by_controller_entity_id = controller_entity_id;
+        m_lock_deadline = getRawSocket().getTimeInMilliseconds() + JDKSAVDECC_AEM_LOCK_TIMEOUT_MS;
+        status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+    }
+
+    // The response carries the controller holding the lock, or zero if there
+    // is none
+    Eui64 locker = m_locked_by_controller_entity_id.isSet() ? m_locked_by_controller_entity_id : Eui64( uint64_t( 0 ) );
+    locker.store( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_LOCK_ENTITY_RESPONSE_OFFSET_LOCKED_ENTITY_ID );
+
+    return status;
 }
 
 uint8_t Entity::receiveEntityAvailableCommand( jdksavdecc_aecpdu_aem const &aem, Frame &pdu )
@@ -749,14 +929,21 @@ uint8_t Entity::receiveControllerAvailableCommand( jdksavdecc_aecpdu_aem const &
 
 bool Entity::receiveControllerAvailableResponse( jdksavdecc_aecpdu_aem const &aem, Frame &pdu )
 {
-    (void)aem;
     (void)pdu;
+    bool r = false;
 
-    // TODO: Send a failed message to the controller that was attempting to
-    // acquire me
-    // cancel any acquire in progress
-    m_acquire_in_progress_by_controller_entity_id = Eui64();
-    return false;
+    // Is it the current owner answering the CONTROLLER_AVAILABLE we sent it?
+    if ( isSet( m_acquire_in_progress_by_controller_entity_id )
+         && aem.aecpdu_header.header.target_entity_id == m_acquired_by_controller_entity_id
+         && aem.aecpdu_header.sequence_id == m_controller_available_sequence_id )
+    {
+        // Yes, the owner is still around so the acquiring controller is told
+        // who owns us and the acquire in progress is cancelled
+        sendAcquireInProgressResponse( JDKSAVDECC_AEM_STATUS_ENTITY_ACQUIRED );
+        m_acquire_in_progress_by_controller_entity_id.clear();
+        r = true;
+    }
+    return r;
 }
 
 uint8_t Entity::receiveRegisterUnsolicitedNotificationCommand( jdksavdecc_aecpdu_aem const &aem, Frame &pdu )
@@ -765,6 +952,9 @@ uint8_t Entity::receiveRegisterUnsolicitedNotificationCommand( jdksavdecc_aecpdu
     bool registered = m_registered_controllers->addController( aem.aecpdu_header.controller_entity_id, pdu.getSA() );
     if ( registered )
     {
+        m_registered_controllers->refreshController( aem.aecpdu_header.controller_entity_id,
+                                                     getRawSocket().getTimeInMilliseconds(),
+                                                     RegisteredControllers::default_timeout_in_millis );
         status = JDKSAVDECC_AECP_STATUS_SUCCESS;
     }
     return status;
@@ -778,4 +968,26 @@ uint8_t Entity::receiveDeRegisterUnsolicitedNotificationCommand( jdksavdecc_aecp
 
     return status;
 }
+
+void Entity::receivedControllerAdvertisement( Frame const &frame )
+{
+    if ( frame.getOctet( JDKSAVDECC_FRAME_HEADER_LEN ) == JDKSAVDECC_1722A_SUBTYPE_ADP )
+    {
+        jdksavdecc_adpdu_common_control_header header;
+        if ( jdksavdecc_adpdu_common_control_header_read( &header, frame.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN, frame.getLength() )
+             > 0 )
+        {
+            if ( header.message_type == JDKSAVDECC_ADP_MESSAGE_TYPE_ENTITY_AVAILABLE )
+            {
+                // valid_time is in 2 second units
+                m_registered_controllers->refreshController(
+                    header.entity_id, getRawSocket().getTimeInMilliseconds(), header.valid_time * 2000 );
+            }
+            else if ( header.message_type == JDKSAVDECC_ADP_MESSAGE_TYPE_ENTITY_DEPARTING )
+            {
+                m_registered_controllers->removeController( header.entity_id );
+            }
+        }
+    }
+}
 }
@@ -33,6 +33,7 @@
 
 #include "JDKSAvdeccMCU/EntityState.hpp"
 #include "JDKSAvdeccMCU/Entity.hpp"
+#include "JDKSAvdeccMCU/Control.hpp"
 
 namespace JDKSAvdeccMCU
 {
@@ -173,11 +174,21 @@ uint8_t EntityState::readDescriptorConfiguration( Frame &pdu, uint16_t configura
 
 uint8_t EntityState::readDescriptorControl( Frame &pdu, uint16_t configuration_index, uint16_t descriptor_index )
 {
-    (void)pdu;
-    (void)configuration_index;
-    (void)descriptor_index;
+    uint8_t status = JDKSAVDECC_AEM_STATUS_NO_SUCH_DESCRIPTOR;
 
-    return JDKSAVDECC_AEM_STATUS_NO_SUCH_DESCRIPTOR;
+    if ( configuration_index == 0 )
+    {
+        for ( uint16_t i = 0; i < m_num_controls; ++i )
+        {
+            if ( m_controls[i] && m_controls[i]->getDescriptorIndex() == descriptor_index )
+            {
+                pdu.setLength( JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_READ_DESCRIPTOR_COMMAND_OFFSET_DESCRIPTOR_TYPE );
+                status = m_controls[i]->readControlDescriptor( pdu );
+                break;
+            }
+        }
+    }
+    return status;
 }
 
 uint8_t EntityState::readDescriptorLocale( Frame &pdu, uint16_t configuration_index, uint16_t descriptor_index )
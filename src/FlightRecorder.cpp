@@ -0,0 +1,288 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/FlightRecorder.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1
+
+namespace JDKSAvdeccMCU
+{
+
+FlightRecorder::FlightRecorder( size_t capacity_in_frames,
+                                uint32_t window_in_ms,
+                                std::string const &file_prefix,
+                                jdksavdecc_timestamp_in_milliseconds post_trigger_in_ms )
+    : m_slots( 0 )
+    , m_mask( 0 )
+    , m_next_ticket( 0 )
+    , m_now( 0 )
+    , m_window_in_ms( window_in_ms )
+    , m_file_prefix( file_prefix )
+    , m_post_trigger_in_ms( post_trigger_in_ms )
+    , m_triggered( false )
+    , m_trigger_seen( false )
+    , m_trigger_time( 0 )
+    , m_dump_count( 0 )
+{
+    size_t capacity = 1;
+    while ( capacity < capacity_in_frames )
+    {
+        capacity <<= 1;
+    }
+    m_mask = capacity - 1;
+    m_slots = new Slot[capacity];
+    for ( size_t i = 0; i < capacity; ++i )
+    {
+        m_slots[i].m_sequence.store( 0, std::memory_order_relaxed );
+    }
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    // Waits for the last triggered dump to be written
+    m_dump_writer.reset();
+    delete[] m_slots;
+}
+
+void FlightRecorder::tick( jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    m_now.store( timestamp, std::memory_order_relaxed );
+
+    if ( !m_triggered.load( std::memory_order_acquire ) )
+    {
+        return;
+    }
+
+    // The trigger time is taken from the first tick after the trigger so
+    // that trigger() can be called from anywhere
+    if ( !m_trigger_seen )
+    {
+        m_trigger_seen = true;
+        m_trigger_time = timestamp;
+    }
+
+    if ( timestamp - m_trigger_time >= m_post_trigger_in_ms )
+    {
+        char suffix[32];
+#if defined( _WIN32 )
+        sprintf_s( suffix, sizeof( suffix ), "-%u.pcap", unsigned( m_dump_count ) );
+#else
+        snprintf( suffix, sizeof( suffix ), "-%u.pcap", unsigned( m_dump_count ) );
+#endif
+        ++m_dump_count;
+
+        m_trigger_seen = false;
+        m_triggered.store( false, std::memory_order_release );
+
+        try
+        {
+            // The previous dump was handed off at least post_trigger_in_ms
+            // ago, so its writer is normally idle and closes at once. The
+            // buffer holds the whole ring so that the frames are only
+            // copied here and the file is written by the writer's thread.
+            m_dump_writer.reset();
+            m_dump_writer.reset( new PcapFileWriter( m_file_prefix + suffix,
+                                                     getCapacity() * ( sizeof( pcaprec_hdr_t ) + sizeof( Slot().m_data ) ),
+                                                     true,
+                                                     100,
+                                                     false ) );
+            dump( *m_dump_writer, m_window_in_ms );
+        }
+        catch ( std::exception const & )
+        {
+            // A failed dump must not take down the entity
+        }
+    }
+}
+
+bool FlightRecorder::receivedPDU( RawSocket *incoming_socket, Frame &frame )
+{
+    record( incoming_socket, false, frame );
+    return false;
+}
+
+void FlightRecorder::record( RawSocket const *socket,
+                             bool sent,
+                             Frame const &frame,
+                             uint8_t const *data1,
+                             uint16_t len1,
+                             uint8_t const *data2,
+                             uint16_t len2 )
+{
+    uint64_t ticket = m_next_ticket.fetch_add( 1, std::memory_order_relaxed );
+    Slot &slot = m_slots[ticket & m_mask];
+
+    slot.m_sequence.store( ticket * 2 + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+
+    slot.m_time_in_microseconds = uint64_t( getFrameTime( socket, frame, sent ) ) * 1000;
+    slot.m_socket = socket;
+    slot.m_sent = sent;
+
+    uint16_t len = std::min( frame.getLength(), uint16_t( sizeof( slot.m_data ) ) );
+    memcpy( slot.m_data, frame.getBuf(), len );
+    if ( data1 )
+    {
+        uint16_t n = std::min( len1, uint16_t( sizeof( slot.m_data ) - len ) );
+        memcpy( slot.m_data + len, data1, n );
+        len += n;
+    }
+    if ( data2 )
+    {
+        uint16_t n = std::min( len2, uint16_t( sizeof( slot.m_data ) - len ) );
+        memcpy( slot.m_data + len, data2, n );
+        len += n;
+    }
+    slot.m_length = len;
+
+    slot.m_sequence.store( ticket * 2 + 2, std::memory_order_release );
+
+    if ( isTrigger( frame, sent ) )
+    {
+        trigger();
+    }
+}
+
+void FlightRecorder::trigger() { m_triggered.store( true, std::memory_order_release ); }
+
+size_t FlightRecorder::dump( PcapFileWriter &writer, uint32_t window_in_ms, RawSocket const *socket ) const
+{
+    uint64_t end = m_next_ticket.load( std::memory_order_acquire );
+    uint64_t begin = end > m_mask + 1 ? end - ( m_mask + 1 ) : 0;
+    uint64_t oldest_time = 0;
+    size_t count = 0;
+
+    if ( window_in_ms > 0 )
+    {
+        uint64_t now = uint64_t( m_now.load( std::memory_order_relaxed ) ) * 1000;
+        uint64_t window = uint64_t( window_in_ms ) * 1000;
+        oldest_time = now > window ? now - window : 0;
+    }
+
+    uint64_t time_in_microseconds;
+    RawSocket const *slot_socket;
+    uint16_t length;
+    uint8_t data[sizeof( Slot().m_data )];
+
+    for ( uint64_t ticket = begin; ticket < end; ++ticket )
+    {
+        Slot const &slot = m_slots[ticket & m_mask];
+
+        // Copy the slot and keep the copy only if the slot still holds
+        // the same complete frame afterwards
+        uint64_t sequence = slot.m_sequence.load( std::memory_order_acquire );
+        if ( sequence != ticket * 2 + 2 )
+        {
+            continue;
+        }
+        time_in_microseconds = slot.m_time_in_microseconds;
+        slot_socket = slot.m_socket;
+        length = std::min( slot.m_length, uint16_t( sizeof( data ) ) );
+        memcpy( data, slot.m_data, length );
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( slot.m_sequence.load( std::memory_order_relaxed ) != sequence )
+        {
+            continue;
+        }
+
+        if ( time_in_microseconds >= oldest_time && ( socket == 0 || socket == slot_socket ) )
+        {
+            writer.WritePacket( time_in_microseconds, data, length );
+            ++count;
+        }
+    }
+    return count;
+}
+
+size_t FlightRecorder::dump( std::string const &filename, uint32_t window_in_ms, RawSocket const *socket ) const
+{
+    PcapFileWriter writer( filename, 4 * 1024 * 1024, false, 1000, false );
+    size_t count = dump( writer, window_in_ms, socket );
+    writer.flush();
+    return count;
+}
+
+bool FlightRecorder::isTrigger( Frame const &frame, bool sent ) const
+{
+    (void)sent;
+
+    if ( frame.getLength() < JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_COMMON_CONTROL_HEADER_LEN
+         || frame.getEtherType() != JDKSAVDECC_AVTP_ETHERTYPE )
+    {
+        return false;
+    }
+
+    uint8_t const *buf = frame.getBuf();
+    if ( jdksavdecc_common_control_header_get_subtype( buf, JDKSAVDECC_FRAME_HEADER_LEN ) != JDKSAVDECC_SUBTYPE_AECP
+         || jdksavdecc_common_control_header_get_control_data( buf, JDKSAVDECC_FRAME_HEADER_LEN )
+            != JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE )
+    {
+        return false;
+    }
+
+    uint32_t status = jdksavdecc_common_control_header_get_status( buf, JDKSAVDECC_FRAME_HEADER_LEN );
+    return status != JDKSAVDECC_AEM_STATUS_SUCCESS && status != JDKSAVDECC_AEM_STATUS_IN_PROGRESS
+           && status != JDKSAVDECC_AEM_STATUS_NOT_IMPLEMENTED;
+}
+
+jdksavdecc_timestamp_in_milliseconds FlightRecorder::getFrameTime( RawSocket const *socket, Frame const &frame, bool sent ) const
+{
+    if ( !sent && frame.getTimeInMilliseconds() != 0 )
+    {
+        return frame.getTimeInMilliseconds();
+    }
+    if ( socket )
+    {
+        return socket->getTimeInMilliseconds();
+    }
+    return m_now.load( std::memory_order_relaxed );
+}
+
+bool FlightRecorderRawSocket::sendFrame(
+    Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 )
+{
+    m_recorder.record( &m_socket, true, frame, data1, len1, data2, len2 );
+    return m_socket.sendFrame( frame, data1, len1, data2, len2 );
+}
+
+bool FlightRecorderRawSocket::sendReplyFrame( Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 )
+{
+    // The socket turns the frame into the reply, record it afterwards
+    bool r = m_socket.sendReplyFrame( frame, data1, len1, data2, len2 );
+    m_recorder.record( &m_socket, true, frame, data1, len1, data2, len2 );
+    return r;
+}
+}
+
+#else
+const char *jdksavdeccmcu_flightrecorder_file = __FILE__;
+#endif
@@ -55,7 +55,10 @@ bool HandlerGroup::add( Handler *v )
 /// and poll incoming network for PDU's and dispatch them
 void HandlerGroup::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
 {
-    // TODO:
+    for ( uint16_t i = 0; i < m_num_items; ++i )
+    {
+        m_item[i]->tick( time_in_millis );
+    }
 }
 
 /// Send ReceivedPDU message to each handler until one returns true.
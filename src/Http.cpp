@@ -34,23 +34,24 @@
 
 #if JDKSAVDECCMCU_ENABLE_HTTP
 
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
 namespace JDKSAvdeccMCU
 {
 
-static void append_to_vector( std::vector<uint8_t> *dest, std::string const &s )
+static uint8_t *append_octets( uint8_t *p, std::string const &s )
 {
-    for ( std::string::const_iterator i = s.begin(); i != s.end(); ++i )
-    {
-        dest->push_back( (uint8_t)*i );
-    }
+    memcpy( p, s.data(), s.length() );
+    return p + s.length();
 }
 
-static void append_to_vector( std::vector<uint8_t> *dest, std::vector<uint8_t> const &b )
+static uint8_t *append_crlf( uint8_t *p )
 {
-    for ( std::vector<uint8_t>::const_iterator i = b.begin(); i != b.end(); ++i )
-    {
-        dest->push_back( *i );
-    }
+    p[0] = '\r';
+    p[1] = '\n';
+    return p + 2;
 }
 
 void HttpRequest::clear()
@@ -155,9 +156,9 @@ void HttpRequest::set( const std::string &method,
             {
                 char lenascii[32];
 #if defined( _WIN32 )
-                sprintf_s( lenascii, sizeof( lenascii ), "%d\r\n", (int)content.size() );
+                sprintf_s( lenascii, sizeof( lenascii ), "%d", (int)content.size() );
 #else
-                sprintf( lenascii, "%d\r\n", (int)content.size() );
+                sprintf( lenascii, "%d", (int)content.size() );
 #endif
                 s.append( lenascii );
             }
@@ -173,22 +174,46 @@ void HttpRequest::set( const std::string &method,
     m_content = content;
 }
 
-void HttpRequest::flatten( std::string *dest ) const
+size_t HttpRequest::getFlattenedLength() const
 {
-    dest->clear();
-    dest->append( m_method );
-    dest->append( " " );
-    dest->append( m_path );
-    dest->append( " " );
-    dest->append( m_version );
-    dest->append( "\r\n" );
+    size_t len = m_method.length() + 1 + m_path.length() + 1 + m_version.length() + 2;
 
     for ( std::vector<std::string>::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i )
     {
-        dest->append( *i );
-        dest->append( "\r\n" );
+        len += i->length() + 2;
     }
-    dest->append( "\r\n" );
+    return len + 2;
+}
+
+size_t HttpRequest::flatten( uint8_t *dest, size_t dest_len ) const
+{
+    size_t len = getFlattenedLength();
+    if ( len > dest_len )
+    {
+        return 0;
+    }
+
+    uint8_t *p = append_octets( dest, m_method );
+    *p++ = ' ';
+    p = append_octets( p, m_path );
+    *p++ = ' ';
+    p = append_octets( p, m_version );
+    p = append_crlf( p );
+
+    for ( std::vector<std::string>::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i )
+    {
+        p = append_octets( p, *i );
+        p = append_crlf( p );
+    }
+    append_crlf( p );
+
+    return len;
+}
+
+void HttpRequest::flatten( std::string *dest ) const
+{
+    dest->resize( getFlattenedLength() );
+    flatten( reinterpret_cast<uint8_t *>( &( *dest )[0] ), dest->length() );
 }
 
 void HttpResponse::clear()
@@ -200,26 +225,51 @@ void HttpResponse::clear()
     m_content.clear();
 }
 
-void HttpResponse::flatten( std::vector<uint8_t> *dest ) const
+size_t HttpResponse::getFlattenedLength() const
 {
-    dest->clear();
-    append_to_vector( dest, m_version );
-    dest->push_back( ' ' );
-    append_to_vector( dest, m_status_code );
-    dest->push_back( ' ' );
-    append_to_vector( dest, m_reason_phrase );
-    dest->push_back( '\r' );
-    dest->push_back( '\n' );
+    size_t len = m_version.length() + 1 + m_status_code.length() + 1 + m_reason_phrase.length() + 2;
 
     for ( std::vector<std::string>::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i )
     {
-        append_to_vector( dest, *i );
-        dest->push_back( '\r' );
-        dest->push_back( '\n' );
+        len += i->length() + 2;
     }
-    dest->push_back( '\r' );
-    dest->push_back( '\n' );
-    append_to_vector( dest, m_content );
+    return len + 2 + m_content.size();
+}
+
+size_t HttpResponse::flatten( uint8_t *dest, size_t dest_len ) const
+{
+    size_t len = getFlattenedLength();
+    if ( len > dest_len )
+    {
+        return 0;
+    }
+
+    uint8_t *p = append_octets( dest, m_version );
+    *p++ = ' ';
+    p = append_octets( p, m_status_code );
+    *p++ = ' ';
+    p = append_octets( p, m_reason_phrase );
+    p = append_crlf( p );
+
+    for ( std::vector<std::string>::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i )
+    {
+        p = append_octets( p, *i );
+        p = append_crlf( p );
+    }
+    p = append_crlf( p );
+
+    if ( !m_content.empty() )
+    {
+        memcpy( p, m_content.data(), m_content.size() );
+    }
+
+    return len;
+}
+
+void HttpResponse::flatten( std::vector<uint8_t> *dest ) const
+{
+    dest->resize( getFlattenedLength() );
+    flatten( dest->data(), dest->size() );
 }
 
 void HttpServerParserSimple::clear()
@@ -532,6 +582,400 @@ ssize_t HttpClientParserSimple::onIncomingHttpData( const uint8_t *data, ssize_t
     return r;
 }
 
+static bool is_header_text( uint8_t const *p, size_t len )
+{
+    size_t i = 0;
+#if defined( __SSE2__ )
+    // 16 octets at a time: as signed octets, everything below ' ' or above
+    // '~' is either less than ' ' or equal to DEL
+    __m128i const space = _mm_set1_epi8( ' ' );
+    __m128i const del = _mm_set1_epi8( 0x7f );
+    __m128i const cr = _mm_set1_epi8( '\r' );
+    __m128i const lf = _mm_set1_epi8( '\n' );
+    for ( ; i + 16 <= len; i += 16 )
+    {
+        __m128i v = _mm_loadu_si128( reinterpret_cast<__m128i const *>( p + i ) );
+        __m128i eol = _mm_or_si128( _mm_cmpeq_epi8( v, cr ), _mm_cmpeq_epi8( v, lf ) );
+        __m128i bad = _mm_or_si128( _mm_andnot_si128( eol, _mm_cmplt_epi8( v, space ) ), _mm_cmpeq_epi8( v, del ) );
+        if ( _mm_movemask_epi8( bad ) != 0 )
+        {
+            return false;
+        }
+    }
+#endif
+    for ( ; i < len; ++i )
+    {
+        uint8_t c = p[i];
+        if ( ( c < ' ' || c > '~' ) && c != '\r' && c != '\n' )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+HttpHeaderBlock::HttpHeaderBlock( size_t max_octets )
+    : m_max_octets( max_octets ), m_scan_pos( 0 ), m_line_start( 0 ), m_complete( false )
+{
+}
+
+void HttpHeaderBlock::clear()
+{
+    m_buf.clear();
+    m_scan_pos = 0;
+    m_line_start = 0;
+    m_complete = false;
+    m_start_line = HttpSlice();
+    m_headers.clear();
+}
+
+ssize_t HttpHeaderBlock::scan( uint8_t const *data, ssize_t len )
+{
+    if ( m_complete || len < 0 )
+    {
+        return m_complete ? 0 : -1;
+    }
+
+    size_t prev_size = m_buf.size();
+    size_t take = std::min( size_t( len ), m_max_octets - prev_size );
+    m_buf.insert( m_buf.end(), data, data + take );
+
+    uint8_t const *base = &m_buf[0];
+    size_t end = m_buf.size();
+
+    while ( m_scan_pos < end )
+    {
+        uint8_t const *lf = static_cast<uint8_t const *>( memchr( base + m_scan_pos, '\n', end - m_scan_pos ) );
+        if ( !lf )
+        {
+            m_scan_pos = end;
+            break;
+        }
+
+        size_t lf_pos = size_t( lf - base );
+        size_t line_len = lf_pos - m_line_start;
+
+        if ( line_len == 0 || ( line_len == 1 && base[m_line_start] == '\r' ) )
+        {
+            // The blank line ends the header, anything after it is not ours
+            m_buf.resize( lf_pos + 1 );
+            m_complete = true;
+            return split() ? ssize_t( m_buf.size() - prev_size ) : -1;
+        }
+
+        m_line_start = lf_pos + 1;
+        m_scan_pos = m_line_start;
+    }
+
+    return m_buf.size() < m_max_octets ? len : -1;
+}
+
+bool HttpHeaderBlock::split()
+{
+    uint8_t const *base = &m_buf[0];
+    size_t pos = 0;
+    size_t end = m_buf.size();
+    bool first = true;
+
+    // Only printable ASCII, CR and LF are allowed in the header
+    if ( !is_header_text( base, end ) )
+    {
+        return false;
+    }
+
+    while ( pos < end )
+    {
+        uint8_t const *lf = static_cast<uint8_t const *>( memchr( base + pos, '\n', end - pos ) );
+        size_t line_end = size_t( lf - base );
+        size_t next = line_end + 1;
+
+        if ( line_end > pos && base[line_end - 1] == '\r' )
+        {
+            --line_end;
+        }
+
+        if ( first )
+        {
+            if ( line_end == pos )
+            {
+                return false;
+            }
+            m_start_line = HttpSlice( pos, line_end - pos );
+            first = false;
+        }
+        else if ( line_end > pos )
+        {
+            HttpHeaderSlice h;
+            uint8_t const *colon = static_cast<uint8_t const *>( memchr( base + pos, ':', line_end - pos ) );
+            if ( colon )
+            {
+                size_t colon_pos = size_t( colon - base );
+                size_t value_pos = colon_pos + 1;
+                while ( value_pos < line_end && base[value_pos] == ' ' )
+                {
+                    ++value_pos;
+                }
+                h.m_name = HttpSlice( pos, colon_pos - pos );
+                h.m_value = HttpSlice( value_pos, line_end - value_pos );
+            }
+            else
+            {
+                h.m_name = HttpSlice( pos, line_end - pos );
+                h.m_value = HttpSlice( line_end, 0 );
+            }
+            m_headers.push_back( h );
+        }
+        pos = next;
+    }
+    return !first;
+}
+
+bool HttpHeaderBlock::findHeader( char const *name, HttpSlice *value ) const
+{
+    size_t name_len = strlen( name );
+    uint8_t const *base = getOctets();
+
+    for ( std::vector<HttpHeaderSlice>::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i )
+    {
+        if ( i->m_name.m_length == name_len )
+        {
+            size_t n = 0;
+            while ( n < name_len && tolower( base[i->m_name.m_offset + n] ) == tolower( (uint8_t)name[n] ) )
+            {
+                ++n;
+            }
+            if ( n == name_len )
+            {
+                *value = i->m_value;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool HttpHeaderBlock::splitStartLine( HttpSlice *first, HttpSlice *second, HttpSlice *rest ) const
+{
+    uint8_t const *base = getOctets();
+    size_t pos = m_start_line.m_offset;
+    size_t end = m_start_line.m_offset + m_start_line.m_length;
+
+    uint8_t const *sp1 = static_cast<uint8_t const *>( memchr( base + pos, ' ', end - pos ) );
+    if ( !sp1 )
+    {
+        return false;
+    }
+    size_t sp1_pos = size_t( sp1 - base );
+    *first = HttpSlice( pos, sp1_pos - pos );
+
+    pos = sp1_pos + 1;
+    uint8_t const *sp2 = static_cast<uint8_t const *>( memchr( base + pos, ' ', end - pos ) );
+    if ( sp2 )
+    {
+        size_t sp2_pos = size_t( sp2 - base );
+        *second = HttpSlice( pos, sp2_pos - pos );
+        *rest = HttpSlice( sp2_pos + 1, end - sp2_pos - 1 );
+    }
+    else
+    {
+        *second = HttpSlice( pos, end - pos );
+        *rest = HttpSlice( end, 0 );
+    }
+    return true;
+}
+
+static bool parse_content_length( uint8_t const *p, size_t len, size_t *value )
+{
+    size_t v = 0;
+    if ( len == 0 )
+    {
+        return false;
+    }
+    for ( size_t i = 0; i < len; ++i )
+    {
+        if ( p[i] < '0' || p[i] > '9' || v > ( ~size_t( 0 ) - 9 ) / 10 )
+        {
+            return false;
+        }
+        v = v * 10 + ( p[i] - '0' );
+    }
+    *value = v;
+    return true;
+}
+
+void HttpServerParserFast::clear()
+{
+    HttpServerParser::clear();
+    m_block.clear();
+    m_parse_state = ParsingHeader;
+    m_content_remaining = 0;
+}
+
+ssize_t HttpServerParserFast::onIncomingHttpData( const uint8_t *data, ssize_t len )
+{
+    ssize_t r = -1;
+
+    if ( len == 0 )
+    {
+        // EOF is only expected while reading content until close
+        if ( m_parse_state == ParsingContentUntilClose )
+        {
+            m_parse_state = ParsingFinished;
+            r = m_handler->onIncomingHttpRequest( *m_request ) ? 0 : -1;
+        }
+    }
+    else if ( m_parse_state == ParsingHeader )
+    {
+        r = m_block.scan( data, len );
+        if ( r >= 0 && m_block.isComplete() )
+        {
+            if ( !onHeaderComplete() )
+            {
+                r = -1;
+            }
+            else if ( m_parse_state == ParsingContentLength )
+            {
+                ssize_t used = onContent( data + r, len - r );
+                r = used >= 0 ? r + used : -1;
+            }
+            else if ( m_parse_state == ParsingContentUntilClose )
+            {
+                m_request->m_content.insert( m_request->m_content.end(), data + r, data + len );
+                r = len;
+            }
+        }
+    }
+    else if ( m_parse_state == ParsingContentLength )
+    {
+        r = onContent( data, len );
+    }
+    else if ( m_parse_state == ParsingContentUntilClose )
+    {
+        m_request->m_content.insert( m_request->m_content.end(), data, data + len );
+        r = len;
+    }
+    else
+    {
+        r = 0;
+    }
+    return r;
+}
+
+bool HttpServerParserFast::onHeaderComplete()
+{
+    HttpSlice method, path, version;
+    if ( !m_block.splitStartLine( &method, &path, &version ) )
+    {
+        return false;
+    }
+
+    m_block.assignTo( &m_request->m_method, method );
+    m_block.assignTo( &m_request->m_path, path );
+    m_block.assignTo( &m_request->m_version, version );
+    m_request->m_headers.clear();
+    m_request->m_content.clear();
+
+    if ( m_store_header_lines )
+    {
+        for ( size_t i = 0; i < m_block.getHeaderCount(); ++i )
+        {
+            HttpHeaderSlice const &h = m_block.getHeader( i );
+            HttpSlice line( h.m_name.m_offset, h.m_value.m_offset + h.m_value.m_length - h.m_name.m_offset );
+            m_request->m_headers.push_back( m_block.getString( line ) );
+        }
+    }
+
+    if ( m_request->m_method == "POST" || m_request->m_method == "PUT" )
+    {
+        HttpSlice content_length;
+        if ( !m_block.findHeader( "Content-Length", &content_length ) )
+        {
+            // Without a length the content ends when the connection does
+            m_parse_state = ParsingContentUntilClose;
+            return true;
+        }
+        if ( !parse_content_length(
+                 m_block.getOctets() + content_length.m_offset, content_length.m_length, &m_content_remaining ) )
+        {
+            return false;
+        }
+        if ( m_content_remaining > 0 )
+        {
+            m_parse_state = ParsingContentLength;
+            return true;
+        }
+    }
+
+    m_parse_state = ParsingFinished;
+    return m_handler->onIncomingHttpRequest( *m_request );
+}
+
+ssize_t HttpServerParserFast::onContent( const uint8_t *data, ssize_t len )
+{
+    size_t used = std::min( size_t( len ), m_content_remaining );
+    m_request->m_content.insert( m_request->m_content.end(), data, data + used );
+    m_content_remaining -= used;
+
+    if ( m_content_remaining == 0 )
+    {
+        // Anything after the content belongs to the next request
+        m_parse_state = ParsingFinished;
+        if ( !m_handler->onIncomingHttpRequest( *m_request ) )
+        {
+            return -1;
+        }
+    }
+    return ssize_t( used );
+}
+
+void HttpClientParserFast::clear()
+{
+    HttpClientParser::clear();
+    m_block.clear();
+}
+
+ssize_t HttpClientParserFast::onIncomingHttpData( const uint8_t *data, ssize_t len )
+{
+    if ( len == 0 )
+    {
+        return -1;
+    }
+
+    bool was_complete = m_block.isComplete();
+    ssize_t r = m_block.scan( data, len );
+
+    if ( r >= 0 && !was_complete && m_block.isComplete() )
+    {
+        HttpSlice version, status_code, reason_phrase;
+        if ( !m_block.splitStartLine( &version, &status_code, &reason_phrase ) )
+        {
+            return -1;
+        }
+
+        m_block.assignTo( &m_response->m_version, version );
+        m_block.assignTo( &m_response->m_status_code, status_code );
+        m_block.assignTo( &m_response->m_reason_phrase, reason_phrase );
+        m_response->m_headers.clear();
+        m_response->m_content.clear();
+
+        if ( m_store_header_lines )
+        {
+            for ( size_t i = 0; i < m_block.getHeaderCount(); ++i )
+            {
+                HttpHeaderSlice const &h = m_block.getHeader( i );
+                HttpSlice line( h.m_name.m_offset, h.m_value.m_offset + h.m_value.m_length - h.m_name.m_offset );
+                m_response->m_headers.push_back( m_block.getString( line ) );
+            }
+        }
+
+        if ( !m_handler->onIncomingHttpResponse( *m_response ) )
+        {
+            r = -1;
+        }
+    }
+    return r;
+}
+
 bool HttpServerHandler::onIncomingHttpRequest( const HttpRequest &request )
 {
     bool r = false;
@@ -0,0 +1,411 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/MemoryObjectUpload.hpp"
+#include "JDKSAvdeccMCU/EntityState.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+MemoryObjectUpload::MemoryObjectUpload( EEPromDevice &device,
+                                        uint32_t device_offset,
+                                        uint32_t max_length,
+                                        uint32_t aa_base_address,
+                                        uint32_t commit_address,
+                                        uint8_t *staging,
+                                        uint8_t *coverage,
+                                        uint16_t staging_size )
+    : m_device( device )
+    , m_device_offset( device_offset )
+    , m_max_length( max_length )
+    , m_aa_base_address( aa_base_address )
+    , m_commit_address( commit_address )
+    , m_staging_size( staging_size )
+{
+    for ( uint16_t i = 0; i < 2; ++i )
+    {
+        m_stage[i].m_buf = staging + i * staging_size;
+        m_stage[i].m_coverage = coverage + i * ( staging_size / 8 );
+    }
+    reset();
+}
+
+void MemoryObjectUpload::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    (void)time_in_millis;
+    if ( m_active && !program() )
+    {
+        fail( JDKSAVDECC_AECP_AA_STATUS_DATA_INVALID );
+    }
+}
+
+uint8_t MemoryObjectUpload::receiveAARead( uint32_t virtual_base_address, uint16_t length, uint8_t *response )
+{
+    if ( virtual_base_address < m_aa_base_address )
+    {
+        return JDKSAVDECC_AECP_AA_STATUS_ADDRESS_TOO_LOW;
+    }
+    uint32_t offset = virtual_base_address - m_aa_base_address;
+    if ( offset > m_max_length || length > m_max_length - offset )
+    {
+        return JDKSAVDECC_AECP_AA_STATUS_ADDRESS_TOO_HIGH;
+    }
+    if ( !m_device.read( m_device_offset + offset, response, length ) )
+    {
+        return JDKSAVDECC_AECP_AA_STATUS_ADDRESS_INVALID;
+    }
+    return JDKSAVDECC_AECP_AA_STATUS_SUCCESS;
+}
+
+uint8_t MemoryObjectUpload::receiveAAWrite( uint32_t virtual_base_address, uint16_t length, uint8_t const *request )
+{
+    if ( virtual_base_address < m_aa_base_address )
+    {
+        return JDKSAVDECC_AECP_AA_STATUS_ADDRESS_TOO_LOW;
+    }
+    uint32_t offset = virtual_base_address - m_aa_base_address;
+    if ( offset > m_max_length || length > m_max_length - offset )
+    {
+        return JDKSAVDECC_AECP_AA_STATUS_ADDRESS_TOO_HIGH;
+    }
+
+    if ( !m_active )
+    {
+        // The first write starts a new upload
+        reset();
+        m_active = true;
+    }
+
+    uint8_t status = JDKSAVDECC_AECP_AA_STATUS_SUCCESS;
+
+    // The block may straddle the two staged windows
+    uint16_t pos = 0;
+    while ( pos < length )
+    {
+        uint32_t block_offset = offset + pos;
+        uint16_t window_pos = uint16_t( block_offset % m_staging_size );
+        uint32_t window_base = block_offset - window_pos;
+        uint16_t n = length - pos;
+        if ( n > m_staging_size - window_pos )
+        {
+            n = m_staging_size - window_pos;
+        }
+
+        // Anything in an already programmed window is a retry of data we
+        // have; so is anything in a window that is being programmed
+        if ( window_base + m_staging_size > m_programmed_offset )
+        {
+            Stage *stage = findStage( window_base, true );
+            if ( !stage )
+            {
+                // Too far ahead of the flash, let the controller retry later
+                status = EntityState::aa_status_no_response;
+                break;
+            }
+            if ( !stage->m_programming )
+            {
+                memcpy( stage->m_buf + window_pos, request + pos, n );
+                for ( uint16_t i = window_pos; i < window_pos + n; ++i )
+                {
+                    uint8_t mask = uint8_t( 1 << ( i & 7 ) );
+                    if ( ( stage->m_coverage[i >> 3] & mask ) == 0 )
+                    {
+                        stage->m_coverage[i >> 3] |= mask;
+                        stage->m_received++;
+                    }
+                }
+            }
+        }
+        pos += n;
+    }
+
+    if ( status == JDKSAVDECC_AECP_AA_STATUS_SUCCESS && offset + length > m_end_offset )
+    {
+        m_end_offset = offset + length;
+    }
+
+    advanceCrc();
+
+    if ( !program() )
+    {
+        fail( JDKSAVDECC_AECP_AA_STATUS_DATA_INVALID );
+        status = JDKSAVDECC_AECP_AA_STATUS_DATA_INVALID;
+    }
+    return status;
+}
+
+uint8_t MemoryObjectUpload::receiveAAExecute( uint32_t virtual_base_address, uint16_t length, uint8_t const *request )
+{
+    if ( virtual_base_address != m_commit_address )
+    {
+        return JDKSAVDECC_AECP_AA_STATUS_ADDRESS_INVALID;
+    }
+    if ( length != 4 )
+    {
+        return JDKSAVDECC_AECP_AA_STATUS_DATA_INVALID;
+    }
+
+    uint32_t crc32 = jdksavdecc_uint32_get( request, 0 );
+
+    if ( !m_active )
+    {
+        // A retry of the EXECUTE that committed the last upload succeeds again
+        return ( m_committed && crc32 == m_committed_crc32 ) ? JDKSAVDECC_AECP_AA_STATUS_SUCCESS
+                                                               : JDKSAVDECC_AECP_AA_STATUS_DATA_INVALID;
+    }
+
+    if ( m_crc_offset != m_end_offset || m_crc32 != crc32 )
+    {
+        fail( JDKSAVDECC_AECP_AA_STATUS_DATA_INVALID );
+        return JDKSAVDECC_AECP_AA_STATUS_DATA_INVALID;
+    }
+
+    // A window staged past the end of the upload holds data from a write
+    // that was not accepted, it can not be programmed
+    for ( uint16_t i = 0; i < 2; ++i )
+    {
+        Stage &stage = m_stage[i];
+        if ( stage.m_in_use && !stage.m_programming && stage.m_base >= m_end_offset )
+        {
+            fail( JDKSAVDECC_AECP_AA_STATUS_ADDRESS_TOO_HIGH );
+            return JDKSAVDECC_AECP_AA_STATUS_ADDRESS_TOO_HIGH;
+        }
+    }
+
+    // Program whatever is still staged, including the final partial window
+    for ( uint16_t i = 0; i < 2; ++i )
+    {
+        Stage &stage = m_stage[i];
+        if ( stage.m_in_use && !stage.m_programming )
+        {
+            uint32_t remaining = m_end_offset - stage.m_base;
+            stage.m_programming = true;
+            stage.m_page_erased = false;
+            stage.m_program_pos = 0;
+            stage.m_program_length = remaining > m_staging_size ? m_staging_size : uint16_t( remaining );
+        }
+    }
+
+    if ( !program() )
+    {
+        fail( JDKSAVDECC_AECP_AA_STATUS_DATA_INVALID );
+        return JDKSAVDECC_AECP_AA_STATUS_DATA_INVALID;
+    }
+
+    if ( m_programmed_offset < m_end_offset )
+    {
+        // The device is still busy, the controller will retry the EXECUTE
+        return EntityState::aa_status_no_response;
+    }
+
+    uint32_t committed_length = m_end_offset;
+    reset();
+    m_committed = true;
+    m_committed_length = committed_length;
+    m_committed_crc32 = crc32;
+    uploadCompleted( committed_length, crc32 );
+    return JDKSAVDECC_AECP_AA_STATUS_SUCCESS;
+}
+
+void MemoryObjectUpload::reset()
+{
+    for ( uint16_t i = 0; i < 2; ++i )
+    {
+        m_stage[i].m_in_use = false;
+    }
+    m_active = false;
+    m_end_offset = 0;
+    m_crc_offset = 0;
+    m_crc32 = 0;
+    m_programmed_offset = 0;
+    m_committed = false;
+    m_committed_length = 0;
+    m_committed_crc32 = 0;
+}
+
+void MemoryObjectUpload::uploadCompleted( uint32_t length, uint32_t crc32 )
+{
+    (void)length;
+    (void)crc32;
+}
+
+void MemoryObjectUpload::uploadFailed( uint8_t aa_status ) { (void)aa_status; }
+
+MemoryObjectUpload::Stage *MemoryObjectUpload::findStage( uint32_t base, bool allocate )
+{
+    Stage *free_stage = 0;
+    for ( uint16_t i = 0; i < 2; ++i )
+    {
+        if ( m_stage[i].m_in_use )
+        {
+            if ( m_stage[i].m_base == base )
+            {
+                return &m_stage[i];
+            }
+        }
+        else if ( !free_stage )
+        {
+            free_stage = &m_stage[i];
+        }
+    }
+
+    // Only the lowest unprogrammed window and the one after it may be staged,
+    // otherwise the lowest window could be starved of a buffer
+    if ( allocate && free_stage && base < m_programmed_offset + 2 * uint32_t( m_staging_size ) )
+    {
+        free_stage->m_in_use = true;
+        free_stage->m_programming = false;
+        free_stage->m_page_erased = false;
+        free_stage->m_base = base;
+        free_stage->m_received = 0;
+        free_stage->m_program_length = 0;
+        free_stage->m_program_pos = 0;
+        memset( free_stage->m_coverage, 0, m_staging_size / 8 );
+        return free_stage;
+    }
+    return 0;
+}
+
+void MemoryObjectUpload::advanceCrc()
+{
+    while ( m_crc_offset < m_end_offset )
+    {
+        uint16_t start = uint16_t( m_crc_offset % m_staging_size );
+        Stage *stage = findStage( m_crc_offset - start, false );
+        if ( !stage )
+        {
+            break;
+        }
+
+        // Only the octets before the end of the upload are part of the CRC,
+        // the rest of the last window is not data
+        uint16_t limit = m_staging_size;
+        if ( m_end_offset - m_crc_offset < uint32_t( m_staging_size - start ) )
+        {
+            limit = uint16_t( start + ( m_end_offset - m_crc_offset ) );
+        }
+
+        // Find the end of the contiguous run of received octets
+        uint8_t const *coverage = stage->m_coverage;
+        uint16_t end = start;
+        while ( end < limit )
+        {
+            if ( ( end & 7 ) == 0 && end + 8 <= limit && coverage[end >> 3] == 0xff )
+            {
+                end += 8;
+            }
+            else if ( coverage[end >> 3] & ( 1 << ( end & 7 ) ) )
+            {
+                end++;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if ( end > start )
+        {
+            m_crc32 = calculateCrc32( m_crc32, stage->m_buf + start, end - start );
+            m_crc_offset += end - start;
+        }
+
+        if ( end < limit )
+        {
+            // A gap, wait for more blocks
+            break;
+        }
+    }
+}
+
+bool MemoryObjectUpload::program()
+{
+    uint16_t page_size = m_device.getPageSize();
+
+    while ( !m_device.isBusy() )
+    {
+        Stage *stage = findStage( m_programmed_offset, false );
+        if ( !stage )
+        {
+            break;
+        }
+        if ( !stage->m_programming )
+        {
+            if ( stage->m_received != m_staging_size )
+            {
+                break;
+            }
+            stage->m_programming = true;
+            stage->m_page_erased = false;
+            stage->m_program_pos = 0;
+            stage->m_program_length = m_staging_size;
+        }
+
+        uint32_t device_offset = m_device_offset + stage->m_base + stage->m_program_pos;
+        if ( !stage->m_page_erased )
+        {
+            if ( !m_device.erasePage( device_offset ) )
+            {
+                return false;
+            }
+            stage->m_page_erased = true;
+        }
+        else
+        {
+            uint16_t n = stage->m_program_length - stage->m_program_pos;
+            if ( n > page_size )
+            {
+                n = page_size;
+            }
+            if ( !m_device.program( device_offset, stage->m_buf + stage->m_program_pos, n ) )
+            {
+                return false;
+            }
+            stage->m_program_pos += n;
+            stage->m_page_erased = false;
+            if ( stage->m_program_pos >= stage->m_program_length )
+            {
+                // The window is in the device, its buffer is free again
+                m_programmed_offset = stage->m_base + stage->m_program_length;
+                stage->m_in_use = false;
+            }
+        }
+    }
+    return true;
+}
+
+void MemoryObjectUpload::fail( uint8_t aa_status )
+{
+    reset();
+    uploadFailed( aa_status );
+}
+}
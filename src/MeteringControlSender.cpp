@@ -0,0 +1,221 @@
+/*
+  Copyright (c) 2014, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/MeteringControlSender.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_FLOAT && JDKSAVDECCMCU_ENABLE_VECTOR
+namespace JDKSAvdeccMCU
+{
+
+MeteringControlSender::MeteringControlSender( ControllerEntity &controller_entity,
+                                              Eui64 const &target_entity_id,
+                                              Eui48 const &target_mac_address,
+                                              jdksavdecc_timestamp_in_milliseconds min_interval_in_millis,
+                                              jdksavdecc_timestamp_in_milliseconds max_interval_in_millis,
+                                              uint16_t max_backlog,
+                                              uint16_t max_frames_per_burst )
+    : m_controller_entity( controller_entity )
+    , m_target_entity_id( target_entity_id )
+    , m_target_mac_address( target_mac_address )
+    , m_min_interval_in_millis( min_interval_in_millis )
+    , m_max_interval_in_millis( max_interval_in_millis > min_interval_in_millis ? max_interval_in_millis : min_interval_in_millis )
+    , m_interval_in_millis( min_interval_in_millis )
+    , m_last_burst_time_in_millis( 0 )
+    , m_max_backlog( max_backlog )
+    , m_max_frames_per_burst( max_frames_per_burst )
+    , m_backlog( 0 )
+    , m_target_out_of_resources( false )
+    , m_next_meter( 0 )
+    , m_sent_count( 0 )
+{
+}
+
+void MeteringControlSender::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    if ( m_meters.empty() || !wasTimeOutHit( time_in_millis, m_last_burst_time_in_millis, m_interval_in_millis ) )
+    {
+        return;
+    }
+    m_last_burst_time_in_millis = time_in_millis;
+
+    adaptInterval();
+
+    // Take turns from where the last burst stopped, so that a busy meter
+    // at the front can not starve the ones behind it
+    uint16_t frames = 0;
+    size_t count = m_meters.size();
+    size_t next = m_next_meter;
+    for ( size_t n = 0; n < count && frames < m_max_frames_per_burst; ++n )
+    {
+        size_t i = ( m_next_meter + n ) % count;
+        Meter &m = m_meters[i];
+        if ( isDue( m, time_in_millis ) )
+        {
+            sendMeter( m, time_in_millis );
+            ++frames;
+            next = ( i + 1 ) % count;
+        }
+    }
+    m_next_meter = next;
+}
+
+bool MeteringControlSender::receivedPDU( RawSocket *incoming_socket, Frame &frame )
+{
+    (void)incoming_socket;
+    jdksavdecc_aecpdu_aem aem;
+    uint16_t pos = JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AECPDU_AEM_LEN;
+
+    // Unsolicited responses are not answers to our commands
+    if ( m_backlog > 0 && parseAEM( &aem, frame ) && isAEMForController( aem, m_controller_entity.getEntityID() )
+         && aem.command_type == JDKSAVDECC_AEM_COMMAND_SET_CONTROL
+         && aem.aecpdu_header.header.target_entity_id == m_target_entity_id && frame.getLength() >= pos + 4
+         && frame.getDoublet( pos ) == JDKSAVDECC_DESCRIPTOR_CONTROL )
+    {
+        uint16_t descriptor_index = frame.getDoublet( pos + 2 );
+        for ( size_t i = 0; i < m_meters.size(); ++i )
+        {
+            if ( m_meters[i].m_target_descriptor_index == descriptor_index )
+            {
+                --m_backlog;
+                if ( aem.aecpdu_header.header.status == JDKSAVDECC_AEM_STATUS_NO_RESOURCES )
+                {
+                    m_target_out_of_resources = true;
+                }
+                break;
+            }
+        }
+    }
+
+    // The ControllerEntity and other handlers may want the response as well
+    return false;
+}
+
+void MeteringControlSender::adaptInterval()
+{
+    if ( m_target_out_of_resources || m_backlog > m_max_backlog )
+    {
+        // The target is falling behind, back off quickly
+        m_interval_in_millis *= 2;
+        if ( m_interval_in_millis > m_max_interval_in_millis || m_interval_in_millis == 0 )
+        {
+            m_interval_in_millis = m_max_interval_in_millis;
+        }
+    }
+    else if ( m_backlog == 0 )
+    {
+        // The target kept up, speed up gradually
+        m_interval_in_millis = m_min_interval_in_millis + ( m_interval_in_millis - m_min_interval_in_millis ) * 3 / 4;
+    }
+
+    // Responses that never came are not held against the following bursts
+    m_backlog = 0;
+    m_target_out_of_resources = false;
+}
+
+bool MeteringControlSender::isDue( Meter const &m, jdksavdecc_timestamp_in_milliseconds time_in_millis ) const
+{
+    return !m.m_sent || wasTimeOutHit( time_in_millis, m.m_last_send_time_in_millis, m.m_refresh_in_millis ) || hasChanged( m );
+}
+
+bool MeteringControlSender::hasChanged( Meter const &m ) const
+{
+    uint8_t const *current = m.m_holder->getBuf();
+    uint8_t const *last = &m.m_last_sent_value[0];
+    uint16_t length = m.m_holder->getLength();
+
+    if ( memcmp( current, last, length ) == 0 )
+    {
+        return false;
+    }
+    if ( m.m_threshold <= 0.0f )
+    {
+        return true;
+    }
+
+    const uint16_t block_size = 32;
+    float current_values[block_size];
+    float last_values[block_size];
+    uint16_t value_length = m.m_holder->getValueLength();
+    uint16_t num_items = m.m_holder->getNumItems();
+
+    for ( uint16_t first = 0; first < num_items; first += block_size )
+    {
+        uint16_t n = ( num_items - first ) < block_size ? uint16_t( num_items - first ) : block_size;
+        uint16_t offset = first * value_length;
+
+        // Skip the blocks that are unchanged without decoding them
+        if ( memcmp( current + offset, last + offset, n * value_length ) == 0 )
+        {
+            continue;
+        }
+
+        m.m_decode( current_values, current + offset, n, m.m_multiplier_power );
+        m.m_decode( last_values, last + offset, n, m.m_multiplier_power );
+        for ( uint16_t i = 0; i < n; ++i )
+        {
+            float d = current_values[i] - last_values[i];
+            if ( d > m.m_threshold || d < -m.m_threshold )
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void MeteringControlSender::sendMeter( Meter &m, jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    FrameWithSize<4> pdufragment;
+
+    pdufragment.putDoublet( JDKSAVDECC_DESCRIPTOR_CONTROL );
+    pdufragment.putDoublet( m.m_target_descriptor_index );
+
+    m_controller_entity.sendCommand( m_target_entity_id,
+                                     m_target_mac_address,
+                                     JDKSAVDECC_AEM_COMMAND_SET_CONTROL,
+                                     false,
+                                     pdufragment.getBuf(),
+                                     pdufragment.getLength(),
+                                     m.m_holder->getBuf(),
+                                     m.m_holder->getLength() );
+
+    m.m_last_sent_value.assign( m.m_holder->getBuf(), m.m_holder->getBuf() + m.m_holder->getLength() );
+    m.m_sent = true;
+    m.m_last_send_time_in_millis = time_in_millis;
+    m.m_holder->clearDirty();
+    ++m_backlog;
+    ++m_sent_count;
+}
+}
+#else
+const char *jdksavdeccmcu_meteringcontrolsender_file = __FILE__;
+#endif
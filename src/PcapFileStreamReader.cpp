@@ -0,0 +1,531 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1
+#include <stdexcept>
+
+#include "JDKSAvdeccMCU/PcapFileStreamReader.hpp"
+
+#if !defined( _WIN32 )
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+namespace
+{
+const uint32_t pcap_magic_microseconds = 0xa1b2c3d4;
+const uint32_t pcap_magic_nanoseconds = 0xa1b23c4d;
+const uint32_t pcapng_byte_order_magic = 0x1a2b3c4d;
+
+const uint32_t pcapng_section_header_block = 0x0a0d0d0a;
+const uint32_t pcapng_interface_description_block = 0x00000001;
+const uint32_t pcapng_packet_block = 0x00000002;
+const uint32_t pcapng_simple_packet_block = 0x00000003;
+const uint32_t pcapng_enhanced_packet_block = 0x00000006;
+
+const uint16_t pcapng_opt_endofopt = 0;
+const uint16_t pcapng_if_tsresol = 9;
+const uint16_t pcapng_if_tsoffset = 14;
+
+const uint64_t nanoseconds_per_second = 1000000000ULL;
+
+const uint64_t powers_of_ten[] = {1ULL,
+                                  10ULL,
+                                  100ULL,
+                                  1000ULL,
+                                  10000ULL,
+                                  100000ULL,
+                                  1000000ULL,
+                                  10000000ULL,
+                                  100000000ULL,
+                                  1000000000ULL,
+                                  10000000000ULL,
+                                  100000000000ULL,
+                                  1000000000000ULL,
+                                  10000000000000ULL,
+                                  100000000000000ULL,
+                                  1000000000000000ULL,
+                                  10000000000000000ULL,
+                                  100000000000000000ULL,
+                                  1000000000000000000ULL,
+                                  10000000000000000000ULL};
+}
+
+const uint32_t PcapFileStreamReader::max_block_length;
+
+PcapFileStreamReader::PcapFileStreamReader( std::string const &filename, size_t buffer_size )
+    : m_filename( filename )
+    , m_file( 0 )
+    , m_owns_file( false )
+    , m_mapping( 0 )
+    , m_mapping_length( 0 )
+    , m_buffer( buffer_size > 64 ? buffer_size : 64 )
+    , m_data( 0 )
+    , m_pos( 0 )
+    , m_end( 0 )
+    , m_eof( false )
+    , m_format( FormatUnknown )
+    , m_swap( false )
+    , m_nanosecond( false )
+    , m_link_type( 0 )
+    , m_last_timestamp_in_nanoseconds( 0 )
+    , m_packet_count( 0 )
+{
+    open();
+    if ( m_file || m_mapping )
+    {
+        try
+        {
+            readFileHeader();
+        }
+        catch ( ... )
+        {
+            close();
+            throw;
+        }
+    }
+}
+
+PcapFileStreamReader::~PcapFileStreamReader() { close(); }
+
+void PcapFileStreamReader::open()
+{
+    if ( m_filename == "-" )
+    {
+        m_file = stdin;
+        return;
+    }
+
+#if !defined( _WIN32 )
+    int fd = ::open( m_filename.c_str(), O_RDONLY );
+    if ( fd >= 0 )
+    {
+        struct stat st;
+        if ( fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) && st.st_size > 0
+             && uint64_t( st.st_size ) <= uint64_t( size_t( -1 ) ) )
+        {
+            void *p = mmap( 0, size_t( st.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( p != MAP_FAILED )
+            {
+                madvise( p, size_t( st.st_size ), MADV_SEQUENTIAL );
+                m_mapping = static_cast<uint8_t *>( p );
+                m_mapping_length = size_t( st.st_size );
+                m_data = m_mapping;
+                m_end = m_mapping_length;
+                m_eof = true;
+                m_buffer.clear();
+            }
+        }
+        ::close( fd );
+        if ( m_mapping )
+        {
+            return;
+        }
+    }
+#endif
+
+#if defined( _WIN32 )
+    fopen_s( &m_file, m_filename.c_str(), "rb" );
+#else
+    m_file = fopen( m_filename.c_str(), "rb" );
+#endif
+    m_owns_file = m_file != 0;
+}
+
+void PcapFileStreamReader::close()
+{
+#if !defined( _WIN32 )
+    if ( m_mapping )
+    {
+        munmap( m_mapping, m_mapping_length );
+    }
+#endif
+    m_mapping = 0;
+    m_mapping_length = 0;
+
+    if ( m_file && m_owns_file )
+    {
+        fclose( m_file );
+    }
+    m_file = 0;
+    m_owns_file = false;
+    m_data = 0;
+    m_pos = 0;
+    m_end = 0;
+    m_format = FormatUnknown;
+}
+
+bool PcapFileStreamReader::ensure( size_t len )
+{
+    if ( m_end - m_pos >= len )
+    {
+        return true;
+    }
+    if ( m_eof || !m_file )
+    {
+        return false;
+    }
+
+    // Move the unread octets to the front of the buffer and refill the rest
+    size_t avail = m_end - m_pos;
+    if ( m_pos > 0 && avail > 0 )
+    {
+        memmove( &m_buffer[0], &m_buffer[m_pos], avail );
+    }
+    m_pos = 0;
+    m_end = avail;
+    if ( len > m_buffer.size() )
+    {
+        m_buffer.resize( len );
+    }
+    while ( m_end < len && !m_eof )
+    {
+        size_t n = fread( &m_buffer[m_end], 1, m_buffer.size() - m_end, m_file );
+        if ( n == 0 )
+        {
+            if ( ferror( m_file ) )
+            {
+                fail( "Error reading pcap file" );
+            }
+            m_eof = true;
+        }
+        m_end += n;
+    }
+    m_data = &m_buffer[0];
+    return m_end - m_pos >= len;
+}
+
+void PcapFileStreamReader::readFileHeader()
+{
+    if ( !ensure( 4 ) )
+    {
+        fail( "Error reading pcap file header" );
+    }
+
+    uint32_t magic;
+    memcpy( &magic, m_data + m_pos, sizeof( magic ) );
+
+    if ( magic == pcapng_section_header_block )
+    {
+        // The section header block is handled by readPcapNgPacket()
+        m_format = FormatPcapNg;
+        return;
+    }
+
+    if ( magic == pcap_magic_microseconds || magic == pcap_magic_nanoseconds )
+    {
+        m_swap = false;
+    }
+    else if ( PcapFileSwap( magic ) == pcap_magic_microseconds || PcapFileSwap( magic ) == pcap_magic_nanoseconds )
+    {
+        m_swap = true;
+        magic = PcapFileSwap( magic );
+    }
+    else
+    {
+        fail( "Error pcap file header is incompatible" );
+    }
+
+    if ( !ensure( sizeof( pcap_hdr_t ) ) )
+    {
+        fail( "Error reading pcap file header" );
+    }
+    m_nanosecond = magic == pcap_magic_nanoseconds;
+    m_link_type = uint16_t( get32( m_data + m_pos + 20 ) & 0xffff );
+    m_pos += sizeof( pcap_hdr_t );
+    m_format = FormatPcap;
+}
+
+bool PcapFileStreamReader::readPacket( PcapFilePacketView *packet )
+{
+    bool r = false;
+    if ( m_format == FormatPcap )
+    {
+        r = readPcapPacket( packet );
+    }
+    else if ( m_format == FormatPcapNg )
+    {
+        r = readPcapNgPacket( packet );
+    }
+    if ( r )
+    {
+        m_last_timestamp_in_nanoseconds = packet->m_timestamp_in_nanoseconds;
+        ++m_packet_count;
+    }
+    return r;
+}
+
+bool PcapFileStreamReader::readPcapPacket( PcapFilePacketView *packet )
+{
+    if ( !ensure( sizeof( pcaprec_hdr_t ) ) )
+    {
+        return false;
+    }
+
+    uint8_t const *hdr = m_data + m_pos;
+    uint32_t ts_sec = get32( hdr );
+    uint32_t ts_frac = get32( hdr + 4 );
+    uint32_t incl_len = get32( hdr + 8 );
+    uint32_t orig_len = get32( hdr + 12 );
+
+    if ( incl_len > max_block_length )
+    {
+        fail( "Error reading packet from" );
+    }
+    if ( !ensure( sizeof( pcaprec_hdr_t ) + incl_len ) )
+    {
+        return false;
+    }
+
+    packet->m_timestamp_in_nanoseconds = uint64_t( ts_sec ) * nanoseconds_per_second
+                                         + ( m_nanosecond ? uint64_t( ts_frac ) : uint64_t( ts_frac ) * 1000 );
+    packet->m_data = m_data + m_pos + sizeof( pcaprec_hdr_t );
+    packet->m_captured_length = incl_len;
+    packet->m_original_length = orig_len;
+    packet->m_interface_id = 0;
+    packet->m_link_type = m_link_type;
+
+    m_pos += sizeof( pcaprec_hdr_t ) + incl_len;
+    return true;
+}
+
+bool PcapFileStreamReader::readPcapNgPacket( PcapFilePacketView *packet )
+{
+    while ( ensure( 12 ) )
+    {
+        uint8_t const *block = m_data + m_pos;
+        uint32_t raw_type;
+        memcpy( &raw_type, block, sizeof( raw_type ) );
+
+        // The byte order of a section is only known from its header block,
+        // whose type reads the same in either byte order
+        if ( raw_type == pcapng_section_header_block )
+        {
+            uint32_t byte_order_magic;
+            memcpy( &byte_order_magic, block + 8, sizeof( byte_order_magic ) );
+            if ( byte_order_magic == pcapng_byte_order_magic )
+            {
+                m_swap = false;
+            }
+            else if ( PcapFileSwap( byte_order_magic ) == pcapng_byte_order_magic )
+            {
+                m_swap = true;
+            }
+            else
+            {
+                fail( "Error pcapng section header is incompatible" );
+            }
+        }
+
+        uint32_t type = get32( block );
+        uint32_t block_length = get32( block + 4 );
+        if ( block_length < 12 || ( block_length & 3 ) != 0 || block_length > max_block_length )
+        {
+            fail( "Error reading pcapng block from" );
+        }
+        if ( !ensure( block_length ) )
+        {
+            return false;
+        }
+        block = m_data + m_pos;
+        m_pos += block_length;
+
+        if ( type == pcapng_section_header_block )
+        {
+            readSectionHeader( block, block_length );
+        }
+        else if ( type == pcapng_interface_description_block )
+        {
+            readInterfaceDescription( block, block_length );
+        }
+        else if ( type == pcapng_enhanced_packet_block || type == pcapng_packet_block )
+        {
+            if ( block_length < 32 )
+            {
+                fail( "Error reading pcapng packet from" );
+            }
+            uint32_t interface_id = type == pcapng_packet_block ? get16( block + 8 ) : get32( block + 8 );
+            uint64_t timestamp = ( uint64_t( get32( block + 12 ) ) << 32 ) | get32( block + 16 );
+            uint32_t captured_length = get32( block + 20 );
+            if ( interface_id >= m_interfaces.size() || captured_length > block_length - 32 )
+            {
+                fail( "Error reading pcapng packet from" );
+            }
+            Interface const &iface = m_interfaces[interface_id];
+            packet->m_timestamp_in_nanoseconds = toNanoseconds( iface, timestamp );
+            packet->m_data = block + 28;
+            packet->m_captured_length = captured_length;
+            packet->m_original_length = get32( block + 24 );
+            packet->m_interface_id = interface_id;
+            packet->m_link_type = iface.m_link_type;
+            return true;
+        }
+        else if ( type == pcapng_simple_packet_block )
+        {
+            if ( block_length < 16 || m_interfaces.empty() )
+            {
+                fail( "Error reading pcapng packet from" );
+            }
+            uint32_t original_length = get32( block + 8 );
+
+            // Simple packets have no timestamp, keep the order of the file
+            packet->m_timestamp_in_nanoseconds = m_last_timestamp_in_nanoseconds;
+            packet->m_data = block + 12;
+            packet->m_captured_length = std::min( original_length, block_length - 16 );
+            packet->m_original_length = original_length;
+            packet->m_interface_id = 0;
+            packet->m_link_type = m_interfaces[0].m_link_type;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PcapFileStreamReader::readSectionHeader( uint8_t const *block, uint32_t block_length )
+{
+    if ( block_length < 28 || get16( block + 12 ) != 1 )
+    {
+        fail( "Error pcapng section header is incompatible" );
+    }
+
+    // Interface ids are local to their section
+    m_interfaces.clear();
+}
+
+void PcapFileStreamReader::readInterfaceDescription( uint8_t const *block, uint32_t block_length )
+{
+    if ( block_length < 20 )
+    {
+        fail( "Error reading pcapng interface from" );
+    }
+
+    Interface iface;
+    iface.m_link_type = get16( block + 8 );
+    iface.m_binary_resolution = false;
+    iface.m_resolution = 6;
+    iface.m_offset_in_seconds = 0;
+
+    size_t pos = 16;
+    size_t end = block_length - 4;
+    while ( pos + 4 <= end )
+    {
+        uint16_t code = get16( block + pos );
+        uint16_t len = get16( block + pos + 2 );
+        if ( code == pcapng_opt_endofopt )
+        {
+            break;
+        }
+        if ( pos + 4 + len > end )
+        {
+            fail( "Error reading pcapng interface from" );
+        }
+        if ( code == pcapng_if_tsresol && len >= 1 )
+        {
+            uint8_t v = block[pos + 4];
+            iface.m_binary_resolution = ( v & 0x80 ) != 0;
+            iface.m_resolution = v & 0x7f;
+        }
+        else if ( code == pcapng_if_tsoffset && len >= 8 )
+        {
+            iface.m_offset_in_seconds = int64_t( get64( block + pos + 4 ) );
+        }
+        pos += 4 + ( ( len + 3u ) & ~3u );
+    }
+
+    if ( ( !iface.m_binary_resolution && iface.m_resolution > 19 ) || iface.m_resolution > 63 )
+    {
+        fail( "Error pcapng interface timestamp resolution is incompatible" );
+    }
+    m_interfaces.push_back( iface );
+}
+
+uint64_t PcapFileStreamReader::toNanoseconds( Interface const &iface, uint64_t timestamp ) const
+{
+    uint64_t ns;
+    if ( !iface.m_binary_resolution )
+    {
+        if ( iface.m_resolution <= 9 )
+        {
+            ns = timestamp * powers_of_ten[9 - iface.m_resolution];
+        }
+        else
+        {
+            ns = timestamp / powers_of_ten[iface.m_resolution - 9];
+        }
+    }
+    else
+    {
+        uint64_t seconds = timestamp >> iface.m_resolution;
+        uint64_t fraction = timestamp - ( seconds << iface.m_resolution );
+        ns = seconds * nanoseconds_per_second
+             + uint64_t( double( fraction ) * double( nanoseconds_per_second ) / double( 1ULL << iface.m_resolution ) );
+    }
+    return ns + uint64_t( iface.m_offset_in_seconds ) * nanoseconds_per_second;
+}
+
+uint16_t PcapFileStreamReader::get16( uint8_t const *p ) const
+{
+    uint16_t v;
+    memcpy( &v, p, sizeof( v ) );
+    return m_swap ? uint16_t( ( v >> 8 ) | ( v << 8 ) ) : v;
+}
+
+uint32_t PcapFileStreamReader::get32( uint8_t const *p ) const
+{
+    uint32_t v;
+    memcpy( &v, p, sizeof( v ) );
+    return m_swap ? PcapFileSwap( v ) : v;
+}
+
+uint64_t PcapFileStreamReader::get64( uint8_t const *p ) const
+{
+    uint64_t v;
+    memcpy( &v, p, sizeof( v ) );
+    return m_swap ? ( uint64_t( PcapFileSwap( uint32_t( v ) ) ) << 32 ) | PcapFileSwap( uint32_t( v >> 32 ) ) : v;
+}
+
+void PcapFileStreamReader::fail( char const *what ) const
+{
+    throw std::runtime_error( std::string( what ) + ": " + m_filename );
+}
+}
+
+#else
+const char *jdksavdeccmcu_pcapfilestreamreader_file = __FILE__;
+
+#endif
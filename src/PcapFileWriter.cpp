@@ -33,20 +33,38 @@
 
 #if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1
 #include <stdexcept>
+#include <chrono>
 
 #include "JDKSAvdeccMCU/PcapFileWriter.hpp"
 
 namespace JDKSAvdeccMCU
 {
 
-PcapFileWriter::PcapFileWriter( std::string const &filename ) : m_file( filename, "rb" ), m_filename( filename )
+PcapFileWriter::PcapFileWriter( std::string const &filename,
+                                size_t buffer_size,
+                                bool background,
+                                uint32_t flush_interval_in_ms,
+                                bool append )
+    : m_file( filename, "rb" )
+    , m_filename( filename )
+    , m_buffer_size( buffer_size )
+    , m_background( background )
+    , m_flush_interval_in_ms( flush_interval_in_ms )
+    , m_active( 0 )
+    , m_pending( -1 )
+    , m_stop( false )
 {
-    /* Did it already exist ?*/
-    if ( m_file.get() )
+    /* Did it already exist with a header? */
+    bool existing = false;
+    if ( append && m_file.get() )
+    {
+        existing = fseek( m_file.get(), 0, SEEK_END ) == 0 && ftell( m_file.get() ) > 0;
+    }
+
+    if ( existing )
     {
         /* yes, so close and re-open in append mode */
-        m_file = PcapFile( filename, "a+b" );
-        if ( !m_file.get() )
+        if ( !m_file.open( filename, "a+b" ) )
         {
             throw std::runtime_error( std::string( "Error appending to pcap file: " ) + filename );
         }
@@ -56,19 +74,17 @@ PcapFileWriter::PcapFileWriter( std::string const &filename ) : m_file( filename
         /* The file does not already exist, so create the file and add a
          * wireshark pcap header */
         /* create data logging file in current directory */
-        m_file = PcapFile( filename, "wb" );
-
-        if ( m_file.get() )
+        if ( m_file.open( filename, "wb" ) )
         {
             pcap_hdr_t header;
             header.magic_number = 0xa1b2c3d4;
             header.version_major = 2;
-            header.version_minor = 2;
+            header.version_minor = 4;
             header.thiszone = 0;
             header.sigfigs = 0;
             header.snaplen = 0xffff;
             header.network = 1;
-            if ( fwrite( &header, sizeof( header ), 1, m_file.get() ) )
+            if ( fwrite( &header, sizeof( header ), 1, m_file.get() ) != 1 )
             {
                 throw std::runtime_error( std::string( "Error writing pcap file: " ) + filename );
             }
@@ -78,9 +94,37 @@ PcapFileWriter::PcapFileWriter( std::string const &filename ) : m_file( filename
             throw std::runtime_error( std::string( "Error creating pcap file: " ) + filename );
         }
     }
+
+    m_buffers[0].reserve( m_buffer_size );
+    m_buffers[1].reserve( m_buffer_size );
+
+    if ( m_background )
+    {
+        m_thread = std::thread( &PcapFileWriter::runWriter, this );
+    }
 }
 
-PcapFileWriter::~PcapFileWriter() {}
+PcapFileWriter::~PcapFileWriter()
+{
+    try
+    {
+        flush();
+    }
+    catch ( ... )
+    {
+        // Nothing more can be done about the lost packets here
+    }
+
+    if ( m_background )
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stop = true;
+        }
+        m_pending_ready.notify_one();
+        m_thread.join();
+    }
+}
 
 void PcapFileWriter::WritePacket( PcapFilePacket const &packet )
 {
@@ -94,19 +138,7 @@ void PcapFileWriter::WritePacket( uint64_t time_in_micros, PcapFilePacket const
 {
     if ( packet.size() > 14 )
     {
-        pcaprec_hdr_t pktheader;
-        pktheader.ts_sec = uint32_t( time_in_micros / 1000000 );
-        pktheader.ts_usec = uint32_t( time_in_micros % 1000000 );
-        pktheader.incl_len = uint32_t( packet.size() );
-        pktheader.orig_len = pktheader.incl_len;
-        if ( fwrite( &pktheader, sizeof( pktheader ), 1, m_file.get() ) != 1 )
-        {
-            throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
-        }
-        if ( fwrite( &packet[0], packet.size(), 1, m_file.get() ) != 1 )
-        {
-            throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
-        }
+        WritePacket( time_in_micros, &packet[0], packet.size() );
     }
 }
 
@@ -124,14 +156,130 @@ void PcapFileWriter::WritePacket( uint64_t packet_time_in_micros,
                                   uint16_t ethertype,
                                   PcapFilePacket const &packet_payload )
 {
+    WritePacket( packet_time_in_micros,
+                 da,
+                 sa,
+                 ethertype,
+                 packet_payload.empty() ? 0 : &packet_payload[0],
+                 packet_payload.size() );
+}
+
+void PcapFileWriter::WritePacket( uint64_t time_in_micros, uint8_t const *data, size_t len )
+{
+    Segment segment;
+    segment.m_data = data;
+    segment.m_length = len;
+    writeRecord( time_in_micros, &segment, 1 );
+}
+
+void PcapFileWriter::WritePacket( uint64_t time_in_micros,
+                                  uint8_t const da[6],
+                                  uint8_t const sa[6],
+                                  uint16_t ethertype,
+                                  uint8_t const *data1,
+                                  size_t len1,
+                                  uint8_t const *data2,
+                                  size_t len2,
+                                  uint8_t const *data3,
+                                  size_t len3 )
+{
+    uint8_t header[14];
+    memcpy( &header[0], da, 6 );
+    memcpy( &header[6], sa, 6 );
+    header[12] = uint8_t( ( ethertype >> 8 ) & 0xff );
+    header[13] = uint8_t( ( ethertype >> 0 ) & 0xff );
+
+    Segment segments[4];
+    segments[0].m_data = header;
+    segments[0].m_length = sizeof( header );
+    segments[1].m_data = data1;
+    segments[1].m_length = data1 ? len1 : 0;
+    segments[2].m_data = data2;
+    segments[2].m_length = data2 ? len2 : 0;
+    segments[3].m_data = data3;
+    segments[3].m_length = data3 ? len3 : 0;
+    writeRecord( time_in_micros, segments, 4 );
+}
+
+void PcapFileWriter::flush()
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+    if ( !m_buffers[m_active].empty() )
+    {
+        handOff( lock );
+    }
+    while ( m_pending >= 0 )
+    {
+        m_pending_written.wait( lock );
+    }
+    throwIfFailed();
+}
+
+void PcapFileWriter::writeRecord( uint64_t time_in_micros, Segment const *segments, size_t count )
+{
+    size_t len = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        len += segments[i].m_length;
+    }
+
     pcaprec_hdr_t pktheader;
-    pktheader.ts_sec = uint32_t( packet_time_in_micros / 1000000 );
-    pktheader.ts_usec = uint32_t( packet_time_in_micros % 1000000 );
-    pktheader.incl_len = int( packet_payload.size() + 14 );
+    pktheader.ts_sec = uint32_t( time_in_micros / 1000000 );
+    pktheader.ts_usec = uint32_t( time_in_micros % 1000000 );
+    pktheader.incl_len = int32_t( len );
     pktheader.orig_len = pktheader.incl_len;
-    ssize_t n;
-    n = fwrite( &pktheader, sizeof( pktheader ), 1, m_file.get() );
-    if ( n != 1 )
+
+    std::unique_lock<std::mutex> lock( m_mutex );
+    throwIfFailed();
+
+    if ( !m_buffers[m_active].empty() && m_buffers[m_active].size() + sizeof( pktheader ) + len > m_buffer_size )
+    {
+        handOff( lock );
+    }
+
+    // A packet bigger than the buffer grows it, everything else fits in
+    // the preallocated capacity
+    std::vector<uint8_t> &buffer = m_buffers[m_active];
+    uint8_t const *p = reinterpret_cast<uint8_t const *>( &pktheader );
+    buffer.insert( buffer.end(), p, p + sizeof( pktheader ) );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        if ( segments[i].m_length > 0 )
+        {
+            buffer.insert( buffer.end(), segments[i].m_data, segments[i].m_data + segments[i].m_length );
+        }
+    }
+}
+
+void PcapFileWriter::handOff( std::unique_lock<std::mutex> &lock )
+{
+    if ( m_background )
+    {
+        // Only wait when the writer is still busy with the other buffer
+        while ( m_pending >= 0 )
+        {
+            m_pending_written.wait( lock );
+        }
+        throwIfFailed();
+        m_pending = m_active;
+        m_active ^= 1;
+        m_pending_ready.notify_one();
+    }
+    else
+    {
+        std::vector<uint8_t> &buffer = m_buffers[m_active];
+        writeBuffer( buffer );
+        buffer.clear();
+    }
+}
+
+void PcapFileWriter::writeBuffer( std::vector<uint8_t> const &buffer )
+{
+    if ( buffer.empty() )
+    {
+        return;
+    }
+    if ( fwrite( &buffer[0], buffer.size(), 1, m_file.get() ) != 1 || fflush( m_file.get() ) != 0 )
     {
 #if defined( _MSC_VER )
         char errbuf[1024];
@@ -141,26 +289,63 @@ void PcapFileWriter::WritePacket( uint64_t packet_time_in_micros,
         throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename + " " + strerror( errno ) );
 #endif
     }
-    if ( fwrite( da, 6, 1, m_file.get() ) != 1 )
-    {
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
-    }
+}
 
-    if ( fwrite( sa, 6, 1, m_file.get() ) != 1 )
-    {
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
-    }
-    if ( fputc( ( ethertype >> 8 ) & 0xff, m_file.get() ) == EOF )
-    {
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
-    }
-    if ( fputc( ( ethertype >> 0 ) & 0xff, m_file.get() ) == EOF )
+void PcapFileWriter::throwIfFailed()
+{
+    if ( !m_error.empty() )
     {
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
+        std::string error;
+        error.swap( m_error );
+        throw std::runtime_error( error );
     }
-    if ( fwrite( &packet_payload[0], packet_payload.size(), 1, m_file.get() ) != 1 )
+}
+
+void PcapFileWriter::runWriter()
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+    while ( true )
     {
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
+        if ( m_pending < 0 && !m_stop )
+        {
+            m_pending_ready.wait_for( lock, std::chrono::milliseconds( m_flush_interval_in_ms ) );
+        }
+
+        // Write what has been captured so far even when the buffer is not full
+        if ( m_pending < 0 && !m_buffers[m_active].empty() )
+        {
+            m_pending = m_active;
+            m_active ^= 1;
+        }
+
+        if ( m_pending >= 0 )
+        {
+            std::vector<uint8_t> &buffer = m_buffers[m_pending];
+            std::string error;
+
+            lock.unlock();
+            try
+            {
+                writeBuffer( buffer );
+            }
+            catch ( std::exception const &e )
+            {
+                error = e.what();
+            }
+            lock.lock();
+
+            buffer.clear();
+            if ( !error.empty() )
+            {
+                m_error = error;
+            }
+            m_pending = -1;
+            m_pending_written.notify_all();
+        }
+        else if ( m_stop )
+        {
+            break;
+        }
     }
 }
 }
@@ -0,0 +1,198 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/PcapReplay.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_RAWSOCKETPCAPFILE && JDKSAVDECCMCU_ENABLE_PCAPFILE
+
+namespace JDKSAvdeccMCU
+{
+
+PcapReplay::PcapReplay( HandlerGroup &handlers, jdksavdecc_timestamp_in_milliseconds tick_interval_in_ms )
+    : m_handlers( handlers )
+    , m_tick_interval_in_ms( tick_interval_in_ms )
+    , m_started( false )
+    , m_current_time( 0 )
+    , m_next_tick_time( 0 )
+    , m_frame_count( 0 )
+    , m_tick_count( 0 )
+{
+}
+
+PcapReplay::PcapReplay( RawSocketPcapFile &socket, HandlerGroup &handlers, jdksavdecc_timestamp_in_milliseconds tick_interval_in_ms )
+    : m_handlers( handlers )
+    , m_tick_interval_in_ms( tick_interval_in_ms )
+    , m_started( false )
+    , m_current_time( 0 )
+    , m_next_tick_time( 0 )
+    , m_frame_count( 0 )
+    , m_tick_count( 0 )
+{
+    addSocket( socket );
+}
+
+void PcapReplay::addSocket( RawSocketPcapFile &socket )
+{
+    if ( m_started )
+    {
+        throw std::runtime_error( "PcapReplay: sockets must be added before the replay starts" );
+    }
+
+    // Reading the time must not move the clock, only moveTo() does
+    socket.setTimeGranularity( 0 );
+    socket.setCurrentTime( m_current_time );
+    m_sockets.push_back( &socket );
+}
+
+bool PcapReplay::step()
+{
+    if ( !m_started )
+    {
+        start();
+    }
+
+    if ( m_pending.empty() )
+    {
+        return false;
+    }
+
+    jdksavdecc_timestamp_in_milliseconds frame_time = m_sockets[m_pending.front().m_socket_index]->getNextFrameTime();
+    if ( m_tick_interval_in_ms > 0 && m_next_tick_time < frame_time )
+    {
+        moveTo( m_next_tick_time );
+    }
+    else
+    {
+        moveTo( frame_time );
+    }
+    return true;
+}
+
+uint64_t PcapReplay::run( jdksavdecc_timestamp_in_milliseconds linger_in_ms )
+{
+    while ( step() )
+    {
+    }
+
+    if ( m_tick_interval_in_ms > 0 )
+    {
+        jdksavdecc_timestamp_in_milliseconds end_time = m_current_time + linger_in_ms;
+        while ( m_next_tick_time <= end_time )
+        {
+            moveTo( m_next_tick_time );
+        }
+    }
+    return m_frame_count;
+}
+
+void PcapReplay::start()
+{
+    m_started = true;
+
+    // All of the captures are timed from the earliest packet in any of
+    // them, captures without frames to replay have nothing to align
+    bool found = false;
+    uint64_t origin = 0;
+    for ( size_t i = 0; i < m_sockets.size(); ++i )
+    {
+        if ( m_sockets[i]->hasNextFrame() )
+        {
+            uint64_t t = m_sockets[i]->getFirstTimestampInNanoseconds();
+            if ( !found || t < origin )
+            {
+                origin = t;
+                found = true;
+            }
+        }
+    }
+
+    for ( size_t i = 0; i < m_sockets.size(); ++i )
+    {
+        if ( found )
+        {
+            m_sockets[i]->setTimeOrigin( origin );
+        }
+        pushPending( i );
+    }
+}
+
+void PcapReplay::pushPending( size_t socket_index )
+{
+    RawSocketPcapFile *socket = m_sockets[socket_index];
+    if ( socket->hasNextFrame() )
+    {
+        PendingSocket p;
+        p.m_timestamp_in_nanoseconds = socket->getNextFrameTimestampInNanoseconds();
+        p.m_socket_index = socket_index;
+        m_pending.push_back( p );
+        std::push_heap( m_pending.begin(), m_pending.end() );
+    }
+}
+
+void PcapReplay::moveTo( jdksavdecc_timestamp_in_milliseconds t )
+{
+    m_current_time = t;
+    for ( size_t i = 0; i < m_sockets.size(); ++i )
+    {
+        m_sockets[i]->setCurrentTime( t );
+    }
+
+    // The frames captured up to now are received before the handlers are
+    // ticked for the same time, the earliest first from whichever socket
+    // captured it
+    while ( !m_pending.empty() && m_sockets[m_pending.front().m_socket_index]->getNextFrameTime() <= t )
+    {
+        size_t socket_index = m_pending.front().m_socket_index;
+        std::pop_heap( m_pending.begin(), m_pending.end() );
+        m_pending.pop_back();
+
+        RawSocketPcapFile *socket = m_sockets[socket_index];
+        if ( socket->recvFrame( &m_frame ) )
+        {
+            ++m_frame_count;
+            m_handlers.receivedPDU( socket, m_frame );
+        }
+        pushPending( socket_index );
+    }
+
+    if ( m_tick_interval_in_ms == 0 || t >= m_next_tick_time )
+    {
+        ++m_tick_count;
+        m_handlers.tick( t );
+        m_next_tick_time = t + m_tick_interval_in_ms;
+    }
+}
+}
+
+#else
+const char *jdksavdeccmcu_pcapreplay_file = __FILE__;
+#endif
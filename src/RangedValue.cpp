@@ -68,7 +68,7 @@ const char *getAvdeccUnitsSuffix(UnitsCode units_code)
         s = "metres";
         break;
     case UnitsCode::TEMPERATURE_KELVIN:
-        s = "ºK";
+        s = "K";
         break;
     case UnitsCode::MASS_GRAMS:
         s = "g";
@@ -80,7 +80,7 @@ const char *getAvdeccUnitsSuffix(UnitsCode units_code)
         s = "dBV";
         break;
     case UnitsCode::VOLTAGE_DBU:
-        s = "dbU";
+        s = "dBu";
         break;
     case UnitsCode::CURRENT_AMPS:
         s = "A";
@@ -89,7 +89,7 @@ const char *getAvdeccUnitsSuffix(UnitsCode units_code)
         s = "W";
         break;
     case UnitsCode::POWER_DBM:
-        s = "dBM";
+        s = "dBm";
         break;
     case UnitsCode::POWER_DBW:
         s = "dBW";
@@ -49,6 +49,10 @@ RawSocketPcapFile::RawSocketPcapFile( uint16_t ethertype,
     , m_default_dest_mac( default_dest_mac )
     , m_join_multicast( join_multicast )
     , m_pcap_file_reader( input_file )
+    , m_seen_first_timestamp( false )
+    , m_first_timestamp_in_nanoseconds( 0 )
+    , m_time_origin_in_nanoseconds( 0 )
+    , m_next_incoming_timestamp_in_nanoseconds( 0 )
     , m_pcap_file_writer( output_file )
     , m_current_time( 0 )
     , m_time_granularity_in_ms( time_granularity_in_ms )
@@ -75,6 +79,18 @@ jdksavdecc_timestamp_in_milliseconds RawSocketPcapFile::getTimeInMilliseconds()
     return t;
 }
 
+void RawSocketPcapFile::setTimeOrigin( uint64_t timestamp_in_nanoseconds )
+{
+    m_time_origin_in_nanoseconds = timestamp_in_nanoseconds;
+    if ( m_next_incoming_frame.getLength() > 0 )
+    {
+        uint64_t t = m_next_incoming_timestamp_in_nanoseconds > m_time_origin_in_nanoseconds
+                         ? m_next_incoming_timestamp_in_nanoseconds - m_time_origin_in_nanoseconds
+                         : 0;
+        m_next_incoming_frame.setTimeInMilliseconds( jdksavdecc_timestamp_in_milliseconds( t / 1000000 ) );
+    }
+}
+
 bool RawSocketPcapFile::recvFrame( Frame *frame )
 {
     bool r = false;
@@ -82,10 +98,17 @@ bool RawSocketPcapFile::recvFrame( Frame *frame )
     {
         if ( m_current_time >= m_next_incoming_frame.getTimeInMilliseconds() )
         {
-            *frame = m_next_incoming_frame;
+            // copy the octets, assigning the Frame would share our buffer
+            uint16_t len = m_next_incoming_frame.getLength();
+            if ( len <= frame->getMaxLength() )
+            {
+                memcpy( frame->getBuf(), m_next_incoming_frame.getBuf(), len );
+                frame->setLength( len );
+                frame->setTimeInMilliseconds( m_next_incoming_frame.getTimeInMilliseconds() );
+                r = true;
+            }
             m_next_incoming_frame.setLength( 0 );
             readNextIncomingFrame();
-            r = true;
         }
     }
     return r;
@@ -99,28 +122,7 @@ bool RawSocketPcapFile::sendFrame( const Frame &frame, const uint8_t *data1, uin
     {
         da = m_default_dest_mac;
     }
-    PcapFilePacket packet;
-    packet.reserve( frame.getLength() + len1 + len2 - JDKSAVDECC_FRAME_HEADER_LEN );
-    for ( size_t i = JDKSAVDECC_FRAME_HEADER_LEN; i < frame.getLength(); ++i )
-    {
-        packet.push_back( frame.getOctet( i ) );
-    }
-    if ( data1 )
-    {
-        for ( size_t i = 0; i < len1; ++i )
-        {
-            packet.push_back( data1[i] );
-        }
-    }
-    if ( data2 )
-    {
-        for ( size_t i = 0; i < len1; ++i )
-        {
-            packet.push_back( data2[i] );
-        }
-    }
-
-    m_pcap_file_writer.WritePacket( m_current_time * 1000, da.value, sa.value, m_ethertype, packet );
+    writeFrame( da, sa, frame, data1, len1, data2, len2 );
     return true;
 }
 
@@ -133,31 +135,28 @@ bool RawSocketPcapFile::sendReplyFrame( Frame &frame, const uint8_t *data1, uint
         // squash multicast
         da.value[0] &= 0xfe;
     }
-    PcapFilePacket packet;
-    packet.resize( frame.getLength() + len1 + len2 - JDKSAVDECC_FRAME_HEADER_LEN );
-    for ( size_t i = JDKSAVDECC_FRAME_HEADER_LEN; i < frame.getLength(); ++i )
-    {
-        packet.push_back( frame.getOctet( i ) );
-    }
-    if ( data1 )
-    {
-        for ( size_t i = 0; i < len1; ++i )
-        {
-            packet.push_back( data1[i] );
-        }
-    }
-    if ( data2 )
-    {
-        for ( size_t i = 0; i < len1; ++i )
-        {
-            packet.push_back( data2[i] );
-        }
-    }
-
-    m_pcap_file_writer.WritePacket( m_current_time * 1000, da.value, sa.value, m_ethertype, packet );
+    writeFrame( da, sa, frame, data1, len1, data2, len2 );
     return true;
 }
 
+void RawSocketPcapFile::writeFrame(
+    const Eui48 &da, const Eui48 &sa, const Frame &frame, const uint8_t *data1, uint16_t len1, const uint8_t *data2, uint16_t len2 )
+{
+    // The frame payload and both data segments are copied straight into
+    // the writer's buffer
+    uint16_t payload_len = frame.getLength() > JDKSAVDECC_FRAME_HEADER_LEN ? frame.getLength() - JDKSAVDECC_FRAME_HEADER_LEN : 0;
+    m_pcap_file_writer.WritePacket( m_current_time * 1000,
+                                    da.value,
+                                    sa.value,
+                                    m_ethertype,
+                                    frame.getBuf() + JDKSAVDECC_FRAME_HEADER_LEN,
+                                    payload_len,
+                                    data1,
+                                    len1,
+                                    data2,
+                                    len2 );
+}
+
 bool RawSocketPcapFile::joinMulticast( const Eui48 &multicast_mac )
 {
     m_join_multicast = multicast_mac;
@@ -169,35 +168,34 @@ const Eui48 &RawSocketPcapFile::getMACAddress() const { return m_my_mac; }
 
 bool RawSocketPcapFile::readNextIncomingFrame()
 {
-    bool r = false;
-    uint64_t timestamp_in_microseconds = 0;
-    PcapFilePacket frame_data;
-    // try read the pcap file
-    if ( m_pcap_file_reader.ReadPacket( &timestamp_in_microseconds, frame_data ) )
+    PcapFilePacketView packet;
+
+    // skip the packets that we don't care about, the packet data is only
+    // valid until the next read so copy it into the next incoming frame
+    while ( m_pcap_file_reader.readPacket( &packet ) )
     {
-        // we got a frame fromt he file, does it fit?
-        if ( frame_data.size() <= m_next_incoming_frame.getMaxLength() )
+        if ( !m_seen_first_timestamp )
         {
-            // yes, so copy the frame into the next incoming frame buffer and
-            // track the time
-            m_next_incoming_frame.setTimeInMilliseconds( timestamp_in_microseconds / 1000 );
-            memcpy( m_next_incoming_frame.getBuf(), &frame_data[0], m_next_incoming_frame.getMaxLength() );
-
-            // make sure it is an ethertype that we care about
-            if ( m_next_incoming_frame.getEtherType() == m_ethertype )
-            {
-                m_next_incoming_frame.setLength( frame_data.size() );
+            m_seen_first_timestamp = true;
+            m_first_timestamp_in_nanoseconds = packet.m_timestamp_in_nanoseconds;
+        }
 
-                r = true;
-            }
-            else
-            {
-                // it isn't a packet we care about, so drop it
-                m_next_incoming_frame.setLength( 0 );
-            }
+        if ( packet.m_captured_length >= JDKSAVDECC_FRAME_HEADER_LEN
+             && packet.m_captured_length <= m_next_incoming_frame.getMaxLength()
+             && ( ( uint16_t( packet.m_data[12] ) << 8 ) | packet.m_data[13] ) == m_ethertype )
+        {
+            uint64_t t = packet.m_timestamp_in_nanoseconds > m_time_origin_in_nanoseconds
+                             ? packet.m_timestamp_in_nanoseconds - m_time_origin_in_nanoseconds
+                             : 0;
+            m_next_incoming_timestamp_in_nanoseconds = packet.m_timestamp_in_nanoseconds;
+            m_next_incoming_frame.setTimeInMilliseconds( jdksavdecc_timestamp_in_milliseconds( t / 1000000 ) );
+            memcpy( m_next_incoming_frame.getBuf(), packet.m_data, packet.m_captured_length );
+            m_next_incoming_frame.setLength( uint16_t( packet.m_captured_length ) );
+            return true;
         }
     }
-    return r;
+    m_next_incoming_frame.setLength( 0 );
+    return false;
 }
 }
 
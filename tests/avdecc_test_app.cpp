@@ -304,9 +304,8 @@ class TestApsStateMachine : public ApsStateMachine
         }
     };
 
-    TestApsStateMachine( uint16_t &assigned_id_count, active_connections_type &active_connections )
-        : ApsStateMachine(
-              &m_test_variables, &m_test_actions, &m_test_events, &m_test_states, assigned_id_count, active_connections )
+    TestApsStateMachine( ApsEntityIdAllocator &entity_id_allocator )
+        : ApsStateMachine( &m_test_variables, &m_test_actions, &m_test_events, &m_test_states, entity_id_allocator )
         , m_test_events( &m_http_server_parser, "/" )
         , m_http_server_parser( &m_http_server_request, &m_test_events )
     {
@@ -503,10 +502,9 @@ int main()
     int r = 255;
 
     {
-        uint16_t assigned_id_count = 0;
-        TestApsStateMachine::active_connections_type active_connections;
+        ApsEntityIdAllocator entity_id_allocator;
 
-        TestApsStateMachine my_aps( assigned_id_count, active_connections );
+        TestApsStateMachine my_aps( entity_id_allocator );
         TestApcStateMachine my_apc;
         my_aps.m_client = &my_apc;
         my_apc.m_server = &my_aps;
@@ -0,0 +1,783 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+///
+/// aps_benchmark
+///
+/// Connects N simulated APCs to an APS, either over loopback TCP using
+/// ApsServer and ApcClient or via in-memory byte queues between bare
+/// ApsStateMachine/ApcStateMachine pairs, injects AECP responses at a
+/// configurable rate and reports the delivered messages/sec, the p50/p99
+/// tunnel latency and the heap allocations per delivered message.
+///
+/// Usage: aps_benchmark [-m tcp|mem] [-n apcs] [-r frames_per_sec]
+///                      [-t seconds] [-d down|up|both] [-w window] [-p port]
+///                      [-s table|run]
+///
+///   -d down: L2 frames are sent from the APS to every APC
+///   -d up:   APCs send frames which reach L2 and the other APCs
+///   -r 0:    inject as fast as the window of in flight frames allows
+///   -s run:  in mem mode, handle every event via the state procedures
+///            instead of the transition table
+///
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU.hpp"
+
+#include <chrono>
+#include <new>
+
+using namespace JDKSAvdeccMCU;
+
+static uint64_t heap_allocations = 0;
+
+// Every form of the global operator new and delete is replaced so that
+// all allocations are counted and every block is freed by the allocator
+// that made it. The work is done out of line so that the compiler never
+// pairs an inlined free() with an operator new call site.
+
+#if defined( __GNUC__ )
+#define APS_BENCHMARK_NOINLINE __attribute__( ( noinline ) )
+#else
+#define APS_BENCHMARK_NOINLINE
+#endif
+
+static APS_BENCHMARK_NOINLINE void *benchmarkAllocate( size_t size ) noexcept
+{
+    ++heap_allocations;
+    return malloc( size ? size : 1 );
+}
+
+static APS_BENCHMARK_NOINLINE void benchmarkFree( void *p ) noexcept { free( p ); }
+
+void *operator new( size_t size )
+{
+    void *p = benchmarkAllocate( size );
+    if ( !p )
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[]( size_t size )
+{
+    void *p = benchmarkAllocate( size );
+    if ( !p )
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new( size_t size, std::nothrow_t const & ) noexcept { return benchmarkAllocate( size ); }
+
+void *operator new[]( size_t size, std::nothrow_t const & ) noexcept { return benchmarkAllocate( size ); }
+
+void operator delete( void *p ) noexcept { benchmarkFree( p ); }
+
+void operator delete[]( void *p ) noexcept { benchmarkFree( p ); }
+
+void operator delete( void *p, size_t ) noexcept { benchmarkFree( p ); }
+
+void operator delete[]( void *p, size_t ) noexcept { benchmarkFree( p ); }
+
+void operator delete( void *p, std::nothrow_t const & ) noexcept { benchmarkFree( p ); }
+
+void operator delete[]( void *p, std::nothrow_t const & ) noexcept { benchmarkFree( p ); }
+
+static uint64_t nowInNanoseconds()
+{
+    return uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() )
+                         .count() );
+}
+
+/// Offsets in the AVTP payload of the AECP response that is sent
+static const size_t bench_payload_length = 40;
+static const size_t bench_timestamp_offset = 24;
+static const size_t bench_direction_offset = 32;
+
+enum Direction
+{
+    DirectionDown = 1,
+    DirectionUp = 2,
+    DirectionBoth = 3
+};
+
+///
+/// \brief The BenchStats class
+///
+/// Collects the delivery count and latency samples of benchmark frames
+///
+class BenchStats
+{
+  public:
+    BenchStats() : m_injected( 0 ), m_delivered( 0 ), m_expected( 0 ) { m_latencies.reserve( max_samples ); }
+
+    static const size_t max_samples = 1 << 22;
+
+    static void formFrame( Frame *frame, Eui48 const &sa, uint8_t direction )
+    {
+        uint8_t payload[bench_payload_length];
+        memset( payload, 0, sizeof( payload ) );
+
+        // AECP AEM_RESPONSE, which an APS never drops
+        payload[0] = JDKSAVDECC_1722A_SUBTYPE_AECP | 0x80;
+        payload[1] = JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE;
+        payload[3] = bench_payload_length - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN;
+        jdksavdecc_uint64_set( nowInNanoseconds(), payload, bench_timestamp_offset );
+        payload[bench_direction_offset] = direction;
+
+        frame->setLength( JDKSAVDECC_FRAME_HEADER_LEN );
+        frame->setDA( Eui48( JDKSAVDECC_MULTICAST_ADP_ACMP_MAC ) );
+        frame->setSA( sa );
+        frame->setEtherType( JDKSAVDECC_AVTP_ETHERTYPE );
+        frame->putBuf( payload, sizeof( payload ) );
+    }
+
+    void onDelivered( uint8_t const *avtp_payload, size_t len )
+    {
+        if ( len >= bench_payload_length && avtp_payload[bench_direction_offset] != 0 )
+        {
+            uint64_t sent = jdksavdecc_uint64_get( avtp_payload, bench_timestamp_offset );
+            ++m_delivered;
+            if ( m_latencies.size() < max_samples )
+            {
+                m_latencies.push_back( nowInNanoseconds() - sent );
+            }
+        }
+    }
+
+    void onInjected( uint64_t fanout )
+    {
+        ++m_injected;
+        m_expected += fanout;
+    }
+
+    uint64_t getInFlight() const { return m_expected > m_delivered ? m_expected - m_delivered : 0; }
+
+    void reset()
+    {
+        m_injected = 0;
+        m_delivered = 0;
+        m_expected = 0;
+        m_latencies.clear();
+    }
+
+    double getPercentileInMicroseconds( double pct )
+    {
+        if ( m_latencies.empty() )
+        {
+            return 0.0;
+        }
+        size_t n = size_t( pct * ( m_latencies.size() - 1 ) );
+        std::nth_element( m_latencies.begin(), m_latencies.begin() + n, m_latencies.end() );
+        return m_latencies[n] / 1000.0;
+    }
+
+    uint64_t m_injected;
+    uint64_t m_delivered;
+    uint64_t m_expected;
+    std::vector<uint64_t> m_latencies;
+};
+
+///
+/// \brief The BenchTransport class
+///
+/// One way of wiring APCs to an APS
+///
+class BenchTransport
+{
+  public:
+    BenchTransport( BenchStats &stats ) : m_stats( stats ) {}
+    virtual ~BenchTransport() {}
+
+    virtual bool open( size_t apc_count ) = 0;
+
+    /// True when every APC has its entity_id
+    virtual bool isReady() const = 0;
+
+    /// Send a frame from L2 to the APS
+    virtual void injectDown() = 0;
+
+    /// Send a frame from the specified APC
+    virtual void injectUp( size_t apc_index ) = 0;
+
+    /// Move data between the APS and APCs
+    virtual void pump() = 0;
+
+    virtual size_t getApcCount() const = 0;
+
+  protected:
+    BenchStats &m_stats;
+};
+
+///
+/// \brief The BenchRawSocket class
+///
+/// An in-memory L2 network port. Frames are formed when recvFrame() is
+/// called so that the latency includes the time waiting for the APS.
+///
+class BenchRawSocket : public RawSocket
+{
+  public:
+    BenchRawSocket( BenchStats &stats ) : m_stats( stats ), m_mac( uint64_t( 0x020000000001ULL ) ), m_pending( 0 ) {}
+
+    virtual void setHandlerGroup( HandlerGroup *handler_group ) override {}
+
+    virtual jdksavdecc_timestamp_in_milliseconds getTimeInMilliseconds() const override
+    {
+        return JDKSAvdeccMCU::getTimeInMilliseconds();
+    }
+
+    virtual bool recvFrame( Frame *frame ) override
+    {
+        if ( m_pending == 0 )
+        {
+            return false;
+        }
+        --m_pending;
+        BenchStats::formFrame( frame, Eui48( uint64_t( 0x020000000002ULL ) ), DirectionDown );
+        return true;
+    }
+
+    virtual bool sendFrame(
+        Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        m_stats.onDelivered( frame.getPayload(), frame.getPayloadLength() );
+        return true;
+    }
+
+    virtual bool sendReplyFrame(
+        Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        return sendFrame( frame, data1, len1, data2, len2 );
+    }
+
+    virtual bool joinMulticast( const Eui48 &multicast_mac ) override { return true; }
+
+    virtual Eui48 const &getMACAddress() const override { return m_mac; }
+
+    void addPending() { ++m_pending; }
+
+  protected:
+    BenchStats &m_stats;
+    Eui48 m_mac;
+    size_t m_pending;
+};
+
+#if JDKSAVDECCMCU_ENABLE_APSSERVER && JDKSAVDECCMCU_ENABLE_APCCLIENT
+
+///
+/// \brief The TcpTransport class
+///
+/// ApsServer and ApcClients on loopback TCP
+///
+class TcpTransport : public BenchTransport
+{
+  public:
+    class Client : public ApcClient
+    {
+      public:
+        Client( BenchStats &stats ) : m_stats( stats ), m_available( false ) {}
+
+        virtual void notifyProxyAvailable() override { m_available = true; }
+
+        virtual void processMsg( AppMessage const &apsMsg ) override
+        {
+            m_stats.onDelivered( apsMsg.getPayload(), apsMsg.getPayloadLength() );
+        }
+
+        BenchStats &m_stats;
+        bool m_available;
+    };
+
+    TcpTransport( BenchStats &stats, std::string const &port ) : BenchTransport( stats ), m_port( port ), m_raw( stats ) {}
+
+    virtual ~TcpTransport()
+    {
+        for ( size_t i = 0; i < m_clients.size(); ++i )
+        {
+            delete m_clients[i];
+        }
+    }
+
+    virtual bool open( size_t apc_count ) override
+    {
+        if ( m_server.addLink( &m_raw, -1, "127.0.0.1", m_port.c_str() ) < 0 )
+        {
+            return false;
+        }
+        m_server.setLinkStatus( 0, true );
+
+        for ( size_t i = 0; i < apc_count; ++i )
+        {
+            Client *c = new Client( m_stats );
+            m_clients.push_back( c );
+            c->start( "127.0.0.1:" + m_port, Eui48( uint64_t( 0x0a0000000000ULL + i ) ) );
+        }
+        return true;
+    }
+
+    virtual bool isReady() const override
+    {
+        for ( size_t i = 0; i < m_clients.size(); ++i )
+        {
+            if ( !m_clients[i]->m_available )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual void injectDown() override { m_raw.addPending(); }
+
+    virtual void injectUp( size_t apc_index ) override
+    {
+        FrameWithMTU frame;
+        BenchStats::formFrame( &frame, Eui48( uint64_t( 0x0a0000000000ULL + apc_index ) ), DirectionUp );
+        m_clients[apc_index]->onNetAvdeccMessageReceived( frame );
+    }
+
+    virtual void pump() override
+    {
+        m_server.run( 0 );
+        for ( size_t i = 0; i < m_clients.size(); ++i )
+        {
+            m_clients[i]->poll( 0 );
+        }
+    }
+
+    virtual size_t getApcCount() const override { return m_clients.size(); }
+
+  protected:
+    std::string m_port;
+    BenchRawSocket m_raw;
+    ApsServer m_server;
+    std::vector<Client *> m_clients;
+};
+
+#endif
+
+///
+/// \brief The MemTransport class
+///
+/// ApsStateMachine and ApcStateMachine pairs joined by byte queues
+///
+class MemTransport : public BenchTransport
+{
+  public:
+    class Pair;
+
+    class Server : public ApsStateMachine
+    {
+      public:
+        Server( MemTransport &transport, Pair &pair )
+            : ApsStateMachine( &m_v, &m_a, &m_e, &m_s, transport.m_entity_id_allocator )
+            , m_transport( transport )
+            , m_pair( pair )
+            , m_e( &m_parser, "/" )
+            , m_parser( &m_request, &m_e, false )
+        {
+        }
+
+        virtual void sendTcpData( uint8_t const *data, ssize_t len ) override;
+
+        virtual void sendAvdeccToL2( Frame const &frame ) override { m_transport.sendToL2( frame, m_pair ); }
+
+        MemTransport &m_transport;
+        Pair &m_pair;
+        ApsStateVariables m_v;
+        ApsStateActions m_a;
+        ApsStateEvents m_e;
+        ApsStates m_s;
+        HttpServerParserFast m_parser;
+        HttpRequest m_request;
+    };
+
+    class Client : public ApcStateMachine
+    {
+      public:
+        Client( MemTransport &transport, Pair &pair )
+            : ApcStateMachine( &m_v, &m_a, &m_e, &m_s )
+            , m_transport( transport )
+            , m_pair( pair )
+            , m_e( &m_parser, "/" )
+            , m_parser( &m_response, &m_e, false )
+            , m_connect_requested( false )
+            , m_available( false )
+        {
+        }
+
+        virtual void connectToProxy( std::string const &addr ) override { m_connect_requested = true; }
+
+        virtual void notifyProxyAvailable() override { m_available = true; }
+
+        virtual void processMsg( AppMessage const &apsMsg ) override
+        {
+            m_transport.m_stats.onDelivered( apsMsg.getPayload(), apsMsg.getPayloadLength() );
+        }
+
+        virtual void sendTcpData( uint8_t const *data, ssize_t len ) override;
+
+        MemTransport &m_transport;
+        Pair &m_pair;
+        ApcStateVariables m_v;
+        ApcStateActions m_a;
+        ApcStateEvents m_e;
+        ApcStates m_s;
+        HttpClientParserFast m_parser;
+        HttpResponse m_response;
+        bool m_connect_requested;
+        bool m_available;
+    };
+
+    class Pair
+    {
+      public:
+        Pair( MemTransport &transport ) : m_server( transport, *this ), m_client( transport, *this ) {}
+
+        Server m_server;
+        Client m_client;
+
+        /// Octets written by one side and not yet given to the other
+        std::vector<uint8_t> m_to_client;
+        std::vector<uint8_t> m_to_server;
+    };
+
+    MemTransport( BenchStats &stats, bool table_driven ) : BenchTransport( stats ), m_raw( stats ), m_table_driven( table_driven ) {}
+
+    virtual ~MemTransport()
+    {
+        for ( size_t i = 0; i < m_pairs.size(); ++i )
+        {
+            delete m_pairs[i];
+        }
+    }
+
+    virtual bool open( size_t apc_count ) override
+    {
+        for ( size_t i = 0; i < apc_count; ++i )
+        {
+            Pair *p = new Pair( *this );
+            m_pairs.push_back( p );
+
+            p->m_server.setTableDriven( m_table_driven );
+            p->m_client.setTableDriven( m_table_driven );
+
+            p->m_server.setup();
+            p->m_server.run();
+            p->m_server.getVariables()->m_linkMac = m_raw.getMACAddress();
+            p->m_server.getVariables()->m_linkStatus = true;
+
+            p->m_client.setup();
+            p->m_client.setApsAddress( "mem" );
+            p->m_client.setPrimaryMac( Eui48( uint64_t( 0x0a0000000000ULL + i ) ) );
+            p->m_client.setPath( "/" );
+            p->m_client.run();
+        }
+        return true;
+    }
+
+    virtual bool isReady() const override
+    {
+        for ( size_t i = 0; i < m_pairs.size(); ++i )
+        {
+            if ( !m_pairs[i]->m_client.m_available )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual void injectDown() override
+    {
+        Frame &frame = m_frame;
+        BenchStats::formFrame( &frame, Eui48( uint64_t( 0x020000000002ULL ) ), DirectionDown );
+        for ( size_t i = 0; i < m_pairs.size(); ++i )
+        {
+            m_pairs[i]->m_server.onNetAvdeccMessageReceived( frame );
+        }
+    }
+
+    virtual void injectUp( size_t apc_index ) override
+    {
+        BenchStats::formFrame( &m_frame, Eui48( uint64_t( 0x0a0000000000ULL + apc_index ) ), DirectionUp );
+        m_pairs[apc_index]->m_client.onNetAvdeccMessageReceived( m_frame );
+    }
+
+    virtual void pump() override
+    {
+        uint32_t now = uint32_t( getTimeInMilliseconds() / 1000 );
+
+        for ( size_t i = 0; i < m_pairs.size(); ++i )
+        {
+            Pair &p = *m_pairs[i];
+
+            if ( p.m_client.m_connect_requested )
+            {
+                p.m_client.m_connect_requested = false;
+                p.m_server.onIncomingTcpConnection();
+                p.m_server.run();
+                p.m_client.getEvents()->onIncomingTcpConnection();
+                p.m_client.run();
+            }
+
+            deliver( &p.m_to_server, p.m_server );
+            deliver( &p.m_to_client, p.m_client );
+
+            p.m_server.tick( now );
+            p.m_client.tick( now );
+        }
+    }
+
+    virtual size_t getApcCount() const override { return m_pairs.size(); }
+
+    void sendToL2( Frame const &frame, Pair &from )
+    {
+        m_raw.sendFrame( frame, 0, 0, 0, 0 );
+
+        // Like ApsServerLink, frames from an APC also go to the others
+        for ( size_t i = 0; i < m_pairs.size(); ++i )
+        {
+            if ( m_pairs[i] != &from )
+            {
+                m_pairs[i]->m_server.onNetAvdeccMessageReceived( frame );
+            }
+        }
+    }
+
+    template <typename StateMachineT>
+    void deliver( std::vector<uint8_t> *queue, StateMachineT &dest )
+    {
+        if ( !queue->empty() )
+        {
+            // The receiver may write more while handling this data
+            m_scratch.swap( *queue );
+            dest.onIncomingTcpData( m_scratch.data(), ssize_t( m_scratch.size() ) );
+            m_scratch.clear();
+        }
+    }
+
+    ApsEntityIdAllocator m_entity_id_allocator;
+
+  protected:
+    BenchRawSocket m_raw;
+    bool m_table_driven;
+    std::vector<Pair *> m_pairs;
+    std::vector<uint8_t> m_scratch;
+    FrameWithMTU m_frame;
+};
+
+void MemTransport::Server::sendTcpData( uint8_t const *data, ssize_t len )
+{
+    m_pair.m_to_client.insert( m_pair.m_to_client.end(), data, data + len );
+}
+
+void MemTransport::Client::sendTcpData( uint8_t const *data, ssize_t len )
+{
+    m_pair.m_to_server.insert( m_pair.m_to_server.end(), data, data + len );
+}
+
+static int usage( char const *argv0 )
+{
+    std::cerr << "usage: " << argv0
+              << " [-m tcp|mem] [-n apcs] [-r frames_per_sec] [-t seconds] [-d down|up|both] [-w window] [-p port] [-s table|run]"
+              << std::endl;
+    return 1;
+}
+
+int main( int argc, char **argv )
+{
+    std::string mode = "mem";
+    std::string port = "17221";
+    size_t apc_count = 16;
+    double rate = 0.0;
+    double seconds = 5.0;
+    int direction = DirectionDown;
+    uint64_t window = 64;
+    bool table_driven = true;
+
+    for ( int i = 1; i < argc; i += 2 )
+    {
+        if ( i + 1 == argc )
+        {
+            // An option without a value, including --help
+            return usage( argv[0] );
+        }
+
+        std::string opt = argv[i];
+        std::string val = argv[i + 1];
+
+        if ( opt == "-m" )
+        {
+            mode = val;
+        }
+        else if ( opt == "-n" )
+        {
+            apc_count = size_t( atoi( val.c_str() ) );
+        }
+        else if ( opt == "-r" )
+        {
+            rate = atof( val.c_str() );
+        }
+        else if ( opt == "-t" )
+        {
+            seconds = atof( val.c_str() );
+        }
+        else if ( opt == "-d" )
+        {
+            direction = val == "up" ? DirectionUp : val == "both" ? DirectionBoth : DirectionDown;
+        }
+        else if ( opt == "-w" )
+        {
+            window = uint64_t( atoi( val.c_str() ) );
+        }
+        else if ( opt == "-p" )
+        {
+            port = val;
+        }
+        else if ( opt == "-s" )
+        {
+            table_driven = val != "run";
+        }
+        else
+        {
+            return usage( argv[0] );
+        }
+    }
+
+    if ( apc_count == 0 )
+    {
+        apc_count = 1;
+    }
+
+    BenchStats stats;
+    BenchTransport *transport = 0;
+
+    if ( mode == "tcp" )
+    {
+#if JDKSAVDECCMCU_ENABLE_APSSERVER && JDKSAVDECCMCU_ENABLE_APCCLIENT
+        transport = new TcpTransport( stats, port );
+#else
+        std::cerr << "tcp mode is not available on this platform" << std::endl;
+        return 1;
+#endif
+    }
+    else
+    {
+        transport = new MemTransport( stats, table_driven );
+    }
+
+    if ( !transport->open( apc_count ) )
+    {
+        std::cerr << "Unable to open transport" << std::endl;
+        return 1;
+    }
+
+    // Wait until every APC has its entity_id
+    uint64_t setup_start = nowInNanoseconds();
+    while ( !transport->isReady() )
+    {
+        transport->pump();
+        if ( nowInNanoseconds() - setup_start > 10000000000ULL )
+        {
+            std::cerr << "Timed out connecting the APCs" << std::endl;
+            return 1;
+        }
+    }
+    double setup_ms = ( nowInNanoseconds() - setup_start ) / 1e6;
+
+    // Every frame down goes to every APC; every frame up goes to L2 and
+    // every other APC
+    uint64_t fanout_down = apc_count;
+    uint64_t fanout_up = apc_count;
+
+    stats.reset();
+    uint64_t allocations_at_start = heap_allocations;
+    uint64_t start = nowInNanoseconds();
+    uint64_t end = start + uint64_t( seconds * 1e9 );
+    uint64_t now = start;
+    size_t next_apc = 0;
+    bool next_is_up = direction == DirectionUp;
+
+    while ( now < end )
+    {
+        uint64_t allowed = rate > 0.0 ? uint64_t( rate * ( now - start ) / 1e9 ) : ~uint64_t( 0 );
+
+        while ( stats.m_injected < allowed && stats.getInFlight() < window * apc_count )
+        {
+            if ( next_is_up )
+            {
+                transport->injectUp( next_apc );
+                next_apc = ( next_apc + 1 ) % apc_count;
+                stats.onInjected( fanout_up );
+            }
+            else
+            {
+                transport->injectDown();
+                stats.onInjected( fanout_down );
+            }
+            if ( direction == DirectionBoth )
+            {
+                next_is_up = !next_is_up;
+            }
+        }
+
+        transport->pump();
+        now = nowInNanoseconds();
+    }
+
+    // Let frames in flight arrive, without counting the time
+    uint64_t drain_end = now + 1000000000ULL;
+    uint64_t delivered_in_window = stats.m_delivered;
+    while ( stats.getInFlight() > 0 && nowInNanoseconds() < drain_end )
+    {
+        transport->pump();
+    }
+
+    double elapsed = ( now - start ) / 1e9;
+    uint64_t allocations = heap_allocations - allocations_at_start;
+
+    std::cout << "mode:             " << mode << std::endl;
+    std::cout << "apcs:             " << apc_count << " (connected in " << setup_ms << " ms)" << std::endl;
+    std::cout << "frames injected:  " << stats.m_injected << std::endl;
+    std::cout << "msgs delivered:   " << stats.m_delivered << " of " << stats.m_expected << std::endl;
+    std::cout << "msgs/sec:         " << uint64_t( delivered_in_window / elapsed ) << std::endl;
+    std::cout << "latency p50:      " << stats.getPercentileInMicroseconds( 0.50 ) << " us" << std::endl;
+    std::cout << "latency p99:      " << stats.getPercentileInMicroseconds( 0.99 ) << " us" << std::endl;
+    std::cout << "allocs/msg:       " << ( stats.m_delivered ? double( allocations ) / stats.m_delivered : 0.0 ) << std::endl;
+
+    delete transport;
+    return 0;
+}